@@ -0,0 +1,158 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Procédure pour initialiser une arène vide
+ *
+ * Aucun bloc n'est alloué avant la première allocation.
+ *
+ * @param pool l'arène
+ * @param block_size la taille des blocs, 0 pour ARENA_BLOCK_SIZE
+ */
+void arena_init(arena *pool, size_t block_size) {
+    arena_init_with(pool, block_size, NULL);
+}
+
+/**
+ * @brief Procédure pour initialiser une arène dont les blocs viennent d'un allocateur
+ *
+ * L'allocateur doit rester valide jusqu'à arena_free.
+ *
+ * @param pool l'arène
+ * @param block_size la taille des blocs, 0 pour ARENA_BLOCK_SIZE
+ * @param allocator l'allocateur des blocs, NULL pour malloc et free
+ */
+void arena_init_with(arena *pool, size_t block_size, const arena_allocator *allocator) {
+    pool->head = NULL;
+    pool->block_size = block_size > 0 ? block_size : ARENA_BLOCK_SIZE;
+    pool->memory = 0;
+    pool->allocator = allocator;
+}
+
+/**
+ * @brief Procédure rendant un bloc à l'allocateur de l'arène
+ *
+ * @param pool l'arène
+ * @param block le bloc à libérer
+ */
+static void arena_release(arena *pool, arena_block *block) {
+    if (pool->allocator) {
+        pool->allocator->release(block, pool->allocator->ctx);
+    } else {
+        free(block);
+    }
+}
+
+/**
+ * @brief Fonction ajoutant un bloc à l'arène
+ *
+ * Une allocation plus grande que le quart d'un bloc reçoit son propre bloc,
+ * placé derrière le bloc courant pour ne pas gaspiller la place qui y reste.
+ *
+ * @param pool l'arène
+ * @param size la taille de l'allocation qui n'a pas trouvé de place
+ * @return arena_block* le bloc dans lequel allouer, NULL en cas d'échec
+ */
+static arena_block *arena_grow(arena *pool, size_t size) {
+    if (pool->block_size == 0) {
+        pool->block_size = ARENA_BLOCK_SIZE; // Arène simplement mise à zéro
+    }
+    int dedicated = size > pool->block_size / 4;
+    size_t block_size = dedicated ? size : pool->block_size;
+    arena_block *block = pool->allocator ? pool->allocator->alloc(sizeof(arena_block) + block_size, pool->allocator->ctx)
+                                         : malloc(sizeof(arena_block) + block_size);
+    if (!block) {
+        return NULL;
+    }
+    block->size = block_size;
+    block->used = 0;
+    pool->memory += sizeof(arena_block) + block_size;
+    if (dedicated && pool->head != NULL) {
+        block->next = pool->head->next;
+        pool->head->next = block;
+    } else {
+        block->next = pool->head;
+        pool->head = block;
+    }
+    return block;
+}
+
+/**
+ * @brief Fonction pour allouer size octets alignés dans l'arène
+ *
+ * L'allocation se résume le plus souvent à avancer un indice dans le bloc
+ * courant : pas d'en-tête par objet ni de recherche de place libre.
+ *
+ * @param pool l'arène
+ * @param size la taille voulue
+ * @return void* la zone allouée, NULL en cas d'échec
+ */
+void *arena_alloc(arena *pool, size_t size) {
+    size_t align = sizeof(max_align_t);
+    size = (size + align - 1) / align * align;
+    arena_block *block = pool->head;
+    if (block == NULL || block->size - block->used < size) {
+        block = arena_grow(pool, size);
+        if (!block) {
+            return NULL;
+        }
+    }
+    void *ptr = (char *)block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+/**
+ * @brief Fonction pour copier une chaîne dans l'arène
+ *
+ * @param pool l'arène
+ * @param s la chaîne à copier
+ * @return char* la copie, NULL en cas d'échec
+ */
+char *arena_strdup(arena *pool, const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = arena_alloc(pool, len);
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+
+/**
+ * @brief Procédure pour rendre toutes les allocations de l'arène
+ *
+ * Le bloc courant est gardé pour être réutilisé ; les autres sont libérés.
+ *
+ * @param pool l'arène
+ */
+void arena_reset(arena *pool) {
+    if (pool->head == NULL) {
+        return;
+    }
+    arena_block *block = pool->head->next;
+    while (block != NULL) {
+        arena_block *next = block->next;
+        arena_release(pool, block);
+        block = next;
+    }
+    pool->head->next = NULL;
+    pool->head->used = 0;
+    pool->memory = sizeof(arena_block) + pool->head->size;
+}
+
+/**
+ * @brief Procédure pour libérer tous les blocs de l'arène
+ *
+ * @param pool l'arène
+ */
+void arena_free(arena *pool) {
+    arena_block *block = pool->head;
+    while (block != NULL) {
+        arena_block *next = block->next;
+        arena_release(pool, block);
+        block = next;
+    }
+    pool->head = NULL;
+    pool->memory = 0;
+}
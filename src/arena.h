@@ -0,0 +1,47 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Taille par défaut d'un bloc de l'arène (64 Ko)
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Allocateur fourni par l'appelant pour les blocs d'une arène
+typedef struct {
+    void *(*alloc)(size_t size, void *ctx);   // comme malloc
+    void (*release)(void *ptr, void *ctx);    // comme free
+    void *ctx;                                // contexte passé aux deux fonctions
+} arena_allocator;
+
+// Bloc de mémoire de l'arène, découpé au fur et à mesure des allocations
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;            // taille utilisable du bloc
+    size_t used;            // octets déjà distribués
+    max_align_t data[];     // données, alignées pour tout type
+} arena_block;
+
+// Arène : allocations sans libération individuelle, toutes rendues d'un coup
+// (une arène mise à zéro est une arène vide valide)
+typedef struct {
+    arena_block *head;      // bloc courant en tête, puis les blocs pleins
+    size_t block_size;      // taille des nouveaux blocs
+    uint64_t memory;        // mémoire réservée par les blocs en octets
+    const arena_allocator *allocator; // allocateur des blocs (NULL pour malloc et free)
+} arena;
+
+// Procédure pour initialiser une arène vide (block_size à 0 pour la taille par défaut)
+void arena_init(arena *pool, size_t block_size);
+// Procédure pour initialiser une arène dont les blocs viennent d'un allocateur (NULL pour malloc)
+void arena_init_with(arena *pool, size_t block_size, const arena_allocator *allocator);
+// Fonction pour allouer size octets alignés dans l'arène (NULL en cas d'échec)
+void *arena_alloc(arena *pool, size_t size);
+// Fonction pour copier une chaîne dans l'arène (NULL en cas d'échec)
+char *arena_strdup(arena *pool, const char *s);
+// Procédure pour rendre toutes les allocations en gardant le premier bloc
+void arena_reset(arena *pool);
+// Procédure pour libérer tous les blocs de l'arène
+void arena_free(arena *pool);
+
+#endif // ARENA_H
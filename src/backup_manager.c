@@ -1,6 +1,14 @@
 #include "backup_manager.h"
 #include "deduplication.h"
 #include "file_handler.h"
+#include "chunk_store.h"
+#include "manifest.h"
+#include "catalog.h"
+#include "chunk_cache.h"
+#include "restore_plan.h"
+#include "files_cache.h"
+#include "watcher.h"
+#include "chunker.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,8 +23,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/sendfile.h>
-#include <regex.h>
 #include <openssl/md5.h>
+#include <openssl/evp.h>
 
 #define PATH_MAX 4096
 
@@ -57,82 +65,6 @@ char* remove_after_last_slash(const char *path) {
     }
 }
 
-/**
- * @brief Fonction pour vérifier si un fichier existe dans un répertoire
- * 
- * @param file_path 
- * @param directory 
- * @return int 
- */
-int file_exists_in_directory(const char *file_path, const char *directory) {
-    DIR *dir;
-    struct dirent *entry;
-    char relative_path[PATH_MAX];
-    const char *relative_file_path = strrchr(file_path, '/');
-    if (!relative_file_path) {
-        relative_file_path = file_path;
-    } else {
-        relative_file_path++;
-    }
-
-    dir = opendir(directory);
-    if (!dir) {
-        perror("opendir");
-        return 0;
-    }
-
-    struct stat stat_buf;
-    while ((entry = readdir(dir)) != NULL) {
-        snprintf(relative_path, sizeof(relative_path), "%s/%s", directory, entry->d_name);
-        if (stat(relative_path, &stat_buf) == 0 && S_ISDIR(stat_buf.st_mode)) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
-            }
-            snprintf(relative_path, sizeof(relative_path), "%s/%s", directory, entry->d_name);
-        } else {
-            if (strcmp(entry->d_name, relative_file_path) == 0) {
-                closedir(dir);
-                return 1;
-            }
-        }
-    }
-
-    closedir(dir);
-    return 0;
-}
-
-/**
- * @brief Fonction pour vérifier si un fichier existe dans un log
- * 
- * @param file_path 
- * @param logs 
- * @return log_element* 
- */
-log_element* file_exists_in_log(const char *file_path, log_t *logs) {
-    log_element *current = logs->head;
-    const char *file_name = strrchr(file_path, '/');
-    if (!file_name) {
-        file_name = file_path;
-    } else {
-        file_name++;
-    }
-
-    while (current != NULL) {
-        const char *log_file_name = strrchr(current->path, '/');
-        if (!log_file_name) {
-            log_file_name = current->path;
-        } else {
-            log_file_name++;
-        }
-
-        if (strcmp(log_file_name, file_name) == 0) {
-            return current;
-        }
-        current = current->next;
-    }
-    return NULL;
-}
-
 /**
  * @brief Fonction qui retourne la date au format : YYYY-MM-DD-HH:MM:SS.sss
  * 
@@ -141,18 +73,18 @@ log_element* file_exists_in_log(const char *file_path, log_t *logs) {
  */
 void get_current_datetime(char *buffer, size_t buffer_size) {
     struct timeval tv;
-    struct tm *tm_info;
+    struct tm tm_info;
 
     gettimeofday(&tv, NULL);
-    tm_info = localtime(&tv.tv_sec);
+    localtime_r(&tv.tv_sec, &tm_info);
 
     snprintf(buffer, buffer_size, "%04d-%02d-%02d-%02d:%02d:%02d.%03ld",
-             tm_info->tm_year + 1900, // Année
-             tm_info->tm_mon + 1,    // Mois (de 0 à 11)
-             tm_info->tm_mday,       // Jour du mois
-             tm_info->tm_hour,       // Heure
-             tm_info->tm_min,        // Minute
-             tm_info->tm_sec,        // Seconde
+             tm_info.tm_year + 1900, // Année
+             tm_info.tm_mon + 1,    // Mois (de 0 à 11)
+             tm_info.tm_mday,       // Jour du mois
+             tm_info.tm_hour,       // Heure
+             tm_info.tm_min,        // Minute
+             tm_info.tm_sec,        // Seconde
              tv.tv_usec / 1000);     // Millisecondes (µsecondes converties)
 }
 
@@ -206,28 +138,26 @@ char *calculate_md5(const char *filename) {
 
 /**
  * @brief Fonction pour extraire tout ceux qui est après la date dans un chemin ansi que la date devant le chemin
- * 
+ *
+ * La date (AAAA-MM-JJ-hh:mm:ss.mmm) est reconnue caractère par caractère :
+ * rien n'est compilé à chaque appel.
+ *
  * @param path 
  * @return char* 
  */
 char *extract_from_date(const char *path) {
-    const char *pattern = "[0-9]{4}-[0-9]{2}-[0-9]{2}-[0-9]{2}:[0-9]{2}:[0-9]{2}\\.[0-9]{3}";
-    regex_t regex;
-    regmatch_t match;
-
-    if (regcomp(&regex, pattern, REG_EXTENDED) != 0) {
-        fprintf(stderr, "Erreur : Impossible de compiler l'expression régulière.\n");
-        return NULL;
-    }
-
-    if (regexec(&regex, path, 1, &match, 0) == 0) {
-        size_t start = match.rm_so;
-        char *result = strdup(path + start);
-        regfree(&regex);
-        return result;
+    static const char format[] = "dddd-dd-dd-dd:dd:dd.ddd";
+    size_t len = strlen(path);
+    for (size_t start = 0; start + sizeof(format) - 1 <= len; start++) {
+        size_t i = 0;
+        while (format[i] != '\0'
+               && (format[i] == 'd' ? (path[start + i] >= '0' && path[start + i] <= '9') : path[start + i] == format[i])) {
+            i++;
+        }
+        if (format[i] == '\0') {
+            return strdup(path + start);
+        }
     }
-
-    regfree(&regex);
     return NULL;
 }
 
@@ -245,377 +175,736 @@ int parse_folder_date(const char *folder_name, struct tm *result) {
 }
 
 /**
- * @brief Fonction pour trouver le dossier le plus récent dans un répertoire
+ * @brief Une procédure permettant obtenir le timestamp actuel
  * 
- * @param base_path 
- * @return char* 
+ * @param buffer le tampon pour stocker le timestamp
+ * @param size la taille du tampon
  */
-char *find_most_recent_folder(const char *base_path) {
-    DIR *dir = opendir(base_path);
-    if (!dir) {
-        perror("Impossible d'ouvrir le répertoire");
-        return NULL;
+void get_current_timestamp(char *buffer, size_t size) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    struct tm local_time;
+    localtime_r(&tv.tv_sec, &local_time);
+    char temp_buffer[64];
+    strftime(temp_buffer, sizeof(temp_buffer), "%Y-%m-%d-%H:%M:%S", &local_time);
+    snprintf(buffer, size, "%s.%03ld", temp_buffer, tv.tv_usec / 1000);
+}
+
+// Contexte d'une sauvegarde locale
+typedef struct {
+    chunk_store *store;
+    catalog_entry *stats;  // taille, nombre de fichiers et octets ajoutés
+    throttle *throttle;    // limitation des lectures et des écritures
+    files_cache *files;    // recettes des fichiers lors des sauvegardes précédentes
+    time_t next_checkpoint; // date du prochain point de reprise
+    chunker chunker;       // découpeur des fichiers lus
+    EVP_MD_CTX *content;   // empreinte des octets du fichier en cours déjà découpés
+    EVP_MD_CTX *work;      // copie de travail de content
+} local_backup;
+
+/**
+ * @brief Fonction donnant l'empreinte du contenu du fichier en cours, à garder dans le cache des fichiers
+ *
+ * Le MD5 des octets déjà lus passe par store_fingerprint : dans un dépôt
+ * chiffré, le cache des fichiers ne permet pas de reconnaître un contenu
+ * connu sans la clé.
+ *
+ * @param backup la sauvegarde locale en cours
+ * @param digest l'empreinte en sortie (MD5_DIGEST_LENGTH octets)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int content_digest(local_backup *backup, unsigned char *digest) {
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    if (EVP_MD_CTX_copy_ex(backup->work, backup->content) != 1 || EVP_DigestFinal_ex(backup->work, md5, NULL) != 1) {
+        return -1;
     }
+    store_fingerprint(backup->store, md5, sizeof(md5), digest);
+    return 0;
+}
 
-    struct dirent *entry;
-    struct tm most_recent_tm = {0};
-    char *most_recent_folder = NULL;
+/**
+ * @brief Fonction enregistrant un point de reprise de la sauvegarde en cours
+ *
+ * Les chunks déjà écrits sont validés sur disque, puis le cache des fichiers
+ * est enregistré avec les recettes des fichiers terminés et celle, partielle,
+ * du fichier en cours. Relancée après un arrêt brutal, la sauvegarde reprend
+ * les fichiers terminés sans les relire, et le fichier en cours comme un
+ * fichier allongé : seule la partie qui suit son dernier chunk est relue.
+ *
+ * @param backup la sauvegarde locale en cours
+ * @param key le chemin absolu du fichier en cours (NULL entre deux fichiers)
+ * @param st les informations du fichier en cours
+ * @param entry la recette partielle du fichier en cours
+ * @param history le découpage du fichier en cours
+ * @return int 0 en cas de succès, -1 si le dépôt est inutilisable
+ */
+static int checkpoint(local_backup *backup, const char *key, const struct stat *st, const manifest_entry *entry,
+                      const chunk_history *history) {
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    backup->next_checkpoint = time(NULL) + BACKUP_CHECKPOINT_INTERVAL;
+    if (key && files_cache_update(backup->files, key, st, entry, history,
+                                  content_digest(backup, digest) == 0 ? digest : NULL) == -1) {
+        return -1;
+    }
+    if (store_flush(backup->store) == -1) {
+        return -1;
+    }
+    // Un point de reprise manqué ne fait perdre que le travail depuis le précédent
+    if (files_cache_checkpoint(backup->files) == -1) {
+        fprintf(stderr, "Attention : point de reprise non enregistré\n");
+    }
+    return 0;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+/**
+ * @brief Fonction reprenant les premiers chunks d'une recette du cache des fichiers
+ *
+ * Les chunks doivent toujours être dans le dépôt : un --prune suivi d'un
+ * compactage a pu les supprimer depuis la sauvegarde précédente. Leur
+ * présence est vérifiée par lots, sans relire leurs données.
+ *
+ * @param backup la sauvegarde locale en cours
+ * @param cached l'entrée du fichier dans le cache
+ * @param n le nombre de chunks à reprendre
+ * @param entry l'entrée du manifeste à compléter (taille comprise)
+ * @return int 0 si les chunks ont été repris, 1 s'il en manque au dépôt, -1 en cas d'erreur
+ */
+static int reuse_chunks(local_backup *backup, const files_cache_entry *cached, size_t n, manifest_entry *entry) {
+    unsigned char present[FILES_CACHE_CHECK_BATCH];
+    for (size_t i = 0; i < n; i += FILES_CACHE_CHECK_BATCH) {
+        size_t batch = (n - i < FILES_CACHE_CHECK_BATCH) ? n - i : FILES_CACHE_CHECK_BATCH;
+        if (store_contains_batch(backup->store, cached->md5[i], batch, present) == -1) {
+            return -1;
         }
+        if (memchr(present, 0, batch) != NULL) {
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (manifest_entry_add_chunk(entry, cached->md5[i], cached->len[i]) == -1) {
+            return -1;
+        }
+        entry->size += cached->len[i];
+    }
+    return 0;
+}
 
-        char path[1024];
-        snprintf(path, sizeof(path), "%s/%s", base_path, entry->d_name);
-
-        struct stat statbuf;
-        if (stat(path, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) {
-            struct tm folder_tm = {0};
-            if (parse_folder_date(entry->d_name, &folder_tm)) {
-                folder_tm.tm_year -= 1900;
-                folder_tm.tm_mon -= 1;
+/**
+ * @brief Fonction vérifiant qu'un fichier allongé commence toujours comme dans le cache
+ *
+ * Les cached->size premiers octets, tout ce que la sauvegarde précédente a
+ * lu, sont relus et comparés à l'empreinte enregistrée : une modification
+ * n'importe où dans l'ancienne étendue, suivie d'un ajout, fait relire tout
+ * le fichier. La lecture seule évite le découpage, les empreintes de chunks
+ * et les recherches dans l'index. L'empreinte du contenu est laissée à la
+ * position start, où reprend le découpage.
+ *
+ * @param backup la sauvegarde locale en cours
+ * @param fd le fichier ouvert avec throttle_open
+ * @param cached l'entrée du fichier dans le cache
+ * @param start la position de la fin des chunks repris (au plus cached->size)
+ * @return int 1 si le début du fichier est inchangé, 0 sinon
+ */
+static int prefix_intact(local_backup *backup, int fd, const files_cache_entry *cached, uint64_t start) {
+    unsigned char buffer[CHUNK_MAX_SIZE];
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    uint64_t pos = 0;
 
-                time_t folder_time = mktime(&folder_tm);
-                time_t most_recent_time = mktime(&most_recent_tm);
-                if (most_recent_folder == NULL || difftime(folder_time, most_recent_time) > 0) {
-                    free(most_recent_folder);
-                    most_recent_folder = strdup(entry->d_name);
-                    most_recent_tm = folder_tm;
-                }
-            }
+    if (EVP_DigestInit_ex(backup->content, EVP_md5(), NULL) != 1 || lseek(fd, 0, SEEK_SET) == -1) {
+        return 0;
+    }
+    if (start == 0 && EVP_MD_CTX_copy_ex(backup->work, backup->content) != 1) {
+        return 0;
+    }
+    // Lectures alignées de CHUNK_MAX_SIZE octets, comme l'exige O_DIRECT
+    while (pos < cached->size) {
+        ssize_t lus = throttle_read(backup->throttle, fd, buffer, CHUNK_MAX_SIZE);
+        if (lus <= 0) {
+            return 0;
+        }
+        uint64_t n = (uint64_t)lus < cached->size - pos ? (uint64_t)lus : cached->size - pos;
+        uint64_t split = (start > pos && start - pos < n) ? start - pos : n;
+        if (EVP_DigestUpdate(backup->content, buffer, (size_t)split) != 1) {
+            return 0;
         }
+        // La copie de travail garde l'empreinte des octets précédant start
+        if (pos + split == start && EVP_MD_CTX_copy_ex(backup->work, backup->content) != 1) {
+            return 0;
+        }
+        if (split < n && EVP_DigestUpdate(backup->content, buffer + split, (size_t)(n - split)) != 1) {
+            return 0;
+        }
+        pos += n;
     }
-
-    closedir(dir);
-    return most_recent_folder;
+    if (EVP_DigestFinal_ex(backup->content, md5, NULL) != 1) {
+        return 0;
+    }
+    store_fingerprint(backup->store, md5, sizeof(md5), digest);
+    if (memcmp(digest, cached->digest, sizeof(digest)) != 0) {
+        return 0;
+    }
+    return EVP_MD_CTX_copy_ex(backup->content, backup->work) == 1;
 }
 
 /**
- * @brief fonction pour copier un fichier avec les liens durs
- * 
- * @param source 
- * @param destination 
+ * @brief Fonction stockant un petit fichier dans le manifeste plutôt qu'en chunk
+ *
+ * Un fichier de quelques centaines d'octets coûterait un en-tête de pack,
+ * une entrée d'index et une recherche par sauvegarde : son contenu est
+ * recopié dans son entrée du manifeste, et sa restauration ne lit aucun pack.
+ * Un dépôt chiffré n'en stocke aucun (voir store_open) : le manifeste et le
+ * cache des fichiers ne sont pas chiffrés.
+ * Le fichier est lu d'un seul appel, un octet au-delà de sa taille pour
+ * détecter qu'il a grandi depuis son stat.
+ *
+ * @param backup la sauvegarde locale en cours
+ * @param fd le fichier ouvert avec throttle_open, positionné au début
+ * @param size la taille du fichier relevée par stat
+ * @param entry l'entrée du manifeste à compléter
+ * @return int 0 si le contenu est dans l'entrée, 1 s'il faut découper le fichier, -1 en cas d'erreur
  */
-void copy_file_link(const char *source, const char *destination) {
-    int source_fd, dest_fd;
-    struct stat stat_buf;
-    off_t offset = 0;
-    source_fd = open(source, O_RDONLY);
-    if (source_fd == -1) {
-        perror("open source");
-        exit(EXIT_FAILURE);
-    }
-    if (fstat(source_fd, &stat_buf) == -1) {
-        perror("fstat");
-        close(source_fd);
-        exit(EXIT_FAILURE);
-    }
-    dest_fd = open(destination, O_WRONLY | O_CREAT | O_TRUNC, stat_buf.st_mode);
-    if (dest_fd == -1) {
-        perror("open destination");
-        close(source_fd);
-        exit(EXIT_FAILURE);
-    }
-    if (sendfile(dest_fd, source_fd, &offset, stat_buf.st_size) == -1) {
-        perror("sendfile");
-        close(source_fd);
-        close(dest_fd);
-        exit(EXIT_FAILURE);
-    }
-    close(source_fd);
-    close(dest_fd);
+static int store_inline(local_backup *backup, int fd, size_t size, manifest_entry *entry) {
+    unsigned char buffer[MANIFEST_INLINE_LIMIT + 1];
+    ssize_t lu = throttle_read(backup->throttle, fd, buffer, size + 1);
+    if (lu != (ssize_t)size) {
+        return lseek(fd, 0, SEEK_SET) == -1 ? -1 : 1;
+    }
+    if (manifest_entry_set_data(entry, buffer, size) == -1) {
+        return -1;
+    }
+    backup->files->stats.inlined++;
+    return 0;
 }
 
 /**
- * @brief Une procédure permettant de copier un répertoire avec les liens dur
- * 
- * @param source_dir Le chemin du répertoire source
- * @param dest_dir Le chemin du répertoire de destination
+ * @brief Fonction découpant un fichier en chunks et les ajoutant au dépôt local
+ *
+ * Un fichier dont l'inode, la taille et la date de modification n'ont pas
+ * changé depuis la sauvegarde précédente reprend sa recette sans être lu.
+ * Un fichier qui a seulement grandi (journaux, segments de WAL) reprend
+ * les chunks de son ancienne recette si son ancienne étendue a toujours
+ * l'empreinte enregistrée (voir prefix_intact) : seule la fin, à partir du
+ * dernier chunk incomplet, est découpée. Un fichier d'au plus inline_max
+ * octets est stocké dans le manifeste (voir store_inline). Les autres sont
+ * découpés selon la politique que chunker_choose tire de leur format et
+ * du rendement de leurs lectures précédentes.
+ *
+ * @param ctx la sauvegarde locale en cours
+ * @param path le chemin du fichier
+ * @param entry l'entrée du manifeste à compléter
+ * @return int 0 en cas de succès, 1 si le fichier est illisible, -1 si le dépôt est inutilisable
  */
-void copy_directory_link(const char *source, const char *destination) {
-    DIR *dir;
-    struct dirent *entry;
-    char source_path[PATH_MAX];
-    char dest_path[PATH_MAX];
-    struct stat stat_buf;
-    if (mkdir(destination, 0755) == -1 && errno != EEXIST) {
-        perror("mkdir");
-        exit(EXIT_FAILURE);
-    }
-    dir = opendir(source);
-    if (!dir) {
-        perror("opendir");
-        exit(EXIT_FAILURE);
+static int store_file(void *ctx, const char *path, manifest_entry *entry) {
+    local_backup *backup = ctx;
+    const unsigned char *data;
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    char key[PATH_MAX * 2];
+    struct stat st;
+    files_cache_entry *cached = NULL;
+    int known = 0;
+    ssize_t bytes_lus;
+
+    entry->size = 0;
+    if (backup->files) {
+        snprintf(key, sizeof(key), "%s/%s", backup->stats->source, entry->path);
+        known = (stat(path, &st) == 0);
+        cached = known ? files_cache_lookup(backup->files, key, &st) : NULL;
     }
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+    if (cached && cached->data && backup->store->encrypted) {
+        cached = NULL; // contenu en clair d'avant le chiffrement du dépôt : le fichier repasse par les packs
+    }
+    if (cached && files_cache_unchanged(cached, &st)) {
+        int reused = cached->data ? manifest_entry_set_data(entry, cached->data, (size_t)cached->size)
+                                  : reuse_chunks(backup, cached, cached->nb_chunks, entry);
+        if (reused == -1) {
+            return -1;
         }
+        if (reused == 0) {
+            backup->files->stats.unchanged++;
+            backup->files->stats.inlined += (entry->data != NULL);
+            backup->files->stats.skipped_bytes += entry->size;
+            backup->stats->size += entry->size;
+            backup->stats->files++;
+            if (files_cache_update(backup->files, key, &st, entry, NULL, cached->data ? NULL : cached->digest) == -1
+                || (time(NULL) >= backup->next_checkpoint && checkpoint(backup, NULL, NULL, NULL, NULL) == -1)) {
+                return -1;
+            }
+            return 0;
+        }
+        cached = NULL;
+    }
 
-        snprintf(source_path, PATH_MAX, "%s/%s", source, entry->d_name);
-        snprintf(dest_path, PATH_MAX, "%s/%s", destination, entry->d_name);
-
-        if (stat(source_path, &stat_buf) == -1) {
-            perror("stat");
-            continue;
+    int fd = throttle_open(backup->throttle, path);
+    if (fd == -1) {
+        perror("Erreur lors de l'ouverture du fichier");
+        return 1;
+    }
+    off_t start = 0;
+    size_t full = cached ? files_cache_stable_prefix(cached, &st) : 0;
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < full; i++) {
+        prefix += cached->len[i];
+    }
+    if (full > 0 && prefix_intact(backup, fd, cached, prefix)) {
+        int reused = reuse_chunks(backup, cached, full, entry);
+        if (reused == -1) {
+            throttle_close(backup->throttle, fd);
+            return -1;
+        }
+        if (reused == 0) {
+            start = (off_t)entry->size;
+            backup->files->stats.appended++;
+            backup->files->stats.skipped_bytes += (uint64_t)start;
+        }
+    }
+    if (start == 0 && backup->files) {
+        backup->files->stats.reread++;
+    }
+    if (start == 0 && ((full > 0 && lseek(fd, 0, SEEK_SET) == -1)
+                       || EVP_DigestInit_ex(backup->content, EVP_md5(), NULL) != 1)) {
+        perror("Erreur lors de la lecture du fichier");
+        throttle_close(backup->throttle, fd);
+        return 1;
+    }
+    uint32_t inline_max = backup->store->opts.inline_max;
+    if (inline_max > MANIFEST_INLINE_LIMIT) {
+        inline_max = MANIFEST_INLINE_LIMIT;
+    }
+    if (start == 0 && known && st.st_size > 0 && (uint64_t)st.st_size <= inline_max) {
+        int inlined = store_inline(backup, fd, (size_t)st.st_size, entry);
+        if (inlined == -1) {
+            throttle_close(backup->throttle, fd);
+            return -1;
         }
+        if (inlined == 0) {
+            throttle_close(backup->throttle, fd);
+            backup->stats->size += entry->size;
+            backup->stats->files++;
+            if (files_cache_update(backup->files, key, &st, entry, NULL, NULL) == -1
+                || (time(NULL) >= backup->next_checkpoint && checkpoint(backup, NULL, NULL, NULL, NULL) == -1)) {
+                return -1;
+            }
+            return 0;
+        }
+    }
+    if (chunker_start(&backup->chunker, backup->throttle, fd, start) == -1) {
+        perror("Erreur lors de la lecture du fichier");
+        throttle_close(backup->throttle, fd);
+        return 1;
+    }
+    // Un fichier allongé garde la politique de sa recette, dont il reprend les chunks
+    chunk_history history = {CHUNKER_FIXED, -1, 0};
+    int previous = known && files_cache_history(backup->files, key, &history);
+    if (start > 0) {
+        backup->chunker.policy = history.policy;
+    } else {
+        chunker_choose(&backup->chunker, entry->path, known ? (uint64_t)st.st_size : 0, previous ? &history : NULL);
+        history.policy = (uint8_t)backup->chunker.policy;
+    }
+    if (backup->files) {
+        backup->files->stats.policies[backup->chunker.policy]++;
+    }
 
-        if (S_ISDIR(stat_buf.st_mode)) {
-            copy_directory_link(source_path, dest_path);
+    uint64_t lus = 0, presents = 0;
+    while ((bytes_lus = chunker_next(&backup->chunker, backup->throttle, fd, &data)) > 0) {
+        store_fingerprint(backup->store, data, (size_t)bytes_lus, md5);
+        int written = store_put(backup->store, md5, data, (uint32_t)bytes_lus);
+        if (written == -1 || manifest_entry_add_chunk(entry, md5, (uint32_t)bytes_lus) == -1
+            || EVP_DigestUpdate(backup->content, data, (size_t)bytes_lus) != 1) {
+            throttle_close(backup->throttle, fd);
+            return -1;
+        }
+        if (written == 1) {
+            backup->stats->added += (uint64_t)bytes_lus;
+            throttle_write(backup->throttle, (size_t)bytes_lus);
         } else {
-            copy_file_link(source_path, dest_path);
-            if (unlink(source_path) == -1) {
-                perror("unlink");
-                exit(EXIT_FAILURE);
-            }
-            if (link(dest_path, source_path) == -1) {
-                perror("link");
-                exit(EXIT_FAILURE);
-            }
+            presents += (uint64_t)bytes_lus;
+        }
+        lus += (uint64_t)bytes_lus;
+        entry->size += (uint64_t)bytes_lus;
+        // Point de reprise au milieu d'un gros fichier : la reprise refera le dernier chunk s'il le faut
+        if (known && time(NULL) >= backup->next_checkpoint && checkpoint(backup, key, &st, entry, &history) == -1) {
+            throttle_close(backup->throttle, fd);
+            return -1;
         }
     }
-    closedir(dir);
+    throttle_close(backup->throttle, fd);
+    if (bytes_lus < 0) {
+        perror("Erreur lors de la lecture du fichier");
+        known = 0;  // recette incomplète : le fichier sera relu la prochaine fois
+    }
+    // Rendement d'une nouvelle version relue en entier : ce qu'elle partage avec les précédentes
+    if (previous && start == 0 && backup->chunker.policy == CHUNKER_CDC && lus >= CHUNKER_YIELD_MIN_SIZE) {
+        history.yield = (int8_t)(presents * 100 / lus);
+    }
+    backup->stats->size += entry->size;
+    backup->stats->files++;
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    if (known && files_cache_update(backup->files, key, &st, entry, &history,
+                                    content_digest(backup, digest) == 0 ? digest : NULL) == -1) {
+        return -1;
+    }
+    if (backup->files && time(NULL) >= backup->next_checkpoint && checkpoint(backup, NULL, NULL, NULL, NULL) == -1) {
+        return -1;
+    }
+    return 0;
 }
 
 /**
- * @brief fonction pour copier un dossier tout en écrivant toute les modifications dans le fichier de log
- * 
- * @param source_dir 
- * @param dest_dir 
- * @param log 
- * @param new 
+ * @brief Procédure supprimant les sauvegardes interrompues avant leur publication
+ *
+ * Une sauvegarde arrêtée brutalement laisse un répertoire avec un manifeste
+ * temporaire jamais renommé. Son travail n'est pas perdu : ses chunks
+ * validés sont dans le dépôt et ses recettes dans le dernier point de
+ * reprise du cache des fichiers, que la nouvelle sauvegarde reprend.
+ * Le dépôt étant verrouillé, aucune autre sauvegarde n'est en cours.
+ *
+ * @param backup_dir le répertoire du dépôt
  */
-log_t copy_directory(const char *source_dir, const char *dest_dir, FILE *log, int new) {
-    //printf("Copie du répertoire %s vers : %s\n", source_dir, dest_dir);
-    DIR *dir = opendir(source_dir);
+static void clean_interrupted_backups(const char *backup_dir) {
+    DIR *dir = opendir(backup_dir);
+    struct dirent *dirent;
     if (!dir) {
-        perror("Erreur lors de l'ouverture du répertoire source");
-        exit(EXIT_FAILURE);
+        return;
     }
+    while ((dirent = readdir(dir)) != NULL) {
+        char path[PATH_MAX + 64];
+        struct stat st;
+        if (dirent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s/%s", backup_dir, dirent->d_name, MANIFEST_NAME);
+        if (stat(path, &st) == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s/%s.tmp", backup_dir, dirent->d_name, MANIFEST_NAME);
+        if (unlink(path) == -1) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s/%s", backup_dir, dirent->d_name, MANIFEST_INDEX_NAME);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%s/%s.tmp", backup_dir, dirent->d_name, MANIFEST_INDEX_NAME);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%s", backup_dir, dirent->d_name);
+        if (rmdir(path) == 0) {
+            printf("Reprise de la sauvegarde interrompue %s\n", dirent->d_name);
+        }
+    }
+    closedir(dir);
+}
 
-    struct dirent *entry;
-    struct stat statbuf;
-    log_t logs = {NULL, NULL};
-
-    mkdir(dest_dir, 0755);
-    if(new==1){
-        while ((entry = readdir(dir)) != NULL) {
-                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                    continue;
-                }
-                char src_path[PATH_MAX];
-                char dest_path[PATH_MAX];
-                snprintf(src_path, sizeof(src_path), "%s/%s", source_dir, entry->d_name);
-                snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_dir, entry->d_name);
-                //printf("Copie de %s vers %s\n", src_path, dest_path);
-                if (stat(src_path, &statbuf) == -1) {
-                    perror("Erreur lors de la récupération des informations sur un fichier");
-                    continue;
-                }
-
-                if (S_ISDIR(statbuf.st_mode)) {
-                    printf("\n\nCopie du répertoire %s vers : %s\n\n\n", src_path, dest_path);
-                    copy_directory(src_path, dest_path, log, 1);
-                } else {
-                    log_element *elem = malloc(sizeof(log_element));
-                    char date[64];
-                    get_current_datetime(date, sizeof(date));
-                    char *chemin_date = extract_from_date(dest_path);
-                    elem->path = chemin_date;
-                    elem->date = date;
-                    elem->md5 = calculate_md5(src_path);
-                    write_log_element(elem,log);
-                    backup_file(src_path, dest_path);
-                }
+/**
+ * @brief Fonction cherchant la dernière sauvegarde publiée d'une source
+ *
+ * @param backup_dir le répertoire du dépôt
+ * @param source le chemin absolu de la source
+ * @param manifest_path le chemin de son manifeste, en sortie
+ * @param size la taille du tampon manifest_path
+ * @param since la date de début de cette sauvegarde, en sortie
+ * @return int 1 si une sauvegarde a été trouvée, 0 sinon
+ */
+static int previous_snapshot(const char *backup_dir, const char *source, char *manifest_path, size_t size,
+                             time_t *since) {
+    catalog_entry *entries;
+    size_t count;
+    int found = 0;
+    if (catalog_load(backup_dir, &entries, &count) == -1) {
+        return 0;
+    }
+    for (size_t i = count; i-- > 0 && !found;) {
+        struct tm date;
+        struct stat st;
+        if (strcmp(entries[i].source, source) != 0) {
+            continue;
         }
-    }else{
-        logs = read_backup_log(log);
-        log_element *current = logs.head;
-        if (current == NULL) {
-            printf("Aucun élément de log trouvé.\n");
-            return;
-        } else {
-            while ((entry = readdir(dir)) != NULL) {
-                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                    continue;
-                }
-                char src_path[PATH_MAX];
-                char dest_path[PATH_MAX];
-                snprintf(src_path, sizeof(src_path), "%s/%s", source_dir, entry->d_name);
-                snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_dir, entry->d_name);
-                printf("Copie de %s vers %s\n", src_path, dest_path);
-                if (stat(src_path, &statbuf) == -1) {
-                    perror("Erreur lors de la récupération des informations sur un fichier");
-                    continue;
-                }
+        snprintf(manifest_path, size, "%s/%s/%s", backup_dir, entries[i].name, MANIFEST_NAME);
+        memset(&date, 0, sizeof(date));
+        if (stat(manifest_path, &st) == 0 && parse_folder_date(entries[i].name, &date)) {
+            date.tm_year -= 1900;
+            date.tm_mon -= 1;
+            date.tm_isdst = -1;
+            *since = mktime(&date);
+            found = (*since != (time_t)-1);
+        }
+    }
+    free(entries);
+    return found;
+}
 
-                if (S_ISDIR(statbuf.st_mode)) {
-                    printf("\n\n\n\nCopie du répertoire %s vers : %s\n\n\n", src_path, dest_path);
-                    log_t logs_2= copy_directory(src_path, dest_path, log, 0);
-                    log_element *current_2 = logs_2.head;
-                    log_element *current_3 = logs.head;
-                    while (current_2 != NULL)
-                    {
-                        printf("Ecriture de l'élément de log : %s\n", current_2->path);
-                        current_2 = current_2->next;
-                    }
-                    while (current_3 != NULL)
-                    {
-                        printf("jkdfvnjkfdnjvEcriture de l'élément de log : %s\n", current_3->path);
-                        current_3 = current_3->next;
-                    }
-                    
-                    if(logs.head == NULL){
-                        logs.head = logs_2.head;
-                        logs.tail = logs_2.tail;
-                    }else{
-                        logs.tail->next = logs_2.head;
-                        logs.tail = logs_2.tail;
-                    }
-                } else {
-                    int est_present = file_exists_in_directory(src_path, dest_dir);
-                    if(est_present){
-                        log_element *elem = malloc(sizeof(log_element));
-                        char *test = extract_from_date(dest_path);
-                        printf("Date : %s\n", test);
-                        elem = file_exists_in_log(test, &logs);
-                        char *md5=calculate_md5(src_path);
-                        if(elem==NULL){
-                            printf("Le fichier %s n'est pas présent dans %s\n", src_path, dest_dir);
-                        }else{
-                            if(strcmp(md5,elem->md5)==0){
-                                char *chemin_date = extract_from_date(dest_path);
-                                elem->path = chemin_date;
-                            }else{
-                                printf("Le fichier %s a été modifié\n", src_path);
-                                char date[64];
-                                get_current_datetime(date, sizeof(date));
-                                char *chemin_date = extract_from_date(dest_path);
-                                elem->path = chemin_date;
-                                elem->date = date;
-                                elem->md5 = md5;
-                                backup_file(src_path, dest_path);
-                            }
-                        }
-                    }else{
-                        printf("Le fichier %s n'est pas présent dans %s\n", src_path, dest_dir);
-                        log_element *elem = malloc(sizeof(log_element));
-                        elem->prev = logs.tail;
-                        elem->next = NULL;
-                        logs.tail->next = elem;
-                        logs.tail = elem;
-                        char date[64];
-                        get_current_datetime(date, sizeof(date));
-                        char *chemin_date = extract_from_date(dest_path);
-                        char *md5=calculate_md5(src_path);
-                        elem->path = chemin_date;
-                        elem->date = date;
-                        elem->md5 = md5;
-                        backup_file(src_path, dest_path);
-                    }
+/**
+ * @brief Fonction écrivant le manifeste à partir du précédent et des seuls chemins modifiés
+ *
+ * Les entrées du manifeste précédent sont recopiées dans l'ordre, sans
+ * stat ni lecture, sauf celles que le journal de l'observateur désigne :
+ * elles sont réexaminées sur place, ce qui garde chaque dossier avant son
+ * contenu. Les chemins nouveaux sont ajoutés à la fin, parents d'abord
+ * puisque triés. Les chunks recopiés sont cités par le manifeste
+ * précédent, toujours publié : ils sont encore dans le dépôt.
+ *
+ * @param manifest le manifeste en cours de construction
+ * @param previous le manifeste précédent de la même source
+ * @param source_dir le répertoire source
+ * @param changes les chemins modifiés depuis la sauvegarde précédente
+ * @param patterns le filtre des entrées de la source (NULL pour tout garder)
+ * @param backup la sauvegarde locale en cours
+ * @return int 0 en cas de succès, -1 si la sauvegarde doit être interrompue
+ */
+static int walk_changes(FILE *manifest, FILE *previous, const char *source_dir, const dirty_set *changes,
+                        pattern_set *patterns, local_backup *backup) {
+    manifest_entry entry;
+    char key[PATH_MAX * 2];
+    unsigned char *done = calloc(changes->count ? changes->count : 1, 1);
+    int ret = 0, lu, status;
+    size_t i;
+
+    if (!done) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    manifest_entry_init(&entry);
+    while (ret == 0 && (lu = manifest_read_entry(previous, &entry)) == 1) {
+        switch (dirty_set_lookup(changes, entry.path, &i)) {
+            case WATCH_DIRTY_SUBTREE:
+                break;
+            case WATCH_DIRTY_PATH:
+                done[i] = 1;
+                status = manifest_walk_path(manifest, source_dir, entry.path, changes->subtree[i], patterns, store_file,
+                                            backup);
+                ret = (status == -1) ? -1 : 0;
+                break;
+            default:
+                // Le filtre peut avoir changé depuis : les entrées recopiées y passent aussi, sans stat
+                if (pattern_check_path(patterns, NULL, entry.path, entry.mode, entry.size, entry.mtime)
+                    == PATTERN_EXCLUDE) {
+                    break;
                 }
-            }
-            while (current != NULL){
-                char dest_path[PATH_MAX] = "";
-                char scr_path[PATH_MAX] = "";
-                strcat(dest_path, remove_after_last_slash(dest_dir));
-                strcat(dest_path, "/");
-                strcat(dest_path, current->path);
-                strcat(scr_path, source_dir);
-                strcat(scr_path, "/");
-                strcat(scr_path, remove_after_last_slash(remove_until_first_slash(current->path)));
-                int est_present = file_exists_in_directory(current->path, source_dir);
-                if(est_present==0){
-                    printf("supression de : %s\n", dest_path);
-                    if (unlink(dest_path) == -1) {
-                        perror("unlink");
-                    }
-                    if(current->prev == NULL && current->next == NULL){
-                        logs.head = NULL;
-                        logs.tail = NULL;
-                    }else if(current->prev == NULL){
-                        logs.head = current->next;
-                    }else if(current->next == NULL){
-                        logs.tail = current->prev;
-                    }else{
-                        current->prev->next = current->next;
-                        current->next->prev = current->prev;
-                    }
-                    current = current->next;
-                }else{
-                    current = current->next;
+                ret = manifest_write_entry(manifest, &entry);
+                if (entry.type == 'F') {
+                    backup->stats->size += entry.size;
+                    backup->stats->files++;
+                    snprintf(key, sizeof(key), "%s/%s", backup->stats->source, entry.path);
+                    files_cache_touch(backup->files, key);
                 }
-            }
         }
     }
-    closedir(dir);
-    return logs;
+    manifest_entry_free(&entry);
+    if (lu == -1) {
+        ret = -1;
+    }
+    for (i = 0; ret == 0 && i < changes->count; i++) {
+        size_t index;
+        if (done[i] || changes->paths[i][0] == '\0'
+            || dirty_set_lookup(changes, changes->paths[i], &index) == WATCH_DIRTY_SUBTREE) {
+            continue;
+        }
+        status = manifest_walk_path(manifest, source_dir, changes->paths[i], changes->subtree[i], patterns, store_file,
+                                    backup);
+        ret = (status == -1) ? -1 : 0;
+    }
+    free(done);
+    return ret;
 }
 
 /**
- * @brief Une procédure permettant obtenir le timestamp actuel
- * 
- * @param buffer le tampon pour stocker le timestamp
- * @param size la taille du tampon
+ * @brief Fonction sauvegardant un répertoire dans un dépôt déjà ouvert
+ *
+ * Le manifeste n'est publié qu'une fois tous ses chunks écrits dans le
+ * dépôt ; en cas d'échec, le répertoire de la sauvegarde est supprimé.
+ * Toutes les BACKUP_CHECKPOINT_INTERVAL secondes, un point de reprise
+ * permet à une sauvegarde relancée après un arrêt brutal de ne pas
+ * recommencer depuis le début. Si un observateur (--watch) suit la source
+ * depuis la sauvegarde précédente, seuls les chemins qu'il a notés sont
+ * revus au lieu de parcourir toute l'arborescence.
+ *
+ * @param store le dépôt de chunks ouvert en écriture
+ * @param source_dir le répertoire source
+ * @param backup_dir le répertoire du dépôt
+ * @param limits les limites de lecture et d'écriture
+ * @param patterns le filtre des entrées de la source (NULL pour tout garder)
+ * @param stats les statistiques de la sauvegarde en sortie (nom, taille, octets ajoutés...)
+ * @param files_stats le bilan du cache des fichiers en sortie (NULL s'il est inutile)
+ * @return int 0 en cas de succès, -1 sinon
  */
-void get_current_timestamp(char *buffer, size_t size) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    struct tm *local_time = localtime(&tv.tv_sec);
-    char temp_buffer[64];
-    strftime(temp_buffer, sizeof(temp_buffer), "%Y-%m-%d-%H:%M:%S", local_time);
-    snprintf(buffer, size, "%s.%03ld", temp_buffer, tv.tv_usec / 1000);
+int backup_to_store(chunk_store *store, const char *source_dir, const char *backup_dir, throttle *limits,
+                    pattern_set *patterns, catalog_entry *stats, files_cache_stats *files_stats) {
+    files_cache files;
+    local_backup backup = {store, stats, limits, &files, time(NULL) + BACKUP_CHECKPOINT_INTERVAL, {0}, NULL, NULL};
+    char snapshot_dir[PATH_MAX];
+    char manifest_path[PATH_MAX + 32];
+    char index_path[PATH_MAX + 32];
+    char tmp_path[PATH_MAX + 64];
+    struct timeval debut, fin;
+
+    gettimeofday(&debut, NULL);
+    memset(stats, 0, sizeof(*stats));
+    get_current_timestamp(stats->name, sizeof(stats->name));
+    if (realpath(source_dir, stats->source) == NULL) {
+        snprintf(stats->source, sizeof(stats->source), "%s", source_dir);
+    }
+    snprintf(snapshot_dir, sizeof(snapshot_dir), "%s/%s", backup_dir, stats->name);
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", snapshot_dir, MANIFEST_NAME);
+    snprintf(index_path, sizeof(index_path), "%s/%s", snapshot_dir, MANIFEST_INDEX_NAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", manifest_path);
+    clean_interrupted_backups(backup_dir);
+    if (mkdir(snapshot_dir, 0755) == -1) {
+        perror("Erreur lors de la création du répertoire de sauvegarde");
+        return -1;
+    }
+
+    backup.content = EVP_MD_CTX_new();
+    backup.work = EVP_MD_CTX_new();
+    if (files_cache_load(&files, store->dir, store->opts.populate) == -1 || chunker_init(&backup.chunker) == -1
+        || !backup.content || !backup.work) {
+        files_cache_free(&files);
+        chunker_free(&backup.chunker);
+        EVP_MD_CTX_free(backup.content);
+        EVP_MD_CTX_free(backup.work);
+        rmdir(snapshot_dir);
+        return -1;
+    }
+    // Avec un observateur actif, seuls les chemins modifiés depuis la sauvegarde précédente sont revus
+    char previous_path[PATH_MAX + 96];
+    dirty_set changes;
+    time_t since;
+    FILE *previous = NULL;
+    int incremental = 0;
+    if (previous_snapshot(backup_dir, stats->source, previous_path, sizeof(previous_path), &since)
+        && watch_load(store->dir, stats->source, since, &changes) == 1) {
+        previous = fopen(previous_path, "r");
+        incremental = (previous != NULL);
+        if (previous) {
+            printf("Parcours limité aux %zu chemins modifiés depuis la sauvegarde précédente\n", changes.count);
+        } else {
+            dirty_set_free(&changes);
+        }
+    }
+    FILE *manifest = fopen(tmp_path, "w");
+    int ret;
+    if (manifest == NULL) {
+        ret = -1;
+    } else if (previous) {
+        ret = walk_changes(manifest, previous, source_dir, &changes, patterns, &backup);
+    } else {
+        ret = manifest_walk(manifest, source_dir, "", patterns, store_file, &backup);
+    }
+    if (incremental) {
+        fclose(previous);
+        dirty_set_free(&changes);
+    }
+    if (manifest && close_synced(manifest) != 0) {
+        ret = -1;
+    }
+    // Sans index, une restauration partielle parcourt tout le manifeste : ce n'est pas bloquant
+    if (ret == 0 && manifest_build_index(tmp_path, index_path) == -1) {
+        fprintf(stderr, "Attention : sauvegarde sans index des chemins\n");
+    }
+    // Le manifeste n'est publié, par un renommage atomique, qu'une fois tous ses chunks validés sur disque
+    if (ret == -1 || store_flush(store) == -1 || rename(tmp_path, manifest_path) == -1
+        || sync_dir(snapshot_dir) == -1 || sync_dir(backup_dir) == -1) {
+        int err = errno;
+        fprintf(stderr, "Erreur : la sauvegarde de %s a échoué\n", source_dir);
+        unlink(tmp_path);
+        unlink(index_path);
+        rmdir(snapshot_dir);
+        files_cache_free(&files);
+        chunker_free(&backup.chunker);
+        EVP_MD_CTX_free(backup.content);
+        EVP_MD_CTX_free(backup.work);
+        errno = err;
+        return -1;
+    }
+    // Le cache n'est réécrit qu'après la publication : ses recettes ne citent que des chunks écrits
+    if (files_cache_save(&files) == -1) {
+        fprintf(stderr, "Attention : cache des fichiers non enregistré, la prochaine sauvegarde relira tout\n");
+    }
+    // Le journal ne garde que ce que la sauvegarde suivante devra revoir
+    if (watch_trim(store->dir, debut.tv_sec, !incremental) == -1) {
+        fprintf(stderr, "Attention : journal des modifications non allégé\n");
+    }
+    if (files_stats) {
+        *files_stats = files.stats;
+    }
+    files_cache_free(&files);
+    chunker_free(&backup.chunker);
+    EVP_MD_CTX_free(backup.content);
+    EVP_MD_CTX_free(backup.work);
+
+    gettimeofday(&fin, NULL);
+    stats->date = fin.tv_sec;
+    stats->duration = (double)(fin.tv_sec - debut.tv_sec) + (double)(fin.tv_usec - debut.tv_usec) / 1e6;
+    catalog_append(backup_dir, stats);
+    return 0;
 }
 
 /**
- * @brief Une procédure pour créer un nouveau backup incrémental
+ * @brief Une fonction pour créer un nouveau backup incrémental
+ * 
+ * Les chunks sont ajoutés au dépôt partagé par toutes les sauvegardes du
+ * répertoire de destination : seuls les chunks encore inconnus sont écrits.
+ * La sauvegarde elle-même n'est qu'un manifeste, ce qui permet de la
+ * supprimer (--prune) sans toucher aux autres.
  * 
  * @param source_dir le répertoire source
  * @param backup_dir le répertoire de destination
+ * @param store_opts les réglages du filtre du dépôt (NULL pour les réglages par défaut)
+ * @param throttle_opts les limites de lecture et d'écriture (NULL pour aucune limite)
+ * @param patterns le filtre des entrées de la source (NULL pour tout garder)
+ * @return int 0 en cas de succès, -1 sinon
  */
-void create_backup(const char *source_dir, const char *backup_dir) {
-    char date_str[64];
-    char fichierlog[PATH_MAX];
-    get_current_timestamp(date_str, sizeof(date_str));
-    mkdir(backup_dir, 0755);
-    char new_backup_dir[PATH_MAX];
-    snprintf(new_backup_dir, sizeof(new_backup_dir), "%s/%s", backup_dir, date_str);
-    strcat(fichierlog, backup_dir);
-    strcat(fichierlog, "/");
-    strcat(fichierlog, ".backup_log");
-    FILE *log = fopen(fichierlog, "r");
-    log_t list_logs = {NULL, NULL};
-    if(log == NULL){
-        log = fopen(fichierlog, "a");
-        printf("Copie des fichier de : %s dans : %s\n", source_dir, new_backup_dir);
-        copy_directory(source_dir, new_backup_dir, log, 1);
-    }else{
-        log = fopen(fichierlog, "a+");
-        char *closest_backup = find_most_recent_folder(backup_dir);
-        strcat(backup_dir, "/");
-        strcat(backup_dir, closest_backup);
-        printf("Restauration de la sauvegarde la plus proche : %s\n", closest_backup);
-        copy_directory_link(backup_dir, new_backup_dir);
-        list_logs = copy_directory(source_dir, new_backup_dir, log, 0);
-    }
-    if (mkdir(new_backup_dir, 0755) == -1 && errno != EEXIST) {
-        perror("Erreur lors de la création du répertoire de sauvegarde");
-        exit(EXIT_FAILURE);
+int create_backup(const char *source_dir, const char *backup_dir, const store_options *store_opts,
+                  const throttle_options *throttle_opts, pattern_set *patterns) {
+    chunk_store store;
+    catalog_entry stats;
+    files_cache_stats files;
+    throttle limits;
+
+    if (throttle_init(&limits, throttle_opts) == -1) {
+        return -1;
     }
-    fclose(log);
-    if(list_logs.head != NULL){
-        FILE *file_log = fopen(fichierlog, "w");
-        log_element *current = list_logs.head;
-        while (current != NULL){
-            printf("Ecriture de l'élément de log : %s\n", current->path);
-            write_log_element(current, file_log);
-            current = current->next;
-        }
-    }else{
-        printf("Aucun élément de log à écrire\n");
+    throttle_apply_priority(&limits);
+    if (store_open(&store, backup_dir, store_opts) == -1) {
+        throttle_free(&limits);
+        return -1;
     }
-    printf("Sauvegarde terminée dans : %s\n", new_backup_dir);
+
+    printf("Sauvegarde de %s dans : %s\n", source_dir, backup_dir);
+    if (backup_to_store(&store, source_dir, backup_dir, &limits, patterns, &stats, &files) == -1) {
+        store_close(&store);
+        throttle_free(&limits);
+        return -1;
+    }
+    store_filter_stats filter;
+    store_index_stats index;
+    store_filter_report(&store, &filter);
+    store_index_report(&store, &index);
+    store_close(&store);
+
+    printf("Sauvegarde terminée dans : %s/%s (%llu fichiers, %llu octets, %llu octets ajoutés)\n", backup_dir, stats.name,
+           (unsigned long long)stats.files, (unsigned long long)stats.size, (unsigned long long)stats.added);
+    printf("Cache des fichiers : %llu fichiers inchangés, %llu allongés découpés depuis leur dernier chunk, %llu relus en entier (%llu octets repris sans découpage), %llu points de reprise, %llu petits fichiers dans le manifeste\n",
+           (unsigned long long)files.unchanged, (unsigned long long)files.appended,
+           (unsigned long long)files.reread, (unsigned long long)files.skipped_bytes,
+           (unsigned long long)files.checkpoints, (unsigned long long)files.inlined);
+    printf("Découpage : %llu fichiers en blocs de %u octets, %llu selon leur contenu, %llu en blocs de %u octets\n",
+           (unsigned long long)files.policies[CHUNKER_FIXED], (unsigned int)CHUNK_SIZE,
+           (unsigned long long)files.policies[CHUNKER_CDC], (unsigned long long)files.policies[CHUNKER_WHOLE],
+           (unsigned int)CHUNK_MAX_SIZE);
+    if (pattern_set_active(patterns)) {
+        printf("Filtre de la source : %zu règles, %llu entrées écartées sans être parcourues\n", patterns->count,
+               (unsigned long long)patterns->excluded);
+    }
+    printf("Filtre de l'index : %llu recherches, %llu évitées, %llu faux positifs (%llu octets, taux estimé %.3g%% pour %.3g%% visé)\n",
+           (unsigned long long)filter.lookups, (unsigned long long)filter.negatives,
+           (unsigned long long)filter.false_positives, (unsigned long long)filter.memory,
+           filter.estimated_fpr * 100, filter.target_fpr * 100);
+    printf("Index : %zu segments (%llu chunks), %llu chunks en mémoire, %llu octets pour %llu au plus, %llu écritures et %llu fusions de segments, %llu lots validés sur disque\n",
+           index.runs, (unsigned long long)index.run_records, (unsigned long long)index.mem_entries,
+           (unsigned long long)index.memory, (unsigned long long)index.memory_cap,
+           (unsigned long long)index.flushes, (unsigned long long)index.merges, (unsigned long long)index.commits);
+    throttle_report(&limits);
+    throttle_free(&limits);
+    return 0;
 }
 
 /**
@@ -682,12 +971,15 @@ void backup_file(const char *filename, const char *backup_dir) {
     FILE *file = fopen(filename, "rb"); // Ouverture du fichier en lecture binaire
     Md5Entry *hash_table[HASH_TABLE_SIZE] = {NULL}; // Initialisation de la table de hachage
     Chunk_list chunks = NULL; // Initialisation de la liste de chunks
+    arena pool; // Les chunks et les entrées de la table sont libérés d'un coup avec l'arène
+    arena_init(&pool, 0);
 
-    deduplicate_file(file, &chunks, hash_table);
-    write_backup_file(backup_dir, chunks);
+    if (deduplicate_file(file, &chunks, hash_table, &pool) == 0) {
+        write_backup_file(backup_dir, chunks);
+    }
 
     fclose(file);
-    free(chunks);
+    arena_free(&pool);
 }
 
 
@@ -695,8 +987,7 @@ void backup_file(const char *filename, const char *backup_dir) {
  * @brief Une procédure permettant la restauration du fichier backup via le tableau de chunk
  * 
  * @param output_filename fichier de sortie avec les chunks restorés
- * @param chunks tableau de chunks
- * @param chunk_count nombre de chunks contenus dans le tableau
+ * @param chunks tableau de chunks, libéré avec l'arène qui le possède
  */
 void write_restored_file(const char *output_filename, Chunk_list chunks) {
     FILE *dest = fopen(output_filename, "wb");//Ouverture du fichier en écriture binaire
@@ -717,26 +1008,122 @@ void write_restored_file(const char *output_filename, Chunk_list chunks) {
         current = current->next;//On passe au chunk suivant
     }
     fclose(dest);
-    free(chunks);
 }
 
 /**
- * @brief Procédure  qui restaure une sauvegarde
+ * @brief Fonction restaurant une sauvegarde depuis un dépôt déjà ouvert
+ *
+ * Les fichiers sont créés dans l'ordre du manifeste, mais leurs chunks sont
+ * relus dans l'ordre du dépôt par un plan de restauration : chaque chunk
+ * n'est lu qu'une fois par lot, quel que soit le nombre de fichiers qui le
+ * référencent, et les chunks partagés entre lots sont servis par le cache.
+ *
+ * @param store le dépôt de chunks de la sauvegarde
+ * @param cache le cache de chunks partagé par les restaurations (NULL sans cache)
+ * @param backup_id chemin vers le répertoire de la sauvegarde
+ * @param manifest le manifeste de la sauvegarde ouvert en lecture
+ * @param restore_dir répertoire où sera restaurée la sauvegarde
+ * @param pattern le motif des chemins à restaurer (NULL pour toute la sauvegarde)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int restore_from_store(chunk_store *store, chunk_cache *cache, const char *backup_id, FILE *manifest,
+                       const char *restore_dir, const char *pattern) {
+    restore_plan plan;
+    int ret;
+    restore_plan_init(&plan, store, cache, restore_dir);
+    if (pattern) {
+        char index_path[PATH_MAX];
+        snprintf(index_path, sizeof(index_path), "%s/%s", backup_id, MANIFEST_INDEX_NAME);
+        ret = manifest_restore_matching(manifest, index_path, pattern, restore_dir, restore_plan_collect, &plan);
+    } else {
+        ret = manifest_restore(manifest, restore_dir, restore_plan_collect, &plan);
+    }
+    if (restore_plan_execute(&plan) == -1) {
+        ret = -1;
+    }
+    printf("Restauration ordonnée : %llu références vers %llu chunks distincts, %llu servis par le cache, %llu octets lus en %llu lectures, %llu ouvertures de fichiers, %llu lots\n",
+           (unsigned long long)plan.stats.refs, (unsigned long long)plan.stats.chunks,
+           (unsigned long long)plan.stats.cache_hits, (unsigned long long)plan.stats.bytes_read,
+           (unsigned long long)plan.stats.reads, (unsigned long long)plan.stats.reopens,
+           (unsigned long long)plan.stats.batches);
+    restore_plan_free(&plan);
+    return ret;
+}
+
+/**
+ * @brief Fonction restaurant une sauvegarde décrite par un manifeste (sauvegarde reçue par le réseau)
+ *
+ * @param backup_id chemin vers le répertoire de la sauvegarde
+ * @param manifest le manifeste de la sauvegarde ouvert en lecture
+ * @param restore_dir répertoire où sera restaurée la sauvegarde
+ * @param pattern le motif des chemins à restaurer (NULL pour toute la sauvegarde)
+ * @param cache_bytes la taille du cache des chunks relus (0 pour s'en passer)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int restore_manifest_backup(const char *backup_id, FILE *manifest, const char *restore_dir, const char *pattern,
+                                   uint64_t cache_bytes) {
+    chunk_store store;
+    chunk_cache cache;
+    store_options opts = STORE_OPTIONS_DEFAULT;
+    char *repo_dir = strchr(backup_id, '/') ? remove_after_last_slash(backup_id) : strdup(".");
+    if (!repo_dir || chunk_cache_init(&cache, cache_bytes) == -1) {
+        free(repo_dir);
+        return -1;
+    }
+    // La restauration ne fait que lire : elle ne prend pas le verrou d'une sauvegarde en cours
+    opts.read_only = 1;
+    if (store_open(&store, repo_dir[0] ? repo_dir : "/", &opts) == -1) {
+        chunk_cache_free(&cache);
+        free(repo_dir);
+        return -1;
+    }
+    int ret = restore_from_store(&store, cache_bytes > 0 ? &cache : NULL, backup_id, manifest, restore_dir, pattern);
+    store_close(&store);
+    if (cache_bytes > 0) {
+        chunk_cache_stats stats;
+        chunk_cache_report(&cache, &stats);
+        printf("Cache des chunks : %llu chunks servis depuis la mémoire (%llu octets), %llu absents, %llu évincés\n",
+               (unsigned long long)stats.hits, (unsigned long long)stats.hit_bytes,
+               (unsigned long long)stats.misses, (unsigned long long)stats.evictions);
+    }
+    chunk_cache_free(&cache);
+    free(repo_dir);
+    return ret;
+}
+
+/**
+ * @brief Fonction qui restaure une sauvegarde
  * 
  * @param backup_id chemin vers de répertoire de la sauvegarde que l'on veut restaurer
  * @param restore_dir répertoire ou sera restaurée la sauvegarde
+ * @param pattern le motif des chemins à restaurer (NULL pour toute la sauvegarde)
+ * @param cache_bytes la taille du cache des chunks relus (0 pour s'en passer)
+ * @return int 0 si tout a été restauré, -1 sinon
  */
-void restore_backup(const char *backup_id, const char *restore_dir) {
+int restore_backup(const char *backup_id, const char *restore_dir, const char *pattern, uint64_t cache_bytes) {
     DIR *dir;
     struct dirent *entry;
     char backup_path[PATH_MAX];
     char restore_path[PATH_MAX];
     struct stat st;
+    int ret = 0;
+
+    snprintf(backup_path, sizeof(backup_path), "%s/%s", backup_id, MANIFEST_NAME);
+    FILE *manifest = fopen(backup_path, "r");
+    if (manifest) {
+        ret = restore_manifest_backup(backup_id, manifest, restore_dir, pattern, cache_bytes);
+        fclose(manifest);
+        return ret;
+    }
+    if (pattern) {
+        fprintf(stderr, "Erreur : --path demande une sauvegarde décrite par un manifeste\n");
+        return -1;
+    }
 
     dir = opendir(backup_id);
     if (!dir) {
         fprintf(stderr, "Erreur : impossible d'ouvrir le répertoire de sauvegarde %s : %s\n", backup_id, strerror(errno));
-        return;
+        return -1;
     }
 
     while ((entry = readdir(dir)) != NULL) {
@@ -749,16 +1136,20 @@ void restore_backup(const char *backup_id, const char *restore_dir) {
 
         if (stat(backup_path, &st) == -1) {
             fprintf(stderr, "Erreur : impossible de récupérer les informations du fichier %s : %s\n", backup_path, strerror(errno));
+            ret = -1;
             continue;
         }
 
         if (S_ISDIR(st.st_mode)) {
             mkdir(restore_path, 0755);
-            restore_backup(backup_path, restore_path);
+            if (restore_backup(backup_path, restore_path, NULL, cache_bytes) == -1) {
+                ret = -1;
+            }
         } else if (S_ISREG(st.st_mode)) {
             int src_fd = open(backup_path, O_RDONLY);
             if (src_fd == -1) {
                 fprintf(stderr, "Erreur : impossible d'ouvrir le fichier source %s : %s\n", backup_path, strerror(errno));
+                ret = -1;
                 continue;
             }
 
@@ -766,12 +1157,14 @@ void restore_backup(const char *backup_id, const char *restore_dir) {
             if (dest_fd == -1) {
                 fprintf(stderr, "Erreur : impossible de créer le fichier de destination %s : %s\n", restore_path, strerror(errno));
                 close(src_fd);
+                ret = -1;
                 continue;
             }
 
             off_t offset = 0;
             if (sendfile(dest_fd, src_fd, &offset, st.st_size) == -1) {
                 fprintf(stderr, "Erreur : échec de la copie du fichier %s vers %s : %s\n", backup_path, restore_path, strerror(errno));
+                ret = -1;
             }
 
             close(src_fd);
@@ -780,22 +1173,23 @@ void restore_backup(const char *backup_id, const char *restore_dir) {
     }
 
     closedir(dir);
+    return ret;
 }
 
 /**
- * @brief Fonction qui calcule la taille d'un répertoire
+ * @brief Procédure qui calcule la taille d'un répertoire et le nombre de fichiers qu'il contient
  * 
- * @param directory le répertoire dont on veut connaître la taille/l'existence
- * @return entier, -1 si le répertoire n'existe pas, la taille du répertoire sinon
+ * @param directory le répertoire à parcourir
+ * @param stats les statistiques à compléter : taille, nombre de fichiers, et
+ *          octets des fichiers qui ne sont pas des liens vers une autre sauvegarde
  */
-int taille_dossier(const char *directory) {
-    int total_size = 0;
+static void statistiques_dossier(const char *directory, catalog_entry *stats) {
     struct dirent *fichier;
     DIR *dir = opendir(directory);
 
     if (!dir) {
-        printf("Le répertoire n'éxiste pas");
-        return -1;
+        fprintf(stderr, "Le répertoire %s n'existe pas\n", directory);
+        return;
     }
 
     while ((fichier = readdir(dir)) != NULL) {
@@ -803,72 +1197,222 @@ int taille_dossier(const char *directory) {
             continue;
         }
 
-        char path[1024];
+        char path[PATH_MAX * 2];
         snprintf(path, sizeof(path), "%s/%s", directory, fichier->d_name);
         struct stat st;
-        if (stat(path, &st) == -1) {
-            printf("Erreur lors de la récupération des informations du fichier");
+        if (lstat(path, &st) == -1) {
+            perror("Erreur lors de la récupération des informations du fichier");
             continue;
         }
 
         if (S_ISDIR(st.st_mode)) {
-            int dir_size = taille_dossier(path);
-            if (dir_size != -1) {
-                total_size += dir_size;
-            }
+            statistiques_dossier(path, stats);
         } else if (S_ISREG(st.st_mode)) {
-            total_size += st.st_size;
+            stats->size += (uint64_t)st.st_size;
+            stats->files++;
+            if (st.st_nlink == 1) {
+                stats->added += (uint64_t)st.st_size;
+            }
         }
     }
 
     closedir(dir);
-    return total_size;
-} 
+}
+
+/**
+ * @brief Fonction indiquant si une sauvegarde a été publiée
+ *
+ * Une sauvegarde est publiée par le renommage de son manifeste. Tant
+ * qu'elle est en cours, ou si elle a été interrompue, son répertoire est
+ * vide ou ne contient que le manifeste temporaire et l'index des chemins.
+ * Une sauvegarde de l'ancien format, sans manifeste, contient directement
+ * les fichiers sauvegardés.
+ *
+ * @param repo_dir le répertoire de sauvegarde
+ * @param name le nom de la sauvegarde
+ * @return int 1 si la sauvegarde est publiée, 0 sinon
+ */
+int snapshot_published(const char *repo_dir, const char *name) {
+    static const char *const en_cours[] = {MANIFEST_NAME ".tmp", MANIFEST_INDEX_NAME, MANIFEST_INDEX_NAME ".tmp"};
+    char path[PATH_MAX * 2];
+
+    snprintf(path, sizeof(path), "%s/%s/%s", repo_dir, name, MANIFEST_NAME);
+    if (access(path, F_OK) == 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(en_cours) / sizeof(en_cours[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s/%s", repo_dir, name, en_cours[i]);
+        if (access(path, F_OK) == 0) {
+            return 0;
+        }
+    }
+    snprintf(path, sizeof(path), "%s/%s", repo_dir, name);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *fichier;
+    int vide = 1;
+    while (vide && (fichier = readdir(dir)) != NULL) {
+        vide = strcmp(fichier->d_name, ".") == 0 || strcmp(fichier->d_name, "..") == 0;
+    }
+    closedir(dir);
+    return !vide;
+}
+
+/**
+ * @brief Fonction calculant les statistiques d'une sauvegarde absente du catalogue
+ *
+ * Le listage ne prend pas le verrou du dépôt : les statistiques restent en
+ * mémoire et le catalogue n'est jamais modifié.
+ *
+ * @param directory le répertoire de sauvegarde
+ * @param name le nom de la sauvegarde
+ * @param entry l'entrée calculée en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int statistiques_sauvegarde(const char *directory, const char *name, catalog_entry *entry) {
+    char path[PATH_MAX * 2];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        return -1;
+    }
+    memset(entry, 0, sizeof(*entry));
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    snprintf(entry->source, sizeof(entry->source), "-");
+    entry->date = st.st_mtime;
+
+    // Sauvegarde reçue par le réseau : tout est décrit par son manifeste
+    char manifest_path[PATH_MAX * 2 + 32];
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", path, MANIFEST_NAME);
+    FILE *manifest = fopen(manifest_path, "r");
+    if (manifest) {
+        manifest_entry fichier;
+        manifest_entry_init(&fichier);
+        while (manifest_read_entry(manifest, &fichier) == 1) {
+            if (fichier.type == 'F') {
+                entry->size += fichier.size;
+                entry->files++;
+            }
+        }
+        manifest_entry_free(&fichier);
+        fclose(manifest);
+    } else {
+        statistiques_dossier(path, entry);
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction de comparaison de deux noms pour qsort et bsearch
+ */
+static int compare_noms(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Procédure affichant une entrée du catalogue
+ *
+ * @param directory chemin vers le répertoire avec les sauvegardes
+ * @param entry l'entrée à afficher
+ * @param verbose mode verbose activé ou non
+ */
+static void afficher_sauvegarde(const char *directory, const catalog_entry *entry, int verbose) {
+    printf("Nom du répertoire: %s\n", entry->name);
+    if (verbose) {
+        char path[PATH_MAX * 2];
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->name);
+        char *chemin_absolue = realpath(path, NULL);
+        printf("Chemin complet: %s\n", chemin_absolue ? chemin_absolue : path);
+        free(chemin_absolue);
+    }
+    printf("Taille totale: %llu octets\n", (unsigned long long)entry->size);
+    printf("Octets ajoutés: %llu octets\n", (unsigned long long)entry->added);
+    if (verbose) {
+        printf("Nombre de fichiers: %llu\n", (unsigned long long)entry->files);
+        printf("Durée: %.3f s\n", entry->duration);
+        printf("Source: %s\n", entry->source);
+        char date[32];
+        printf("Date de création: %s", ctime_r(&entry->date, date));
+    }
+    printf("\n");
+}
 
 /**
  * @brief Procédure listant les sauvegardes dans un répertoire, et
  *          donnant des info sur chaque sauvegarde (chaque sous répertoire dans ce répertoire enfaite)
  * 
+ * Les informations viennent du catalogue écrit à la création de chaque
+ * sauvegarde : le contenu des sauvegardes n'est pas parcouru. Seules les
+ * sauvegardes publiées absentes du catalogue (créées avant lui) sont
+ * parcourues ; le listage ne modifie jamais le dépôt.
+ * 
  * @param directory chemin vers le répertoire avec les sauvegardes
  * @param verbose mode verbose activé ou non
  */
 void list_backup(const char *directory, int verbose) {
     struct dirent *fichier;
+    catalog_entry *entries;
+    size_t nb_entries;
+    char **noms = NULL;
+    size_t nb_noms = 0, capacite = 0;
     DIR *dir = opendir(directory);
 
     if (!dir) {
         printf("Le répertoire n'éxiste pas");
         return;
     }
+    if (catalog_load(directory, &entries, &nb_entries) == -1) {
+        perror("Erreur lors de la lecture du catalogue");
+        closedir(dir);
+        return;
+    }
 
+    // Liste des sauvegardes présentes, pour ignorer celles supprimées à la main
     while ((fichier = readdir(dir)) != NULL) {
-        
-        if (strcmp(fichier->d_name, ".") == 0 || strcmp(fichier->d_name, "..") == 0) {
+        // Les entrées cachées (., .., .chunks, .backup_log, .catalog) ne sont pas des sauvegardes
+        if (fichier->d_name[0] == '.') {
             continue;
         }
-        char path[1024];
-        snprintf(path, sizeof(path), "%s/%s", directory, fichier->d_name);
-        char *chemin_absolue = realpath(path, NULL);
-        struct stat st;
-        if (stat(path, &st) == -1) {
-            printf("Erreur lors de la récupération des informations du répertoire");
-            continue;
+        if (nb_noms == capacite) {
+            capacite = capacite ? capacite * 2 : 64;
+            char **nouveaux = realloc(noms, capacite * sizeof(char *));
+            if (!nouveaux) {
+                fprintf(stderr, "Erreur d'allocation mémoire\n");
+                break;
+            }
+            noms = nouveaux;
         }
-        if (S_ISDIR(st.st_mode)) {
-            int dir_size = taille_dossier(path);
-            if (verbose) {
-                printf("Nom du répertoire: %s\n", fichier->d_name);
-                printf("Chemin complet: %s\n", chemin_absolue);
-                printf("Taille totale: %d octets\n", dir_size);
-                printf("Date de création: %s", ctime(&st.st_ctime));
-            } else {
-                printf("Nom du répertoire: %s\n", fichier->d_name);
-                printf("Taille totale: %d octets\n", dir_size);
+        noms[nb_noms++] = strdup(fichier->d_name);
+    }
+    closedir(dir);
+    if (nb_noms > 0) {
+        qsort(noms, nb_noms, sizeof(char *), compare_noms);
+    }
+
+    // Les deux listes sont triées par nom : on les parcourt ensemble
+    size_t i = 0, j = 0;
+    while (j < nb_noms) {
+        int cmp = (i < nb_entries) ? strcmp(entries[i].name, noms[j]) : 1;
+        if (cmp < 0) {
+            i++; // Sauvegarde supprimée
+        } else if (cmp == 0) {
+            afficher_sauvegarde(directory, &entries[i], verbose);
+            i++;
+            j++;
+        } else {
+            catalog_entry entry;
+            if (snapshot_published(directory, noms[j]) && statistiques_sauvegarde(directory, noms[j], &entry) == 0) {
+                afficher_sauvegarde(directory, &entry, verbose);
             }
-            printf("\n");
-            free(chemin_absolue);
+            j++;
         }
     }
 
-    closedir(dir);
-}
\ No newline at end of file
+    for (size_t k = 0; k < nb_noms; k++) {
+        free(noms[k]);
+    }
+    free(noms);
+    free(entries);
+}
@@ -3,6 +3,12 @@
 
 #include "deduplication.h"
 #include "file_handler.h"
+#include "chunk_store.h"
+#include "throttle.h"
+#include "catalog.h"
+#include "chunk_cache.h"
+#include "files_cache.h"
+#include "pattern.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,10 +16,20 @@
 #include <time.h>
 #include <sys/stat.h>
 
+// Intervalle entre deux points de reprise d'une sauvegarde locale (5 minutes)
+#define BACKUP_CHECKPOINT_INTERVAL 300
+
 // Fonction pour créer un nouveau backup incrémental
-void create_backup(const char *source_dir, const char *backup_dir);
+int create_backup(const char *source_dir, const char *backup_dir, const store_options *store_opts,
+                  const throttle_options *throttle_opts, pattern_set *patterns);
+// Fonction pour sauvegarder un répertoire dans un dépôt déjà ouvert
+int backup_to_store(chunk_store *store, const char *source_dir, const char *backup_dir, throttle *limits,
+                    pattern_set *patterns, catalog_entry *stats, files_cache_stats *files_stats);
+// Fonction pour restaurer une sauvegarde depuis un dépôt déjà ouvert
+int restore_from_store(chunk_store *store, chunk_cache *cache, const char *backup_id, FILE *manifest,
+                       const char *restore_dir, const char *pattern);
 // Fonction pour restaurer une sauvegarde
-void restore_backup(const char *backup_id, const char *restore_dir);
+int restore_backup(const char *backup_id, const char *restore_dir, const char *pattern, uint64_t cache_bytes);
 // Fonction permettant la restauration du fichier backup via le tableau de chunk
 void write_backup_file(const char *output_filename, Chunk_list chunks);
 // Fonction pour la sauvegarde de fichier dédupliqué
@@ -22,5 +38,11 @@ void backup_file(const char *filename, const char *backup_dir);
 void write_restored_file(const char *output_filename, Chunk_list chunks);
 // Fonction permettant de lister les différentes sauvegardes présentes dans la destination
 void list_backup(const char *directory,int verbose);
+// Fonction indiquant si une sauvegarde a été publiée (et n'est ni en cours ni interrompue)
+int snapshot_published(const char *repo_dir, const char *name);
+// Fonction permettant d'obtenir le timestamp actuel servant de nom aux sauvegardes
+void get_current_timestamp(char *buffer, size_t size);
+// Fonction pour convertir un nom de sauvegarde en date
+int parse_folder_date(const char *folder_name, struct tm *result);
 
 #endif // BACKUP_MANAGER_H
@@ -0,0 +1,310 @@
+#include "bloom_filter.h"
+#include "file_handler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// Nombre de mots de 64 bits d'un bloc
+#define BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+
+// Signature du fichier du filtre (BORGBLM1 : en-tête antérieur, sans somme de contrôle)
+#define BLOOM_MAGIC "BORGBLM2"
+#define BLOOM_MAGIC_V1 "BORGBLM1"
+
+// En-tête du fichier du filtre (64 octets), suivi des blocs alignés sur une ligne de cache
+typedef struct {
+    char magic[8];
+    uint64_t nb_blocks;
+    uint32_t k;
+    uint32_t generation; // segments d'index déjà ajoutés au filtre (numéro du dernier)
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t records;   // enregistrements du journal de l'index déjà ajoutés au filtre
+    double fpr;
+    uint64_t checksum;  // somme de contrôle des champs précédents (absente d'un BORGBLM1)
+} bloom_header;
+
+/**
+ * @brief Fonction pour dimensionner et allouer un filtre vide
+ *
+ * Le nombre de bits par empreinte et de fonctions de hachage découle du taux
+ * de faux positifs visé. Si max_bytes est non nul, la taille du filtre y est
+ * plafonnée, au prix d'un taux de faux positifs plus élevé.
+ *
+ * @param filter le filtre à initialiser
+ * @param capacity le nombre d'empreintes prévu
+ * @param fpr le taux de faux positifs visé (entre 0 et 1)
+ * @param max_bytes la mémoire maximale du filtre (0 = sans limite)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int bloom_init(bloom_filter *filter, uint64_t capacity, double fpr, uint64_t max_bytes) {
+    memset(filter, 0, sizeof(*filter));
+    if (fpr <= 0.0 || fpr >= 1.0) {
+        fpr = BLOOM_DEFAULT_FPR;
+    }
+    if (capacity < BLOOM_MIN_CAPACITY) {
+        capacity = BLOOM_MIN_CAPACITY;
+    }
+
+    double bits_per_key = -log(fpr) / (M_LN2 * M_LN2);
+    uint64_t nb_blocks = (uint64_t)ceil(bits_per_key * (double)capacity / BLOOM_BLOCK_BITS);
+    if (max_bytes > 0 && nb_blocks * (BLOOM_BLOCK_BITS / 8) > max_bytes) {
+        nb_blocks = max_bytes / (BLOOM_BLOCK_BITS / 8);
+    }
+    if (nb_blocks == 0) {
+        nb_blocks = 1;
+    }
+    int k = (int)lround(bits_per_key * M_LN2);
+    filter->k = (uint32_t)(k < 1 ? 1 : (k > 16 ? 16 : k));
+
+    filter->bits = calloc(nb_blocks, BLOCK_WORDS * sizeof(uint64_t));
+    if (!filter->bits) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    filter->nb_blocks = nb_blocks;
+    filter->capacity = capacity;
+    filter->fpr = fpr;
+    return 0;
+}
+
+// Nombre de positions de 9 bits tirées d'un mot de 64 bits
+#define SLICES_PER_WORD 7
+
+/**
+ * @brief Fonction de mélange (splitmix64) fournissant de nouveaux bits de hachage
+ */
+static uint64_t bloom_mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Fonction donnant le bloc d'une empreinte et la source de ses positions
+ *
+ * Le MD5 étant uniformément réparti, ses deux moitiés servent de hachages :
+ * la première choisit le bloc, la seconde fournit les positions dans le bloc
+ * par tranches de 9 bits, remélangée quand elle est épuisée. Un double
+ * hachage ne conviendrait pas : réduit à 512 positions, il ne produit que
+ * peu de combinaisons distinctes et multiplie les faux positifs.
+ */
+static uint64_t *bloom_block(const bloom_filter *filter, const unsigned char *md5, uint64_t *word) {
+    uint64_t h1;
+    memcpy(&h1, md5, sizeof(h1));
+    memcpy(word, md5 + sizeof(h1), sizeof(*word));
+    return filter->bits + (h1 % filter->nb_blocks) * BLOCK_WORDS;
+}
+
+/**
+ * @brief Fonction donnant la position suivante dans le bloc
+ *
+ * @param word la source des positions, mise à jour
+ * @param i le rang de la position
+ * @return uint32_t la position du bit dans le bloc
+ */
+static uint32_t bloom_next_bit(uint64_t *word, uint32_t i) {
+    if (i > 0 && i % SLICES_PER_WORD == 0) {
+        *word = bloom_mix(*word);
+    }
+    return (uint32_t)((*word >> (9 * (i % SLICES_PER_WORD))) % BLOOM_BLOCK_BITS);
+}
+
+/**
+ * @brief Procédure pour ajouter une empreinte au filtre
+ *
+ * @param filter le filtre
+ * @param md5 l'empreinte du chunk
+ */
+void bloom_add(bloom_filter *filter, const unsigned char *md5) {
+    uint64_t word;
+    uint64_t *block = bloom_block(filter, md5, &word);
+    for (uint32_t i = 0; i < filter->k; i++) {
+        uint32_t bit = bloom_next_bit(&word, i);
+        block[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+    filter->count++;
+}
+
+/**
+ * @brief Fonction pour savoir si une empreinte a pu être ajoutée au filtre
+ *
+ * @param filter le filtre
+ * @param md5 l'empreinte du chunk
+ * @return int 0 si l'empreinte n'a certainement pas été ajoutée, 1 sinon
+ */
+int bloom_may_contain(const bloom_filter *filter, const unsigned char *md5) {
+    uint64_t word;
+    const uint64_t *block = bloom_block(filter, md5, &word);
+    for (uint32_t i = 0; i < filter->k; i++) {
+        uint32_t bit = bloom_next_bit(&word, i);
+        if ((block[bit / 64] & ((uint64_t)1 << (bit % 64))) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Fonction donnant la mémoire occupée par le filtre
+ *
+ * @param filter le filtre
+ * @return uint64_t la taille des blocs en octets
+ */
+uint64_t bloom_memory(const bloom_filter *filter) {
+    return filter->nb_blocks * (BLOOM_BLOCK_BITS / 8);
+}
+
+/**
+ * @brief Fonction estimant le taux de faux positifs avec le remplissage actuel
+ *
+ * Le nombre d'empreintes d'un bloc suit une loi de Poisson : le taux est la
+ * moyenne, sur cette loi, du taux d'un petit filtre de Bloom de la taille
+ * d'un bloc, ce qui tient compte des blocs plus chargés que la moyenne.
+ *
+ * @param filter le filtre
+ * @return double le taux de faux positifs estimé
+ */
+double bloom_estimated_fpr(const bloom_filter *filter) {
+    if (filter->count == 0 || filter->nb_blocks == 0) {
+        return 0.0;
+    }
+    double lambda = (double)filter->count / (double)filter->nb_blocks;
+    double probability = exp(-lambda);
+    double fpr = 0.0;
+    int max_keys = (int)(lambda + 10.0 * sqrt(lambda) + 20.0);
+    for (int j = 0; j < max_keys; j++) {
+        if (j > 0) {
+            probability *= lambda / j;
+        }
+        double set = 1.0 - pow(1.0 - 1.0 / BLOOM_BLOCK_BITS, (double)filter->k * j);
+        fpr += probability * pow(set, (double)filter->k);
+    }
+    return fpr;
+}
+
+/**
+ * @brief Fonction pour enregistrer le filtre
+ *
+ * Le fichier est écrit à côté puis renommé, pour ne jamais relire un filtre
+ * à moitié écrit, qui pourrait déclarer absent un chunk présent.
+ *
+ * @param filter le filtre
+ * @param path le chemin du fichier
+ * @param records le nombre d'enregistrements du journal de l'index couverts par le filtre
+ * @param generation le numéro du dernier segment d'index couvert par le filtre
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int bloom_save(const bloom_filter *filter, const char *path, uint64_t records, uint32_t generation) {
+    char tmp_path[PATH_MAX + 8];
+    bloom_header header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BLOOM_MAGIC, sizeof(header.magic));
+    header.nb_blocks = filter->nb_blocks;
+    header.k = filter->k;
+    header.capacity = filter->capacity;
+    header.count = filter->count;
+    header.records = records;
+    header.generation = generation;
+    header.fpr = filter->fpr;
+    header.checksum = checksum64(&header, offsetof(bloom_header, checksum), 0);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        perror("Erreur lors de l'enregistrement du filtre");
+        return -1;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1
+        || fwrite(filter->bits, BLOCK_WORDS * sizeof(uint64_t), filter->nb_blocks, file) != filter->nb_blocks
+        || fflush(file) != 0 || fdatasync(fileno(file)) == -1) {
+        perror("Erreur lors de l'enregistrement du filtre");
+        fclose(file);
+        unlink(tmp_path);
+        return -1;
+    }
+    fclose(file);
+    if (rename(tmp_path, path) == -1) {
+        perror("Erreur lors de l'enregistrement du filtre");
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour projeter en mémoire un filtre enregistré
+ *
+ * Le filtre n'est ni lu ni recopié : ses blocs sont utilisés directement
+ * dans une projection privée du fichier, chargée page par page au fil des
+ * recherches (ou d'un coup avec populate). Les empreintes ajoutées ensuite
+ * ne modifient que la copie en mémoire, jusqu'au prochain enregistrement.
+ *
+ * @param filter le filtre en sortie
+ * @param path le chemin du fichier
+ * @param records le nombre d'enregistrements du journal de l'index couverts par le filtre, en sortie
+ * @param generation le numéro du dernier segment d'index couvert par le filtre, en sortie
+ * @param populate 1 pour charger tout le filtre dès l'ouverture
+ * @return int 0 en cas de succès, -1 si le fichier est absent ou invalide
+ */
+int bloom_load(bloom_filter *filter, const char *path, uint64_t *records, uint32_t *generation, int populate) {
+    bloom_header header;
+    struct stat st;
+
+    memset(filter, 0, sizeof(*filter));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(header)
+        || !(filter->map = map_file(fd, (size_t)st.st_size, populate, 1))) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    filter->map_size = (size_t)st.st_size;
+    memcpy(&header, filter->map, sizeof(header));
+
+    // Un filtre BORGBLM1 a un en-tête plus court, sans somme de contrôle
+    int v2 = memcmp(header.magic, BLOOM_MAGIC, sizeof(header.magic)) == 0;
+    size_t header_size = v2 ? sizeof(header) : offsetof(bloom_header, checksum);
+    if ((v2 ? header.checksum != checksum64(&header, offsetof(bloom_header, checksum), 0)
+            : memcmp(header.magic, BLOOM_MAGIC_V1, sizeof(header.magic)) != 0)
+        || header.nb_blocks == 0 || header.k == 0 || header.k > 16
+        || (uint64_t)st.st_size != header_size + header.nb_blocks * BLOCK_WORDS * sizeof(uint64_t)) {
+        bloom_free(filter);
+        return -1;
+    }
+    filter->bits = (uint64_t *)((unsigned char *)filter->map + header_size);
+    filter->nb_blocks = header.nb_blocks;
+    filter->k = header.k;
+    filter->capacity = header.capacity;
+    filter->count = header.count;
+    filter->fpr = header.fpr;
+    *records = header.records;
+    *generation = header.generation;
+    return 0;
+}
+
+/**
+ * @brief Procédure pour libérer le filtre
+ *
+ * @param filter le filtre
+ */
+void bloom_free(bloom_filter *filter) {
+    if (filter->map) {
+        munmap(filter->map, filter->map_size);
+    } else {
+        free(filter->bits);
+    }
+    memset(filter, 0, sizeof(*filter));
+}
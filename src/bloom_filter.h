@@ -0,0 +1,45 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <stdint.h>
+#include <openssl/md5.h>
+
+// Nombre de bits d'un bloc : tous les bits d'une empreinte tombent dans la même ligne de cache
+#define BLOOM_BLOCK_BITS 512
+
+// Nombre d'empreintes minimal pour lequel le filtre est dimensionné
+#define BLOOM_MIN_CAPACITY 65536
+
+// Taux de faux positifs visé par défaut
+#define BLOOM_DEFAULT_FPR 0.01
+
+// Filtre de Bloom par blocs sur les empreintes MD5
+typedef struct {
+    uint64_t *bits;     // nb_blocks blocs de BLOOM_BLOCK_BITS bits
+    void *map;          // fichier du filtre projeté en copie privée (NULL si les bits sont alloués)
+    size_t map_size;
+    uint64_t nb_blocks;
+    uint32_t k;         // nombre de bits positionnés par empreinte
+    uint64_t capacity;  // nombre d'empreintes prévu au dimensionnement
+    uint64_t count;     // nombre d'empreintes ajoutées
+    double fpr;         // taux de faux positifs visé
+} bloom_filter;
+
+// Fonction pour dimensionner et allouer un filtre vide
+int bloom_init(bloom_filter *filter, uint64_t capacity, double fpr, uint64_t max_bytes);
+// Procédure pour ajouter une empreinte au filtre
+void bloom_add(bloom_filter *filter, const unsigned char *md5);
+// Fonction pour savoir si une empreinte a pu être ajoutée (0 : certainement absente)
+int bloom_may_contain(const bloom_filter *filter, const unsigned char *md5);
+// Fonction donnant la mémoire occupée par le filtre en octets
+uint64_t bloom_memory(const bloom_filter *filter);
+// Fonction estimant le taux de faux positifs avec le remplissage actuel
+double bloom_estimated_fpr(const bloom_filter *filter);
+// Fonction pour enregistrer le filtre et la partie de l'index qu'il couvre
+int bloom_save(const bloom_filter *filter, const char *path, uint64_t records, uint32_t generation);
+// Fonction pour projeter en mémoire un filtre enregistré (toutes ses pages chargées si populate)
+int bloom_load(bloom_filter *filter, const char *path, uint64_t *records, uint32_t *generation, int populate);
+// Procédure pour libérer le filtre
+void bloom_free(bloom_filter *filter);
+
+#endif // BLOOM_FILTER_H
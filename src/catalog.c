@@ -0,0 +1,245 @@
+#include "catalog.h"
+#include "file_handler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Format du catalogue (une ligne par sauvegarde, ajoutée à sa création) :
+ *   <nom>;<date>;<taille>;<octets ajoutés>;<fichiers>;<durée>;<source>
+ * La source est placée en dernier pour pouvoir contenir des ';'.
+ */
+
+/**
+ * @brief Fonction formatant la ligne d'une entrée du catalogue
+ *
+ * @param entry l'entrée à formater
+ * @param line le tampon de la ligne, terminée par un retour à la ligne
+ * @param size la taille du tampon
+ * @return int la longueur de la ligne
+ */
+static int catalog_format(const catalog_entry *entry, char *line, size_t size) {
+    char source[PATH_MAX];
+
+    // Un retour à la ligne dans la source casserait le format
+    snprintf(source, sizeof(source), "%s", entry->source[0] ? entry->source : "-");
+    source[strcspn(source, "\n")] = '\0';
+    int len = snprintf(line, size, "%s;%lld;%llu;%llu;%llu;%.3f;%s\n", entry->name, (long long)entry->date,
+                       (unsigned long long)entry->size, (unsigned long long)entry->added,
+                       (unsigned long long)entry->files, entry->duration, source);
+    return (len < (int)size) ? len : (int)size - 1;
+}
+
+/**
+ * @brief Fonction ajoutant une entrée à la fin d'un fichier catalogue
+ *
+ * La ligne est écrite en un seul appel en mode ajout, ce qui permet à
+ * plusieurs sessions du serveur de valider leurs sauvegardes en même temps.
+ *
+ * @param path le chemin du fichier catalogue
+ * @param entry l'entrée à ajouter
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int catalog_append_file(const char *path, const catalog_entry *entry) {
+    char line[PATH_MAX + 256];
+    int len = catalog_format(entry, line, sizeof(line));
+
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd == -1) {
+        perror("Erreur lors de l'ouverture du catalogue");
+        return -1;
+    }
+    if (write(fd, line, (size_t)len) != len || fdatasync(fd) == -1) {
+        perror("Erreur lors de l'écriture du catalogue");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour ajouter une sauvegarde au catalogue
+ *
+ * @param repo_dir le répertoire de sauvegarde
+ * @param entry l'entrée à ajouter
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int catalog_append(const char *repo_dir, const catalog_entry *entry) {
+    char path[PATH_MAX + 32];
+    snprintf(path, sizeof(path), "%s/%s", repo_dir, CATALOG_NAME);
+    return catalog_append_file(path, entry);
+}
+
+/**
+ * @brief Fonction pour lire l'entrée suivante du catalogue
+ *
+ * @param catalog le catalogue ouvert en lecture
+ * @param entry l'entrée en sortie
+ * @return int 1 si une entrée a été lue, 0 en fin de fichier, -1 si la ligne est invalide
+ */
+int catalog_read_entry(FILE *catalog, catalog_entry *entry) {
+    char line[PATH_MAX + 256];
+    long long date;
+    unsigned long long size, added, files;
+    int offset = 0;
+
+    if (fgets(line, sizeof(line), catalog) == NULL) {
+        return 0;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    memset(entry, 0, sizeof(*entry));
+    if (sscanf(line, "%63[^;];%lld;%llu;%llu;%llu;%lf;%n", entry->name, &date, &size, &added, &files,
+               &entry->duration, &offset) != 6 || offset == 0) {
+        fprintf(stderr, "Erreur : ligne de catalogue invalide : %s\n", line);
+        return -1;
+    }
+    entry->date = (time_t)date;
+    entry->size = size;
+    entry->added = added;
+    entry->files = files;
+    snprintf(entry->source, sizeof(entry->source), "%s", line + offset);
+    return 1;
+}
+
+/**
+ * @brief Fonction de comparaison de deux entrées par nom pour qsort
+ *
+ * Le tableau trié est un tableau de pointeurs vers les entrées restées dans
+ * l'ordre du fichier : à nom égal, l'adresse donne l'ordre d'ajout, ce que
+ * qsort, qui n'est pas stable, ne garantit pas seul.
+ */
+static int compare_entries(const void *a, const void *b) {
+    const catalog_entry *ea = *(const catalog_entry *const *)a;
+    const catalog_entry *eb = *(const catalog_entry *const *)b;
+    int cmp = strcmp(ea->name, eb->name);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (ea > eb) - (ea < eb);
+}
+
+/**
+ * @brief Fonction pour charger tout le catalogue en mémoire, trié par nom
+ *
+ * Les lignes invalides sont ignorées. Si une sauvegarde apparaît plusieurs
+ * fois, c'est la dernière ligne ajoutée qui fait foi.
+ *
+ * @param repo_dir le répertoire de sauvegarde
+ * @param entries le tableau des entrées en sortie (à libérer avec free)
+ * @param count le nombre d'entrées en sortie
+ * @return int 0 en cas de succès (catalogue absent compris), -1 sinon
+ */
+int catalog_load(const char *repo_dir, catalog_entry **entries, size_t *count) {
+    char path[PATH_MAX + 32];
+    size_t capacity = 0;
+    catalog_entry entry;
+    int lu;
+
+    *entries = NULL;
+    *count = 0;
+    snprintf(path, sizeof(path), "%s/%s", repo_dir, CATALOG_NAME);
+    FILE *catalog = fopen(path, "r");
+    if (!catalog) {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+    while ((lu = catalog_read_entry(catalog, &entry)) != 0) {
+        if (lu == -1) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            catalog_entry *new_entries = realloc(*entries, capacity * sizeof(catalog_entry));
+            if (!new_entries) {
+                fprintf(stderr, "Erreur d'allocation mémoire\n");
+                fclose(catalog);
+                free(*entries);
+                *entries = NULL;
+                *count = 0;
+                return -1;
+            }
+            *entries = new_entries;
+        }
+        (*entries)[(*count)++] = entry;
+    }
+    fclose(catalog);
+
+    if (*count == 0) {
+        return 0;
+    }
+
+    // Les noms étant des horodatages, l'ordre alphabétique est l'ordre chronologique
+    const catalog_entry **order = malloc(*count * sizeof(*order));
+    catalog_entry *sorted = malloc(*count * sizeof(catalog_entry));
+    if (!order || !sorted) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        free(order);
+        free(sorted);
+        free(*entries);
+        *entries = NULL;
+        *count = 0;
+        return -1;
+    }
+    for (size_t i = 0; i < *count; i++) {
+        order[i] = &(*entries)[i];
+    }
+    qsort(order, *count, sizeof(*order), compare_entries);
+    size_t kept = 0;
+    for (size_t i = 0; i < *count; i++) {
+        if (i + 1 < *count && strcmp(order[i]->name, order[i + 1]->name) == 0) {
+            continue; // Une ligne plus récente remplace celle-ci
+        }
+        sorted[kept++] = *order[i];
+    }
+    free(order);
+    free(*entries);
+    *entries = sorted;
+    *count = kept;
+    return 0;
+}
+
+/**
+ * @brief Fonction pour remplacer tout le catalogue par les entrées données
+ *
+ * Le nouveau catalogue est écrit à côté, synchronisé une seule fois puis
+ * renommé, pour ne jamais laisser un catalogue à moitié écrit ; le
+ * répertoire est ensuite synchronisé pour que le renommage soit durable.
+ *
+ * @param repo_dir le répertoire de sauvegarde
+ * @param entries les entrées à garder
+ * @param count le nombre d'entrées
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int catalog_rewrite(const char *repo_dir, const catalog_entry *entries, size_t count) {
+    char path[PATH_MAX + 32];
+    char tmp_path[PATH_MAX + 32];
+    char line[PATH_MAX + 256];
+    snprintf(path, sizeof(path), "%s/%s", repo_dir, CATALOG_NAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s.tmp", repo_dir, CATALOG_NAME);
+
+    FILE *catalog = fopen(tmp_path, "w");
+    if (!catalog) {
+        perror("Erreur lors de la réécriture du catalogue");
+        return -1;
+    }
+    int ok = 1;
+    for (size_t i = 0; i < count && ok; i++) {
+        int len = catalog_format(&entries[i], line, sizeof(line));
+        ok = fwrite(line, 1, (size_t)len, catalog) == (size_t)len;
+    }
+    // Une seule synchronisation pour tout le fichier, puis celle du renommage
+    ok = ok && fflush(catalog) == 0 && fdatasync(fileno(catalog)) == 0;
+    if (fclose(catalog) != 0 || !ok || rename(tmp_path, path) == -1) {
+        perror("Erreur lors de la réécriture du catalogue");
+        unlink(tmp_path);
+        return -1;
+    }
+    if (sync_dir(repo_dir) == -1) {
+        perror("Erreur lors de la réécriture du catalogue");
+        return -1;
+    }
+    return 0;
+}
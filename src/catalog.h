@@ -0,0 +1,35 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+
+// Nom du catalogue des sauvegardes à la racine du répertoire de sauvegarde
+#define CATALOG_NAME ".catalog"
+
+// Taille maximale du nom d'une sauvegarde
+#define SNAPSHOT_NAME_SIZE 64
+
+// Entrée du catalogue : statistiques d'une sauvegarde calculées à sa création
+typedef struct {
+    char name[SNAPSHOT_NAME_SIZE];  // nom du répertoire de la sauvegarde
+    time_t date;                    // date de fin de la sauvegarde
+    uint64_t size;                  // taille logique des fichiers sauvegardés
+    uint64_t added;                 // octets réellement ajoutés au dépôt
+    uint64_t files;                 // nombre de fichiers
+    double duration;                // durée de la sauvegarde en secondes
+    char source[PATH_MAX];          // origine de la sauvegarde
+} catalog_entry;
+
+// Fonction pour ajouter une sauvegarde au catalogue
+int catalog_append(const char *repo_dir, const catalog_entry *entry);
+// Fonction pour lire l'entrée suivante du catalogue
+int catalog_read_entry(FILE *catalog, catalog_entry *entry);
+// Fonction pour charger tout le catalogue en mémoire, trié par nom
+int catalog_load(const char *repo_dir, catalog_entry **entries, size_t *count);
+// Fonction pour remplacer tout le catalogue par les entrées données
+int catalog_rewrite(const char *repo_dir, const catalog_entry *entries, size_t count);
+
+#endif // CATALOG_H
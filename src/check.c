@@ -0,0 +1,172 @@
+#include "check.h"
+#include "backup_manager.h"
+#include "chunk_store.h"
+#include "manifest.h"
+#include "catalog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <limits.h>
+
+// Bilan de la vérification des manifestes
+typedef struct {
+    size_t snapshots;         // sauvegardes vérifiées
+    size_t broken_snapshots;  // sauvegardes dont un fichier ne peut pas être restauré
+    uint64_t references;      // chunks référencés par les manifestes
+    uint64_t missing;         // chunks référencés absents du dépôt
+    uint64_t bad_sizes;       // fichiers dont la taille ne correspond pas à leurs chunks
+} manifest_check_stats;
+
+/**
+ * @brief Fonction vérifiant le manifeste d'une sauvegarde et marquant ses chunks
+ *
+ * Chaque chunk référencé doit être dans l'index, et la taille de chaque
+ * fichier doit être la somme des tailles de ses chunks.
+ *
+ * @param store le dépôt de chunks
+ * @param repo_dir le répertoire de sauvegarde
+ * @param name le nom de la sauvegarde
+ * @param stats le bilan à compléter
+ * @return int 0 si la sauvegarde est complète, 1 si elle est incomplète, -1 si le manifeste est illisible
+ */
+static int check_snapshot(chunk_store *store, const char *repo_dir, const char *name, manifest_check_stats *stats) {
+    char path[PATH_MAX];
+    manifest_entry entry;
+    int lu;
+    int broken = 0;
+
+    snprintf(path, sizeof(path), "%s/%s/%s", repo_dir, name, MANIFEST_NAME);
+    FILE *manifest = fopen(path, "r");
+    if (!manifest) {
+        if (errno == ENOENT) {
+            return 0; // Ancien format sans manifeste : aucun chunk référencé
+        }
+        perror(path);
+        return -1;
+    }
+    manifest_entry_init(&entry);
+    while ((lu = manifest_read_entry(manifest, &entry)) == 1) {
+        uint64_t size = 0;
+        size_t missing = 0;
+        for (size_t i = 0; i < entry.nb_chunks; i++) {
+            size += entry.len[i];
+            if (store_mark(store, entry.md5[i]) == -1) {
+                missing++;
+            }
+        }
+        stats->references += entry.nb_chunks;
+        stats->missing += missing;
+        if (missing > 0) {
+            fprintf(stderr, "Erreur : %s : %zu chunks absents pour %s\n", name, missing, entry.path);
+            broken = 1;
+        }
+        if (entry.type == 'F' && !entry.data && size != entry.size) {
+            fprintf(stderr, "Erreur : %s : taille incohérente pour %s (%llu octets, %llu dans les chunks)\n", name,
+                    entry.path, (unsigned long long)entry.size, (unsigned long long)size);
+            stats->bad_sizes++;
+            broken = 1;
+        }
+    }
+    manifest_entry_free(&entry);
+    fclose(manifest);
+    if (lu == -1) {
+        fprintf(stderr, "Erreur : manifeste illisible : %s\n", path);
+        return -1;
+    }
+    return broken;
+}
+
+/**
+ * @brief Fonction vérifiant les manifestes de toutes les sauvegardes
+ *
+ * @param store le dépôt de chunks, dont les chunks référencés sont marqués
+ * @param repo_dir le répertoire de sauvegarde
+ * @param stats le bilan en sortie
+ * @return int 0 en cas de succès, -1 si le répertoire est illisible
+ */
+static int check_manifests(chunk_store *store, const char *repo_dir, manifest_check_stats *stats) {
+    struct dirent *entry;
+    struct tm date;
+    char path[PATH_MAX];
+    struct stat st;
+
+    memset(stats, 0, sizeof(*stats));
+    DIR *dir = opendir(repo_dir);
+    if (!dir) {
+        perror("Erreur lors de l'ouverture du répertoire de sauvegarde");
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        snprintf(path, sizeof(path), "%s/%s", repo_dir, entry->d_name);
+        memset(&date, 0, sizeof(date));
+        if (strlen(entry->d_name) >= SNAPSHOT_NAME_SIZE || !parse_folder_date(entry->d_name, &date)
+            || stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        stats->snapshots++;
+        if (check_snapshot(store, repo_dir, entry->d_name, stats) != 0) {
+            stats->broken_snapshots++;
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour vérifier les manifestes, l'index et les packs d'un répertoire de sauvegarde
+ *
+ * La vérification se fait sans restauration, en trois temps :
+ *  - chaque chunk référencé par un manifeste doit être dans l'index ;
+ *  - les chunks que plus aucune sauvegarde ne référence sont comptés ;
+ *  - chaque chunk de l'index (ou une fraction tirée au hasard) est relu dans
+ *    son pack et son empreinte recalculée, par plusieurs threads.
+ * Rien n'est modifié ; le verrou du dépôt empêche une écriture concurrente.
+ *
+ * @param repo_dir le répertoire de sauvegarde
+ * @param opts les réglages de la vérification
+ * @return int 0 si le dépôt est sain, -1 sinon
+ */
+int check_repository(const char *repo_dir, const check_options *opts) {
+    chunk_store store;
+    manifest_check_stats manifests;
+    store_gc_stats unreferenced;
+    store_verify_stats packs;
+    struct timeval debut, fin;
+
+    gettimeofday(&debut, NULL);
+    if (store_open(&store, repo_dir, NULL) == -1) {
+        return -1;
+    }
+    if (store_clear_marks(&store) == -1 || check_manifests(&store, repo_dir, &manifests) == -1
+        || store_sweep(&store, 0, 1, &unreferenced) == -1
+        || store_verify(&store, opts->workers, opts->verify_percent, &packs) == -1) {
+        store_close(&store);
+        return -1;
+    }
+    store_close(&store);
+    gettimeofday(&fin, NULL);
+    double duration = (double)(fin.tv_sec - debut.tv_sec) + (double)(fin.tv_usec - debut.tv_usec) / 1e6;
+
+    printf("Sauvegardes : %zu vérifiées, %zu incomplètes\n", manifests.snapshots, manifests.broken_snapshots);
+    printf("Références : %llu chunks, %llu absents, %llu fichiers de taille incohérente\n",
+           (unsigned long long)manifests.references, (unsigned long long)manifests.missing,
+           (unsigned long long)manifests.bad_sizes);
+    printf("Index : %llu chunks, dont %zu non référencés (%llu octets récupérables avec --prune)\n",
+           (unsigned long long)packs.index_records, unreferenced.chunks_removed,
+           (unsigned long long)unreferenced.bytes_removed);
+    double percent = (opts->verify_percent > 0 && opts->verify_percent < 100) ? opts->verify_percent : 100;
+    printf("Données : %llu chunks relus (%.3g%% visé) dans %zu packs, %llu octets en %.2f s (%.1f Mo/s)\n",
+           (unsigned long long)packs.chunks_checked, percent, packs.packs_checked,
+           (unsigned long long)packs.bytes_checked, duration,
+           duration > 0 ? (double)packs.bytes_checked / duration / (1024 * 1024) : 0);
+    printf("Erreurs : %llu chunks corrompus, %llu chunks introuvables dans les packs\n",
+           (unsigned long long)packs.chunks_corrupt, (unsigned long long)packs.chunks_missing);
+
+    int ok = manifests.broken_snapshots == 0 && packs.chunks_corrupt == 0 && packs.chunks_missing == 0;
+    printf("%s\n", ok ? "Dépôt sain" : "Dépôt endommagé");
+    return ok ? 0 : -1;
+}
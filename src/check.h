@@ -0,0 +1,16 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// Réglages de la vérification d'un répertoire de sauvegarde
+typedef struct {
+    int workers;           // nombre de threads relisant les packs
+    double verify_percent; // pourcentage des chunks dont les données sont relues
+} check_options;
+
+// Réglages par défaut : toutes les données sont relues par 4 threads
+#define CHECK_OPTIONS_DEFAULT {4, 100}
+
+// Fonction pour vérifier les manifestes, l'index et les packs d'un répertoire de sauvegarde
+int check_repository(const char *repo_dir, const check_options *opts);
+
+#endif // CHECK_H
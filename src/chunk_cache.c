@@ -0,0 +1,330 @@
+#include "chunk_cache.h"
+#include "deduplication.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Fonction donnant la partition d'un chunk
+ *
+ * Les empreintes sont uniformes : leurs premiers octets suffisent à répartir
+ * les chunks entre les partitions et entre les cases d'une partition.
+ *
+ * @param cache le cache
+ * @param md5 l'empreinte du chunk
+ * @return chunk_cache_shard* la partition du chunk
+ */
+static chunk_cache_shard *cache_shard(chunk_cache *cache, const unsigned char *md5) {
+    return &cache->shards[md5[0] % CHUNK_CACHE_SHARDS];
+}
+
+/**
+ * @brief Fonction donnant la case d'un chunk dans la table de sa partition
+ *
+ * @param shard la partition
+ * @param md5 l'empreinte du chunk
+ * @return size_t l'indice de la case
+ */
+static size_t cache_bucket(const chunk_cache_shard *shard, const unsigned char *md5) {
+    uint32_t h;
+    memcpy(&h, md5 + 4, sizeof(h));
+    return h & (shard->table_size - 1);
+}
+
+/**
+ * @brief Fonction pour initialiser un cache de capacity octets
+ *
+ * La capacité est partagée entre les partitions ; la table de chaque
+ * partition est dimensionnée pour des chunks pleins.
+ *
+ * @param cache le cache
+ * @param capacity la mémoire de données au plus, 0 pour désactiver le cache
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int chunk_cache_init(chunk_cache *cache, uint64_t capacity) {
+    memset(cache, 0, sizeof(*cache));
+    cache->capacity = capacity;
+    size_t table_size = 16;
+    while ((uint64_t)table_size * CHUNK_SIZE * CHUNK_CACHE_SHARDS < capacity) {
+        table_size *= 2;
+    }
+    for (size_t i = 0; i < CHUNK_CACHE_SHARDS; i++) {
+        pthread_mutex_init(&cache->shards[i].lock, NULL);
+    }
+    for (size_t i = 0; i < CHUNK_CACHE_SHARDS && capacity > 0; i++) {
+        chunk_cache_shard *shard = &cache->shards[i];
+        shard->capacity = capacity / CHUNK_CACHE_SHARDS;
+        shard->table_size = table_size;
+        shard->table = calloc(table_size, sizeof(cached_chunk *));
+        if (!shard->table) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            chunk_cache_free(cache);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure retirant un chunk de la liste LRU de sa partition
+ *
+ * @param shard la partition (verrou tenu)
+ * @param chunk le chunk
+ */
+static void lru_unlink(chunk_cache_shard *shard, cached_chunk *chunk) {
+    if (chunk->prev) {
+        chunk->prev->next = chunk->next;
+    } else {
+        shard->head = chunk->next;
+    }
+    if (chunk->next) {
+        chunk->next->prev = chunk->prev;
+    } else {
+        shard->tail = chunk->prev;
+    }
+}
+
+/**
+ * @brief Procédure plaçant un chunk en tête de la liste LRU
+ *
+ * @param shard la partition (verrou tenu)
+ * @param chunk le chunk, hors de la liste
+ */
+static void lru_push(chunk_cache_shard *shard, cached_chunk *chunk) {
+    chunk->prev = NULL;
+    chunk->next = shard->head;
+    if (shard->head) {
+        shard->head->prev = chunk;
+    } else {
+        shard->tail = chunk;
+    }
+    shard->head = chunk;
+}
+
+/**
+ * @brief Fonction cherchant un chunk dans sa partition
+ *
+ * @param shard la partition (verrou tenu)
+ * @param md5 l'empreinte du chunk
+ * @return cached_chunk* le chunk, NULL s'il est absent
+ */
+static cached_chunk *shard_find(chunk_cache_shard *shard, const unsigned char *md5) {
+    if (!shard->table) {
+        return NULL;
+    }
+    cached_chunk *chunk = shard->table[cache_bucket(shard, md5)];
+    while (chunk && memcmp(chunk->md5, md5, MD5_DIGEST_LENGTH) != 0) {
+        chunk = chunk->hnext;
+    }
+    return chunk;
+}
+
+/**
+ * @brief Procédure évinçant le chunk le moins récemment utilisé d'une partition
+ *
+ * @param shard la partition (verrou tenu, liste non vide)
+ */
+static void shard_evict(chunk_cache_shard *shard) {
+    cached_chunk *victim = shard->tail;
+    cached_chunk **slot = &shard->table[cache_bucket(shard, victim->md5)];
+    while (*slot != victim) {
+        slot = &(*slot)->hnext;
+    }
+    *slot = victim->hnext;
+    lru_unlink(shard, victim);
+    shard->bytes -= victim->len;
+    shard->entries--;
+    shard->evictions++;
+    free(victim);
+}
+
+/**
+ * @brief Fonction pour copier un chunk du cache
+ *
+ * La copie est faite sous le verrou de la partition : un chunk évincé par
+ * un autre lecteur ne peut pas disparaître pendant qu'on le lit.
+ *
+ * @param cache le cache
+ * @param md5 l'empreinte du chunk
+ * @param buffer le tampon de sortie, d'au moins CHUNK_MAX_SIZE octets
+ * @param len la taille du chunk en sortie
+ * @return int 1 si le chunk était en cache, 0 sinon
+ */
+int chunk_cache_lookup(chunk_cache *cache, const unsigned char *md5, void *buffer, uint32_t *len) {
+    chunk_cache_shard *shard = cache_shard(cache, md5);
+    pthread_mutex_lock(&shard->lock);
+    cached_chunk *chunk = shard_find(shard, md5);
+    if (!chunk) {
+        shard->misses++;
+        pthread_mutex_unlock(&shard->lock);
+        return 0;
+    }
+    memcpy(buffer, chunk->data, chunk->len);
+    *len = chunk->len;
+    lru_unlink(shard, chunk);
+    lru_push(shard, chunk);
+    shard->hits++;
+    shard->hit_bytes += chunk->len;
+    pthread_mutex_unlock(&shard->lock);
+    return 1;
+}
+
+/**
+ * @brief Procédure ajoutant un chunk au cache
+ *
+ * Les chunks les moins récemment utilisés de la partition sont évincés
+ * jusqu'à ce que le nouveau tienne. Un chunk déjà présent n'est pas dupliqué.
+ *
+ * @param cache le cache
+ * @param md5 l'empreinte du chunk
+ * @param data les données déchiffrées du chunk
+ * @param len la taille du chunk
+ * @param missed 1 si le chunk vient d'être relu dans le dépôt après un défaut de cache
+ */
+static void cache_fill(chunk_cache *cache, const unsigned char *md5, const void *data, uint32_t len, int missed) {
+    chunk_cache_shard *shard = cache_shard(cache, md5);
+    cached_chunk *chunk = NULL;
+    if (len <= shard->capacity) {
+        // Allocation hors du verrou : les autres lecteurs de la partition n'attendent pas malloc
+        chunk = malloc(sizeof(cached_chunk) + len);
+    }
+    if (chunk) {
+        memcpy(chunk->md5, md5, MD5_DIGEST_LENGTH);
+        memcpy(chunk->data, data, len);
+        chunk->len = len;
+    }
+
+    pthread_mutex_lock(&shard->lock);
+    if (missed) {
+        shard->miss_bytes += len;
+    }
+    if (chunk && shard_find(shard, md5) == NULL) {
+        while (shard->bytes + len > shard->capacity) {
+            shard_evict(shard);
+        }
+        size_t bucket = cache_bucket(shard, md5);
+        chunk->hnext = shard->table[bucket];
+        shard->table[bucket] = chunk;
+        lru_push(shard, chunk);
+        shard->bytes += len;
+        shard->entries++;
+        chunk = NULL;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    free(chunk);
+}
+
+/**
+ * @brief Procédure pour ajouter un chunk au cache
+ *
+ * @param cache le cache
+ * @param md5 l'empreinte du chunk
+ * @param data les données déchiffrées du chunk
+ * @param len la taille du chunk
+ */
+void chunk_cache_insert(chunk_cache *cache, const unsigned char *md5, const void *data, uint32_t len) {
+    cache_fill(cache, md5, data, len, 0);
+}
+
+/**
+ * @brief Fonction pour lire un chunk depuis le cache, ou depuis le dépôt
+ *
+ * Le dépôt n'est pas protégé par le cache : chaque lecteur utilise son
+ * propre dépôt ou en sérialise l'accès.
+ *
+ * @param cache le cache (NULL pour lire directement le dépôt)
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte du chunk
+ * @param buffer le tampon de sortie, d'au moins CHUNK_MAX_SIZE octets
+ * @param len la taille du chunk en sortie
+ * @return int 0 en cas de succès, -1 si le chunk est absent ou illisible
+ */
+int chunk_cache_get(chunk_cache *cache, chunk_store *store, const unsigned char *md5, void *buffer, uint32_t *len) {
+    if (!cache) {
+        return store_get(store, md5, buffer, len);
+    }
+    if (chunk_cache_lookup(cache, md5, buffer, len) == 1) {
+        return 0;
+    }
+    if (store_get(store, md5, buffer, len) == -1) {
+        return -1;
+    }
+    cache_fill(cache, md5, buffer, *len, 1);
+    return 0;
+}
+
+/**
+ * @brief Procédure pour annoncer les chunks qui vont être lus
+ *
+ * Les chunks absents du cache sont signalés au noyau, qui commence à les
+ * lire dans les packs pendant que les précédents sont écrits.
+ *
+ * @param cache le cache (NULL pour tout annoncer)
+ * @param store le dépôt de chunks
+ * @param md5 les empreintes des chunks, dans l'ordre où ils seront lus
+ * @param n le nombre de chunks
+ */
+void chunk_cache_prefetch(chunk_cache *cache, chunk_store *store, unsigned char (*md5)[MD5_DIGEST_LENGTH], size_t n) {
+    unsigned char absent[CHUNK_CACHE_PREFETCH][MD5_DIGEST_LENGTH];
+    size_t nb_absent = 0;
+    for (size_t i = 0; i < n && i < CHUNK_CACHE_PREFETCH; i++) {
+        if (cache) {
+            chunk_cache_shard *shard = cache_shard(cache, md5[i]);
+            pthread_mutex_lock(&shard->lock);
+            int present = shard_find(shard, md5[i]) != NULL;
+            if (!present) {
+                shard->prefetched++;
+            }
+            pthread_mutex_unlock(&shard->lock);
+            if (present) {
+                continue;
+            }
+        }
+        memcpy(absent[nb_absent++], md5[i], MD5_DIGEST_LENGTH);
+    }
+    store_prefetch(store, absent, nb_absent);
+}
+
+/**
+ * @brief Procédure pour obtenir le bilan du cache
+ *
+ * @param cache le cache
+ * @param stats le bilan en sortie, somme des partitions
+ */
+void chunk_cache_report(chunk_cache *cache, chunk_cache_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = cache->capacity;
+    for (size_t i = 0; i < CHUNK_CACHE_SHARDS; i++) {
+        chunk_cache_shard *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->hit_bytes += shard->hit_bytes;
+        stats->miss_bytes += shard->miss_bytes;
+        stats->evictions += shard->evictions;
+        stats->prefetched += shard->prefetched;
+        stats->entries += shard->entries;
+        stats->bytes += shard->bytes;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/**
+ * @brief Procédure pour libérer le cache
+ *
+ * @param cache le cache
+ */
+void chunk_cache_free(chunk_cache *cache) {
+    for (size_t i = 0; i < CHUNK_CACHE_SHARDS; i++) {
+        chunk_cache_shard *shard = &cache->shards[i];
+        cached_chunk *chunk = shard->head;
+        while (chunk) {
+            cached_chunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        free(shard->table);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
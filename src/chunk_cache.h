@@ -0,0 +1,81 @@
+#ifndef CHUNK_CACHE_H
+#define CHUNK_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <openssl/md5.h>
+#include "chunk_store.h"
+
+// Taille par défaut du cache de chunks d'une restauration (64 Mo)
+#define CHUNK_CACHE_DEFAULT_BYTES (64ULL * 1024 * 1024)
+
+// Nombre de partitions du cache, chacune protégée par son propre verrou
+#define CHUNK_CACHE_SHARDS 16
+
+// Nombre maximal de chunks annoncés d'un coup au noyau par une lecture anticipée
+#define CHUNK_CACHE_PREFETCH 256
+
+// Chunk déchiffré gardé en mémoire
+typedef struct cached_chunk {
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    uint32_t len;
+    struct cached_chunk *hnext;     // suivant dans la case de la table de hachage
+    struct cached_chunk *prev;      // plus récemment utilisé
+    struct cached_chunk *next;      // moins récemment utilisé
+    unsigned char data[];
+} cached_chunk;
+
+// Partition du cache : table de hachage et liste LRU (tête = plus récent)
+typedef struct {
+    pthread_mutex_t lock;
+    cached_chunk **table;
+    size_t table_size;          // puissance de deux
+    cached_chunk *head;
+    cached_chunk *tail;
+    uint64_t bytes;             // octets de données gardés
+    uint64_t capacity;          // octets de données au plus
+    uint64_t entries;           // chunks gardés
+    uint64_t hits;              // chunks servis depuis la mémoire
+    uint64_t misses;            // chunks absents
+    uint64_t hit_bytes;         // octets servis depuis la mémoire
+    uint64_t miss_bytes;        // octets relus dans le dépôt
+    uint64_t evictions;         // chunks évincés pour faire de la place
+    uint64_t prefetched;        // chunks annoncés au noyau avant leur lecture
+} chunk_cache_shard;
+
+// Cache de chunks partagé par les lecteurs d'un dépôt (capacité nulle : cache désactivé)
+typedef struct {
+    chunk_cache_shard shards[CHUNK_CACHE_SHARDS];
+    uint64_t capacity;
+} chunk_cache;
+
+// Bilan du cache
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t hit_bytes;
+    uint64_t miss_bytes;
+    uint64_t evictions;
+    uint64_t prefetched;
+    uint64_t entries;
+    uint64_t bytes;
+    uint64_t capacity;
+} chunk_cache_stats;
+
+// Fonction pour initialiser un cache de capacity octets
+int chunk_cache_init(chunk_cache *cache, uint64_t capacity);
+// Fonction pour copier un chunk du cache (1 si présent, 0 sinon)
+int chunk_cache_lookup(chunk_cache *cache, const unsigned char *md5, void *buffer, uint32_t *len);
+// Procédure pour ajouter un chunk au cache, en évinçant les moins récemment utilisés
+void chunk_cache_insert(chunk_cache *cache, const unsigned char *md5, const void *data, uint32_t len);
+// Fonction pour lire un chunk depuis le cache, ou depuis le dépôt en le gardant en cache
+int chunk_cache_get(chunk_cache *cache, chunk_store *store, const unsigned char *md5, void *buffer, uint32_t *len);
+// Procédure pour annoncer les chunks qui vont être lus, afin que le noyau les charge en avance
+void chunk_cache_prefetch(chunk_cache *cache, chunk_store *store, unsigned char (*md5)[MD5_DIGEST_LENGTH], size_t n);
+// Procédure pour obtenir le bilan du cache
+void chunk_cache_report(chunk_cache *cache, chunk_cache_stats *stats);
+// Procédure pour libérer le cache
+void chunk_cache_free(chunk_cache *cache);
+
+#endif // CHUNK_CACHE_H
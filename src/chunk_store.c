@@ -0,0 +1,2273 @@
+#include "chunk_store.h"
+#include "deduplication.h"
+#include "file_handler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <time.h>
+
+// Taille maximale d'un chunk dans un pack (chiffré, il est suivi de son code d'authentification)
+#define RECORD_MAX_SIZE (CHUNK_MAX_SIZE + CRYPTO_SEAL_OVERHEAD)
+
+/**
+ * @brief Fonction de hachage d'une empreinte pour l'index en mémoire
+ *
+ * Le MD5 étant uniformément réparti, ses premiers octets suffisent.
+ *
+ * @param md5 l'empreinte du chunk
+ * @param size la taille de la table
+ * @return size_t l'indice dans la table
+ */
+static size_t store_hash(const unsigned char *md5, size_t size) {
+    uint64_t hash;
+    memcpy(&hash, md5, sizeof(hash));
+    return hash % size;
+}
+
+/**
+ * @brief Fonction cherchant une entrée de la table en mémoire
+ *
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte recherchée
+ * @return StoreEntry* l'entrée, NULL si le chunk n'est pas dans la table
+ */
+static StoreEntry *store_lookup(chunk_store *store, const unsigned char *md5) {
+    StoreEntry *current = store->table[store_hash(md5, store->table_size)];
+    while (current != NULL) {
+        if (memcmp(current->rec.md5, md5, MD5_DIGEST_LENGTH) == 0) {
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Procédure doublant la taille de la table quand elle devient trop chargée
+ *
+ * @param store le dépôt de chunks
+ */
+static void store_grow(chunk_store *store) {
+    size_t new_size = store->table_size * 2;
+    StoreEntry **new_table = calloc(new_size, sizeof(StoreEntry *));
+    if (!new_table) {
+        return; // On garde l'ancienne table, plus lente mais correcte
+    }
+    for (size_t i = 0; i < store->table_size; i++) {
+        StoreEntry *current = store->table[i];
+        while (current != NULL) {
+            StoreEntry *next = current->next;
+            size_t h = store_hash(current->rec.md5, new_size);
+            current->next = new_table[h];
+            new_table[h] = current;
+            current = next;
+        }
+    }
+    free(store->table);
+    store->table = new_table;
+    store->table_size = new_size;
+}
+
+/**
+ * @brief Procédure vidant la table en mémoire
+ *
+ * @param store le dépôt de chunks
+ */
+static void store_clear_table(chunk_store *store) {
+    memset(store->table, 0, store->table_size * sizeof(StoreEntry *));
+    arena_reset(&store->entries);
+    store->mem_count = 0;
+}
+
+/**
+ * @brief Fonction donnant la mémoire occupée par les balises des segments
+ *
+ * @param store le dépôt de chunks
+ * @return uint64_t la taille des balises en octets
+ */
+static uint64_t store_fences_memory(const chunk_store *store) {
+    uint64_t memory = 0;
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        memory += store->runs[i].nb_fences * MD5_DIGEST_LENGTH;
+    }
+    return memory;
+}
+
+/**
+ * @brief Fonction donnant la mémoire occupée par la table en mémoire
+ *
+ * @param store le dépôt de chunks
+ * @return uint64_t la taille de la table et de l'arène de ses entrées en octets
+ */
+static uint64_t store_table_memory(const chunk_store *store) {
+    return store->entries.memory + (uint64_t)store->table_size * sizeof(StoreEntry *);
+}
+
+/**
+ * @brief Fonction donnant le plafond de mémoire de l'index
+ *
+ * @param store le dépôt de chunks
+ * @return uint64_t le plafond en octets
+ */
+static uint64_t store_memory_cap(const chunk_store *store) {
+    return store->opts.index_memory > 0 ? store->opts.index_memory : INDEX_MEMORY_DEFAULT;
+}
+
+/**
+ * @brief Fonction de comparaison de deux entrées de la table par empreinte pour qsort
+ */
+static int compare_entries(const void *a, const void *b) {
+    return memcmp((*(StoreEntry *const *)a)->rec.md5, (*(StoreEntry *const *)b)->rec.md5, MD5_DIGEST_LENGTH);
+}
+
+/**
+ * @brief Fonction rassemblant les entrées de la table triées par empreinte
+ *
+ * @param store le dépôt de chunks
+ * @param entries le tableau en sortie (à libérer avec free)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_sorted_table(chunk_store *store, StoreEntry ***entries) {
+    size_t n = 0;
+    *entries = malloc((store->mem_count ? store->mem_count : 1) * sizeof(StoreEntry *));
+    if (!*entries) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    for (size_t i = 0; i < store->table_size; i++) {
+        for (StoreEntry *current = store->table[i]; current != NULL; current = current->next) {
+            (*entries)[n++] = current;
+        }
+    }
+    qsort(*entries, n, sizeof(StoreEntry *), compare_entries);
+    return 0;
+}
+
+// Source d'enregistrements triés pour une fusion : la table en mémoire ou un segment
+typedef struct {
+    StoreEntry **entries;       // entrées triées de la table (NULL pour un segment)
+    size_t nb_entries;
+    size_t next;
+    run_cursor cursor;          // parcours du segment
+    const unsigned char *marks; // marques du segment (NULL : tout est vivant)
+    store_record rec;           // enregistrement courant
+    int marked;
+    int valid;                  // 1 si rec est disponible
+} merge_source;
+
+/**
+ * @brief Fonction faisant avancer une source de fusion
+ *
+ * @param source la source
+ * @return int 0 en cas de succès (fin comprise), -1 en cas d'erreur de lecture
+ */
+static int source_next(merge_source *source) {
+    if (source->entries != NULL) {
+        source->valid = source->next < source->nb_entries;
+        if (source->valid) {
+            source->rec = source->entries[source->next]->rec;
+            source->marked = source->entries[source->next]->marked;
+            source->next++;
+        }
+        return 0;
+    }
+    int lu = run_cursor_next(&source->cursor);
+    if (lu == -1) {
+        return -1;
+    }
+    source->valid = lu;
+    if (lu == 1) {
+        uint64_t position = source->cursor.position;
+        source->rec = source->cursor.rec;
+        source->marked = source->marks ? (source->marks[position / 8] >> (position % 8)) & 1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction de comparaison d'un enregistrement déplacé et d'une empreinte pour bsearch
+ */
+static int compare_moved(const void *key, const void *element) {
+    return memcmp(key, ((const store_record *)element)->md5, MD5_DIGEST_LENGTH);
+}
+
+/**
+ * @brief Fonction fusionnant des sources triées dans un nouveau segment
+ *
+ * Les sources sont données de la plus récente à la plus ancienne : pour une
+ * empreinte présente plusieurs fois, l'enregistrement le plus récent est
+ * gardé, ou le seul marqué lors du ramasse-miettes.
+ *
+ * @param sources les sources, de la plus récente à la plus ancienne
+ * @param n le nombre de sources
+ * @param writer le segment en cours d'écriture
+ * @param only_marked 1 pour ne garder que les enregistrements marqués
+ * @param moved les chunks déplacés par le compactage, triés par empreinte (peut être NULL)
+ * @param nb_moved le nombre de chunks déplacés
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int merge_sources(merge_source *sources, size_t n, run_writer *writer, int only_marked,
+                         const store_record *moved, size_t nb_moved) {
+    for (size_t i = 0; i < n; i++) {
+        if (source_next(&sources[i]) == -1) {
+            return -1;
+        }
+    }
+    for (;;) {
+        const unsigned char *min = NULL;
+        for (size_t i = 0; i < n; i++) {
+            if (sources[i].valid && (min == NULL || memcmp(sources[i].rec.md5, min, MD5_DIGEST_LENGTH) < 0)) {
+                min = sources[i].rec.md5;
+            }
+        }
+        if (min == NULL) {
+            return 0;
+        }
+
+        unsigned char key[MD5_DIGEST_LENGTH];
+        store_record chosen;
+        int found = 0;
+        memcpy(key, min, MD5_DIGEST_LENGTH);
+        for (size_t i = 0; i < n; i++) {
+            if (!sources[i].valid || memcmp(sources[i].rec.md5, key, MD5_DIGEST_LENGTH) != 0) {
+                continue;
+            }
+            if (!found && (!only_marked || sources[i].marked)) {
+                chosen = sources[i].rec;
+                found = 1;
+            }
+            if (source_next(&sources[i]) == -1) {
+                return -1;
+            }
+        }
+        if (!found) {
+            continue;
+        }
+        if (moved != NULL) {
+            const store_record *new_location = bsearch(key, moved, nb_moved, sizeof(store_record), compare_moved);
+            if (new_location) {
+                chosen = *new_location;
+            }
+        }
+        if (run_writer_add(writer, &chosen) == -1) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief Fonction ajoutant un segment à la liste, dans l'ordre des numéros
+ *
+ * @param store le dépôt de chunks (runs_lock tenu par l'appelant)
+ * @param run le segment ouvert
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_add_run(chunk_store *store, const index_run *run) {
+    index_run *runs = realloc(store->runs, (store->nb_runs + 1) * sizeof(index_run));
+    if (!runs) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    store->runs = runs;
+    size_t i = store->nb_runs;
+    while (i > 0 && runs[i - 1].id > run->id) {
+        runs[i] = runs[i - 1];
+        i--;
+    }
+    runs[i] = *run;
+    store->nb_runs++;
+    return 0;
+}
+
+/**
+ * @brief Fonction exécutée par le thread de fusion des segments
+ *
+ * Les segments étant immuables, la fusion les lit sans verrou ; seule la
+ * substitution du résultat dans la liste se fait sous runs_lock. En cas
+ * d'échec, les segments d'origine sont simplement conservés.
+ *
+ * @param arg le dépôt de chunks
+ * @return void* NULL
+ */
+static void *merge_thread(void *arg) {
+    chunk_store *store = arg;
+    merge_source *sources = calloc(MERGE_FANIN, sizeof(merge_source));
+    run_writer writer;
+    index_run merged;
+    size_t n = 0;
+
+    if (!sources) {
+        goto fin;
+    }
+    // Du segment le plus récent au plus ancien
+    pthread_mutex_lock(&store->runs_lock);
+    for (size_t i = store->nb_runs; i > 0; i--) {
+        for (int j = 0; j < MERGE_FANIN; j++) {
+            if (store->runs[i - 1].id == store->merge_ids[j]) {
+                run_cursor_open(&sources[n++].cursor, &store->runs[i - 1]);
+            }
+        }
+    }
+    pthread_mutex_unlock(&store->runs_lock);
+
+    if (run_writer_open(&writer, store->dir, store->merge_target) == -1) {
+        goto fin;
+    }
+    if (merge_sources(sources, n, &writer, 0, NULL, 0) == -1) {
+        run_writer_abort(&writer);
+        goto fin;
+    }
+    if (run_writer_commit(&writer) == -1 || run_open(&merged, store->dir, store->merge_target, store->opts.populate) == -1) {
+        goto fin;
+    }
+
+    pthread_mutex_lock(&store->runs_lock);
+    size_t kept = 0;
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        int fused = 0;
+        for (int j = 0; j < MERGE_FANIN; j++) {
+            fused |= (store->runs[i].id == store->merge_ids[j]);
+        }
+        if (fused) {
+            run_close(&store->runs[i]);
+        } else {
+            store->runs[kept++] = store->runs[i];
+        }
+    }
+    store->nb_runs = kept;
+    if (store_add_run(store, &merged) == -1) {
+        run_close(&merged);
+    }
+    store->merges++;
+    pthread_mutex_unlock(&store->runs_lock);
+
+    // Sans segment fusionné durable, les segments fusionnés restent : les doublons sont sans danger
+    if (sync_dir(store->dir) == 0) {
+        for (int j = 0; j < MERGE_FANIN; j++) {
+            char path[PATH_MAX + 32];
+            run_path(store->dir, store->merge_ids[j], path, sizeof(path));
+            unlink(path);
+        }
+    }
+
+fin:
+    free(sources);
+    pthread_mutex_lock(&store->runs_lock);
+    store->merge_done = 1;
+    pthread_mutex_unlock(&store->runs_lock);
+    return NULL;
+}
+
+/**
+ * @brief Procédure attendant la fin de la fusion en cours
+ *
+ * @param store le dépôt de chunks
+ */
+static void store_wait_merge(chunk_store *store) {
+    if (store->merging) {
+        pthread_join(store->merge_thread, NULL);
+        store->merging = 0;
+    }
+}
+
+/**
+ * @brief Procédure lançant la fusion des plus petits segments si nécessaire
+ *
+ * Fusionner les plus petits segments d'abord garde un nombre de segments
+ * logarithmique, et donc un nombre de lectures borné par recherche.
+ *
+ * @param store le dépôt de chunks
+ */
+static void store_maybe_merge(chunk_store *store) {
+    if (store->merging) {
+        pthread_mutex_lock(&store->runs_lock);
+        int done = store->merge_done;
+        pthread_mutex_unlock(&store->runs_lock);
+        if (!done) {
+            return;
+        }
+        store_wait_merge(store);
+    }
+    if (store->gc_active || store->opts.read_only || store->nb_runs < MERGE_FANIN) {
+        return;
+    }
+
+    size_t *order = malloc(store->nb_runs * sizeof(size_t));
+    if (!order) {
+        return;
+    }
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        order[i] = i;
+    }
+    for (int j = 0; j < MERGE_FANIN; j++) {
+        size_t best = j;
+        for (size_t i = j + 1; i < store->nb_runs; i++) {
+            if (store->runs[order[i]].records < store->runs[order[best]].records) {
+                best = i;
+            }
+        }
+        size_t tmp = order[j];
+        order[j] = order[best];
+        order[best] = tmp;
+        store->merge_ids[j] = store->runs[order[j]].id;
+    }
+    free(order);
+
+    store->merge_target = store->next_run++;
+    store->merge_done = 0;
+    if (pthread_create(&store->merge_thread, NULL, merge_thread, store) == 0) {
+        store->merging = 1;
+    } else {
+        merge_thread(store); // Sans thread disponible, la fusion se fait tout de suite
+    }
+}
+
+/**
+ * @brief Fonction synchronisant sur disque les chunks écrits dans le pack courant
+ *
+ * @param store le dépôt de chunks
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_sync_pack(chunk_store *store) {
+    if (store->pack && (fflush(store->pack) != 0 || fdatasync(fileno(store->pack)) == -1)) {
+        perror("Erreur lors de la synchronisation du pack");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction écrivant la table en mémoire dans un nouveau segment
+ *
+ * Hors relecture du journal à l'ouverture, le journal est ensuite vidé :
+ * ses enregistrements sont désormais dans le segment.
+ *
+ * @param store le dépôt de chunks
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_flush_table(chunk_store *store) {
+    StoreEntry **entries;
+    run_writer writer;
+    index_run run;
+
+    if (store->mem_count == 0) {
+        return 0;
+    }
+    // Le segment est synchronisé : les chunks qu'il indexe doivent l'être avant lui
+    if (!store->replaying && store_sync_pack(store) == -1) {
+        return -1;
+    }
+    if (store_sorted_table(store, &entries) == -1) {
+        return -1;
+    }
+    uint32_t id = store->next_run++;
+    if (run_writer_open(&writer, store->dir, id) == -1) {
+        free(entries);
+        return -1;
+    }
+    for (size_t i = 0; i < store->mem_count; i++) {
+        if (run_writer_add(&writer, &entries[i]->rec) == -1) {
+            run_writer_abort(&writer);
+            free(entries);
+            return -1;
+        }
+    }
+    free(entries);
+    // Le segment doit survivre à un arrêt brutal avant que le journal ne soit vidé
+    if (run_writer_commit(&writer) == -1 || sync_dir(store->dir) == -1
+        || run_open(&run, store->dir, id, store->opts.populate) == -1) {
+        return -1;
+    }
+    pthread_mutex_lock(&store->runs_lock);
+    int added = store_add_run(store, &run);
+    pthread_mutex_unlock(&store->runs_lock);
+    if (added == -1) {
+        run_close(&run);
+        return -1;
+    }
+    store_clear_table(store);
+    store->flushes++;
+
+    if (store->replaying) {
+        store->replay_flushed = 1;
+    } else {
+        char path[PATH_MAX + 32];
+        snprintf(path, sizeof(path), "%s/index", store->dir);
+        fclose(store->index);
+        store->index = fopen(path, "wb");
+        if (!store->index) {
+            perror("Erreur lors de la réinitialisation du journal de l'index");
+            return -1;
+        }
+        store->index_records = 0;
+        // Le lot en cours est dans le segment, inutile de l'écrire dans le journal
+        store->nb_pending = 0;
+        store->uncommitted = 0;
+        store->commits++;
+    }
+    store_maybe_merge(store);
+    return 0;
+}
+
+/**
+ * @brief Fonction ajoutant au filtre toutes les empreintes d'un segment
+ *
+ * @param filter le filtre
+ * @param run le segment
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int filter_add_run(bloom_filter *filter, const index_run *run) {
+    run_cursor *cursor = malloc(sizeof(run_cursor));
+    int lu;
+    if (!cursor) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    run_cursor_open(cursor, run);
+    while ((lu = run_cursor_next(cursor)) == 1) {
+        bloom_add(filter, cursor->rec.md5);
+    }
+    free(cursor);
+    return lu;
+}
+
+/**
+ * @brief Fonction reconstruisant le filtre à partir de la table et des segments
+ *
+ * Le filtre est dimensionné pour le double des chunks connus afin de ne pas
+ * être reconstruit à chaque ajout. Faute de mémoire, le dépôt fonctionne
+ * sans filtre.
+ *
+ * @param store le dépôt de chunks
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_rebuild_filter(chunk_store *store) {
+    double fpr = store->opts.filter_fpr > 0 ? store->opts.filter_fpr
+                 : (store->filter.bits ? store->filter.fpr : BLOOM_DEFAULT_FPR);
+    bloom_filter filter;
+    int ret = 0;
+
+    bloom_free(&store->filter);
+    store->filter_dirty = 1;
+    if (bloom_init(&filter, (uint64_t)store->count * 2, fpr, store->opts.filter_max_bytes) == -1) {
+        return -1;
+    }
+    for (size_t i = 0; i < store->table_size; i++) {
+        for (StoreEntry *current = store->table[i]; current != NULL; current = current->next) {
+            bloom_add(&filter, current->rec.md5);
+        }
+    }
+    pthread_mutex_lock(&store->runs_lock);
+    for (size_t i = 0; i < store->nb_runs && ret == 0; i++) {
+        ret = filter_add_run(&filter, &store->runs[i]);
+    }
+    pthread_mutex_unlock(&store->runs_lock);
+    if (ret == -1) {
+        bloom_free(&filter);
+        return -1;
+    }
+    store->filter = filter;
+    return 0;
+}
+
+/**
+ * @brief Fonction cherchant une empreinte dans les segments, du plus récent au plus ancien
+ *
+ * @param store le dépôt de chunks (runs_lock tenu par l'appelant)
+ * @param md5 l'empreinte recherchée
+ * @param rec l'enregistrement en sortie
+ * @param run_index l'indice du segment contenant l'empreinte en sortie (peut être NULL)
+ * @param position le rang de l'enregistrement dans ce segment en sortie (peut être NULL)
+ * @param caches un bloc consulté par segment pour les recherches par lots (peut être NULL)
+ * @return int 1 si l'empreinte est présente, 0 sinon, -1 en cas d'erreur de lecture
+ */
+static int store_search_runs(chunk_store *store, const unsigned char *md5, store_record *rec, size_t *run_index,
+                             uint64_t *position, run_block_cache *caches) {
+    for (size_t i = store->nb_runs; i > 0; i--) {
+        int found = run_find(&store->runs[i - 1], md5, rec, position, caches ? &caches[i - 1] : NULL);
+        if (found != 0) {
+            if (found == 1 && run_index) {
+                *run_index = i - 1;
+            }
+            return found;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction cherchant un chunk en consultant d'abord le filtre
+ *
+ * Le filtre tient en mémoire et ne coûte qu'une ligne de cache : un chunk
+ * qu'il déclare absent l'est certainement, sans lire la table ni les
+ * segments sur disque.
+ *
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte recherchée
+ * @param rec l'enregistrement en sortie
+ * @param caches un bloc consulté par segment (NULL hors recherche par lots, runs_lock tenu sinon)
+ * @return int 1 si le chunk est présent, 0 sinon, -1 en cas d'erreur de lecture
+ */
+static int store_find(chunk_store *store, const unsigned char *md5, store_record *rec, run_block_cache *caches) {
+    store->lookups++;
+    if (store->filter.bits && !bloom_may_contain(&store->filter, md5)) {
+        store->negatives++;
+        return 0;
+    }
+    StoreEntry *entry = store_lookup(store, md5);
+    if (entry != NULL) {
+        *rec = entry->rec;
+        return 1;
+    }
+    if (caches == NULL) {
+        pthread_mutex_lock(&store->runs_lock);
+    }
+    int found = store_search_runs(store, md5, rec, NULL, NULL, caches);
+    if (caches == NULL) {
+        pthread_mutex_unlock(&store->runs_lock);
+    }
+    if (found == 0 && store->filter.bits) {
+        store->false_positives++;
+    }
+    return found;
+}
+
+/**
+ * @brief Fonction insérant un enregistrement dans la table en mémoire
+ *
+ * Les entrées sont allouées dans une arène, rendue d'un coup quand la table
+ * est vidée. Quand la table dépasse sa part du plafond de mémoire, elle est
+ * écrite dans un segment sur disque : la mémoire reste bornée, au prix de lectures sur
+ * disque pour les chunks plus anciens.
+ *
+ * @param store le dépôt de chunks
+ * @param rec l'enregistrement à insérer
+ * @param filter 1 pour ajouter aussi l'empreinte au filtre
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_insert(chunk_store *store, const store_record *rec, int filter) {
+    StoreEntry *entry = arena_alloc(&store->entries, sizeof(StoreEntry));
+    if (!entry) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    entry->rec = *rec;
+    entry->marked = 0;
+    size_t h = store_hash(rec->md5, store->table_size);
+    entry->next = store->table[h];
+    store->table[h] = entry;
+    store->mem_count++;
+    store->count++;
+    if (store->mem_count > store->table_size * 2) {
+        store_grow(store);
+    }
+    if (filter && store->filter.bits) {
+        bloom_add(&store->filter, rec->md5);
+        store->filter_dirty = 1;
+        if (store->filter.count > store->filter.capacity) {
+            store_rebuild_filter(store);
+        }
+    }
+
+    uint64_t cap = store_memory_cap(store);
+    pthread_mutex_lock(&store->runs_lock);
+    uint64_t fences = store_fences_memory(store);
+    pthread_mutex_unlock(&store->runs_lock);
+    uint64_t table_cap = (fences + MEMTABLE_MIN_MEMORY < cap) ? cap - fences : MEMTABLE_MIN_MEMORY;
+    if (!store->opts.read_only && store_table_memory(store) > table_cap) {
+        return store_flush_table(store);
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure construisant le chemin d'un pack
+ *
+ * @param store le dépôt de chunks
+ * @param pack_id le numéro du pack
+ * @param buffer le tampon de sortie
+ * @param size la taille du tampon
+ */
+static void pack_path(chunk_store *store, uint32_t pack_id, char *buffer, size_t size) {
+    snprintf(buffer, size, "%s/pack-%08u", store->dir, pack_id);
+}
+
+/**
+ * @brief Fonction ouvrant en ajout le pack courant
+ *
+ * @param store le dépôt de chunks
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int open_current_pack(chunk_store *store) {
+    char path[PATH_MAX + 32];
+    struct stat st;
+    pack_path(store, store->pack_id, path, sizeof(path));
+    store->pack = fopen(path, "ab");
+    if (!store->pack) {
+        perror("Erreur lors de l'ouverture du pack");
+        return -1;
+    }
+    store->pack_size = (stat(path, &st) == 0) ? (uint64_t)st.st_size : 0;
+    return 0;
+}
+
+/**
+ * @brief Fonction de comparaison de deux numéros de segment pour qsort
+ */
+static int compare_ids(const void *a, const void *b) {
+    uint32_t ia = *(const uint32_t *)a;
+    uint32_t ib = *(const uint32_t *)b;
+    return (ia < ib) ? -1 : (ia > ib);
+}
+
+/**
+ * @brief Fonction recensant les packs et les segments du dépôt
+ *
+ * Les segments temporaires laissés par un arrêt brutal sont supprimés.
+ *
+ * @param store le dépôt de chunks
+ * @param ids les numéros des segments triés en sortie (à libérer avec free)
+ * @param nb_ids le nombre de segments en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_scan(chunk_store *store, uint32_t **ids, size_t *nb_ids) {
+    size_t capacity = 0;
+    struct dirent *entry;
+    unsigned int id;
+    char suffix[8];
+
+    *ids = NULL;
+    *nb_ids = 0;
+    DIR *dir = opendir(store->dir);
+    if (!dir) {
+        perror("Erreur lors de l'ouverture du dépôt de chunks");
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "pack-%u", &id) == 1 && id > store->pack_id) {
+            store->pack_id = id;
+        }
+        int fields = sscanf(entry->d_name, "run-%u%7s", &id, suffix);
+        if (fields == 2 && !store->opts.read_only) {
+            char path[PATH_MAX + 300];
+            snprintf(path, sizeof(path), "%s/%s", store->dir, entry->d_name);
+            unlink(path);
+            continue;
+        }
+        if (fields != 1) {
+            continue;
+        }
+        if (*nb_ids == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            uint32_t *new_ids = realloc(*ids, capacity * sizeof(uint32_t));
+            if (!new_ids) {
+                fprintf(stderr, "Erreur d'allocation mémoire\n");
+                closedir(dir);
+                return -1;
+            }
+            *ids = new_ids;
+        }
+        (*ids)[(*nb_ids)++] = id;
+    }
+    closedir(dir);
+    qsort(*ids, *nb_ids, sizeof(uint32_t), compare_ids);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour ouvrir (ou créer) le dépôt de chunks d'un répertoire de sauvegarde
+ *
+ * Seules les balises des segments sont chargées en mémoire ; le journal des
+ * chunks les plus récents est relu dans la table. Le filtre enregistré à la
+ * dernière fermeture est complété avec les segments et les enregistrements
+ * du journal ajoutés depuis ; il n'est reconstruit entièrement que s'il est
+ * absent, périmé ou si ses réglages changent. Enfin le dernier pack est
+ * rouvert en ajout pour y écrire les nouveaux chunks.
+ *
+ * En lecture seule, rien n'est créé ni écrit et le dépôt n'est pas
+ * verrouillé : la vue peut omettre les tout derniers chunks d'un écrivain
+ * concurrent. Un dépôt absent est alors vu comme vide.
+ *
+ * @param store le dépôt à initialiser
+ * @param repo_dir le répertoire de sauvegarde
+ * @param opts les réglages de l'index (NULL pour les réglages par défaut)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int store_open(chunk_store *store, const char *repo_dir, const store_options *opts) {
+    char path[PATH_MAX + 32];
+    uint64_t covered = 0;
+    uint32_t generation = 0;
+    uint32_t *ids;
+    size_t nb_ids;
+    memset(store, 0, sizeof(*store));
+    store->read_fd = -1;
+    store->lock_fd = -1;
+    pthread_mutex_init(&store->runs_lock, NULL);
+    if (opts) {
+        store->opts = *opts;
+    }
+    arena_init_with(&store->entries, 0, store->opts.allocator);
+
+    snprintf(store->dir, sizeof(store->dir), "%s/%s", repo_dir, STORE_DIR);
+    store->table_size = STORE_TABLE_SIZE;
+    store->table = calloc(store->table_size, sizeof(StoreEntry *));
+    if (!store->table) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        store_close(store);
+        return -1;
+    }
+    if (store->opts.read_only) {
+        struct stat st;
+        if (stat(store->dir, &st) == -1 && errno == ENOENT) {
+            return 0;
+        }
+    } else {
+        mkdir(repo_dir, 0755);
+        if (mkdir(store->dir, 0755) == -1 && errno != EEXIST) {
+            perror("Erreur lors de la création du dépôt de chunks");
+            store_close(store);
+            return -1;
+        }
+    }
+
+    // Un seul processus à la fois écrit dans le dépôt (serveur, sauvegarde, prune)
+    snprintf(path, sizeof(path), "%s/lock", store->dir);
+    if (!store->opts.read_only) {
+        store->lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (!store->opts.read_only && (store->lock_fd == -1 || flock(store->lock_fd, LOCK_EX | LOCK_NB) == -1)) {
+        int err = errno;
+        if (err == EWOULDBLOCK) {
+            fprintf(stderr, "Erreur : le dépôt %s est utilisé par un autre processus\n", repo_dir);
+        } else {
+            perror("Erreur lors du verrouillage du dépôt");
+        }
+        store_close(store);
+        errno = err; // Pour que l'appelant distingue un dépôt verrouillé
+        return -1;
+    }
+
+    // Segments sur disque
+    if (store_scan(store, &ids, &nb_ids) == -1) {
+        store_close(store);
+        return -1;
+    }
+    for (size_t i = 0; i < nb_ids; i++) {
+        index_run run;
+        if (run_open(&run, store->dir, ids[i], store->opts.populate) == -1 || store_add_run(store, &run) == -1) {
+            free(ids);
+            store_close(store);
+            return -1;
+        }
+        store->count += run.records;
+    }
+    store->next_run = nb_ids ? ids[nb_ids - 1] + 1 : 1;
+    free(ids);
+
+    // Filtre : seuls les segments créés depuis son enregistrement lui sont ajoutés
+    snprintf(path, sizeof(path), "%s/filter", store->dir);
+    if (bloom_load(&store->filter, path, &covered, &generation, store->opts.populate) == 0) {
+        for (size_t i = 0; i < store->nb_runs; i++) {
+            if (store->runs[i].id > generation) {
+                covered = 0; // Le journal a été vidé depuis
+                if (filter_add_run(&store->filter, &store->runs[i]) == -1) {
+                    bloom_free(&store->filter);
+                    break;
+                }
+                store->filter_dirty = 1;
+            }
+        }
+    }
+
+    // Relecture du journal : un enregistrement tronqué par un arrêt brutal est retiré,
+    // pour que les suivants soient ajoutés à la bonne position
+    snprintf(path, sizeof(path), "%s/index", store->dir);
+    FILE *index = fopen(path, "rb");
+    if (index) {
+        store_record rec;
+        struct stat st;
+        store->replaying = 1;
+        while (fread(&rec, sizeof(rec), 1, index) == 1) {
+            int filter = store->index_records++ >= covered;
+            if (store_lookup(store, rec.md5) == NULL && store_insert(store, &rec, filter) == -1) {
+                fclose(index);
+                store_close(store);
+                return -1;
+            }
+        }
+        store->replaying = 0;
+        off_t valid = (off_t)(store->index_records * sizeof(rec));
+        if (!store->opts.read_only && fstat(fileno(index), &st) == 0 && st.st_size > valid
+            && truncate(path, valid) == -1) {
+            perror("Erreur lors de la réparation du journal de l'index");
+        }
+        fclose(index);
+    }
+
+    // Clé : un dépôt chiffré ne s'ouvre qu'avec sa phrase secrète, un nouveau dépôt peut être chiffré
+    int keyed = crypto_load_key(store->dir, &store->key);
+    if (keyed == 0 && store->opts.encrypt != CRYPTO_NONE && !store->opts.read_only) {
+        if (store->count > 0) {
+            fprintf(stderr, "Erreur : le dépôt %s existe déjà sans chiffrement\n", repo_dir);
+            keyed = -1;
+        } else if (crypto_create_key(store->dir, store->opts.encrypt, &store->key) == 0) {
+            keyed = 1;
+            printf("Dépôt chiffré avec %s\n", crypto_cipher_name(store->key.cipher));
+        } else {
+            keyed = -1;
+        }
+    }
+    if (keyed == 1) {
+        store->sealed = malloc(RECORD_MAX_SIZE);
+        keyed = (store->sealed && crypto_session_init(&store->crypto, &store->key) == 0) ? 1 : -1;
+        store->encrypted = (keyed == 1);
+        // Un fichier recopié dans le manifeste y serait en clair : tout passe par les packs chiffrés
+        store->opts.inline_max = 0;
+    }
+    if (keyed == -1) {
+        store_close(store);
+        return -1;
+    }
+    if (store->opts.read_only) {
+        if (store->filter.bits == NULL || covered > store->index_records) {
+            store_rebuild_filter(store);
+        }
+        return 0;
+    }
+    store->index = fopen(path, "ab");
+    if (!store->index) {
+        perror("Erreur lors de l'ouverture de l'index");
+        store_close(store);
+        return -1;
+    }
+    // Un journal trop gros pour la mémoire a été découpé en segments : on finit de le vider
+    if (store->replay_flushed && store_flush_table(store) == -1) {
+        store_close(store);
+        return -1;
+    }
+    if (store->filter.bits == NULL || covered > store->index_records
+        || (store->opts.filter_fpr > 0 && store->opts.filter_fpr != store->filter.fpr)
+        || (store->opts.filter_max_bytes > 0 && bloom_memory(&store->filter) > store->opts.filter_max_bytes)) {
+        store_rebuild_filter(store);
+    }
+
+    if (open_current_pack(store) == -1) {
+        store_close(store);
+        return -1;
+    }
+    store_maybe_merge(store);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour savoir si un chunk est déjà présent dans le dépôt
+ *
+ * Une erreur de lecture de l'index est traitée comme une absence : le chunk
+ * sera réécrit plutôt que perdu.
+ *
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte du chunk
+ * @return int 1 si le chunk est présent, 0 sinon
+ */
+int store_contains(chunk_store *store, const unsigned char *md5) {
+    store_record rec;
+    return store_find(store, md5, &rec, NULL) == 1;
+}
+
+/**
+ * @brief Fonction de comparaison de deux pointeurs vers des empreintes pour qsort
+ */
+static int compare_md5_pointers(const void *a, const void *b) {
+    return memcmp(*(const unsigned char *const *)a, *(const unsigned char *const *)b, MD5_DIGEST_LENGTH);
+}
+
+/**
+ * @brief Fonction pour savoir quels chunks d'un lot sont présents
+ *
+ * Les empreintes sont cherchées dans l'ordre croissant : dans chaque
+ * segment, les empreintes voisines tombent dans le même bloc, qui n'est
+ * localisé qu'une fois pour tout le lot.
+ *
+ * @param store le dépôt de chunks
+ * @param md5 les empreintes, les unes à la suite des autres
+ * @param n le nombre d'empreintes
+ * @param present pour chaque empreinte, 1 si le chunk est présent, 0 sinon (en sortie)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int store_contains_batch(chunk_store *store, const unsigned char *md5, size_t n, unsigned char *present) {
+    const unsigned char **order = malloc((n ? n : 1) * sizeof(const unsigned char *));
+    if (!order) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        order[i] = md5 + i * MD5_DIGEST_LENGTH;
+    }
+    qsort(order, n, sizeof(const unsigned char *), compare_md5_pointers);
+
+    pthread_mutex_lock(&store->runs_lock);
+    run_block_cache *caches = malloc((store->nb_runs ? store->nb_runs : 1) * sizeof(run_block_cache));
+    if (!caches) {
+        pthread_mutex_unlock(&store->runs_lock);
+        free(order);
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        caches[i].run = store->runs[i].id;
+        caches[i].block = UINT64_MAX;
+    }
+    for (size_t i = 0; i < n; i++) {
+        store_record rec;
+        present[(order[i] - md5) / MD5_DIGEST_LENGTH] = store_find(store, order[i], &rec, caches) == 1;
+    }
+    pthread_mutex_unlock(&store->runs_lock);
+    free(caches);
+    free(order);
+    return 0;
+}
+
+/**
+ * @brief Fonction écrivant un chunk à la fin du pack courant, précédé de son en-tête
+ *
+ * Un nouveau pack est ouvert quand le pack courant dépasserait PACK_MAX_SIZE.
+ *
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte du chunk
+ * @param data les données du chunk
+ * @param len la taille du chunk
+ * @param rec l'emplacement du chunk en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_append(chunk_store *store, const unsigned char *md5, const void *data, uint32_t len, store_record *rec) {
+    if (store->pack_size > 0 && store->pack_size + sizeof(pack_header) + len > PACK_MAX_SIZE) {
+        // Le lot en cours peut citer des chunks du pack fermé : il est synchronisé avant
+        if (store->nb_pending > 0 && store_sync_pack(store) == -1) {
+            return -1;
+        }
+        fclose(store->pack);
+        store->pack = NULL;
+        store->pack_id++;
+        if (open_current_pack(store) == -1) {
+            return -1;
+        }
+    }
+
+    pack_header header;
+    memcpy(header.md5, md5, MD5_DIGEST_LENGTH);
+    header.len = len;
+    if (fwrite(&header, sizeof(header), 1, store->pack) != 1
+        || (len > 0 && fwrite(data, len, 1, store->pack) != 1)) {
+        perror("Erreur lors de l'écriture dans le pack");
+        return -1;
+    }
+
+    memcpy(rec->md5, md5, MD5_DIGEST_LENGTH);
+    rec->pack = store->pack_id;
+    rec->len = len;
+    rec->offset = store->pack_size + sizeof(header);
+    store->pack_size += sizeof(header) + len;
+    store->uncommitted += sizeof(header) + len;
+    return 0;
+}
+
+/**
+ * @brief Fonction pour ajouter un chunk au dépôt
+ *
+ * Le chunk est écrit à la fin du pack courant précédé de son en-tête, puis son
+ * emplacement est ajouté à la table et au lot en cours, qui rejoint le
+ * journal à la prochaine validation (tous les STORE_COMMIT_BYTES écrits, ou
+ * avec store_flush). Un chunk déjà présent n'est pas réécrit. Dans un dépôt
+ * chiffré, seules les données chiffrées et authentifiées sont écrites.
+ *
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte du chunk
+ * @param data les données du chunk
+ * @param len la taille du chunk
+ * @return int 1 si le chunk a été écrit, 0 s'il existait déjà, -1 en cas d'erreur
+ */
+int store_put(chunk_store *store, const unsigned char *md5, const void *data, uint32_t len) {
+    store_record rec;
+    int found = store_find(store, md5, &rec, NULL);
+    if (found != 0) {
+        return found == 1 ? 0 : -1;
+    }
+    if (store->opts.read_only) {
+        fprintf(stderr, "Erreur : dépôt ouvert en lecture seule\n");
+        return -1;
+    }
+    if (store->encrypted) {
+        if (crypto_seal(&store->crypto, md5, data, len, store->sealed) == -1) {
+            return -1;
+        }
+        data = store->sealed;
+        len += CRYPTO_SEAL_OVERHEAD;
+    }
+
+    if (store_append(store, md5, data, len, &rec) == -1) {
+        return -1;
+    }
+    if (store->nb_pending == store->pending_capacity) {
+        size_t capacity = store->pending_capacity ? store->pending_capacity * 2 : 1024;
+        store_record *pending = realloc(store->pending, capacity * sizeof(store_record));
+        if (!pending) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        store->pending = pending;
+        store->pending_capacity = capacity;
+    }
+    store->pending[store->nb_pending++] = rec;
+    if (store_insert(store, &rec, 1) == -1) {
+        return -1;
+    }
+    if (store->uncommitted >= STORE_COMMIT_BYTES && store_flush(store) == -1) {
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Fonction relisant un chunk à l'emplacement donné, tel qu'il est écrit dans le pack
+ *
+ * @param store le dépôt de chunks
+ * @param rec l'emplacement du chunk
+ * @param buffer le tampon de sortie, d'au moins RECORD_MAX_SIZE octets
+ * @return int 0 en cas de succès, -1 si le chunk est illisible
+ */
+static int store_read(chunk_store *store, const store_record *rec, void *buffer) {
+    if (rec->len > RECORD_MAX_SIZE) {
+        return -1;
+    }
+    if (store->pack && rec->pack == store->pack_id) {
+        fflush(store->pack); // Le chunk est peut-être encore dans le tampon d'écriture
+    }
+    if (store->read_fd == -1 || store->read_pack != rec->pack) {
+        char path[PATH_MAX + 32];
+        if (store->read_fd != -1) {
+            close(store->read_fd);
+        }
+        pack_path(store, rec->pack, path, sizeof(path));
+        store->read_fd = open(path, O_RDONLY);
+        if (store->read_fd == -1) {
+            perror("Erreur lors de l'ouverture du pack");
+            return -1;
+        }
+        store->read_pack = rec->pack;
+    }
+
+    ssize_t lus = pread(store->read_fd, buffer, rec->len, (off_t)rec->offset);
+    if (lus != (ssize_t)rec->len) {
+        fprintf(stderr, "Erreur : chunk tronqué dans le pack %u\n", rec->pack);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour relire un chunk du dépôt
+ *
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte du chunk
+ * @param buffer le tampon de sortie, d'au moins CHUNK_MAX_SIZE octets
+ * @param len la taille du chunk en sortie
+ * @return int 0 en cas de succès, -1 si le chunk est absent ou illisible
+ */
+int store_get(chunk_store *store, const unsigned char *md5, void *buffer, uint32_t *len) {
+    store_record rec;
+    if (store_find(store, md5, &rec, NULL) != 1) {
+        return -1;
+    }
+    if (!store->encrypted) {
+        if (store_read(store, &rec, buffer) == -1) {
+            return -1;
+        }
+        *len = rec.len;
+        return 0;
+    }
+    if (store_read(store, &rec, store->sealed) == -1) {
+        return -1;
+    }
+    int plain_len = crypto_open(&store->crypto, md5, store->sealed, rec.len, buffer);
+    if (plain_len == -1) {
+        fprintf(stderr, "Erreur : chunk altéré dans le pack %u\n", rec.pack);
+        return -1;
+    }
+    *len = (uint32_t)plain_len;
+    return 0;
+}
+
+/**
+ * @brief Fonction pour trouver la place d'un chunk dans les packs
+ *
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte du chunk
+ * @param rec l'enregistrement du chunk en sortie
+ * @return int 1 si le chunk est présent, 0 sinon, -1 en cas d'erreur de lecture de l'index
+ */
+int store_locate(chunk_store *store, const unsigned char *md5, store_record *rec) {
+    return store_find(store, md5, rec, NULL);
+}
+
+/**
+ * @brief Fonction pour relire des chunks triés par pack et position
+ *
+ * Les chunks voisins d'un même pack sont lus d'un seul tenant, par
+ * fenêtres d'au plus SORTED_READ_SIZE, et chaque pack est parcouru une
+ * seule fois dans l'ordre croissant des positions : un disque lit le dépôt
+ * séquentiellement, quel que soit l'ordre des fichiers qui référencent les
+ * chunks. Chaque chunk est authentifié et déchiffré avant d'être passé à
+ * sink ; un chunk illisible lui est signalé avec data à NULL.
+ *
+ * @param store le dépôt de chunks
+ * @param records les chunks à relire, triés par pack puis par position
+ * @param n le nombre de chunks
+ * @param sink la fonction recevant chaque chunk (une valeur non nulle interrompt la lecture)
+ * @param ctx le contexte passé à sink
+ * @param stats le bilan de la relecture en sortie
+ * @return int 0 en cas de succès, -1 si la lecture a été interrompue
+ */
+int store_read_records(chunk_store *store, const store_record *records, size_t n, record_sink sink, void *ctx,
+                       store_read_stats *stats) {
+    unsigned char plain[CHUNK_MAX_SIZE];
+    memset(stats, 0, sizeof(*stats));
+    if (n == 0) {
+        return 0;
+    }
+    unsigned char *buffer = malloc(SORTED_READ_SIZE);
+    if (!buffer) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    if (store->pack) {
+        fflush(store->pack); // Le dernier pack a peut-être des chunks dans son tampon d'écriture
+    }
+
+    int ret = 0, fd = -1;
+    uint32_t fd_pack = 0;
+    size_t i = 0;
+    while (i < n && ret == 0) {
+        const store_record *rec = &records[i];
+        if (fd == -1 || fd_pack != rec->pack) {
+            char path[PATH_MAX + 32];
+            if (fd != -1) {
+                close(fd);
+            }
+            pack_path(store, rec->pack, path, sizeof(path));
+            fd = open(path, O_RDONLY);
+            fd_pack = rec->pack;
+            if (fd == -1) {
+                fprintf(stderr, "Erreur : pack %u illisible : %s\n", rec->pack, strerror(errno));
+            } else {
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
+        }
+        if (fd == -1 || rec->len > RECORD_MAX_SIZE) {
+            stats->failed++;
+            ret = sink(ctx, i++, NULL, 0);
+            continue;
+        }
+
+        // Fenêtre couvrant les chunks suivants du pack tant qu'ils sont proches
+        uint64_t start = rec->offset;
+        uint64_t end = rec->offset + rec->len;
+        size_t j = i + 1;
+        while (j < n && records[j].pack == rec->pack && records[j].len <= RECORD_MAX_SIZE
+               && records[j].offset >= start && records[j].offset + records[j].len - start <= SORTED_READ_SIZE
+               && records[j].offset <= end + SORTED_MAX_GAP) {
+            if (records[j].offset + records[j].len > end) {
+                end = records[j].offset + records[j].len;
+            }
+            j++;
+        }
+        ssize_t lus = pread(fd, buffer, (size_t)(end - start), (off_t)start);
+        stats->reads++;
+        if (lus > 0) {
+            stats->bytes_read += (uint64_t)lus;
+        }
+        for (; i < j && ret == 0; i++) {
+            const unsigned char *data = buffer + (records[i].offset - start);
+            uint32_t len = records[i].len;
+            if (lus < 0 || records[i].offset + len > start + (uint64_t)lus) {
+                fprintf(stderr, "Erreur : chunk tronqué dans le pack %u\n", records[i].pack);
+                data = NULL;
+            } else if (store->encrypted) {
+                int plain_len = crypto_open(&store->crypto, records[i].md5, data, len, plain);
+                if (plain_len == -1) {
+                    fprintf(stderr, "Erreur : chunk altéré dans le pack %u\n", records[i].pack);
+                    data = NULL;
+                } else {
+                    data = plain;
+                    len = (uint32_t)plain_len;
+                }
+            }
+            if (data) {
+                stats->chunks++;
+            } else {
+                stats->failed++;
+                len = 0;
+            }
+            ret = sink(ctx, i, data, len);
+        }
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    free(buffer);
+    return ret == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Procédure pour annoncer au noyau les chunks qui vont être relus
+ *
+ * Chaque chunk trouvé fait l'objet d'un posix_fadvise(WILLNEED) sur sa
+ * place dans son pack : le noyau lance les lectures sans attendre, et les
+ * store_get suivants trouvent les données dans le cache de pages. Les
+ * chunks consécutifs d'un même pack partagent le même descripteur.
+ *
+ * @param store le dépôt de chunks
+ * @param md5 les empreintes des chunks
+ * @param n le nombre de chunks
+ */
+void store_prefetch(chunk_store *store, unsigned char (*md5)[MD5_DIGEST_LENGTH], size_t n) {
+    int fd = -1;
+    uint32_t fd_pack = 0;
+    for (size_t i = 0; i < n; i++) {
+        store_record rec;
+        if (store_find(store, md5[i], &rec, NULL) != 1) {
+            continue;
+        }
+        if (fd == -1 || fd_pack != rec.pack) {
+            char path[PATH_MAX + 32];
+            if (fd != -1) {
+                close(fd);
+            }
+            pack_path(store, rec.pack, path, sizeof(path));
+            fd = open(path, O_RDONLY);
+            fd_pack = rec.pack;
+            if (fd == -1) {
+                continue;
+            }
+        }
+        posix_fadvise(fd, (off_t)rec.offset, (off_t)rec.len, POSIX_FADV_WILLNEED);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Procédure calculant l'empreinte d'un chunk avec les contextes d'un thread
+ *
+ * @param session les contextes de chiffrement (NULL pour un MD5)
+ * @param data les données du chunk
+ * @param len la taille du chunk
+ * @param md5 l'empreinte en sortie
+ */
+static void store_fingerprint_with(crypto_session *session, const void *data, size_t len, unsigned char *md5) {
+    if (session) {
+        crypto_fingerprint(session, data, len, md5);
+    } else {
+        compute_md5((void *)data, len, md5);
+    }
+}
+
+/**
+ * @brief Procédure pour calculer l'empreinte d'un chunk
+ *
+ * Dans un dépôt chiffré, l'empreinte est un HMAC avec la clé du dépôt ;
+ * sinon c'est le MD5 des données.
+ *
+ * @param store le dépôt de chunks
+ * @param data les données du chunk
+ * @param len la taille du chunk
+ * @param md5 l'empreinte en sortie
+ */
+void store_fingerprint(chunk_store *store, const void *data, size_t len, unsigned char *md5) {
+    store_fingerprint_with(store->encrypted ? &store->crypto : NULL, data, len, md5);
+}
+
+/**
+ * @brief Fonction pour valider sur disque le lot de chunks en cours
+ *
+ * Validation groupée : le pack courant est synchronisé une seule fois pour
+ * tout le lot, puis les emplacements du lot sont ajoutés au journal, qui
+ * est synchronisé à son tour. Un chunk n'est donc jamais indexé avant que
+ * ses données soient sur disque ; après un arrêt brutal, les chunks du lot
+ * interrompu sont absents de l'index et seront simplement réécrits.
+ *
+ * @param store le dépôt de chunks
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int store_flush(chunk_store *store) {
+    if (!store->index || (store->nb_pending == 0 && store->uncommitted == 0)) {
+        return 0;
+    }
+    if (store_sync_pack(store) == -1) {
+        return -1;
+    }
+    if (store->nb_pending > 0
+        && fwrite(store->pending, sizeof(store_record), store->nb_pending, store->index) != store->nb_pending) {
+        perror("Erreur lors de l'écriture dans l'index");
+        return -1;
+    }
+    if (fflush(store->index) != 0 || fdatasync(fileno(store->index)) == -1) {
+        perror("Erreur lors de la synchronisation du journal de l'index");
+        return -1;
+    }
+    store->index_records += store->nb_pending;
+    store->nb_pending = 0;
+    store->uncommitted = 0;
+    store->commits++;
+    return 0;
+}
+
+/**
+ * @brief Procédure pour fermer le dépôt et libérer l'index en mémoire
+ *
+ * Le dernier lot est validé. Un journal de plus de STORE_JOURNAL_CLOSE_RECORDS
+ * enregistrements est écrit en segment : la prochaine ouverture projette le
+ * segment au lieu de relire le journal. La fusion en cours est attendue. Le
+ * filtre est enregistré avec le dernier segment et le nombre d'enregistrements
+ * du journal qu'il couvre, pour n'avoir à ajouter que les suivants à la
+ * prochaine ouverture.
+ *
+ * @param store le dépôt de chunks
+ */
+void store_close(chunk_store *store) {
+    if (store->index && store_flush(store) == 0 && store->index_records > STORE_JOURNAL_CLOSE_RECORDS) {
+        store_flush_table(store);
+    }
+    store_wait_merge(store);
+    free(store->pending);
+    if (store->pack) {
+        fclose(store->pack);
+    }
+    if (store->index) {
+        fclose(store->index);
+        if (store->filter.bits && store->filter_dirty) {
+            char path[PATH_MAX + 32];
+            snprintf(path, sizeof(path), "%s/filter", store->dir);
+            bloom_save(&store->filter, path, store->index_records, store->next_run - 1);
+        }
+    }
+    bloom_free(&store->filter);
+    if (store->read_fd != -1) {
+        close(store->read_fd);
+    }
+    if (store->lock_fd != -1) {
+        close(store->lock_fd);
+    }
+    arena_free(&store->entries);
+    free(store->table);
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        run_close(&store->runs[i]);
+    }
+    free(store->runs);
+    pthread_mutex_destroy(&store->runs_lock);
+    if (store->encrypted) {
+        crypto_session_free(&store->crypto);
+    }
+    free(store->sealed);
+    OPENSSL_cleanse(&store->key, sizeof(store->key));
+    memset(store, 0, sizeof(*store));
+    store->read_fd = -1;
+    store->lock_fd = -1;
+}
+
+/**
+ * @brief Fonction pour préparer le marquage du ramasse-miettes
+ *
+ * Les fusions sont suspendues jusqu'au balayage : les marques des segments
+ * sont des bits indexés par le rang des enregistrements.
+ *
+ * @param store le dépôt de chunks
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int store_clear_marks(chunk_store *store) {
+    store_wait_merge(store);
+    store->gc_active = 1;
+    for (size_t i = 0; i < store->table_size; i++) {
+        for (StoreEntry *current = store->table[i]; current != NULL; current = current->next) {
+            current->marked = 0;
+        }
+    }
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        free(store->runs[i].marks);
+        store->runs[i].marks = calloc((size_t)(store->runs[i].records / 8 + 1), 1);
+        if (!store->runs[i].marks) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour marquer un chunk comme référencé par une sauvegarde
+ *
+ * @param store le dépôt de chunks
+ * @param md5 l'empreinte du chunk
+ * @return int 0 en cas de succès, -1 si le chunk est absent du dépôt
+ */
+int store_mark(chunk_store *store, const unsigned char *md5) {
+    StoreEntry *entry = store_lookup(store, md5);
+    store_record rec;
+    size_t run_index;
+    uint64_t position;
+
+    if (entry != NULL) {
+        entry->marked = 1;
+        return 0;
+    }
+    if (store_search_runs(store, md5, &rec, &run_index, &position, NULL) != 1 || !store->runs[run_index].marks) {
+        return -1;
+    }
+    store->runs[run_index].marks[position / 8] |= (unsigned char)(1 << (position % 8));
+    return 0;
+}
+
+// Pack candidat au ramasse-miettes
+typedef struct {
+    uint32_t pack;
+    uint64_t live;    // octets encore référencés
+    uint64_t garbage; // octets morts
+} pack_usage;
+
+/**
+ * @brief Fonction de comparaison de deux packs pour qsort : les packs vides
+ *          d'abord, puis ceux qui libèrent le plus d'espace
+ */
+static int compare_usage(const void *a, const void *b) {
+    const pack_usage *ua = a;
+    const pack_usage *ub = b;
+    if ((ua->live == 0) != (ub->live == 0)) {
+        return (ua->live == 0) ? -1 : 1;
+    }
+    return (ua->garbage > ub->garbage) ? -1 : (ua->garbage < ub->garbage);
+}
+
+/**
+ * @brief Fonction de comparaison de deux enregistrements par emplacement pour qsort
+ */
+static int compare_location(const void *a, const void *b) {
+    const store_record *ra = a;
+    const store_record *rb = b;
+    if (ra->pack != rb->pack) {
+        return (ra->pack < rb->pack) ? -1 : 1;
+    }
+    return (ra->offset < rb->offset) ? -1 : (ra->offset > rb->offset);
+}
+
+/**
+ * @brief Fonction de comparaison de deux enregistrements par empreinte pour qsort
+ */
+static int compare_records(const void *a, const void *b) {
+    return memcmp(((const store_record *)a)->md5, ((const store_record *)b)->md5, MD5_DIGEST_LENGTH);
+}
+
+/**
+ * @brief Fonction préparant les sources de la réécriture de l'index : la table
+ *          puis les segments à réécrire, du plus récent au plus ancien
+ *
+ * @param store le dépôt de chunks
+ * @param dirty pour la table (0) puis chaque segment (i + 1), 1 s'il est à réécrire
+ * @param sources le tableau des sources en sortie (à libérer avec free)
+ * @param entries les entrées triées de la table en sortie (à libérer avec free)
+ * @return int le nombre de sources, -1 en cas d'erreur
+ */
+static int store_dirty_sources(chunk_store *store, const unsigned char *dirty, merge_source **sources,
+                               StoreEntry ***entries) {
+    int n = 1;
+    *sources = calloc(store->nb_runs + 1, sizeof(merge_source));
+    if (!*sources || store_sorted_table(store, entries) == -1) {
+        free(*sources);
+        *sources = NULL;
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    (*sources)[0].entries = *entries;
+    (*sources)[0].nb_entries = store->mem_count;
+    for (size_t i = store->nb_runs; i > 0; i--) {
+        if (dirty[i]) {
+            merge_source *source = &(*sources)[n++];
+            run_cursor_open(&source->cursor, &store->runs[i - 1]);
+            source->marks = store->runs[i - 1].marks;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Fonction parcourant tous les enregistrements marqués ou non
+ *
+ * Hors ramasse-miettes, tous les enregistrements sont considérés marqués.
+ * Chaque enregistrement est donné avec sa source : 0 pour la table, i + 1
+ * pour le segment store->runs[i].
+ *
+ * @param store le dépôt de chunks
+ * @param visit la fonction appelée pour chaque enregistrement
+ * @param ctx le contexte de la fonction
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_visit(chunk_store *store, void (*visit)(void *ctx, const store_record *rec, int marked, size_t source),
+                       void *ctx) {
+    for (size_t i = 0; i < store->table_size; i++) {
+        for (StoreEntry *current = store->table[i]; current != NULL; current = current->next) {
+            visit(ctx, &current->rec, current->marked, 0);
+        }
+    }
+    run_cursor *cursor = malloc(sizeof(run_cursor));
+    if (!cursor) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        int lu;
+        run_cursor_open(cursor, &store->runs[i]);
+        while ((lu = run_cursor_next(cursor)) == 1) {
+            uint64_t position = cursor->position;
+            const unsigned char *marks = store->runs[i].marks;
+            visit(ctx, &cursor->rec, marks ? (marks[position / 8] >> (position % 8)) & 1 : 1, i + 1);
+        }
+        if (lu == -1) {
+            free(cursor);
+            return -1;
+        }
+    }
+    free(cursor);
+    return 0;
+}
+
+// Contexte du premier parcours du balayage
+typedef struct {
+    uint64_t *live;
+    uint32_t last_pack;
+    unsigned char *dirty;   // sources contenant un chunk supprimé
+    store_gc_stats *stats;
+} sweep_usage;
+
+/**
+ * @brief Procédure comptant les octets vivants de chaque pack et les chunks supprimés
+ */
+static void visit_usage(void *ctx, const store_record *rec, int marked, size_t source) {
+    sweep_usage *usage = ctx;
+    if (!marked) {
+        usage->dirty[source] = 1;
+        usage->stats->chunks_removed++;
+        usage->stats->bytes_removed += rec->len;
+    } else if (rec->pack <= usage->last_pack) {
+        usage->live[rec->pack] += sizeof(pack_header) + rec->len;
+    }
+}
+
+// Contexte du relevé des chunks à déplacer
+typedef struct {
+    const unsigned char *selected;
+    uint32_t last_pack;
+    unsigned char *dirty;   // sources contenant un chunk déplacé
+    store_record *moved;
+    size_t nb_moved;
+    size_t capacity;
+    int error;
+} sweep_moves;
+
+/**
+ * @brief Procédure relevant les chunks vivants des packs à compacter
+ */
+static void visit_moves(void *ctx, const store_record *rec, int marked, size_t source) {
+    sweep_moves *moves = ctx;
+    if (!marked || rec->pack > moves->last_pack || !moves->selected[rec->pack] || moves->error) {
+        return;
+    }
+    moves->dirty[source] = 1;
+    if (moves->nb_moved == moves->capacity) {
+        size_t capacity = moves->capacity ? moves->capacity * 2 : 1024;
+        store_record *moved = realloc(moves->moved, capacity * sizeof(store_record));
+        if (!moved) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            moves->error = 1;
+            return;
+        }
+        moves->moved = moved;
+        moves->capacity = capacity;
+    }
+    moves->moved[moves->nb_moved++] = *rec;
+}
+
+/**
+ * @brief Fonction recopiant dans le pack courant les chunks vivants des packs choisis
+ *
+ * Les chunks sont lus dans l'ordre des packs et des positions, pour lire
+ * chaque pack séquentiellement. Les nouveaux emplacements sont rendus triés
+ * par empreinte, pour être substitués lors de la fusion des segments.
+ *
+ * @param store le dépôt de chunks
+ * @param selected pour chaque pack, 1 s'il est compacté
+ * @param last_pack le numéro du dernier pack pouvant être compacté
+ * @param dirty les sources de l'index à réécrire, complétées de celles citant un chunk déplacé
+ * @param stats le bilan à compléter
+ * @param moved les nouveaux emplacements en sortie (à libérer avec free)
+ * @param nb_moved le nombre de chunks déplacés en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_compact(chunk_store *store, const unsigned char *selected, uint32_t last_pack, unsigned char *dirty,
+                         store_gc_stats *stats, store_record **moved, size_t *nb_moved) {
+    sweep_moves moves = {selected, last_pack, dirty, NULL, 0, 0, 0};
+    unsigned char buffer[RECORD_MAX_SIZE];
+
+    if (store_visit(store, visit_moves, &moves) == -1 || moves.error) {
+        free(moves.moved);
+        return -1;
+    }
+    qsort(moves.moved, moves.nb_moved, sizeof(store_record), compare_location);
+
+    for (size_t i = 0; i < moves.nb_moved; i++) {
+        store_record rec;
+        if (store_read(store, &moves.moved[i], buffer) == -1
+            || store_append(store, moves.moved[i].md5, buffer, moves.moved[i].len, &rec) == -1) {
+            free(moves.moved);
+            return -1;
+        }
+        moves.moved[i] = rec;
+        stats->bytes_moved += rec.len;
+    }
+    qsort(moves.moved, moves.nb_moved, sizeof(store_record), compare_records);
+    *moved = moves.moved;
+    *nb_moved = moves.nb_moved;
+    return 0;
+}
+
+/**
+ * @brief Fonction remplaçant la table et les segments touchés par le balayage
+ *          par un seul segment ne contenant que leurs chunks marqués
+ *
+ * Seuls les segments citant un chunk supprimé ou déplacé sont relus et
+ * réécrits : un balayage qui ne retire que quelques chunks ne coûte que les
+ * segments qui les contiennent. Les segments intacts ne contiennent que des
+ * chunks marqués, c'est-à-dire les exemplaires les plus récents : ils ne
+ * peuvent pas faire doublon avec le nouveau segment.
+ * Le nouveau segment et le journal vidé sont rendus durables, répertoire
+ * compris, avant la suppression des anciens segments : après un arrêt
+ * brutal, les doublons éventuels désignent des packs encore présents.
+ *
+ * @param store le dépôt de chunks
+ * @param dirty pour la table (0) puis chaque segment (i + 1), 1 s'il est à réécrire
+ * @param moved les nouveaux emplacements des chunks déplacés, triés par empreinte
+ * @param nb_moved le nombre de chunks déplacés
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int store_rewrite_runs(chunk_store *store, const unsigned char *dirty, const store_record *moved,
+                              size_t nb_moved) {
+    merge_source *sources;
+    StoreEntry **entries;
+    run_writer writer;
+    index_run run;
+    char path[PATH_MAX + 32];
+
+    int n = store_dirty_sources(store, dirty, &sources, &entries);
+    if (n == -1) {
+        return -1;
+    }
+    uint32_t id = store->next_run++;
+    if (run_writer_open(&writer, store->dir, id) == -1) {
+        free(sources);
+        free(entries);
+        return -1;
+    }
+    int ret = merge_sources(sources, (size_t)n, &writer, 1, moved, nb_moved);
+    free(sources);
+    free(entries);
+    if (ret == -1) {
+        run_writer_abort(&writer);
+        return -1;
+    }
+    int empty = (writer.records == 0);
+    if (empty) {
+        run_writer_abort(&writer);
+    } else if (run_writer_commit(&writer) == -1 || sync_dir(store->dir) == -1
+               || run_open(&run, store->dir, id, store->opts.populate) == -1) {
+        return -1;
+    }
+
+    // Le journal, repris dans le nouveau segment désormais durable, est vidé
+    snprintf(path, sizeof(path), "%s/index", store->dir);
+    fclose(store->index);
+    store->index = fopen(path, "wb");
+    if (!store->index || fdatasync(fileno(store->index)) == -1) {
+        perror("Erreur lors de la réinitialisation du journal de l'index");
+        if (!empty) {
+            run_close(&run);
+        }
+        return -1;
+    }
+    store->index_records = 0;
+
+    pthread_mutex_lock(&store->runs_lock);
+    size_t kept = 0;
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        if (dirty[i + 1]) {
+            run_path(store->dir, store->runs[i].id, path, sizeof(path));
+            run_close(&store->runs[i]);
+            unlink(path);
+        } else {
+            store->runs[kept++] = store->runs[i];
+        }
+    }
+    store->nb_runs = kept;
+    ret = empty ? 0 : store_add_run(store, &run);
+    store->count = 0;
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        store->count += store->runs[i].records;
+    }
+    pthread_mutex_unlock(&store->runs_lock);
+    if (ret == -1) {
+        run_close(&run);
+        return -1;
+    }
+    store_clear_table(store);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour supprimer les chunks non marqués et compacter les packs
+ *
+ * Les chunks non marqués sont retirés de l'index. Les packs sans chunk vivant
+ * sont supprimés ; les autres packs dont l'espace mort dépasse
+ * COMPACT_MIN_GARBAGE sont compactés, les plus rentables d'abord, tant que
+ * les octets à recopier ne dépassent pas max_moved. Les packs non traités le
+ * seront au passage suivant : chaque passage est borné. Seuls la table et
+ * les segments citant un chunk supprimé ou déplacé sont réécrits ; le
+ * filtre garde les empreintes supprimées, ce qui ne fait que rendre vaines
+ * quelques recherches jusqu'à sa prochaine reconstruction.
+ *
+ * @param store le dépôt de chunks, marqué avec store_mark
+ * @param max_moved le nombre maximal d'octets à recopier (0 = sans limite)
+ * @param dry_run 1 pour seulement calculer le bilan
+ * @param stats le bilan en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int store_sweep(chunk_store *store, uint64_t max_moved, int dry_run, store_gc_stats *stats) {
+    uint32_t last_pack = store->pack_id; // Le pack courant n'est pas compacté
+    uint64_t *live = calloc((size_t)last_pack + 1, sizeof(uint64_t));
+    unsigned char *selected = calloc((size_t)last_pack + 1, 1);
+    unsigned char *dirty = calloc(store->nb_runs + 1, 1);
+    pack_usage *candidates = calloc((size_t)last_pack + 1, sizeof(pack_usage));
+    store_record *moved = NULL;
+    size_t nb_candidates = 0, nb_moved = 0;
+    int ret = -1;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!live || !selected || !dirty || !candidates) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        goto fin;
+    }
+    if (store_flush(store) == -1) {
+        goto fin;
+    }
+
+    // Chunks supprimés et espace vivant de chaque pack
+    sweep_usage usage = {live, last_pack, dirty, stats};
+    if (store_visit(store, visit_usage, &usage) == -1) {
+        goto fin;
+    }
+
+    // Choix des packs dans la limite des octets à recopier
+    for (uint32_t p = 0; p < last_pack; p++) {
+        char path[PATH_MAX + 32];
+        struct stat st;
+        pack_path(store, p, path, sizeof(path));
+        if (stat(path, &st) == -1 || (uint64_t)st.st_size <= live[p]) {
+            continue;
+        }
+        uint64_t garbage = (uint64_t)st.st_size - live[p];
+        if (live[p] == 0 || (double)garbage >= COMPACT_MIN_GARBAGE * (double)st.st_size) {
+            candidates[nb_candidates].pack = p;
+            candidates[nb_candidates].live = live[p];
+            candidates[nb_candidates].garbage = garbage;
+            nb_candidates++;
+        }
+    }
+    qsort(candidates, nb_candidates, sizeof(pack_usage), compare_usage);
+    uint64_t budget = 0;
+    for (size_t i = 0; i < nb_candidates; i++) {
+        if (max_moved > 0 && budget + candidates[i].live > max_moved) {
+            continue;
+        }
+        budget += candidates[i].live;
+        selected[candidates[i].pack] = 1;
+        stats->packs_deleted++;
+        stats->packs_compacted += (candidates[i].live > 0);
+        stats->bytes_freed += candidates[i].garbage;
+    }
+    if (dry_run) {
+        stats->bytes_moved = budget;
+        ret = 0;
+        goto fin;
+    }
+
+    // Recopie des chunks vivants, puis index, puis suppression des anciens packs
+    if (store_compact(store, selected, last_pack, dirty, stats, &moved, &nb_moved) == -1 || fflush(store->pack) != 0
+        || fdatasync(fileno(store->pack)) == -1) {
+        perror("Erreur lors du compactage");
+        goto fin;
+    }
+    if (stats->chunks_removed > 0 || nb_moved > 0) {
+        if (store_rewrite_runs(store, dirty, moved, nb_moved) == -1) {
+            goto fin;
+        }
+        // Le journal a été vidé : le filtre est réenregistré avec ce qu'il couvre désormais
+        store->filter_dirty = 1;
+    }
+    // Les suppressions des anciens segments sont durables avant celles des packs qu'ils désignent
+    if (sync_dir(store->dir) == -1) {
+        perror("Erreur lors du compactage");
+        goto fin;
+    }
+    if (store->read_fd != -1) {
+        close(store->read_fd);
+        store->read_fd = -1;
+    }
+    for (uint32_t p = 0; p < last_pack; p++) {
+        if (selected[p]) {
+            char path[PATH_MAX + 32];
+            pack_path(store, p, path, sizeof(path));
+            if (unlink(path) == -1) {
+                perror("Erreur lors de la suppression d'un pack");
+            }
+        }
+    }
+    ret = 0;
+
+fin:
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        free(store->runs[i].marks);
+        store->runs[i].marks = NULL;
+    }
+    store->gc_active = 0;
+    free(live);
+    free(selected);
+    free(dirty);
+    free(candidates);
+    free(moved);
+    return ret;
+}
+
+// Contexte du relevé des chunks à vérifier
+typedef struct {
+    store_record *records;
+    size_t count;
+    size_t capacity;
+    uint64_t total;
+    uint64_t threshold; // un chunk est retenu si son tirage est inférieur au seuil
+    uint64_t seed;
+    int error;
+} verify_sample;
+
+/**
+ * @brief Procédure retenant un chunk à vérifier selon le taux d'échantillonnage
+ *
+ * Le tirage mélange l'empreinte et une graine propre à chaque vérification :
+ * deux vérifications partielles successives ne relisent pas les mêmes chunks.
+ */
+static void visit_sample(void *ctx, const store_record *rec, int marked, size_t source) {
+    verify_sample *sample = ctx;
+    uint64_t draw;
+    (void)marked;
+    (void)source;
+    sample->total++;
+    memcpy(&draw, rec->md5, sizeof(draw));
+    if (sample->error || (draw ^ sample->seed) % 1000000 >= sample->threshold) {
+        return;
+    }
+    if (sample->count == sample->capacity) {
+        size_t capacity = sample->capacity ? sample->capacity * 2 : 4096;
+        store_record *records = realloc(sample->records, capacity * sizeof(store_record));
+        if (!records) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            sample->error = 1;
+            return;
+        }
+        sample->records = records;
+        sample->capacity = capacity;
+    }
+    sample->records[sample->count++] = *rec;
+}
+
+// Travail partagé par les threads de vérification
+typedef struct {
+    chunk_store *store;
+    const store_record *records; // chunks triés par pack et par position
+    const size_t *packs;         // indice du premier chunk de chaque pack, plus la fin
+    size_t nb_packs;
+    size_t next;                 // prochain pack à vérifier
+    pthread_mutex_t lock;
+    store_verify_stats stats;
+} verify_job;
+
+/**
+ * @brief Procédure vérifiant les chunks d'un pack, lus par fenêtres dans l'ordre des positions
+ *
+ * Les chunks voisins sont lus d'un seul tenant : une vérification complète
+ * lit chaque pack séquentiellement, une vérification partielle ne lit que
+ * les zones des chunks tirés.
+ *
+ * @param job le travail partagé
+ * @param first l'indice du premier chunk du pack
+ * @param last l'indice suivant le dernier chunk du pack
+ * @param buffer un tampon de VERIFY_READ_SIZE octets
+ * @param session les contextes de chiffrement du thread (NULL si le dépôt n'est pas chiffré)
+ * @param stats le bilan du thread à compléter
+ */
+static void verify_pack(verify_job *job, size_t first, size_t last, unsigned char *buffer, crypto_session *session,
+                        store_verify_stats *stats) {
+    const store_record *records = job->records;
+    unsigned char plain[CHUNK_MAX_SIZE];
+    uint32_t pack = records[first].pack;
+    char path[PATH_MAX + 32];
+    struct stat st;
+
+    pack_path(job->store, pack, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "Erreur : pack %u illisible (%zu chunks) : %s\n", pack, last - first, strerror(errno));
+        stats->chunks_missing += last - first;
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+    stats->packs_checked++;
+
+    size_t i = first;
+    while (i < last) {
+        const store_record *rec = &records[i];
+        if (rec->offset < sizeof(pack_header) || rec->len > RECORD_MAX_SIZE
+            || rec->offset + rec->len > (uint64_t)st.st_size) {
+            fprintf(stderr, "Erreur : chunk hors du pack %u à la position %llu\n", pack,
+                    (unsigned long long)rec->offset);
+            stats->chunks_missing++;
+            i++;
+            continue;
+        }
+
+        // Fenêtre couvrant les chunks suivants tant qu'ils sont proches
+        uint64_t start = rec->offset - sizeof(pack_header);
+        uint64_t end = rec->offset + rec->len;
+        size_t j = i + 1;
+        while (j < last && records[j].offset >= sizeof(pack_header) && records[j].len <= RECORD_MAX_SIZE
+               && records[j].offset + records[j].len <= (uint64_t)st.st_size
+               && records[j].offset + records[j].len - start <= VERIFY_READ_SIZE
+               && records[j].offset - sizeof(pack_header) <= end + VERIFY_MAX_GAP) {
+            if (records[j].offset + records[j].len > end) {
+                end = records[j].offset + records[j].len;
+            }
+            j++;
+        }
+        ssize_t lus = pread(fd, buffer, (size_t)(end - start), (off_t)start);
+        if (lus != (ssize_t)(end - start)) {
+            fprintf(stderr, "Erreur lors de la lecture du pack %u\n", pack);
+            stats->chunks_missing += j - i;
+            i = j;
+            continue;
+        }
+
+        for (; i < j; i++) {
+            const unsigned char *header_data = buffer + (records[i].offset - sizeof(pack_header) - start);
+            pack_header header;
+            unsigned char md5[MD5_DIGEST_LENGTH];
+            const unsigned char *data = header_data + sizeof(header);
+            uint32_t len = records[i].len;
+            int authentic = 1;
+            memcpy(&header, header_data, sizeof(header));
+            if (session) {
+                int plain_len = crypto_open(session, records[i].md5, data, len, plain);
+                authentic = plain_len != -1;
+                data = plain;
+                len = authentic ? (uint32_t)plain_len : 0;
+            }
+            if (authentic) {
+                store_fingerprint_with(session, data, len, md5);
+            }
+            if (!authentic || header.len != records[i].len || memcmp(header.md5, records[i].md5, MD5_DIGEST_LENGTH) != 0
+                || memcmp(md5, records[i].md5, MD5_DIGEST_LENGTH) != 0) {
+                fprintf(stderr, "Erreur : chunk corrompu dans le pack %u à la position %llu\n", pack,
+                        (unsigned long long)records[i].offset);
+                stats->chunks_corrupt++;
+                continue;
+            }
+            stats->chunks_checked++;
+            stats->bytes_checked += records[i].len;
+        }
+    }
+    close(fd);
+}
+
+/**
+ * @brief Fonction exécutée par chaque thread de vérification : les packs sont
+ *          distribués un par un aux threads libres
+ *
+ * @param arg le travail partagé
+ * @return void* NULL
+ */
+static void *verify_worker(void *arg) {
+    verify_job *job = arg;
+    store_verify_stats stats;
+    crypto_session session;
+    unsigned char *buffer = malloc(VERIFY_READ_SIZE);
+
+    memset(&stats, 0, sizeof(stats));
+    if (!buffer) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return NULL;
+    }
+    // Les contextes de chiffrement ne se partagent pas entre threads
+    if (job->store->encrypted && crypto_session_init(&session, &job->store->key) == -1) {
+        free(buffer);
+        return NULL;
+    }
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        size_t p = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (p >= job->nb_packs) {
+            break;
+        }
+        verify_pack(job, job->packs[p], job->packs[p + 1], buffer, job->store->encrypted ? &session : NULL, &stats);
+    }
+    free(buffer);
+    if (job->store->encrypted) {
+        crypto_session_free(&session);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->stats.chunks_checked += stats.chunks_checked;
+    job->stats.bytes_checked += stats.bytes_checked;
+    job->stats.chunks_corrupt += stats.chunks_corrupt;
+    job->stats.chunks_missing += stats.chunks_missing;
+    job->stats.packs_checked += stats.packs_checked;
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+/**
+ * @brief Fonction pour relire les chunks du dépôt et vérifier leur empreinte
+ *
+ * Chaque enregistrement de l'index doit désigner, dans un pack existant, un
+ * en-tête portant la même empreinte et la même taille, suivi de données dont
+ * l'empreinte recalculée est identique. Les packs sont répartis entre les
+ * threads ; chacun est lu dans l'ordre des positions. Avec percent < 100,
+ * seule une fraction tirée au hasard des chunks est relue.
+ *
+ * @param store le dépôt de chunks
+ * @param workers le nombre de threads de vérification
+ * @param percent le pourcentage de chunks à relire (100 pour tous)
+ * @param stats le bilan en sortie
+ * @return int 0 si la vérification a pu être menée (chunks en erreur compris), -1 sinon
+ */
+int store_verify(chunk_store *store, int workers, double percent, store_verify_stats *stats) {
+    verify_sample sample;
+    verify_job job;
+    size_t *packs;
+    pthread_t *threads;
+    int started = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&sample, 0, sizeof(sample));
+    if (percent <= 0 || percent > 100) {
+        percent = 100;
+    }
+    sample.threshold = (uint64_t)(percent * 10000);
+    sample.seed = percent < 100 ? ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid() : 0;
+    if (store_flush(store) == -1 || store_visit(store, visit_sample, &sample) == -1 || sample.error) {
+        free(sample.records);
+        return -1;
+    }
+    qsort(sample.records, sample.count, sizeof(store_record), compare_location);
+
+    packs = malloc((sample.count + 1) * sizeof(size_t));
+    threads = malloc((workers > 1 ? (size_t)workers : 1) * sizeof(pthread_t));
+    if (!packs || !threads) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        free(packs);
+        free(threads);
+        free(sample.records);
+        return -1;
+    }
+    memset(&job, 0, sizeof(job));
+    job.store = store;
+    job.records = sample.records;
+    job.packs = packs;
+    for (size_t i = 0; i < sample.count; i++) {
+        if (i == 0 || sample.records[i].pack != sample.records[i - 1].pack) {
+            packs[job.nb_packs++] = i;
+        }
+    }
+    packs[job.nb_packs] = sample.count;
+    pthread_mutex_init(&job.lock, NULL);
+
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, verify_worker, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+    verify_worker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+
+    *stats = job.stats;
+    stats->index_records = sample.total;
+    free(threads);
+    free(packs);
+    free(sample.records);
+    return 0;
+}
+
+/**
+ * @brief Procédure pour obtenir le bilan du filtre placé devant l'index
+ *
+ * @param store le dépôt de chunks
+ * @param stats le bilan en sortie
+ */
+void store_filter_report(const chunk_store *store, store_filter_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->lookups = store->lookups;
+    stats->negatives = store->negatives;
+    stats->false_positives = store->false_positives;
+    if (store->filter.bits) {
+        stats->memory = bloom_memory(&store->filter);
+        stats->target_fpr = store->filter.fpr;
+        stats->estimated_fpr = bloom_estimated_fpr(&store->filter);
+    }
+}
+
+/**
+ * @brief Procédure pour obtenir le bilan de l'index
+ *
+ * @param store le dépôt de chunks
+ * @param stats le bilan en sortie
+ */
+void store_index_report(chunk_store *store, store_index_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&store->runs_lock);
+    stats->runs = store->nb_runs;
+    for (size_t i = 0; i < store->nb_runs; i++) {
+        stats->run_records += store->runs[i].records;
+    }
+    stats->memory = store_table_memory(store) + store_fences_memory(store);
+    stats->merges = store->merges;
+    pthread_mutex_unlock(&store->runs_lock);
+    stats->mem_entries = store->mem_count;
+    stats->memory_cap = store_memory_cap(store);
+    stats->flushes = store->flushes;
+    stats->commits = store->commits;
+}
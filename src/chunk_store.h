@@ -0,0 +1,226 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <openssl/md5.h>
+#include "bloom_filter.h"
+#include "index_run.h"
+#include "arena.h"
+#include "crypto.h"
+
+// Répertoire du dépôt contenant les packs et l'index des chunks
+#define STORE_DIR ".chunks"
+
+// Taille maximale d'un pack avant d'en ouvrir un nouveau (64 Mo)
+#define PACK_MAX_SIZE (64 * 1024 * 1024)
+
+// Taille initiale de la table de hachage de l'index
+#define STORE_TABLE_SIZE 65536
+
+// Mémoire par défaut de l'index (table des chunks récents et balises des segments, 256 Mo)
+#define INDEX_MEMORY_DEFAULT (256ULL * 1024 * 1024)
+
+// Mémoire laissée à la table des chunks récents quand les balises dépassent le plafond (1 Mo)
+#define MEMTABLE_MIN_MEMORY (1024 * 1024)
+
+// Nombre de segments à partir duquel les plus petits sont fusionnés en arrière-plan
+#define MERGE_FANIN 4
+
+// Taille maximale d'une lecture de pack lors d'une vérification (8 Mo)
+#define VERIFY_READ_SIZE (8 * 1024 * 1024)
+
+// Écart au-delà duquel deux chunks vérifiés ne sont pas lus d'un seul tenant (1 Mo)
+#define VERIFY_MAX_GAP (1024 * 1024)
+
+// Taille maximale d'une lecture de pack lors d'une relecture ordonnée (4 Mo)
+#define SORTED_READ_SIZE (4 * 1024 * 1024)
+
+// Écart au-delà duquel deux chunks relus dans l'ordre ne sont pas lus d'un seul tenant (256 Ko)
+#define SORTED_MAX_GAP (256 * 1024)
+
+// Octets écrits dans les packs au-delà desquels le lot en cours est validé sur disque (32 Mo)
+#define STORE_COMMIT_BYTES (32 * 1024 * 1024)
+
+// Taille par défaut en deçà de laquelle un fichier est stocké dans le manifeste plutôt qu'en chunk
+#define STORE_INLINE_DEFAULT 512
+
+// Enregistrements du journal de l'index au-delà desquels la table est écrite en segment à la fermeture
+// (le journal doit être relu à chaque ouverture, un segment est projeté en mémoire sans être lu)
+#define STORE_JOURNAL_CLOSE_RECORDS 65536
+
+// Proportion minimale d'espace mort pour qu'un pack soit compacté
+#define COMPACT_MIN_GARBAGE 0.2
+
+// En-tête précédant chaque chunk dans un pack
+typedef struct {
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    uint32_t len;
+} pack_header;
+
+// Entrée de l'index en mémoire
+typedef struct StoreEntry {
+    store_record rec;
+    unsigned char marked;   // 1 si le chunk est référencé par une sauvegarde (ramasse-miettes)
+    struct StoreEntry *next;
+} StoreEntry;
+
+// Réglages de l'index (0 = réglages enregistrés avec le filtre, ou valeur par défaut)
+typedef struct {
+    double filter_fpr;         // taux de faux positifs visé
+    uint64_t filter_max_bytes; // mémoire maximale du filtre en octets
+    uint64_t index_memory;     // mémoire maximale de l'index en octets
+    int read_only;             // 1 pour consulter le dépôt sans rien y écrire ni le verrouiller
+    int encrypt;               // chiffrement d'un nouveau dépôt (CRYPTO_NONE, CRYPTO_AUTO...)
+    const arena_allocator *allocator; // allocateur de l'index en mémoire (NULL pour malloc)
+    uint32_t inline_max;       // taille maximale d'un fichier stocké dans le manifeste (0 pour aucun, forcé si chiffré)
+    int populate;              // 1 pour charger d'un coup les segments, le filtre et le cache des fichiers projetés
+} store_options;
+
+// Réglages par défaut du dépôt
+#define STORE_OPTIONS_DEFAULT {0, 0, 0, 0, CRYPTO_NONE, NULL, STORE_INLINE_DEFAULT, 0}
+
+// Dépôt de chunks partagé par toutes les sauvegardes d'un répertoire
+//
+// L'index est organisé en niveaux : les chunks récents sont dans une table
+// en mémoire, doublée d'un journal sur disque ; quand elle atteint le plafond
+// de mémoire, elle est écrite en un segment trié et le journal est vidé. Les
+// segments sont fusionnés en arrière-plan pour en limiter le nombre.
+typedef struct {
+    char dir[PATH_MAX];     // chemin du répertoire .chunks
+    StoreEntry **table;     // chunks récents (table de hachage chaînée)
+    size_t table_size;
+    size_t mem_count;       // nombre de chunks de la table
+    arena entries;          // entrées de la table, libérées ensemble à chaque écriture en segment
+    size_t count;           // nombre de chunks connus (table et segments)
+    FILE *index;            // journal des chunks de la table, ouvert en ajout
+    FILE *pack;             // pack courant ouvert en ajout
+    uint32_t pack_id;       // numéro du pack courant
+    uint64_t pack_size;     // taille du pack courant
+    int read_fd;            // pack ouvert en lecture
+    uint32_t read_pack;     // numéro du pack ouvert en lecture
+    int lock_fd;            // verrou empêchant deux processus d'écrire dans le dépôt
+    uint64_t index_records; // nombre d'enregistrements du journal
+    index_run *runs;        // segments sur disque, du plus ancien au plus récent
+    size_t nb_runs;
+    uint32_t next_run;      // numéro du prochain segment
+    pthread_mutex_t runs_lock; // protège la liste des segments pendant une fusion
+    pthread_t merge_thread;
+    int merging;            // 1 si une fusion a été lancée et pas encore attendue
+    int merge_done;         // 1 quand la fusion en arrière-plan est terminée
+    uint32_t merge_ids[MERGE_FANIN]; // segments en cours de fusion
+    uint32_t merge_target;  // numéro du segment produit par la fusion
+    int replaying;          // 1 pendant la relecture du journal à l'ouverture
+    int replay_flushed;     // 1 si la table a été écrite pendant la relecture
+    int gc_active;          // 1 entre store_clear_marks et store_sweep
+    uint64_t flushes;       // tables écrites en segments
+    uint64_t merges;        // fusions de segments terminées
+    store_options opts;     // réglages de l'index
+    bloom_filter filter;    // filtre des chunks présents (bits à NULL si indisponible)
+    int filter_dirty;       // 1 si le filtre a changé depuis son enregistrement
+    uint64_t lookups;       // recherches d'empreintes
+    uint64_t negatives;     // recherches évitées grâce au filtre
+    uint64_t false_positives; // recherches vaines malgré une réponse positive du filtre
+    int encrypted;          // 1 si les chunks sont chiffrés et leurs empreintes calculées avec une clé
+    repo_key key;           // clés du dépôt chiffré
+    crypto_session crypto;  // contextes de chiffrement du thread qui utilise le dépôt
+    unsigned char *sealed;  // tampon d'un chunk chiffré
+    store_record *pending;  // enregistrements du lot en cours, pas encore écrits dans le journal
+    size_t nb_pending;
+    size_t pending_capacity;
+    uint64_t uncommitted;   // octets écrits dans les packs depuis la dernière validation
+    uint64_t commits;       // lots validés (une synchronisation des packs et une du journal)
+} chunk_store;
+
+// Bilan du filtre placé devant l'index
+typedef struct {
+    uint64_t lookups;         // recherches d'empreintes
+    uint64_t negatives;       // chunks déclarés absents sans consulter l'index
+    uint64_t false_positives; // chunks absents malgré une réponse positive du filtre
+    uint64_t memory;          // mémoire du filtre en octets
+    double target_fpr;        // taux de faux positifs visé
+    double estimated_fpr;     // taux de faux positifs estimé avec le remplissage actuel
+} store_filter_stats;
+
+// Bilan d'un passage du ramasse-miettes
+typedef struct {
+    size_t chunks_removed;  // chunks qui ne sont plus référencés
+    uint64_t bytes_removed; // taille de ces chunks
+    size_t packs_deleted;   // packs supprimés (vides ou compactés)
+    size_t packs_compacted; // packs dont les chunks vivants ont été recopiés
+    uint64_t bytes_moved;   // octets de chunks vivants recopiés
+    uint64_t bytes_freed;   // espace disque libéré
+} store_gc_stats;
+
+// Bilan d'une relecture ordonnée de chunks
+typedef struct {
+    uint64_t chunks;        // chunks relus et déchiffrés
+    uint64_t reads;         // lectures de pack
+    uint64_t bytes_read;    // octets lus dans les packs, écarts compris
+    uint64_t failed;        // chunks absents, tronqués ou altérés
+} store_read_stats;
+
+// Fonction recevant un chunk relu dans l'ordre (data à NULL si le chunk est illisible)
+typedef int (*record_sink)(void *ctx, size_t i, const void *data, uint32_t len);
+
+// Bilan d'une vérification des packs
+typedef struct {
+    uint64_t index_records;   // enregistrements de l'index
+    uint64_t chunks_checked;  // chunks relus, authentifiés s'ils sont chiffrés, et dont l'empreinte a été recalculée
+    uint64_t bytes_checked;   // taille de ces chunks
+    uint64_t chunks_corrupt;  // chunks dont l'en-tête ou l'empreinte ne correspond pas à l'index
+    uint64_t chunks_missing;  // chunks hors de leur pack ou dans un pack absent
+    size_t packs_checked;     // packs lus
+} store_verify_stats;
+
+// Bilan de l'index
+typedef struct {
+    size_t runs;              // segments sur disque
+    uint64_t run_records;     // enregistrements des segments
+    uint64_t mem_entries;     // chunks de la table en mémoire
+    uint64_t memory;          // mémoire de la table et des balises en octets
+    uint64_t memory_cap;      // plafond de mémoire en octets
+    uint64_t flushes;         // tables écrites en segments
+    uint64_t merges;          // fusions de segments
+    uint64_t commits;         // lots validés sur disque
+} store_index_stats;
+
+// Fonction pour ouvrir (ou créer) le dépôt de chunks d'un répertoire de sauvegarde
+int store_open(chunk_store *store, const char *repo_dir, const store_options *opts);
+// Fonction pour savoir si un chunk est déjà présent dans le dépôt
+int store_contains(chunk_store *store, const unsigned char *md5);
+// Fonction pour savoir quels chunks d'un lot sont présents, en triant les recherches
+int store_contains_batch(chunk_store *store, const unsigned char *md5, size_t n, unsigned char *present);
+// Fonction pour ajouter un chunk au dépôt (sans effet s'il existe déjà)
+int store_put(chunk_store *store, const unsigned char *md5, const void *data, uint32_t len);
+// Fonction pour relire un chunk du dépôt
+int store_get(chunk_store *store, const unsigned char *md5, void *buffer, uint32_t *len);
+// Fonction pour trouver la place d'un chunk dans les packs (1 si trouvé, 0 sinon, -1 en cas d'erreur)
+int store_locate(chunk_store *store, const unsigned char *md5, store_record *rec);
+// Fonction pour relire des chunks triés par pack et position, en lectures séquentielles regroupées
+int store_read_records(chunk_store *store, const store_record *records, size_t n, record_sink sink, void *ctx,
+                       store_read_stats *stats);
+// Procédure pour annoncer au noyau les chunks qui vont être relus
+void store_prefetch(chunk_store *store, unsigned char (*md5)[MD5_DIGEST_LENGTH], size_t n);
+// Procédure pour calculer l'empreinte d'un chunk (à clé si le dépôt est chiffré)
+void store_fingerprint(chunk_store *store, const void *data, size_t len, unsigned char *md5);
+// Fonction pour valider sur disque le lot de chunks en cours (packs puis journal)
+int store_flush(chunk_store *store);
+// Procédure pour fermer le dépôt et libérer l'index en mémoire
+void store_close(chunk_store *store);
+// Fonction pour préparer le marquage du ramasse-miettes
+int store_clear_marks(chunk_store *store);
+// Fonction pour marquer un chunk comme référencé par une sauvegarde
+int store_mark(chunk_store *store, const unsigned char *md5);
+// Fonction pour supprimer les chunks non marqués et compacter les packs
+int store_sweep(chunk_store *store, uint64_t max_moved, int dry_run, store_gc_stats *stats);
+// Procédure pour obtenir le bilan du filtre placé devant l'index
+void store_filter_report(const chunk_store *store, store_filter_stats *stats);
+// Fonction pour relire les chunks du dépôt et vérifier leur empreinte avec plusieurs threads
+int store_verify(chunk_store *store, int workers, double percent, store_verify_stats *stats);
+// Procédure pour obtenir le bilan de l'index
+void store_index_report(chunk_store *store, store_index_stats *stats);
+
+#endif // CHUNK_STORE_H
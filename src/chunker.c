@@ -0,0 +1,303 @@
+#include "chunker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+// Graine de la table des octets : changer la table déplacerait toutes les coupures, et perdrait la déduplication
+#define CHUNKER_GEAR_SEED 0x62f3c1a9d5e7084bULL
+
+// Masques de l'empreinte glissante (FastCDC) : plus exigeant avant la taille visée, moins après
+#define CHUNKER_MASK_HARD 0x0003590703530000ULL
+#define CHUNKER_MASK_EASY 0x0000d90003530000ULL
+
+// Signature d'un format reconnu au début d'un fichier
+typedef struct {
+    size_t offset;
+    const char *bytes;
+    size_t len;
+    int policy;
+} chunker_magic;
+
+static const chunker_magic magics[] = {
+    {0, "QFI\xfb", 4, CHUNKER_FIXED},           // qcow2
+    {0, "KDMV", 4, CHUNKER_FIXED},              // vmdk
+    {0, "conectix", 8, CHUNKER_FIXED},          // vhd
+    {0, "vhdxfile", 8, CHUNKER_FIXED},          // vhdx
+    {0, "<<< Oracle VM VirtualBox", 24, CHUNKER_FIXED}, // vdi
+    {0, "SQLite format 3", 16, CHUNKER_FIXED},  // pages de taille fixe
+    {0, "\x1f\x8b", 2, CHUNKER_WHOLE},          // gzip
+    {0, "BZh", 3, CHUNKER_WHOLE},               // bzip2
+    {0, "\xfd" "7zXZ", 6, CHUNKER_WHOLE},       // xz
+    {0, "\x28\xb5\x2f\xfd", 4, CHUNKER_WHOLE},  // zstd
+    {0, "PK\x03\x04", 4, CHUNKER_WHOLE},        // zip, jar, docx, odt...
+    {0, "7z\xbc\xaf\x27\x1c", 6, CHUNKER_WHOLE},
+    {0, "Rar!\x1a\x07", 6, CHUNKER_WHOLE},
+    {0, "\xff\xd8\xff", 3, CHUNKER_WHOLE},      // jpeg
+    {0, "\x89PNG", 4, CHUNKER_WHOLE},
+    {0, "GIF8", 4, CHUNKER_WHOLE},
+    {8, "WEBP", 4, CHUNKER_WHOLE},
+    {4, "ftyp", 4, CHUNKER_WHOLE},              // mp4, mov, heic
+    {0, "\x1a\x45\xdf\xa3", 4, CHUNKER_WHOLE},  // mkv, webm
+    {0, "ID3", 3, CHUNKER_WHOLE},               // mp3
+    {0, "OggS", 4, CHUNKER_WHOLE},
+    {0, "fLaC", 4, CHUNKER_WHOLE},
+};
+
+// Extension reconnue quand le début du fichier ne l'est pas
+typedef struct {
+    const char *ext;
+    int policy;
+} chunker_ext;
+
+static const chunker_ext extensions[] = {
+    {"img", CHUNKER_FIXED}, {"raw", CHUNKER_FIXED}, {"iso", CHUNKER_FIXED}, {"qcow2", CHUNKER_FIXED},
+    {"vmdk", CHUNKER_FIXED}, {"vdi", CHUNKER_FIXED}, {"vhd", CHUNKER_FIXED}, {"vhdx", CHUNKER_FIXED},
+    {"db", CHUNKER_FIXED}, {"sqlite", CHUNKER_FIXED},
+    {"jpg", CHUNKER_WHOLE}, {"jpeg", CHUNKER_WHOLE}, {"png", CHUNKER_WHOLE}, {"gif", CHUNKER_WHOLE},
+    {"webp", CHUNKER_WHOLE}, {"heic", CHUNKER_WHOLE}, {"mp3", CHUNKER_WHOLE}, {"aac", CHUNKER_WHOLE},
+    {"ogg", CHUNKER_WHOLE}, {"opus", CHUNKER_WHOLE}, {"flac", CHUNKER_WHOLE}, {"m4a", CHUNKER_WHOLE},
+    {"mp4", CHUNKER_WHOLE}, {"m4v", CHUNKER_WHOLE}, {"mkv", CHUNKER_WHOLE}, {"webm", CHUNKER_WHOLE},
+    {"avi", CHUNKER_WHOLE}, {"mov", CHUNKER_WHOLE}, {"zip", CHUNKER_WHOLE}, {"gz", CHUNKER_WHOLE},
+    {"tgz", CHUNKER_WHOLE}, {"bz2", CHUNKER_WHOLE}, {"xz", CHUNKER_WHOLE}, {"zst", CHUNKER_WHOLE},
+    {"7z", CHUNKER_WHOLE}, {"rar", CHUNKER_WHOLE}, {"jar", CHUNKER_WHOLE}, {"apk", CHUNKER_WHOLE},
+    {"docx", CHUNKER_WHOLE}, {"xlsx", CHUNKER_WHOLE}, {"pptx", CHUNKER_WHOLE}, {"odt", CHUNKER_WHOLE},
+    {"epub", CHUNKER_WHOLE},
+};
+
+/**
+ * @brief Fonction pour allouer la fenêtre d'un découpeur
+ *
+ * La table des octets de l'empreinte glissante est tirée d'une graine fixe
+ * (splitmix64) : les coupures d'un même contenu sont identiques d'une
+ * sauvegarde et d'une machine à l'autre.
+ *
+ * @param c le découpeur
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int chunker_init(chunker *c) {
+    memset(c, 0, sizeof(*c));
+    c->window = malloc(2 * CHUNK_MAX_SIZE);
+    if (!c->window) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    uint64_t state = CHUNKER_GEAR_SEED;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        c->gear[i] = z ^ (z >> 31);
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction complétant la fenêtre pour qu'elle contienne au moins CHUNK_MAX_SIZE octets
+ *
+ * Les lectures font toujours CHUNK_MAX_SIZE octets : depuis une position
+ * alignée, le fichier reste lu par blocs alignés, comme l'exige O_DIRECT.
+ *
+ * @param c le découpeur
+ * @param t le régulateur des lectures
+ * @param fd le fichier ouvert avec throttle_open
+ * @return int 0 en cas de succès, -1 en cas d'erreur de lecture
+ */
+static int chunker_fill(chunker *c, throttle *t, int fd) {
+    if (c->eof || c->end - c->start >= CHUNK_MAX_SIZE) {
+        return 0;
+    }
+    memmove(c->window, c->window + c->start, c->end - c->start);
+    c->end -= c->start;
+    c->start = 0;
+    ssize_t lus = throttle_read(t, fd, c->window + c->end, CHUNK_MAX_SIZE);
+    if (lus < 0) {
+        return -1;
+    }
+    c->end += (size_t)lus;
+    c->eof = (lus < CHUNK_MAX_SIZE);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour commencer le découpage d'un fichier à une position
+ *
+ * La lecture part du bloc aligné qui contient la position, dont le début
+ * est ignoré : un fichier allongé reprend au milieu d'un bloc sans casser
+ * l'alignement des lectures.
+ *
+ * @param c le découpeur
+ * @param t le régulateur des lectures
+ * @param fd le fichier ouvert avec throttle_open
+ * @param offset la position du premier octet à découper
+ * @return int 0 en cas de succès, -1 en cas d'erreur de lecture
+ */
+int chunker_start(chunker *c, throttle *t, int fd, off_t offset) {
+    off_t aligned = offset - offset % CHUNK_SIZE;
+    c->start = 0;
+    c->end = 0;
+    c->eof = 0;
+    c->policy = CHUNKER_FIXED;
+    if (lseek(fd, aligned, SEEK_SET) == -1 || chunker_fill(c, t, fd) == -1) {
+        return -1;
+    }
+    c->start = (size_t)(offset - aligned) < c->end ? (size_t)(offset - aligned) : c->end;
+    return 0;
+}
+
+/**
+ * @brief Fonction reconnaissant le format d'un fichier à son début, puis à son extension
+ *
+ * @param c le découpeur, dont la fenêtre contient le début du fichier
+ * @param path le chemin du fichier
+ * @return int la politique du format, -1 s'il n'est pas reconnu
+ */
+static int chunker_sniff(const chunker *c, const char *path) {
+    const unsigned char *head = c->window + c->start;
+    size_t n = c->end - c->start;
+    for (size_t i = 0; i < sizeof(magics) / sizeof(magics[0]); i++) {
+        if (n >= magics[i].offset + magics[i].len
+            && memcmp(head + magics[i].offset, magics[i].bytes, magics[i].len) == 0) {
+            return magics[i].policy;
+        }
+    }
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(slash ? slash + 1 : path, '.');
+    if (!dot) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) {
+        if (strcasecmp(dot + 1, extensions[i].ext) == 0) {
+            return extensions[i].policy;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Fonction choisissant la politique de découpage d'un fichier
+ *
+ * Une image disque garde des blocs alignés, qui se retrouvent d'une image
+ * à l'autre. Un format compressé ne se déduplique que par copies
+ * entières : de gros blocs divisent par seize ses entrées d'index et ses
+ * empreintes. Le reste est découpé selon son contenu, sauf si sa dernière
+ * relecture n'a presque rien retrouvé dans le dépôt : il passe alors en
+ * gros blocs, et n'est de nouveau découpé selon son contenu que toutes les
+ * CHUNKER_PROBE_INTERVAL sauvegardes, pour remesurer son rendement.
+ *
+ * @param c le découpeur, démarré au début du fichier
+ * @param path le chemin du fichier
+ * @param size la taille du fichier (0 si inconnue)
+ * @param history le découpage des lectures précédentes, mis à jour (NULL pour un fichier inconnu)
+ * @return int la politique choisie (CHUNKER_*)
+ */
+int chunker_choose(chunker *c, const char *path, uint64_t size, chunk_history *history) {
+    int policy = chunker_sniff(c, path);
+    if (c->eof && c->end - c->start <= CHUNK_SIZE) {
+        policy = CHUNKER_FIXED; // un seul chunk, quelle que soit la politique
+    } else if (policy == -1 && history && history->yield >= 0 && history->yield < CHUNKER_MIN_YIELD
+               && size >= CHUNKER_YIELD_MIN_SIZE && history->runs < CHUNKER_PROBE_INTERVAL) {
+        policy = CHUNKER_WHOLE;
+        history->runs++;
+    } else if (policy == -1) {
+        policy = CHUNKER_CDC;
+        if (history) {
+            history->runs = 0;
+        }
+    }
+    if (history) {
+        history->policy = (uint8_t)policy;
+    }
+    c->policy = policy;
+    return policy;
+}
+
+/**
+ * @brief Fonction cherchant la fin du prochain chunk découpé selon le contenu (FastCDC)
+ *
+ * Une empreinte glissante est calculée sur les octets à partir de
+ * CHUNKER_CDC_MIN ; la coupure tombe au premier octet où ses bits masqués
+ * sont nuls. Le masque plus exigeant avant CHUNKER_CDC_AVG et plus
+ * permissif après resserre les tailles autour de la taille visée. Une
+ * insertion ne déplace donc que les coupures voisines, au lieu de décaler
+ * tous les blocs suivants.
+ *
+ * @param c le découpeur
+ * @param data les données à découper
+ * @param n leur taille, au moins CHUNK_MAX_SIZE sauf en fin de fichier
+ * @return size_t la taille du chunk
+ */
+static size_t chunker_cut(const chunker *c, const unsigned char *data, size_t n) {
+    size_t max = n < CHUNK_MAX_SIZE ? n : CHUNK_MAX_SIZE;
+    size_t normal = max < CHUNKER_CDC_AVG ? max : CHUNKER_CDC_AVG;
+    uint64_t hash = 0;
+    size_t i = CHUNKER_CDC_MIN;
+    if (n <= CHUNKER_CDC_MIN) {
+        return n;
+    }
+    for (; i < normal; i++) {
+        hash = (hash << 1) + c->gear[data[i]];
+        if ((hash & CHUNKER_MASK_HARD) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < max; i++) {
+        hash = (hash << 1) + c->gear[data[i]];
+        if ((hash & CHUNKER_MASK_EASY) == 0) {
+            return i + 1;
+        }
+    }
+    return max;
+}
+
+/**
+ * @brief Fonction donnant le prochain chunk du fichier
+ *
+ * Les données restent valables jusqu'à l'appel suivant.
+ *
+ * @param c le découpeur
+ * @param t le régulateur des lectures
+ * @param fd le fichier ouvert avec throttle_open
+ * @param data les données du chunk en sortie
+ * @return ssize_t la taille du chunk, 0 en fin de fichier, -1 en cas d'erreur de lecture
+ */
+ssize_t chunker_next(chunker *c, throttle *t, int fd, const unsigned char **data) {
+    if (chunker_fill(c, t, fd) == -1) {
+        return -1;
+    }
+    size_t avail = c->end - c->start;
+    size_t len;
+    if (c->policy == CHUNKER_CDC) {
+        len = chunker_cut(c, c->window + c->start, avail);
+    } else {
+        len = chunker_block_size(c->policy);
+        len = avail < len ? avail : len;
+    }
+    *data = c->window + c->start;
+    c->start += len;
+    return (ssize_t)len;
+}
+
+/**
+ * @brief Fonction donnant la taille des blocs d'une politique
+ *
+ * @param policy la politique (CHUNKER_*)
+ * @return uint32_t la taille des blocs, 0 si les coupures dépendent du contenu
+ */
+uint32_t chunker_block_size(int policy) {
+    if (policy == CHUNKER_CDC) {
+        return 0;
+    }
+    return policy == CHUNKER_WHOLE ? CHUNK_MAX_SIZE : CHUNK_SIZE;
+}
+
+/**
+ * @brief Procédure pour libérer la fenêtre d'un découpeur
+ *
+ * @param c le découpeur
+ */
+void chunker_free(chunker *c) {
+    free(c->window);
+    c->window = NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "deduplication.h"
+#include "throttle.h"
+
+// Politiques de découpage d'un fichier en chunks
+#define CHUNKER_FIXED 0     // blocs alignés de CHUNK_SIZE (images disque, bases de données)
+#define CHUNKER_CDC 1       // coupures choisies par le contenu (texte, dumps, archives non compressées)
+#define CHUNKER_WHOLE 2     // fichier entier, par blocs de CHUNK_MAX_SIZE (médias et archives compressés)
+#define CHUNKER_POLICIES 3
+
+// Tailles des chunks découpés selon le contenu : minimale et visée (2 Ko et 8 Ko, CHUNK_MAX_SIZE au plus)
+#define CHUNKER_CDC_MIN (2 * 1024)
+#define CHUNKER_CDC_AVG (8 * 1024)
+
+// Part des octets déjà présents dans le dépôt en deçà de laquelle un fichier n'est plus découpé selon le contenu (%)
+#define CHUNKER_MIN_YIELD 2
+
+// Taille minimale d'un fichier relu pour que son rendement décide de son découpage (1 Mo)
+#define CHUNKER_YIELD_MIN_SIZE (1024 * 1024)
+
+// Nombre de sauvegardes après lesquelles un fichier au rendement faible est de nouveau découpé selon le contenu
+#define CHUNKER_PROBE_INTERVAL 8
+
+// Découpage d'un fichier lors de ses lectures précédentes, gardé dans le cache des fichiers
+typedef struct {
+    uint8_t policy;         // politique de la dernière lecture (CHUNKER_*)
+    int8_t yield;           // part en % des octets déjà présents lors du dernier découpage selon le contenu (-1 si inconnue)
+    uint8_t runs;           // sauvegardes relues en blocs de CHUNK_MAX_SIZE depuis cette mesure
+} chunk_history;
+
+// Découpeur d'un fichier : fenêtre de lecture et politique en cours
+typedef struct {
+    unsigned char *window;  // 2 * CHUNK_MAX_SIZE octets
+    size_t start;           // début des données lues pas encore découpées
+    size_t end;             // fin des données lues
+    int eof;                // 1 si la fin du fichier est dans la fenêtre
+    int policy;             // CHUNKER_*
+    uint64_t gear[256];     // valeur pseudo-aléatoire de chaque octet pour l'empreinte glissante
+} chunker;
+
+// Fonction pour allouer la fenêtre d'un découpeur
+int chunker_init(chunker *c);
+// Fonction pour commencer le découpage d'un fichier à une position (lit la première fenêtre)
+int chunker_start(chunker *c, throttle *t, int fd, off_t offset);
+// Fonction choisissant la politique d'un fichier d'après son nom, son format et son historique (mis à jour)
+int chunker_choose(chunker *c, const char *path, uint64_t size, chunk_history *history);
+// Fonction donnant le prochain chunk du fichier (0 en fin de fichier, -1 en cas d'erreur de lecture)
+ssize_t chunker_next(chunker *c, throttle *t, int fd, const unsigned char **data);
+// Fonction donnant la taille des blocs d'une politique (0 si les coupures dépendent du contenu)
+uint32_t chunker_block_size(int policy);
+// Procédure pour libérer la fenêtre d'un découpeur
+void chunker_free(chunker *c);
+
+#endif // CHUNKER_H
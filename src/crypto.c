@@ -0,0 +1,373 @@
+#include "crypto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <openssl/core_names.h>
+#include <openssl/rand.h>
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+// Fichier de clé : les deux clés du dépôt chiffrées par une clé dérivée de
+// la phrase secrète (PBKDF2-HMAC-SHA256, puis AES-256-GCM)
+typedef struct {
+    char magic[8];
+    uint32_t cipher;
+    uint32_t iterations;
+    unsigned char salt[16];
+    unsigned char nonce[CRYPTO_NONCE_SIZE];
+    unsigned char wrapped[2 * CRYPTO_KEY_SIZE];
+    unsigned char tag[CRYPTO_TAG_SIZE];
+} key_file;
+
+/**
+ * @brief Fonction choisissant l'algorithme le plus rapide sur ce processeur
+ *
+ * AES-GCM n'est rapide qu'avec les instructions AES et de multiplication
+ * sans retenue ; sinon ChaCha20-Poly1305, écrit pour les processeurs
+ * généralistes, l'emporte largement.
+ *
+ * @return int CRYPTO_AES_GCM ou CRYPTO_CHACHA20_POLY1305
+ */
+static int cipher_for_cpu(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul")) {
+        return CRYPTO_AES_GCM;
+    }
+#elif defined(__aarch64__) && defined(HWCAP_AES) && defined(HWCAP_PMULL)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    if ((hwcap & HWCAP_AES) && (hwcap & HWCAP_PMULL)) {
+        return CRYPTO_AES_GCM;
+    }
+#endif
+    return CRYPTO_CHACHA20_POLY1305;
+}
+
+/**
+ * @brief Fonction donnant l'algorithme OpenSSL d'une constante
+ */
+static const EVP_CIPHER *evp_cipher(int cipher) {
+    return (cipher == CRYPTO_AES_GCM) ? EVP_aes_256_gcm() : EVP_chacha20_poly1305();
+}
+
+/**
+ * @brief Fonction pour donner le nom de l'algorithme de chiffrement
+ *
+ * @param cipher la constante de l'algorithme
+ * @return const char* son nom
+ */
+const char *crypto_cipher_name(int cipher) {
+    switch (cipher) {
+        case CRYPTO_AES_GCM:
+            return "aes-256-gcm";
+        case CRYPTO_CHACHA20_POLY1305:
+            return "chacha20-poly1305";
+        case CRYPTO_AUTO:
+            return "auto";
+        default:
+            return "aucun";
+    }
+}
+
+/**
+ * @brief Fonction pour convertir un nom d'algorithme en constante
+ *
+ * @param name auto, aes-256-gcm ou chacha20-poly1305
+ * @return int la constante, -1 si le nom est inconnu
+ */
+int crypto_parse_cipher(const char *name) {
+    if (strcmp(name, "auto") == 0) {
+        return CRYPTO_AUTO;
+    }
+    if (strcmp(name, "aes-256-gcm") == 0) {
+        return CRYPTO_AES_GCM;
+    }
+    if (strcmp(name, "chacha20-poly1305") == 0) {
+        return CRYPTO_CHACHA20_POLY1305;
+    }
+    return -1;
+}
+
+/**
+ * @brief Fonction dérivant la clé du fichier de clé à partir de la phrase secrète
+ *
+ * @param header le fichier de clé (sel et nombre d'itérations)
+ * @param kek la clé dérivée en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int derive_kek(const key_file *header, unsigned char *kek) {
+    const char *passphrase = getenv(CRYPTO_PASSPHRASE_ENV);
+    if (!passphrase || passphrase[0] == '\0') {
+        fprintf(stderr, "Erreur : dépôt chiffré, phrase secrète absente (variable %s)\n", CRYPTO_PASSPHRASE_ENV);
+        return -1;
+    }
+    if (PKCS5_PBKDF2_HMAC(passphrase, (int)strlen(passphrase), header->salt, sizeof(header->salt),
+                          (int)header->iterations, EVP_sha256(), CRYPTO_KEY_SIZE, kek) != 1) {
+        fprintf(stderr, "Erreur lors de la dérivation de la clé\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction chiffrant ou déchiffrant les clés du dépôt avec la clé dérivée
+ *
+ * L'en-tête (signature, algorithme, itérations) est authentifié avec les clés.
+ *
+ * @param header le fichier de clé
+ * @param kek la clé dérivée de la phrase secrète
+ * @param keys les deux clés en clair (entrée pour chiffrer, sortie pour déchiffrer)
+ * @param enc 1 pour chiffrer, 0 pour déchiffrer
+ * @return int 0 en cas de succès, -1 si l'authentification échoue
+ */
+static int wrap_keys(key_file *header, const unsigned char *kek, unsigned char *keys, int enc) {
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int n, ok = ctx != NULL;
+    ok = ok && EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), NULL, kek, header->nonce, enc) == 1;
+    ok = ok && EVP_CipherUpdate(ctx, NULL, &n, (const unsigned char *)header, offsetof(key_file, salt)) == 1;
+    if (enc) {
+        ok = ok && EVP_CipherUpdate(ctx, header->wrapped, &n, keys, sizeof(header->wrapped)) == 1;
+        ok = ok && EVP_CipherFinal_ex(ctx, header->wrapped + n, &n) == 1;
+        ok = ok && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, CRYPTO_TAG_SIZE, header->tag) == 1;
+    } else {
+        ok = ok && EVP_CipherUpdate(ctx, keys, &n, header->wrapped, sizeof(header->wrapped)) == 1;
+        ok = ok && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, CRYPTO_TAG_SIZE, header->tag) == 1;
+        ok = ok && EVP_CipherFinal_ex(ctx, keys + n, &n) == 1;
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Fonction pour lire la clé d'un dépôt
+ *
+ * @param store_dir le répertoire du dépôt de chunks
+ * @param key la clé en sortie
+ * @return int 1 si la clé est chargée, 0 si le dépôt n'est pas chiffré, -1 en cas d'erreur
+ */
+int crypto_load_key(const char *store_dir, repo_key *key) {
+    char path[PATH_MAX + 16];
+    unsigned char kek[CRYPTO_KEY_SIZE];
+    unsigned char keys[2 * CRYPTO_KEY_SIZE];
+    key_file header;
+
+    snprintf(path, sizeof(path), "%s/%s", store_dir, CRYPTO_KEY_NAME);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        perror("Erreur lors de l'ouverture de la clé du dépôt");
+        return -1;
+    }
+    int lu = fread(&header, sizeof(header), 1, file) == 1;
+    fclose(file);
+    if (!lu || memcmp(header.magic, CRYPTO_KEY_MAGIC, sizeof(header.magic)) != 0
+        || (header.cipher != CRYPTO_AES_GCM && header.cipher != CRYPTO_CHACHA20_POLY1305)) {
+        fprintf(stderr, "Erreur : clé du dépôt invalide : %s\n", path);
+        return -1;
+    }
+    if (derive_kek(&header, kek) == -1) {
+        return -1;
+    }
+    if (wrap_keys(&header, kek, keys, 0) == -1) {
+        fprintf(stderr, "Erreur : phrase secrète incorrecte\n");
+        OPENSSL_cleanse(kek, sizeof(kek));
+        return -1;
+    }
+    key->cipher = (int)header.cipher;
+    memcpy(key->enc_key, keys, CRYPTO_KEY_SIZE);
+    memcpy(key->mac_key, keys + CRYPTO_KEY_SIZE, CRYPTO_KEY_SIZE);
+    OPENSSL_cleanse(kek, sizeof(kek));
+    OPENSSL_cleanse(keys, sizeof(keys));
+    return 1;
+}
+
+/**
+ * @brief Fonction pour créer la clé d'un nouveau dépôt chiffré
+ *
+ * Les clés sont tirées au hasard ; seule leur version chiffrée par la
+ * phrase secrète est écrite dans le dépôt.
+ *
+ * @param store_dir le répertoire du dépôt de chunks
+ * @param cipher l'algorithme voulu (CRYPTO_AUTO pour le choisir selon le processeur)
+ * @param key la clé créée en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int crypto_create_key(const char *store_dir, int cipher, repo_key *key) {
+    char path[PATH_MAX + 16];
+    char tmp_path[PATH_MAX + 32];
+    unsigned char kek[CRYPTO_KEY_SIZE];
+    unsigned char keys[2 * CRYPTO_KEY_SIZE];
+    key_file header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CRYPTO_KEY_MAGIC, sizeof(header.magic));
+    header.cipher = (uint32_t)((cipher == CRYPTO_AUTO) ? cipher_for_cpu() : cipher);
+    header.iterations = CRYPTO_KDF_ITERATIONS;
+    if (RAND_bytes(header.salt, sizeof(header.salt)) != 1 || RAND_bytes(header.nonce, sizeof(header.nonce)) != 1
+        || RAND_bytes(keys, sizeof(keys)) != 1) {
+        fprintf(stderr, "Erreur : générateur aléatoire indisponible\n");
+        return -1;
+    }
+    if (derive_kek(&header, kek) == -1) {
+        return -1;
+    }
+    int wrapped = wrap_keys(&header, kek, keys, 1);
+    OPENSSL_cleanse(kek, sizeof(kek));
+    if (wrapped == -1) {
+        fprintf(stderr, "Erreur lors du chiffrement de la clé\n");
+        OPENSSL_cleanse(keys, sizeof(keys));
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", store_dir, CRYPTO_KEY_NAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1 || write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) || fsync(fd) == -1
+        || close(fd) == -1 || rename(tmp_path, path) == -1) {
+        perror("Erreur lors de l'écriture de la clé du dépôt");
+        unlink(tmp_path);
+        OPENSSL_cleanse(keys, sizeof(keys));
+        return -1;
+    }
+    key->cipher = (int)header.cipher;
+    memcpy(key->enc_key, keys, CRYPTO_KEY_SIZE);
+    memcpy(key->mac_key, keys + CRYPTO_KEY_SIZE, CRYPTO_KEY_SIZE);
+    OPENSSL_cleanse(keys, sizeof(keys));
+    return 0;
+}
+
+/**
+ * @brief Fonction pour préparer les contextes de chiffrement d'une clé
+ *
+ * La préparation des clés (tables AES, clé HMAC) est faite une seule fois ;
+ * chaque chunk ne change ensuite que le nonce. Un contexte ne doit servir
+ * qu'à un thread à la fois.
+ *
+ * @param session les contextes en sortie
+ * @param key la clé du dépôt
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int crypto_session_init(crypto_session *session, const repo_key *key) {
+    OSSL_PARAM params[2];
+    params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0);
+    params[1] = OSSL_PARAM_construct_end();
+
+    memset(session, 0, sizeof(*session));
+    EVP_MAC *hmac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    session->mac = hmac ? EVP_MAC_CTX_new(hmac) : NULL;
+    EVP_MAC_free(hmac);
+    session->enc = EVP_CIPHER_CTX_new();
+    session->dec = EVP_CIPHER_CTX_new();
+    if (!session->mac || !session->enc || !session->dec
+        || EVP_MAC_init(session->mac, key->mac_key, CRYPTO_KEY_SIZE, params) != 1
+        || EVP_EncryptInit_ex(session->enc, evp_cipher(key->cipher), NULL, key->enc_key, NULL) != 1
+        || EVP_DecryptInit_ex(session->dec, evp_cipher(key->cipher), NULL, key->enc_key, NULL) != 1) {
+        fprintf(stderr, "Erreur lors de la préparation du chiffrement\n");
+        crypto_session_free(session);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure pour libérer les contextes de chiffrement
+ *
+ * @param session les contextes
+ */
+void crypto_session_free(crypto_session *session) {
+    EVP_MAC_CTX_free(session->mac);
+    EVP_CIPHER_CTX_free(session->enc);
+    EVP_CIPHER_CTX_free(session->dec);
+    memset(session, 0, sizeof(*session));
+}
+
+/**
+ * @brief Procédure pour calculer l'empreinte à clé d'un chunk
+ *
+ * HMAC-SHA256 tronqué à la taille d'une empreinte MD5 : l'index et les
+ * manifestes ne changent pas de format, et sans la clé l'empreinte ne
+ * permet plus de vérifier si le dépôt contient un contenu connu.
+ *
+ * @param session les contextes de chiffrement
+ * @param data les données du chunk
+ * @param len la taille du chunk
+ * @param id l'empreinte en sortie (MD5_DIGEST_LENGTH octets)
+ */
+void crypto_fingerprint(crypto_session *session, const void *data, size_t len, unsigned char *id) {
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    size_t mac_len = 0;
+    EVP_MAC_init(session->mac, NULL, 0, NULL);
+    EVP_MAC_update(session->mac, data, len);
+    EVP_MAC_final(session->mac, mac, &mac_len, sizeof(mac));
+    memcpy(id, mac, MD5_DIGEST_LENGTH);
+}
+
+/**
+ * @brief Fonction pour chiffrer un chunk
+ *
+ * Le nonce est tiré au hasard pour chaque chunk et écrit devant lui : sur
+ * 96 bits, une répétition n'est à craindre qu'après des milliards de chunks
+ * sous la même clé, et ne dépend pas des collisions des empreintes. Un même
+ * chunk n'est chiffré qu'une fois, la déduplication l'écartant ensuite.
+ * L'empreinte est authentifiée avec les données, si bien qu'un chunk ne
+ * peut pas être présenté sous l'identifiant d'un autre.
+ *
+ * @param session les contextes de chiffrement
+ * @param id l'empreinte à clé du chunk
+ * @param plain les données en clair
+ * @param len la taille des données
+ * @param out le nonce, les données chiffrées puis le code d'authentification
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int crypto_seal(crypto_session *session, const unsigned char *id, const void *plain, uint32_t len, unsigned char *out) {
+    int n = 0, fin = 0;
+    unsigned char *cipher = out + CRYPTO_NONCE_SIZE;
+    if (RAND_bytes(out, CRYPTO_NONCE_SIZE) != 1) {
+        fprintf(stderr, "Erreur : générateur aléatoire indisponible\n");
+        return -1;
+    }
+    if (EVP_EncryptInit_ex(session->enc, NULL, NULL, NULL, out) != 1
+        || EVP_EncryptUpdate(session->enc, NULL, &n, id, MD5_DIGEST_LENGTH) != 1
+        || (len > 0 && EVP_EncryptUpdate(session->enc, cipher, &n, plain, (int)len) != 1)
+        || EVP_EncryptFinal_ex(session->enc, cipher + n, &fin) != 1
+        || EVP_CIPHER_CTX_ctrl(session->enc, EVP_CTRL_AEAD_GET_TAG, CRYPTO_TAG_SIZE, cipher + len) != 1) {
+        fprintf(stderr, "Erreur lors du chiffrement d'un chunk\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour déchiffrer et authentifier un chunk
+ *
+ * @param session les contextes de chiffrement
+ * @param id l'empreinte à clé du chunk
+ * @param sealed le chunk tel qu'écrit par crypto_seal
+ * @param len la taille de sealed
+ * @param out les données en clair
+ * @return int la taille des données en clair, -1 si le chunk a été altéré
+ */
+int crypto_open(crypto_session *session, const unsigned char *id, const unsigned char *sealed, uint32_t len, void *out) {
+    int n = 0, fin = 0;
+    if (len < CRYPTO_SEAL_OVERHEAD) {
+        return -1;
+    }
+    const unsigned char *nonce = sealed;
+    sealed += CRYPTO_NONCE_SIZE;
+    uint32_t plain_len = len - CRYPTO_SEAL_OVERHEAD;
+    if (EVP_DecryptInit_ex(session->dec, NULL, NULL, NULL, nonce) != 1
+        || EVP_DecryptUpdate(session->dec, NULL, &n, id, MD5_DIGEST_LENGTH) != 1
+        || (plain_len > 0 && EVP_DecryptUpdate(session->dec, out, &n, sealed, (int)plain_len) != 1)
+        || EVP_CIPHER_CTX_ctrl(session->dec, EVP_CTRL_AEAD_SET_TAG, CRYPTO_TAG_SIZE, (void *)(sealed + plain_len)) != 1
+        || EVP_DecryptFinal_ex(session->dec, (unsigned char *)out + n, &fin) != 1) {
+        return -1;
+    }
+    return (int)plain_len;
+}
@@ -0,0 +1,72 @@
+#ifndef CRYPTO_H
+#define CRYPTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <openssl/evp.h>
+#include <openssl/md5.h>
+
+// Nom du fichier de clé dans le répertoire du dépôt de chunks
+#define CRYPTO_KEY_NAME "key"
+
+// Signature du fichier de clé
+#define CRYPTO_KEY_MAGIC "BORGKEY2"
+
+// Variable d'environnement donnant la phrase secrète du dépôt
+#define CRYPTO_PASSPHRASE_ENV "BORG_PASSPHRASE"
+
+// Nombre d'itérations de PBKDF2 pour dériver la clé de la phrase secrète
+#define CRYPTO_KDF_ITERATIONS 200000
+
+// Taille du code d'authentification ajouté à chaque chunk chiffré
+#define CRYPTO_TAG_SIZE 16
+
+// Taille du nonce (tiré au hasard et écrit devant chaque chunk chiffré)
+#define CRYPTO_NONCE_SIZE 12
+
+// Octets ajoutés à chaque chunk chiffré : nonce et code d'authentification
+#define CRYPTO_SEAL_OVERHEAD (CRYPTO_NONCE_SIZE + CRYPTO_TAG_SIZE)
+
+// Taille des clés de chiffrement et d'empreinte
+#define CRYPTO_KEY_SIZE 32
+
+// Algorithmes de chiffrement des chunks
+#define CRYPTO_NONE 0
+#define CRYPTO_AUTO 1              // choisi selon le processeur à la création du dépôt
+#define CRYPTO_AES_GCM 2           // AES-256-GCM (AES-NI, VAES)
+#define CRYPTO_CHACHA20_POLY1305 3 // ChaCha20-Poly1305 (processeurs sans AES matériel)
+
+// Clés d'un dépôt chiffré
+typedef struct {
+    int cipher;                              // CRYPTO_AES_GCM ou CRYPTO_CHACHA20_POLY1305
+    unsigned char enc_key[CRYPTO_KEY_SIZE];  // clé de chiffrement des chunks
+    unsigned char mac_key[CRYPTO_KEY_SIZE];  // clé des empreintes (HMAC-SHA256)
+} repo_key;
+
+// Contextes OpenSSL préparés pour une clé (un par thread)
+typedef struct {
+    EVP_CIPHER_CTX *enc;    // chiffrement, clé déjà installée
+    EVP_CIPHER_CTX *dec;    // déchiffrement, clé déjà installée
+    EVP_MAC_CTX *mac;       // HMAC-SHA256, clé déjà installée
+} crypto_session;
+
+// Fonction pour lire la clé d'un dépôt (1 si chargée, 0 si le dépôt n'est pas chiffré, -1 en cas d'erreur)
+int crypto_load_key(const char *store_dir, repo_key *key);
+// Fonction pour créer la clé d'un nouveau dépôt chiffré
+int crypto_create_key(const char *store_dir, int cipher, repo_key *key);
+// Fonction pour donner le nom de l'algorithme de chiffrement
+const char *crypto_cipher_name(int cipher);
+// Fonction pour convertir un nom d'algorithme (auto, aes-256-gcm, chacha20-poly1305) en constante
+int crypto_parse_cipher(const char *name);
+// Fonction pour préparer les contextes de chiffrement d'une clé
+int crypto_session_init(crypto_session *session, const repo_key *key);
+// Procédure pour libérer les contextes de chiffrement
+void crypto_session_free(crypto_session *session);
+// Procédure pour calculer l'empreinte à clé d'un chunk (tronquée à 16 octets)
+void crypto_fingerprint(crypto_session *session, const void *data, size_t len, unsigned char *id);
+// Fonction pour chiffrer un chunk (len + CRYPTO_SEAL_OVERHEAD octets en sortie)
+int crypto_seal(crypto_session *session, const unsigned char *id, const void *plain, uint32_t len, unsigned char *out);
+// Fonction pour déchiffrer et authentifier un chunk (donne la taille des données en clair, -1 si altéré)
+int crypto_open(crypto_session *session, const unsigned char *id, const unsigned char *sealed, uint32_t len, void *out);
+
+#endif // CRYPTO_H
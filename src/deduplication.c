@@ -30,7 +30,7 @@ unsigned int hash_md5(unsigned char *md5) {
 void compute_md5(void *data, size_t len, unsigned char *md5_out) {
     if (md5_out == NULL) {
         fprintf(stderr, "md5_out buffer is not allocated\n");
-        exit(EXIT_FAILURE);
+        return;
     }
     MD5(data, len, md5_out); // Fonction de la librairie openssl qui permet de calculer le MD5 d'un chunk
 }
@@ -64,10 +64,16 @@ int find_md5(Md5Entry **hash_table, unsigned char *md5) {
  * @param hash_table le tableau de hachage qui contient les MD5 et l'index des chunks unique
  * @param md5 le md5 du chunk à ajouter
  * @param index l'index du chunk
+ * @param pool l'arène dans laquelle allouer l'entrée
+ * @return int 0 en cas de succès, -1 si l'allocation échoue
  */
 
-void add_md5(Md5Entry **hash_table, unsigned char *md5, int index) {
-        Md5Entry *new_el = (Md5Entry *)malloc(sizeof(Md5Entry));
+int add_md5(Md5Entry **hash_table, unsigned char *md5, int index, arena *pool) {
+        Md5Entry *new_el = (Md5Entry *)arena_alloc(pool, sizeof(Md5Entry));
+        if (new_el == NULL) { //Gestion des erreurs
+            perror("Impossible d'allouer de la mémoire");
+            return -1;
+        }
         memcpy(new_el->md5, md5, MD5_DIGEST_LENGTH); // memcpy est une fonction qui copie un certain nombre de bytes d'un espace mémoire à un autre
         new_el->index = index;//Stockage de l'index du chunk dans le chunk
         new_el->next = NULL;
@@ -75,13 +81,14 @@ void add_md5(Md5Entry **hash_table, unsigned char *md5, int index) {
         Md5Entry *current = hash_table[index]; //Parcours de la liste chaînée à l'indice index       
         if (current == NULL){ // Si la liste est vide
             hash_table[index] = new_el; // On ajoute le chunk à la liste
-            return ; 
+            return 0;
         } else {
             while (current->next != NULL){ //Sinon on parcourt la liste jusqu'à la fin
                 current = current->next;
             }
             current->next = new_el; // On ajoute le chunk à la fin de la liste
         }
+        return 0;
 }
 
 /**
@@ -90,16 +97,21 @@ void add_md5(Md5Entry **hash_table, unsigned char *md5, int index) {
  * @param chunk La liste doublement chaînée de chunks
  * @param md5 la somme MD5 du chunk
  * @param tampon la donnée du chunk
- * @return Chunk_list 
+ * @param pool l'arène dans laquelle allouer le chunk et sa donnée
+ * @return Chunk_list la liste avec le nouveau chunk, NULL si l'allocation échoue
  */
-Chunk_list add_unique_chunk(Chunk_list chunk,unsigned char *md5, unsigned char *tampon){
-    Chunk *new_el = (Chunk *)malloc(sizeof(Chunk));
+Chunk_list add_unique_chunk(Chunk_list chunk,unsigned char *md5, unsigned char *tampon, arena *pool){
+    Chunk *new_el = (Chunk *)arena_alloc(pool, sizeof(Chunk));
+    if (new_el == NULL) { //Gestion des erreurs
+        perror("Impossible d'allouer de la mémoire");
+        return NULL;
+    }
     new_el->is_unique = 0;
     memcpy(new_el->md5, md5, MD5_DIGEST_LENGTH); // memcpy est une fonction qui copie un certain nombre de bytes d'un espace mémoire à un autre
-    new_el->data = malloc(CHUNK_SIZE);
+    new_el->data = arena_alloc(pool, CHUNK_SIZE);
     if (new_el->data == NULL) { //Gestion des erreurs
         perror("Impossible d'allouer de la mémoire");
-        exit(EXIT_FAILURE);
+        return NULL;
     }
     memcpy(new_el->data, tampon, CHUNK_SIZE); //Copie de la data du tampon dans l'attribut data du chunk
     new_el->next = NULL;
@@ -147,13 +159,22 @@ int find_index_Chunklist (Chunk_list chunk, unsigned char *md5){
  * @param chunk le tableau de chunks
  * @param md5 la somme MD5 du chunk
  * @param index l'index du chunk dans le tableau de chunks
- * @return Chunk_list le tableau de chunks mis à jour
+ * @param pool l'arène dans laquelle allouer le chunk et sa référence
+ * @return Chunk_list le tableau de chunks mis à jour, NULL si l'allocation échoue
  */
-Chunk_list add_seen_chunk(Chunk_list chunk, unsigned char *md5,int index){
-    Chunk *new_el = (Chunk *)malloc(sizeof(Chunk));
+Chunk_list add_seen_chunk(Chunk_list chunk, unsigned char *md5,int index, arena *pool){
+    Chunk *new_el = (Chunk *)arena_alloc(pool, sizeof(Chunk));
+    if (new_el == NULL) { //Gestion des erreurs
+        perror("Impossible d'allouer de la mémoire");
+        return NULL;
+    }
     memcpy(new_el->md5, md5, MD5_DIGEST_LENGTH); // memcpy est une fonction qui copie un certain nombre de bytes d'un espace mémoire à un autre
     new_el->is_unique = 1;
-    new_el->data = malloc(sizeof(int));
+    new_el->data = arena_alloc(pool, sizeof(int));
+    if (new_el->data == NULL) { //Gestion des erreurs
+        perror("Impossible d'allouer de la mémoire");
+        return NULL;
+    }
     memcpy(new_el->data, &index, sizeof(int)); //Copie de l'index du chunk auquel celui-ci fait référence dans l'attribut data du chunk
     new_el->next = NULL;
 
@@ -239,8 +260,10 @@ void see_chunk_list(Chunk_list chunk) {
  * @param file le fichier qui sera dédupliqué
  * @param chunks le tableau de chunks initialisés qui contiendra les chunks issu du fichier
  * @param hash_table le tableau de hachage qui contient les MD5 et l'index des chunks unique
+ * @param pool l'arène du fichier, qui possède les chunks et les entrées de la table
+ * @return int 0 en cas de succès, -1 si la mémoire manque
  */
-void deduplicate_file(FILE *file, Chunk_list *chunks, Md5Entry **hash_table) {
+int deduplicate_file(FILE *file, Chunk_list *chunks, Md5Entry **hash_table, arena *pool) {
     unsigned char tampon[CHUNK_SIZE];
     unsigned char hash[MD5_DIGEST_LENGTH];
     size_t bytes_lus;
@@ -251,16 +274,27 @@ void deduplicate_file(FILE *file, Chunk_list *chunks, Md5Entry **hash_table) {
         int index_h = find_md5(hash_table, hash);
         if (index_h == -1) { // Si la somme MD5 du chunk n'est pas déjà présente dans la table de hachage (Chunk unique)
             index_h = hash_md5(hash);
-            add_md5(hash_table, hash, index_h); // Ajout de la somme MD5 du chunk dans la table de hachage
-            *chunks = add_unique_chunk(*chunks, hash, tampon); // Ajout du chunk dans la liste de chunks
+            if (add_md5(hash_table, hash, index_h, pool) == -1) { // Ajout de la somme MD5 du chunk dans la table de hachage
+                return -1;
+            }
+            Chunk_list list = add_unique_chunk(*chunks, hash, tampon, pool); // Ajout du chunk dans la liste de chunks
+            if (list == NULL) {
+                return -1;
+            }
+            *chunks = list;
             nb_chunks++;
         } else { //(Chunk doublon)
             int index_c = find_index_Chunklist(*chunks, hash); // Recherche de l'index du chunk déjà présent dans la liste de chunks
-            *chunks = add_seen_chunk(*chunks, hash, index_c); // Ajout du chunk dans la liste de chunks
+            Chunk_list list = add_seen_chunk(*chunks, hash, index_c, pool); // Ajout du chunk dans la liste de chunks
+            if (list == NULL) {
+                return -1;
+            }
+            *chunks = list;
             nb_chunks++;
         }
     }
     printf("Nombre de chunks : %d\n", nb_chunks);
+    return 0;
 }
 
 /**
@@ -302,16 +336,17 @@ void find_data_in_chunklist(Chunk_list chunk, int index, void **data) {
  * 
  * @param file le nom du fichier dédupliqué
  * @param chunks représente le tableau de chunk qui contiendra les chunks restauré depuis filename
- * @param chunk_count est un compteur du nombre de chunk restauré depuis le fichier filename
+ * @param pool l'arène du fichier, qui possède les chunks restaurés
+ * @return int 0 en cas de succès, -1 si la mémoire manque
  */
 
-void undeduplicate_file(FILE *file, Chunk_list *chunks) {
+int undeduplicate_file(FILE *file, Chunk_list *chunks, arena *pool) {
     unsigned char hash[MD5_DIGEST_LENGTH];
     unsigned char tampon[CHUNK_SIZE];
     char *line = (char*)malloc(30 * sizeof(char)); // Allocation de la mémoire pour l'identificateur
     if (line == NULL) { //Gestion des erreurs
         fprintf(stderr, "Memory allocation failed for line\n");
-        return;
+        return -1;
     }
     size_t bytes_lus;
 
@@ -329,12 +364,22 @@ void undeduplicate_file(FILE *file, Chunk_list *chunks) {
                         continue;
                     }
                     compute_md5(data, CHUNK_SIZE, hash);//Calcul de la somme MD5 de la data
-                    *chunks = add_unique_chunk(*chunks, hash, data); //Ajout du chunk dans la liste de chunks
+                    Chunk_list list = add_unique_chunk(*chunks, hash, data, pool); //Ajout du chunk dans la liste de chunks
+                    if (list == NULL) {
+                        free(line);
+                        return -1;
+                    }
+                    *chunks = list;
                 } else { // Si le chunk est unique
                     bytes_lus = fread(tampon, 1, CHUNK_SIZE, file);
                     if (bytes_lus > 0) { 
                         compute_md5(tampon, bytes_lus, hash);//Calcul de la somme MD5 du chunk
-                        *chunks = add_unique_chunk(*chunks, hash, tampon); //Ajout du chunk dans la liste de chunks
+                        Chunk_list list = add_unique_chunk(*chunks, hash, tampon, pool); //Ajout du chunk dans la liste de chunks
+                        if (list == NULL) {
+                            free(line);
+                            return -1;
+                        }
+                        *chunks = list;
                     } else { //Gestion des erreurs
                         fprintf(stderr, "Failed to read chunk from file\n");
                     }
@@ -343,4 +388,5 @@ void undeduplicate_file(FILE *file, Chunk_list *chunks) {
         }
     }
     free(line);
+    return 0;
 }
\ No newline at end of file
@@ -7,10 +7,14 @@
 #include <stdint.h>
 #include <openssl/md5.h>
 #include <dirent.h>
+#include "arena.h"
 
 // Taille d'un chunk (4096 octets)
 #define CHUNK_SIZE 4096
 
+// Taille maximale d'un chunk, quelle que soit la politique de découpage (64 Ko)
+#define CHUNK_MAX_SIZE (64 * 1024)
+
 // Taille de la table de hachage qui contiendra les chunks
 // dont on a déjà calculé le MD5 pour effectuer les comparaisons
 #define HASH_TABLE_SIZE 1000
@@ -43,13 +47,13 @@ void compute_md5(void *data, size_t len, unsigned char *md5_out);
 // Fonction permettant de chercher un MD5 dans la table de hachage
 int find_md5(Md5Entry **hash_table, unsigned char *md5);
 // Fonction pour ajouter un MD5 dans la table de hachage
-void add_md5(Md5Entry **hash_table, unsigned char *md5,int index);
+int add_md5(Md5Entry **hash_table, unsigned char *md5,int index, arena *pool);
 // Fonction pour afficher la table de hachage
 void see_hash_table(Md5Entry **hash_table);
 // Fonction pour ajouter un chunk unique à la liste de chunks
-Chunk_list add_unique_chunk(Chunk_list chunk,unsigned char *md5, unsigned char *tampon);
+Chunk_list add_unique_chunk(Chunk_list chunk,unsigned char *md5, unsigned char *tampon, arena *pool);
 // Fonction pour ajouter un chunk déjà vu à la liste de chunks
-Chunk_list add_seen_chunk(Chunk_list chunk,unsigned char *md5,int index);
+Chunk_list add_seen_chunk(Chunk_list chunk,unsigned char *md5,int index, arena *pool);
 // Fonction pour afficher la liste de chunks
 void see_chunk_list(Chunk_list chunk);
 //Fonction pour lire un identificateur et retourner l'index
@@ -66,15 +70,18 @@ int extract_second_number(const char *identificator);
  * @param file le fichier qui sera dédupliqué
  * @param chunks le tableau de chunks initialisés qui contiendra les chunks issu du fichier
  * @param hash_table le tableau de hachage qui contient les MD5 et l'index des chunks unique
+ * @param pool l'arène du fichier, qui possède les chunks et les entrées de la table
+ * @return int 0 en cas de succès, -1 si la mémoire manque
  */
-void deduplicate_file(FILE *file, Chunk_list *chunks, Md5Entry **hash_table);
+int deduplicate_file(FILE *file, Chunk_list *chunks, Md5Entry **hash_table, arena *pool);
 
 /*
  * @brief Fonction permettant de charger un fichier dédupliqué en table de chunks en remplaçant les références par les données correspondantes
  * 
  * @param file le nom du fichier dédupliqué
  * @param chunks représente le tableau de chunk qui contiendra les chunks restauré depuis filename
- * @param chunk_count est un compteur du nombre de chunk restauré depuis le fichier filename*/
-void undeduplicate_file(FILE *file, Chunk_list *chunks);
+ * @param pool l'arène du fichier, qui possède les chunks restaurés
+ * @return int 0 en cas de succès, -1 si la mémoire manque */
+int undeduplicate_file(FILE *file, Chunk_list *chunks, arena *pool);
 
 #endif // DEDUPLICATION_H
\ No newline at end of file
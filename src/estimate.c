@@ -0,0 +1,378 @@
+#include "estimate.h"
+#include "deduplication.h"
+#include "file_handler.h"
+#include "manifest.h"
+#include "chunker.h"
+#include "files_cache.h"
+#include "throttle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Quantile de la loi normale pour un intervalle de confiance à 95 %
+#define CONFIDENCE_Z 1.96
+
+// Fichier de la source à estimer
+typedef struct {
+    char *path;
+    char *name;     // chemin dans la source, tel qu'écrit dans le manifeste
+    uint64_t size;
+} source_file;
+
+// Ensemble des empreintes déjà vues dans la source (adressage ouvert)
+typedef struct {
+    unsigned char (*slots)[MD5_DIGEST_LENGTH];
+    unsigned char *used;
+    size_t size;    // puissance de deux
+    size_t count;
+} md5_set;
+
+// Liste des fichiers de la source
+typedef struct {
+    source_file *files;
+    size_t nb_files;
+    size_t capacity;
+    uint64_t total;  // taille totale de la source
+} source_list;
+
+/**
+ * @brief Fonction relevant un fichier de la source sans le lire, appelée par manifest_walk
+ *
+ * @param ctx la liste des fichiers
+ * @param path le chemin du fichier
+ * @param entry l'entrée du manifeste, dont seul le chemin est relevé
+ * @return int 1 pour ne rien écrire dans le manifeste, -1 en cas d'erreur
+ */
+static int list_file(void *ctx, const char *path, manifest_entry *entry) {
+    source_list *list = ctx;
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        return 1;
+    }
+    if (list->nb_files == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        source_file *files = realloc(list->files, capacity * sizeof(source_file));
+        if (!files) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        list->files = files;
+        list->capacity = capacity;
+    }
+    list->files[list->nb_files].path = strdup(path);
+    list->files[list->nb_files].name = strdup(entry->path);
+    if (!list->files[list->nb_files].path || !list->files[list->nb_files].name) {
+        free(list->files[list->nb_files].path);
+        free(list->files[list->nb_files].name);
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    list->files[list->nb_files].size = (uint64_t)st.st_size;
+    list->nb_files++;
+    list->total += (uint64_t)st.st_size;
+    return 1;
+}
+
+/**
+ * @brief Fonction ajoutant une empreinte à l'ensemble si elle n'y est pas déjà
+ *
+ * @param set l'ensemble
+ * @param md5 l'empreinte
+ * @return int 1 si l'empreinte a été ajoutée, 0 si elle était présente, -1 en cas d'erreur
+ */
+static int md5_set_add(md5_set *set, const unsigned char *md5) {
+    if ((set->count + 1) * 2 > set->size) {
+        md5_set bigger = {NULL, NULL, set->size ? set->size * 2 : 65536, 0};
+        bigger.slots = malloc(bigger.size * MD5_DIGEST_LENGTH);
+        bigger.used = calloc(bigger.size, 1);
+        if (!bigger.slots || !bigger.used) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            free(bigger.slots);
+            free(bigger.used);
+            return -1;
+        }
+        for (size_t i = 0; i < set->size; i++) {
+            if (set->used[i]) {
+                md5_set_add(&bigger, set->slots[i]);
+            }
+        }
+        free(set->slots);
+        free(set->used);
+        *set = bigger;
+    }
+    uint64_t hash;
+    memcpy(&hash, md5, sizeof(hash));
+    size_t i = (size_t)hash & (set->size - 1);
+    while (set->used[i]) {
+        if (memcmp(set->slots[i], md5, MD5_DIGEST_LENGTH) == 0) {
+            return 0;
+        }
+        i = (i + 1) & (set->size - 1);
+    }
+    memcpy(set->slots[i], md5, MD5_DIGEST_LENGTH);
+    set->used[i] = 1;
+    set->count++;
+    return 1;
+}
+
+/**
+ * @brief Fonction donnant le tirage pseudo-aléatoire suivant (splitmix64)
+ *
+ * @param state l'état du générateur
+ * @return uint64_t le tirage
+ */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Fonction découpant une unité tirée comme la sauvegarde le ferait et comptant ses octets nouveaux
+ *
+ * Chaque chunk appartient à l'unité qui contient son premier octet. Des
+ * blocs fixes tombent d'eux-mêmes au début de l'unité ; un découpage selon
+ * le contenu reprend CHUNK_MAX_SIZE octets plus tôt, le temps que ses
+ * coupures rejoignent celles d'une lecture depuis le début du fichier.
+ *
+ * @param store le dépôt ouvert en lecture seule
+ * @param seen les empreintes déjà vues dans la source
+ * @param c le découpeur, dont la politique est celle du fichier
+ * @param limits le régulateur des lectures
+ * @param fd le fichier ouvert avec throttle_open
+ * @param start le début de l'unité
+ * @param end la fin de l'unité
+ * @param new_bytes les octets nouveaux de l'unité en sortie
+ * @param read_bytes les octets lus, complétés
+ * @return int 0 en cas de succès, 1 si le fichier est illisible, -1 en cas d'erreur
+ */
+static int sample_cluster(chunk_store *store, md5_set *seen, chunker *c, throttle *limits, int fd, uint64_t start,
+                          uint64_t end, double *new_bytes, uint64_t *read_bytes) {
+    const unsigned char *data;
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    int policy = c->policy;
+    uint64_t pos = start;
+    ssize_t len = 0;
+
+    if (policy == CHUNKER_CDC) {
+        pos = start > CHUNK_MAX_SIZE ? start - CHUNK_MAX_SIZE : 0;
+    }
+    *new_bytes = 0;
+    if (chunker_start(c, limits, fd, (off_t)pos) == -1) {
+        return 1;
+    }
+    c->policy = policy;
+    uint64_t first = pos;
+    while (pos < end && (len = chunker_next(c, limits, fd, &data)) > 0) {
+        if (pos >= start) {
+            store_fingerprint(store, data, (size_t)len, md5);
+            if (!store_contains(store, md5)) {
+                int added = md5_set_add(seen, md5);
+                if (added == -1) {
+                    return -1;
+                }
+                *new_bytes += added ? (double)len : 0;
+            }
+        }
+        pos += (uint64_t)len;
+    }
+    *read_bytes += pos - first;
+    return len < 0 ? 1 : 0;
+}
+
+/**
+ * @brief Fonction ramenant un nombre d'octets estimé dans [0, total]
+ *
+ * @param bytes le nombre d'octets estimé
+ * @param total la taille de la source
+ * @return double le nombre d'octets borné
+ */
+static double clamp_bytes(double bytes, double total) {
+    return bytes < 0 ? 0 : (bytes > total ? total : bytes);
+}
+
+/**
+ * @brief Procédure affichant une durée en heures, minutes et secondes
+ *
+ * @param label le libellé de la ligne
+ * @param seconds la durée
+ */
+static void print_duration(const char *label, double seconds) {
+    unsigned long long s = (unsigned long long)(seconds + 0.5);
+    printf("%s : %lluh%02llum%02llus\n", label, s / 3600, (s / 60) % 60, s % 60);
+}
+
+/**
+ * @brief Fonction pour estimer ce qu'ajouterait une sauvegarde, sans rien écrire
+ *
+ * La source est découpée en unités d'ESTIMATE_CLUSTER_CHUNKS * CHUNK_SIZE
+ * octets consécutifs d'un même fichier ; chaque unité est tirée
+ * indépendamment avec la probabilité p = sample_percent / 100, lue, et
+ * découpée avec la politique que la sauvegarde choisirait pour le fichier
+ * (chunker_choose, d'après son format et l'historique du cache des
+ * fichiers). Ses chunks sont cherchés dans l'index ouvert en lecture seule
+ * et parmi les chunks déjà vus. Les petits fichiers que la sauvegarde
+ * recopierait dans le manifeste n'ajoutent aucun chunk et ne sont pas lus. Les
+ * octets nouveaux sont estimés par la somme des unités tirées divisée par p
+ * (estimateur de Horvitz-Thompson), avec un intervalle de confiance à 95 %
+ * tiré de sa variance. Les doublons entre unités non tirées échappent à
+ * l'échantillon : l'estimation majore alors légèrement les octets nouveaux.
+ * Avec p = 1, tout est lu et l'estimation est exacte.
+ *
+ * @param source_dir le répertoire à sauvegarder
+ * @param backup_dir le répertoire de sauvegarde
+ * @param opts les réglages de l'estimation
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int estimate_backup(const char *source_dir, const char *backup_dir, const estimate_options *opts) {
+    source_list list = {NULL, 0, 0, 0};
+    md5_set seen = {NULL, NULL, 0, 0};
+    store_options store_opts = opts->store;
+    chunk_store store;
+    files_cache files;
+    chunker chunks;
+    throttle limits;
+    char source[PATH_MAX];
+    char key[PATH_MAX * 2];
+    struct timeval debut, fin;
+    double p = opts->sample_percent / 100;
+    uint64_t state = ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid();
+    uint64_t sampled = 0, read_bytes = 0, clusters = 0;
+    double sum_new = 0, sum_new_sq = 0;
+    int ret = -1;
+
+    if (p <= 0 || p > 1) {
+        p = 1;
+    }
+    if (realpath(source_dir, source) == NULL) {
+        snprintf(source, sizeof(source), "%s", source_dir);
+    }
+    // Les dossiers parcourus ne sont écrits nulle part
+    FILE *devnull = fopen("/dev/null", "w");
+    if (!devnull || chunker_init(&chunks) == -1) {
+        fprintf(stderr, "Erreur lors de la préparation de l'estimation\n");
+        if (devnull) {
+            fclose(devnull);
+        }
+        return -1;
+    }
+    if (throttle_init(&limits, NULL) == -1) {
+        chunker_free(&chunks);
+        fclose(devnull);
+        return -1;
+    }
+    if (manifest_walk(devnull, source_dir, "", opts->patterns, list_file, &list) == -1) {
+        goto fin;
+    }
+    store_opts.read_only = 1;
+    if (store_open(&store, backup_dir, &store_opts) == -1) {
+        goto fin;
+    }
+    if (files_cache_load(&files, store.dir, store.opts.populate) == -1) {
+        files_cache_free(&files);
+        store_close(&store);
+        goto fin;
+    }
+    // Même seuil que store_file, déjà ramené à 0 par store_open pour un dépôt chiffré
+    uint64_t inline_max = store.opts.inline_max < MANIFEST_INLINE_LIMIT ? store.opts.inline_max : MANIFEST_INLINE_LIMIT;
+
+    gettimeofday(&debut, NULL);
+    for (size_t f = 0; f < list.nb_files; f++) {
+        uint64_t cluster_size = (uint64_t)ESTIMATE_CLUSTER_CHUNKS * CHUNK_SIZE;
+        uint64_t size = list.files[f].size;
+        uint64_t nb_clusters = (size + cluster_size - 1) / cluster_size;
+        int fd = -1;
+        if (size <= inline_max) {
+            continue;
+        }
+        clusters += nb_clusters;
+        for (uint64_t c = 0; c < nb_clusters; c++) {
+            if (p < 1 && (double)(next_random(&state) >> 11) / 9007199254740992.0 >= p) {
+                continue;
+            }
+            // Politique du fichier, choisie au premier tirage comme store_file le ferait
+            if (fd == -1) {
+                chunk_history history = {CHUNKER_FIXED, -1, 0};
+                snprintf(key, sizeof(key), "%s/%s", source, list.files[f].name);
+                int previous = files_cache_history(&files, key, &history);
+                if ((fd = throttle_open(&limits, list.files[f].path)) == -1
+                    || chunker_start(&chunks, &limits, fd, 0) == -1) {
+                    perror(list.files[f].path);
+                    break;
+                }
+                chunker_choose(&chunks, list.files[f].name, size, previous ? &history : NULL);
+            }
+            uint64_t end = (c + 1) * cluster_size < size ? (c + 1) * cluster_size : size;
+            double new_bytes;
+            int lu = sample_cluster(&store, &seen, &chunks, &limits, fd, c * cluster_size, end, &new_bytes,
+                                    &read_bytes);
+            if (lu == -1) {
+                throttle_close(&limits, fd);
+                files_cache_free(&files);
+                store_close(&store);
+                goto fin;
+            }
+            if (lu == 1) {
+                perror(list.files[f].path);
+                break;
+            }
+            sampled++;
+            sum_new += new_bytes;
+            sum_new_sq += new_bytes * new_bytes;
+        }
+        if (fd != -1) {
+            throttle_close(&limits, fd);
+        }
+    }
+    gettimeofday(&fin, NULL);
+    files_cache_free(&files);
+    store_close(&store);
+
+    double elapsed = (double)(fin.tv_sec - debut.tv_sec) + (double)(fin.tv_usec - debut.tv_usec) / 1e6;
+    double total = (double)list.total;
+    double estimate = sum_new / p;
+    double margin = CONFIDENCE_Z * sqrt(sum_new_sq * (1 - p)) / p;
+    // La source ne peut rien ajouter de plus qu'elle-même : l'estimation et ses bornes sont
+    // ramenées dans [0, total] avant d'en tirer le ratio
+    double low = clamp_bytes(estimate - margin, total);
+    double high = clamp_bytes(estimate + margin, total);
+    estimate = clamp_bytes(estimate, total);
+    double speed = elapsed > 0 ? (double)read_bytes / elapsed : 0;
+
+    printf("Estimation de la sauvegarde de %s dans %s (aucune écriture)\n", source_dir, backup_dir);
+    printf("Source : %zu fichiers, %llu octets\n", list.nb_files, (unsigned long long)list.total);
+    printf("Échantillon : %llu unités sur %llu (%.3g%% visé), %llu octets lus en %.2f s\n",
+           (unsigned long long)sampled, (unsigned long long)clusters, p * 100, (unsigned long long)read_bytes,
+           elapsed);
+    printf("Octets ajoutés estimés : %.0f (intervalle de confiance à 95 %% : %.0f à %.0f)\n", estimate, low, high);
+    if (estimate > 0) {
+        printf("Ratio de déduplication estimé : %.2f (%.2f à %.2f)\n", total / estimate, total / high,
+               low > 0 ? total / low : INFINITY);
+    } else {
+        printf("Ratio de déduplication estimé : aucun chunk nouveau\n");
+    }
+    if (speed > 0) {
+        print_duration("Durée estimée de la sauvegarde", (double)list.total / speed);
+        printf("Débit de lecture et d'empreintes mesuré : %.1f Mo/s\n", speed / (1024 * 1024));
+    }
+    ret = 0;
+
+fin:
+    fclose(devnull);
+    throttle_free(&limits);
+    chunker_free(&chunks);
+    for (size_t f = 0; f < list.nb_files; f++) {
+        free(list.files[f].path);
+        free(list.files[f].name);
+    }
+    free(list.files);
+    free(seen.slots);
+    free(seen.used);
+    return ret;
+}
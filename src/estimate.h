@@ -0,0 +1,23 @@
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include "chunk_store.h"
+#include "pattern.h"
+
+// Nombre de chunks lus d'un seul tenant pour chaque unité tirée (1 Mo)
+#define ESTIMATE_CLUSTER_CHUNKS 256
+
+// Réglages d'une estimation de sauvegarde (--dry-run)
+typedef struct {
+    double sample_percent; // pourcentage des données relues (100 pour une simulation complète)
+    store_options store;   // réglages de l'index consulté
+    pattern_set *patterns; // filtre des entrées de la source (NULL pour tout garder)
+} estimate_options;
+
+// Réglages par défaut : simulation complète
+#define ESTIMATE_OPTIONS_DEFAULT {100, STORE_OPTIONS_DEFAULT, NULL}
+
+// Fonction pour estimer ce qu'ajouterait une sauvegarde, sans rien écrire
+int estimate_backup(const char *source_dir, const char *backup_dir, const estimate_options *opts);
+
+#endif // ESTIMATE_H
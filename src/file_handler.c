@@ -4,20 +4,21 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <errno.h>
 #include <dirent.h>
 #include "file_handler.h"
 
 #define BUFFER_SIZE 4096
 
-int verbose = 0;
-
 /**
  * @brief Affiche sur la sortie standard les fichiers, fichiers cachés et dossiers situés à l'endroit du chemin passé en paramètre. 
  * 
  * @param path : chemin absolu ou relatif vers un dossier impérativement
+ * @param count le nombre de fichiers trouvés en sortie
+ * @param verbose 1 pour afficher les fichiers trouvés
  */
-char **list_files(const char *path, int *count) {
+char **list_files(const char *path, int *count, int verbose) {
     struct dirent *dir;
     DIR *d = opendir(path);
 
@@ -75,8 +76,9 @@ char **list_files(const char *path, int *count) {
  * 
  * @param src chamin absolu ou relatif vers un FICHIER (source)
  * @param dest chamin absolu ou relatif vers un DOSSIER (destination) sans le dernier "/"
+ * @param verbose 1 pour afficher la copie effectuée
  */
-void copy_file(const char *src, const char *dest) {
+void copy_file(const char *src, const char *dest, int verbose) {
     int src_fd, dest_fd;
     ssize_t bytes_read, bytes_written;
     char buffer[BUFFER_SIZE];
@@ -142,11 +144,15 @@ void copy_file(const char *src, const char *dest) {
  * @brief Prend en paramètre un chemin absolu ou relatif vers le fichier .backup_log
  *          et retourne une liste doublement chainée avec ses données lues
  * 
+ * Les éléments et leurs chaînes sont alloués dans l'arène de la liste, à
+ * libérer avec free_backup_log.
+ *
  * @param logfile chemin absolu ou relatif vers le fichier .backup_log
  * @return log_t liste doublement chainée avec les données lues dans le fichier
  */
 log_t read_backup_log(FILE *file) {
     log_t logs = {NULL};
+    arena_init(&logs.pool, 0);
 
     if (!file) {
         perror("Erreur lors de l'ouverture du fichier de log");
@@ -156,34 +162,31 @@ log_t read_backup_log(FILE *file) {
     // Repositionner le pointeur de fichier au début
     rewind(file);
     char line[512];
+    char path[256], md5[256], date[256];
     while (fgets(line, sizeof(line), file)) {
-        log_element *elem = malloc(sizeof(log_element));
-        if (!elem) {
-            fprintf(stderr, "Erreur d'allocation mémoire\n");
-            return logs;
+        path[0] = md5[0] = date[0] = '\0';
+        sscanf(line, "%255[^;];%255[^;];%255s", path, md5, date);
+
+        // Chaque chaîne n'occupe que sa longueur dans l'arène
+        log_element *elem = arena_alloc(&logs.pool, sizeof(log_element));
+        if (elem) {
+            elem->path = arena_strdup(&logs.pool, path);
+            elem->md5 = arena_strdup(&logs.pool, md5);
+            elem->date = arena_strdup(&logs.pool, date);
         }
-
-        elem->path = malloc(256);
-        elem->date = malloc(256);
-        elem->md5 = malloc(256);
-        if (!elem->path || !elem->date || !elem->md5) {
+        if (!elem || !elem->path || !elem->md5 || !elem->date) {
             fprintf(stderr, "Erreur d'allocation mémoire\n");
-            free(elem->path);
-            free(elem->date);
-            free(elem->md5);
-            free(elem);
-            return logs;
+            break;
         }
-
-        sscanf(line, "%255[^;];%255[^;];%255s", elem->path, elem->md5, elem->date);
+        elem->prev = NULL;
         elem->next = logs.head;
+        if (logs.head) {
+            logs.head->prev = elem;
+        } else {
+            logs.tail = elem;
+        }
         logs.head = elem;
     }
-    log_element *elem = logs.head;
-    while (elem->next != NULL) {
-        elem = elem->next;
-    }
-    logs.tail = elem;
     return logs;
 }
  
@@ -194,47 +197,50 @@ log_t read_backup_log(FILE *file) {
  * @param new_line la nouvelle ligne à insérer dans la structure logs au 
  *          format /chemin/vers/le/fichier,somme_md5,date
  * @param logs la structure chainée des logs initialisée avec read_backup_log
+ * @param verbose 1 pour afficher l'élément ajouté ou mis à jour
  */
-void update_backup_log(const char *new_line, log_t *logs) {
+void update_backup_log(const char *new_line, log_t *logs, int verbose) {
     if (!new_line || !logs) {
         fprintf(stderr, "Paramètres invalides pour update_backup_log\n");
         return;
     }
 
-    char *new_path = strdup(strtok((char *)new_line, ";"));  // Chemin
-    char *new_md5 = strdup(strtok(NULL, ";"));               // Somme md5
-    char *new_date = strdup(strtok(NULL, "\n"));             // Date
+    // Découpage d'une copie : la ligne reçue n'est pas modifiée
+    char line[1024];
+    char *reste;
+    snprintf(line, sizeof(line), "%s", new_line);
+    char *path = strtok_r(line, ";", &reste);  // Chemin
+    char *md5 = strtok_r(NULL, ";", &reste);   // Somme md5
+    char *date = strtok_r(NULL, "\n", &reste); // Date
 
-    if (!new_path || !new_md5 || !new_date) {
+    if (!path || !md5 || !date) {
         fprintf(stderr, "Erreur en découpant la nouvelle ligne\n");
-        free(new_path);
-        free(new_md5);
-        free(new_date);
+        return;
+    }
+    char *new_md5 = arena_strdup(&logs->pool, md5);
+    char *new_date = arena_strdup(&logs->pool, date);
+    if (!new_md5 || !new_date) {
+        perror("Erreur d'allocation mémoire");
         return;
     }
 
     log_element *current = logs->head;
     while (current) {
-        if (strcmp(current->path, new_path) == 0) {
+        if (strcmp(current->path, path) == 0) {
             // Mise à jour de l'entrée existante, pas besoin de créer une nouvelle ligne
-            free(current->md5);
-            free(current->date);
+            // (les anciennes chaînes restent dans l'arène jusqu'à free_backup_log)
             current->md5 = new_md5;
             current->date = new_date;
-
-            free(new_path); // `new_path` n'est pas utilisé dans ce cas
             return;
         }
         current = current->next;
     }
 
     // Si le chemin n'existe pas encore, ajouter un nouvel élément
-    log_element *new_elt = malloc(sizeof(log_element));
-    if (!new_elt) {
+    log_element *new_elt = arena_alloc(&logs->pool, sizeof(log_element));
+    char *new_path = arena_strdup(&logs->pool, path);
+    if (!new_elt || !new_path) {
         perror("Erreur d'allocation mémoire");
-        free(new_path);
-        free(new_md5);
-        free(new_date);
         return;
     }
 
@@ -263,8 +269,9 @@ void update_backup_log(const char *new_line, log_t *logs) {
  * 
  * @param elt un élément log_element à écrire sur une ligne
  * @param logfile le chemin du fichier .backup_log
+ * @param verbose 1 pour afficher l'élément écrit
  */
-void write_log_element(log_element *elt, FILE *logfile) {
+void write_log_element(log_element *elt, FILE *logfile, int verbose) {
     if (!elt || !logfile) {
         fprintf(stderr, "Paramètres invalides pour write_log_element\n");
         return;
@@ -279,3 +286,168 @@ void write_log_element(log_element *elt, FILE *logfile) {
         printf("Écriture de l'élément dans le fichier log : Chemin = %s, MD5 = %s, Date = %s\n", elt->path, elt->md5, elt->date);
     }
 }
+
+/**
+ * @brief Procédure libérant d'un coup tous les éléments d'une liste de log
+ *
+ * @param logs la liste initialisée avec read_backup_log
+ */
+void free_backup_log(log_t *logs) {
+    arena_free(&logs->pool);
+    logs->head = NULL;
+    logs->tail = NULL;
+}
+
+/**
+ * @brief Fonction lisant jusqu'à len octets, en enchaînant les lectures partielles
+ *
+ * @param fd le fichier
+ * @param buffer le tampon de sortie
+ * @param len la taille voulue
+ * @return ssize_t le nombre d'octets lus (inférieur à len en fin de fichier), -1 en cas d'erreur
+ */
+ssize_t read_full(int fd, void *buffer, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = read(fd, (char *)buffer + total, len - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += (size_t)n;
+    }
+    return (ssize_t)total;
+}
+
+/**
+ * @brief Fonction écrivant len octets, en enchaînant les écritures partielles
+ *
+ * @param fd le fichier
+ * @param buffer les données
+ * @param len la taille à écrire
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int write_full(int fd, const void *buffer, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = write(fd, (const char *)buffer + total, len - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        total += (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction synchronisant un fichier sur disque avant de le fermer
+ *
+ * À appeler avant de renommer un fichier temporaire à sa place définitive :
+ * sans cela, un arrêt brutal peut laisser un fichier renommé mais vide.
+ *
+ * @param file le fichier ouvert en écriture (fermé dans tous les cas)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int close_synced(FILE *file) {
+    int ret = (fflush(file) == 0 && fdatasync(fileno(file)) == 0) ? 0 : -1;
+    if (fclose(file) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Fonction synchronisant un répertoire
+ *
+ * Un renommage n'est durable qu'une fois le répertoire qui le contient
+ * synchronisé.
+ *
+ * @param path le chemin du répertoire
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int sync_dir(const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+        return -1;
+    }
+    int ret = fsync(fd);
+    close(fd);
+    return ret;
+}
+
+/**
+ * @brief Fonction projetant un fichier en mémoire, pour utiliser son contenu sur place
+ *
+ * Une projection partagée est en lecture seule et suit le cache de pages :
+ * rien n'est lu avant le premier accès. Une projection privée peut être
+ * modifiée sans que le fichier change. Avec populate, toutes les pages
+ * sont chargées d'un coup (MAP_POPULATE) : l'ouverture lit le fichier,
+ * mais les premières recherches ne paient plus de défauts de page.
+ *
+ * @param fd le fichier ouvert en lecture
+ * @param size la taille à projeter (non nulle)
+ * @param populate 1 pour charger toutes les pages dès la projection
+ * @param private_copy 1 pour une projection privée modifiable, 0 pour une projection en lecture seule
+ * @return void* l'adresse de la projection, NULL en cas d'erreur
+ */
+void *map_file(int fd, size_t size, int populate, int private_copy) {
+    int prot = private_copy ? PROT_READ | PROT_WRITE : PROT_READ;
+    int flags = (private_copy ? MAP_PRIVATE : MAP_SHARED) | (populate ? MAP_POPULATE : 0);
+    void *map = mmap(NULL, size, prot, flags, fd, 0);
+    return (map == MAP_FAILED) ? NULL : map;
+}
+
+/**
+ * @brief Fonction de mélange (finaliseur de splitmix64)
+ *
+ * @param x la valeur à mélanger
+ * @return uint64_t la valeur mélangée
+ */
+static uint64_t checksum_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Fonction calculant une somme de contrôle sur 64 bits
+ *
+ * Les données sont consommées par mots de 64 bits, multipliés et mélangés :
+ * bien plus rapide qu'un CRC calculé octet par octet, pour détecter une
+ * corruption accidentelle (pas une modification malveillante). La somme
+ * d'un morceau peut servir de graine au suivant, pour couvrir des zones
+ * disjointes.
+ *
+ * @param data les données
+ * @param len le nombre d'octets
+ * @param seed la graine (0, ou la somme des données précédentes)
+ * @return uint64_t la somme de contrôle
+ */
+uint64_t checksum64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = data;
+    uint64_t h = seed ^ (len * 0x9E3779B97F4A7C15ULL);
+    uint64_t word;
+    while (len >= 8) {
+        memcpy(&word, p, 8);
+        h = (h ^ checksum_mix(word)) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+        p += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        word = 0;
+        memcpy(&word, p, len);
+        h = (h ^ checksum_mix(word ^ 0xFF)) * 0x9E3779B97F4A7C15ULL;
+    }
+    return checksum_mix(h);
+}
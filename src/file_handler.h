@@ -2,10 +2,13 @@
 #define FILE_HANDLER_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <openssl/md5.h>
+#include "arena.h"
 
 // Structure pour une ligne du fichier log
 typedef struct log_element {
@@ -20,12 +23,27 @@ typedef struct log_element {
 typedef struct {
     log_element *head; // Début de la liste de log 
     log_element *tail; // Fin de la liste de log
+    arena pool; // Arène possédant les éléments et leurs chaînes
 } log_t;
 
-char **list_files(const char *path, int *count);
-void copy_file(const char *src, const char *dest);
+char **list_files(const char *path, int *count, int verbose);
+void copy_file(const char *src, const char *dest, int verbose);
 log_t read_backup_log(FILE *file);
-void update_backup_log(const char *logfile, log_t *logs);
-void write_log_element(log_element *elt, FILE *logfile);
+void update_backup_log(const char *logfile, log_t *logs, int verbose);
+void write_log_element(log_element *elt, FILE *logfile, int verbose);
+// Procédure libérant d'un coup tous les éléments d'une liste de log
+void free_backup_log(log_t *logs);
+// Fonction lisant jusqu'à len octets, en enchaînant les lectures partielles
+ssize_t read_full(int fd, void *buffer, size_t len);
+// Fonction écrivant len octets, en enchaînant les écritures partielles
+int write_full(int fd, const void *buffer, size_t len);
+// Fonction synchronisant un fichier sur disque avant de le fermer
+int close_synced(FILE *file);
+// Fonction synchronisant un répertoire, pour rendre durables les créations et renommages qu'il contient
+int sync_dir(const char *path);
+// Fonction projetant un fichier en mémoire (lecture seule partagée ou copie privée, MAP_POPULATE si populate)
+void *map_file(int fd, size_t size, int populate, int private_copy);
+// Fonction calculant une somme de contrôle sur 64 bits, enchaînable par sa graine
+uint64_t checksum64(const void *data, size_t len, uint64_t seed);
 
 #endif // FILE_HANDLER_H
@@ -0,0 +1,847 @@
+#include "files_cache.h"
+#include "file_handler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * Format du cache des fichiers :
+ *   <en-tête files_cache_header>
+ *   <tas : pour chaque fichier, son chemin puis ses empreintes et ses tailles
+ *    de chunks (ou son contenu), chaque zone complétée à un multiple de 8 octets>
+ *   <un enregistrement files_cache_record de taille fixe par fichier>
+ *   <table d'adressage ouvert des chemins vers les enregistrements>
+ * Le fichier est projeté en mémoire et consulté sur place : l'ouverture ne
+ * vérifie que l'en-tête, un enregistrement est vérifié quand il est consulté.
+ *
+ * Les caches antérieurs, au format texte, sont encore relus : pour chaque
+ * fichier, une ligne
+ *   I;<inode>;<mtime en ns>;<âge>;<politique de découpage>;<rendement en %>;<sauvegardes depuis sa mesure>
+ * suivie de son entrée au format du manifeste (ligne F, avec le chemin
+ * absolu, puis une ligne C par chunk ou une ligne B).
+ */
+
+// Arrondi d'une taille au multiple de 8 supérieur
+#define PAD8(n) (((n) + 7) & ~(uint64_t)7)
+
+/**
+ * @brief Fonction de hachage d'un chemin (FNV-1a)
+ *
+ * @param path le chemin
+ * @param size la taille de la table, puissance de deux
+ * @return size_t l'indice de la case
+ */
+static size_t path_hash(const char *path, size_t size) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return (size_t)(h & (size - 1));
+}
+
+/**
+ * @brief Fonction donnant la date de modification d'un fichier en nanosecondes
+ *
+ * @param st les informations du fichier
+ * @return int64_t la date en nanosecondes
+ */
+static int64_t mtime_ns(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Fonction doublant la table de hachage quand elle est trop chargée
+ *
+ * @param cache le cache
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int cache_grow(files_cache *cache) {
+    size_t size = cache->table_size * 2;
+    files_cache_entry **table = calloc(size, sizeof(files_cache_entry *));
+    if (!table) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    for (size_t i = 0; i < cache->table_size; i++) {
+        files_cache_entry *e = cache->table[i];
+        while (e) {
+            files_cache_entry *next = e->next;
+            size_t h = path_hash(e->path, size);
+            e->next = table[h];
+            table[h] = e;
+            e = next;
+        }
+    }
+    free(cache->table);
+    cache->table = table;
+    cache->table_size = size;
+    return 0;
+}
+
+/**
+ * @brief Fonction donnant la taille de la recette d'un fichier dans le tas
+ *
+ * @param e l'entrée du fichier
+ * @return uint64_t la taille du contenu d'un petit fichier, ou des empreintes et des tailles de ses chunks
+ */
+static uint64_t recipe_size(const files_cache_entry *e) {
+    return e->data ? e->size : (uint64_t)e->nb_chunks * (MD5_DIGEST_LENGTH + sizeof(uint32_t));
+}
+
+/**
+ * @brief Fonction calculant la somme de contrôle d'un enregistrement
+ *
+ * @param rec l'enregistrement (sa somme n'est pas prise en compte)
+ * @param e le fichier, dont le chemin et la recette sont couverts par la somme
+ * @return uint64_t la somme de contrôle
+ */
+static uint64_t record_checksum(const files_cache_record *rec, const files_cache_entry *e) {
+    uint64_t sum = checksum64(rec, offsetof(files_cache_record, checksum), 0);
+    sum = checksum64(e->path, (size_t)rec->path_len + 1, sum);
+    if (e->data) {
+        return checksum64(e->data, (size_t)e->size, sum);
+    }
+    sum = checksum64(e->md5, e->nb_chunks * MD5_DIGEST_LENGTH, sum);
+    return checksum64(e->len, e->nb_chunks * sizeof(uint32_t), sum);
+}
+
+/**
+ * @brief Procédure présentant un enregistrement du cache projeté comme une entrée
+ *
+ * Le chemin et la recette ne sont pas recopiés : l'entrée pointe dans la projection.
+ *
+ * @param cache le cache
+ * @param rec l'enregistrement
+ * @param e l'entrée en sortie
+ */
+static void record_view(const files_cache *cache, const files_cache_record *rec, files_cache_entry *e) {
+    memset(e, 0, sizeof(*e));
+    e->path = (char *)(cache->map + rec->path);
+    e->ino = (ino_t)rec->ino;
+    e->mtime_ns = rec->mtime_ns;
+    e->size = rec->size;
+    e->age = rec->age;
+    if (rec->inlined) {
+        e->data = (unsigned char *)(cache->map + rec->recipe);
+    } else {
+        e->nb_chunks = rec->nb_chunks;
+        e->md5 = (unsigned char (*)[MD5_DIGEST_LENGTH])(cache->map + rec->recipe);
+        e->len = (uint32_t *)(cache->map + rec->recipe + (uint64_t)rec->nb_chunks * MD5_DIGEST_LENGTH);
+    }
+    memcpy(e->digest, rec->digest, sizeof(e->digest));
+    e->history.policy = rec->policy;
+    e->history.yield = (int8_t)(rec->yield < 0 || rec->yield > 100 ? -1 : rec->yield);
+    e->history.runs = rec->runs;
+}
+
+/**
+ * @brief Fonction vérifiant qu'un enregistrement reste dans le fichier projeté
+ *
+ * @param cache le cache
+ * @param rec l'enregistrement
+ * @return int 1 si son chemin et sa recette sont dans la projection, 0 sinon
+ */
+static int record_in_bounds(const files_cache *cache, const files_cache_record *rec) {
+    uint64_t size = cache->map_size;
+    uint64_t recipe = rec->inlined ? rec->size : (uint64_t)rec->nb_chunks * (MD5_DIGEST_LENGTH + sizeof(uint32_t));
+    return rec->path < size && rec->path_len < size - rec->path && cache->map[rec->path + rec->path_len] == '\0'
+           && rec->recipe % 8 == 0 && rec->recipe <= size && recipe <= size - rec->recipe
+           && rec->policy < CHUNKER_POLICIES;
+}
+
+/**
+ * @brief Fonction vérifiant un enregistrement du cache projeté
+ *
+ * @param cache le cache
+ * @param rec l'enregistrement
+ * @param e l'entrée correspondante en sortie
+ * @return int 1 si l'enregistrement est intact, 0 sinon
+ */
+static int record_valid(const files_cache *cache, const files_cache_record *rec, files_cache_entry *e) {
+    if (!record_in_bounds(cache, rec)) {
+        return 0;
+    }
+    record_view(cache, rec, e);
+    return rec->checksum == record_checksum(rec, e);
+}
+
+/**
+ * @brief Fonction cherchant un chemin dans le cache projeté
+ *
+ * La table est parcourue par sondage linéaire ; une case qui désigne un
+ * enregistrement hors du fichier est ignorée.
+ *
+ * @param cache le cache
+ * @param path le chemin absolu du fichier
+ * @return const files_cache_record* l'enregistrement du chemin, NULL s'il est absent
+ */
+static const files_cache_record *base_find(const files_cache *cache, const char *path) {
+    if (!cache->map) {
+        return NULL;
+    }
+    const files_cache_header *header = cache->header;
+    const uint32_t *table = (const uint32_t *)(cache->map + header->table);
+    const files_cache_record *records = (const files_cache_record *)(cache->map + header->records);
+    size_t h = path_hash(path, header->slots);
+    for (uint64_t probe = 0; probe < header->slots && table[h] != 0; probe++, h = (h + 1) & (header->slots - 1)) {
+        uint64_t i = table[h] - 1;
+        if (i < header->count && record_in_bounds(cache, &records[i])
+            && strcmp((const char *)cache->map + records[i].path, path) == 0) {
+            return &records[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Fonction cherchant un chemin parmi les entrées en mémoire
+ *
+ * @param cache le cache
+ * @param path le chemin absolu du fichier
+ * @return files_cache_entry* l'entrée, NULL si le chemin n'a pas été consulté
+ */
+static files_cache_entry *cache_find(const files_cache *cache, const char *path) {
+    for (files_cache_entry *e = cache->table[path_hash(path, cache->table_size)]; e; e = e->next) {
+        if (strcmp(e->path, path) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Fonction ajoutant une entrée en mémoire pour un chemin
+ *
+ * @param cache le cache
+ * @param path le chemin absolu du fichier
+ * @return files_cache_entry* l'entrée vide, NULL en cas d'erreur d'allocation
+ */
+static files_cache_entry *cache_new(files_cache *cache, const char *path) {
+    if (cache->count >= cache->table_size) {
+        cache_grow(cache);
+    }
+    size_t h = path_hash(path, cache->table_size);
+    files_cache_entry *e = arena_alloc(&cache->pool, sizeof(files_cache_entry));
+    if (!e || !(e->path = arena_strdup(&cache->pool, path))) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return NULL;
+    }
+    e->nb_chunks = 0;
+    e->md5 = NULL;
+    e->len = NULL;
+    e->data = NULL;
+    memset(e->digest, 0, sizeof(e->digest));
+    e->history.policy = CHUNKER_FIXED;
+    e->history.yield = -1;
+    e->history.runs = 0;
+    e->age = 0;
+    e->seen = 0;
+    e->next = cache->table[h];
+    cache->table[h] = e;
+    cache->count++;
+    return e;
+}
+
+/**
+ * @brief Fonction donnant l'entrée d'un chemin consulté par la sauvegarde
+ *
+ * Un chemin présent dans le cache projeté reçoit une entrée en mémoire qui
+ * pointe sur sa recette enregistrée, sans la recopier.
+ *
+ * @param cache le cache
+ * @param path le chemin absolu du fichier
+ * @return files_cache_entry* l'entrée, NULL si le chemin est inconnu ou son enregistrement corrompu
+ */
+static files_cache_entry *cache_get(files_cache *cache, const char *path) {
+    files_cache_entry *e = cache_find(cache, path);
+    const files_cache_record *rec = e ? NULL : base_find(cache, path);
+    files_cache_entry view;
+    if (!rec) {
+        return e;
+    }
+    if (!record_valid(cache, rec, &view)) {
+        fprintf(stderr, "Attention : entrée corrompue dans le cache des fichiers, %s sera relu\n", path);
+        return NULL;
+    }
+    e = cache_new(cache, path);
+    if (e) {
+        files_cache_entry *next = e->next;
+        char *copy = e->path;
+        *e = view;
+        e->path = copy;
+        e->next = next;
+    }
+    return e;
+}
+
+/**
+ * @brief Fonction donnant l'entrée d'un chemin, créée vide si besoin
+ *
+ * @param cache le cache
+ * @param path le chemin absolu du fichier
+ * @return files_cache_entry* l'entrée, NULL en cas d'erreur d'allocation
+ */
+static files_cache_entry *cache_insert(files_cache *cache, const char *path) {
+    files_cache_entry *e = cache_get(cache, path);
+    return e ? e : cache_new(cache, path);
+}
+
+/**
+ * @brief Fonction copiant une recette dans l'arène du cache
+ *
+ * Une recette identique à celle déjà enregistrée n'est pas recopiée. Le
+ * contenu d'un petit fichier stocké dans le manifeste tient lieu de recette.
+ *
+ * @param cache le cache
+ * @param e l'entrée du fichier
+ * @param entry l'entrée du manifeste portant la recette
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int cache_set_recipe(files_cache *cache, files_cache_entry *e, const manifest_entry *entry) {
+    if (entry->data) {
+        if (!e->data || e->size != entry->size || memcmp(e->data, entry->data, (size_t)entry->size) != 0) {
+            unsigned char *data = arena_alloc(&cache->pool, entry->size ? (size_t)entry->size : 1);
+            if (!data) {
+                fprintf(stderr, "Erreur d'allocation mémoire\n");
+                return -1;
+            }
+            memcpy(data, entry->data, (size_t)entry->size);
+            e->data = data;
+        }
+        e->nb_chunks = 0;
+        return 0;
+    }
+    e->data = NULL;
+    if (e->nb_chunks == entry->nb_chunks && e->md5
+        && memcmp(e->md5, entry->md5, entry->nb_chunks * MD5_DIGEST_LENGTH) == 0
+        && memcmp(e->len, entry->len, entry->nb_chunks * sizeof(uint32_t)) == 0) {
+        return 0;
+    }
+    size_t n = entry->nb_chunks ? entry->nb_chunks : 1;
+    void *md5 = arena_alloc(&cache->pool, n * MD5_DIGEST_LENGTH);
+    uint32_t *len = arena_alloc(&cache->pool, n * sizeof(uint32_t));
+    if (!md5 || !len) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    memcpy(md5, entry->md5, entry->nb_chunks * MD5_DIGEST_LENGTH);
+    memcpy(len, entry->len, entry->nb_chunks * sizeof(uint32_t));
+    e->md5 = md5;
+    e->len = len;
+    e->nb_chunks = entry->nb_chunks;
+    return 0;
+}
+
+/**
+ * @brief Fonction relisant un cache au format texte, antérieur à sa projection en mémoire
+ *
+ * @param cache le cache vide
+ * @param file le fichier du cache, ouvert au début
+ * @return int 0 en cas de succès, -1 en cas d'erreur d'allocation
+ */
+static int load_text(files_cache *cache, FILE *file) {
+    char line[128];
+    manifest_entry entry;
+    manifest_entry_init(&entry);
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), file)) {
+        unsigned long long ino;
+        long long mtime;
+        unsigned int age, policy = CHUNKER_FIXED, runs = 0;
+        int yield = -1;
+        uint64_t total = 0;
+        // Un cache antérieur aux politiques de découpage n'a que des blocs fixes
+        int champs = sscanf(line, "I;%llu;%lld;%u;%u;%d;%u", &ino, &mtime, &age, &policy, &yield, &runs);
+        int lu = (champs == 3 || (champs == 6 && policy < CHUNKER_POLICIES)) ? manifest_read_entry(file, &entry) : -1;
+        for (size_t i = 0; lu == 1 && i < entry.nb_chunks; i++) {
+            total += entry.len[i];
+        }
+        // Une recette qui ne couvre pas toute la taille (cache tronqué) ferait restaurer un fichier faux
+        if (lu != 1 || entry.type != 'F' || (!entry.data && total != entry.size)) {
+            fprintf(stderr, "Attention : cache des fichiers invalide, tous les fichiers seront relus\n");
+            memset(cache->table, 0, cache->table_size * sizeof(files_cache_entry *));
+            cache->count = 0;
+            arena_reset(&cache->pool);
+            break;
+        }
+        files_cache_entry *e = cache_insert(cache, entry.path);
+        if (!e || cache_set_recipe(cache, e, &entry) == -1) {
+            ret = -1;
+            break;
+        }
+        e->ino = (ino_t)ino;
+        e->mtime_ns = (int64_t)mtime;
+        e->size = entry.size;
+        e->age = age;
+        e->history.policy = (uint8_t)policy;
+        e->history.yield = (int8_t)(yield < 0 || yield > 100 ? -1 : yield);
+        e->history.runs = (uint8_t)runs;
+    }
+    manifest_entry_free(&entry);
+    return ret;
+}
+
+/**
+ * @brief Fonction vérifiant l'en-tête d'un cache projeté
+ *
+ * @param header l'en-tête
+ * @param size la taille du fichier
+ * @return int 1 si l'en-tête est intact et ses zones dans le fichier, 0 sinon
+ */
+static int header_valid(const files_cache_header *header, uint64_t size) {
+    return memcmp(header->magic, FILES_CACHE_MAGIC, sizeof(header->magic)) == 0
+           && header->checksum == checksum64(header, offsetof(files_cache_header, checksum), 0)
+           && header->size == size && header->slots > header->count && (header->slots & (header->slots - 1)) == 0
+           && header->count < UINT32_MAX && header->heap == sizeof(files_cache_header)
+           && header->records % 8 == 0 && header->records >= header->heap
+           && header->records + header->count * sizeof(files_cache_record) == header->table
+           && header->table + header->slots * sizeof(uint32_t) == size;
+}
+
+/**
+ * @brief Fonction pour projeter en mémoire le cache des fichiers d'un dépôt
+ *
+ * Le cache n'est ni lu ni converti : l'ouverture ne coûte qu'une
+ * projection et la vérification de l'en-tête, quel que soit le nombre de
+ * fichiers. Il n'est qu'une accélération : s'il est absent ou illisible,
+ * la sauvegarde part d'un cache vide et relit tous les fichiers.
+ *
+ * @param cache le cache en sortie
+ * @param store_dir le répertoire du dépôt de chunks
+ * @param populate 1 pour charger tout le cache dès l'ouverture
+ * @return int 0 en cas de succès, -1 en cas d'erreur d'allocation
+ */
+int files_cache_load(files_cache *cache, const char *store_dir, int populate) {
+    memset(cache, 0, sizeof(*cache));
+    snprintf(cache->path, sizeof(cache->path), "%s/%s", store_dir, FILES_CACHE_NAME);
+    arena_init(&cache->pool, 0);
+    cache->table_size = FILES_CACHE_TABLE_SIZE;
+    cache->table = calloc(cache->table_size, sizeof(files_cache_entry *));
+    if (!cache->table) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+
+    int fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        if (errno != ENOENT) {
+            perror("Attention : cache des fichiers illisible");
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+        return 0;
+    }
+    if ((size_t)st.st_size >= sizeof(files_cache_header)
+        && (cache->map = map_file(fd, (size_t)st.st_size, populate, 0)) != NULL) {
+        cache->map_size = (size_t)st.st_size;
+        cache->header = (const files_cache_header *)cache->map;
+        if (header_valid(cache->header, cache->map_size)) {
+            close(fd);
+            return 0;
+        }
+        int previous = memcmp(cache->header->magic, FILES_CACHE_MAGIC_V2, sizeof(cache->header->magic)) == 0;
+        munmap((void *)cache->map, cache->map_size);
+        cache->map = NULL;
+        cache->map_size = 0;
+        cache->header = NULL;
+        if (previous) {
+            fprintf(stderr, "Cache des fichiers sans empreinte de leur contenu : tous les fichiers seront relus une fois\n");
+            close(fd);
+            return 0;
+        }
+    }
+
+    // Cache au format texte d'une version précédente
+    FILE *file = fdopen(fd, "r");
+    if (!file) {
+        close(fd);
+        return 0;
+    }
+    int c = fgetc(file);
+    int ret = 0;
+    if (c == 'I') {
+        rewind(file);
+        ret = load_text(cache, file);
+    } else if (c != EOF) {
+        fprintf(stderr, "Attention : cache des fichiers invalide, tous les fichiers seront relus\n");
+    }
+    fclose(file);
+    return ret;
+}
+
+/**
+ * @brief Fonction pour chercher un fichier dont l'inode n'a pas changé
+ *
+ * Un fichier remplacé (nouvel inode, par exemple par un renommage) n'est
+ * pas considéré comme le même fichier, même s'il a la même taille.
+ *
+ * @param cache le cache
+ * @param path le chemin absolu du fichier
+ * @param st les informations actuelles du fichier
+ * @return files_cache_entry* l'entrée du fichier, NULL s'il est inconnu ou remplacé
+ */
+files_cache_entry *files_cache_lookup(files_cache *cache, const char *path, const struct stat *st) {
+    files_cache_entry *e = cache_get(cache, path);
+    return (e && e->ino == st->st_ino) ? e : NULL;
+}
+
+/**
+ * @brief Fonction pour retrouver le découpage d'un fichier, même remplacé
+ *
+ * Un éditeur qui enregistre par renommage change l'inode à chaque
+ * version : le rendement mesuré suit le chemin, pas l'inode.
+ *
+ * @param cache le cache
+ * @param path le chemin absolu du fichier
+ * @param history le découpage des lectures précédentes en sortie
+ * @return int 1 si le chemin est connu, 0 sinon
+ */
+int files_cache_history(files_cache *cache, const char *path, chunk_history *history) {
+    files_cache_entry *e = cache_get(cache, path);
+    if (!e) {
+        return 0;
+    }
+    *history = e->history;
+    return 1;
+}
+
+/**
+ * @brief Procédure pour marquer comme revu un fichier repris sans examen
+ *
+ * Une sauvegarde guidée par le journal des modifications ne fait pas de
+ * stat sur les fichiers inchangés : ils ne doivent pas vieillir pour autant.
+ *
+ * @param cache le cache chargé
+ * @param path le chemin absolu du fichier
+ */
+void files_cache_touch(files_cache *cache, const char *path) {
+    files_cache_entry *e = cache_get(cache, path);
+    if (e) {
+        e->seen = 1;
+    }
+}
+
+/**
+ * @brief Fonction pour savoir si un fichier est resté identique depuis sa mise en cache
+ *
+ * @param cached l'entrée du fichier
+ * @param st les informations actuelles du fichier
+ * @return int 1 si la taille et la date de modification sont inchangées, 0 sinon
+ */
+int files_cache_unchanged(const files_cache_entry *cached, const struct stat *st) {
+    return cached->size == (uint64_t)st->st_size && cached->mtime_ns == mtime_ns(st);
+}
+
+/**
+ * @brief Fonction donnant le nombre de chunks qu'un fichier allongé peut reprendre
+ *
+ * Avec des blocs de taille fixe, un ajout en fin de fichier ne change que
+ * le dernier chunk, s'il était incomplet : tous les chunks pleins de
+ * l'ancienne recette restent valables si le début du fichier n'a pas bougé.
+ * Découpé selon son contenu, un chunk ne dépend que des octets qui le
+ * précèdent : seul le dernier, coupé par la fin du fichier, est à refaire.
+ * C'est à l'appelant de vérifier que les size premiers octets ont toujours
+ * l'empreinte enregistrée, puis de reprendre le découpage avec la même
+ * politique. Sans empreinte, rien ne peut être repris.
+ *
+ * @param cached l'entrée du fichier
+ * @param st les informations actuelles du fichier
+ * @return size_t le nombre de chunks réutilisables, 0 si le fichier n'a pas seulement grandi
+ */
+size_t files_cache_stable_prefix(const files_cache_entry *cached, const struct stat *st) {
+    uint32_t chunk_size = chunker_block_size(cached->history.policy);
+    static const unsigned char unknown[MD5_DIGEST_LENGTH];
+    if ((uint64_t)st->st_size <= cached->size || mtime_ns(st) < cached->mtime_ns || cached->data
+        || memcmp(cached->digest, unknown, sizeof(unknown)) == 0) {
+        return 0;
+    }
+    if (chunk_size == 0) {
+        return cached->nb_chunks > 0 ? cached->nb_chunks - 1 : 0;
+    }
+    size_t full = (size_t)(cached->size / chunk_size);
+    if (full > cached->nb_chunks) {
+        return 0;
+    }
+    for (size_t i = 0; i < full; i++) {
+        if (cached->len[i] != chunk_size) {
+            return 0;
+        }
+    }
+    return full;
+}
+
+/**
+ * @brief Fonction pour enregistrer la nouvelle recette d'un fichier
+ *
+ * La taille enregistrée est celle réellement lue, qui peut dépasser
+ * st_size si le fichier a grandi pendant la lecture : la sauvegarde
+ * suivante reprendra alors au bon endroit.
+ *
+ * @param cache le cache
+ * @param path le chemin absolu du fichier
+ * @param st les informations du fichier relevées avant sa lecture
+ * @param entry l'entrée du manifeste du fichier
+ * @param history le découpage de la recette (NULL pour garder celui déjà enregistré)
+ * @param digest l'empreinte des entry->size octets lus (NULL si inconnue)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int files_cache_update(files_cache *cache, const char *path, const struct stat *st, const manifest_entry *entry,
+                       const chunk_history *history, const unsigned char *digest) {
+    files_cache_entry *e = cache_insert(cache, path);
+    if (!e || cache_set_recipe(cache, e, entry) == -1) {
+        return -1;
+    }
+    if (history) {
+        e->history = *history;
+    }
+    if (digest) {
+        memmove(e->digest, digest, sizeof(e->digest)); // digest peut être celui de l'entrée elle-même
+    } else {
+        memset(e->digest, 0, sizeof(e->digest));
+    }
+    e->ino = st->st_ino;
+    e->mtime_ns = mtime_ns(st);
+    e->size = entry->size;
+    e->age = 0;
+    e->seen = 1;
+    return 0;
+}
+
+// Écriture du cache, en deux passes sur les mêmes fichiers : le tas, puis les enregistrements et la table
+typedef struct {
+    FILE *file;
+    uint64_t count;         // fichiers déjà écrits dans la passe
+    uint64_t heap;          // position de la zone du prochain fichier dans le tas
+    uint64_t slots;         // cases de la table (seconde passe)
+    uint32_t *table;        // table construite pendant la seconde passe
+} cache_writer;
+
+// Fonction écrivant un fichier lors d'une passe
+typedef int (*cache_visit)(cache_writer *writer, const files_cache_entry *e, uint32_t age);
+
+/**
+ * @brief Fonction complétant par des zéros une zone du tas jusqu'au multiple de 8 suivant
+ *
+ * @param file le fichier en cours d'écriture
+ * @param len la taille de la zone
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int write_padding(FILE *file, uint64_t len) {
+    static const unsigned char zeros[8];
+    size_t pad = (size_t)(PAD8(len) - len);
+    return (pad > 0 && fwrite(zeros, pad, 1, file) != 1) ? -1 : 0;
+}
+
+/**
+ * @brief Fonction écrivant le chemin et la recette d'un fichier dans le tas (première passe)
+ *
+ * @param writer l'écriture en cours
+ * @param e le fichier
+ * @param age l'âge à enregistrer (inutilisé dans cette passe)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int write_heap(cache_writer *writer, const files_cache_entry *e, uint32_t age) {
+    (void)age;
+    size_t path_len = strlen(e->path) + 1;
+    int failed = fwrite(e->path, path_len, 1, writer->file) != 1 || write_padding(writer->file, path_len) == -1;
+    if (e->data) {
+        failed = failed || (e->size > 0 && fwrite(e->data, (size_t)e->size, 1, writer->file) != 1);
+    } else if (e->nb_chunks > 0) {
+        failed = failed || fwrite(e->md5, MD5_DIGEST_LENGTH, e->nb_chunks, writer->file) != e->nb_chunks
+                 || fwrite(e->len, sizeof(uint32_t), e->nb_chunks, writer->file) != e->nb_chunks;
+    }
+    failed = failed || write_padding(writer->file, recipe_size(e)) == -1;
+    writer->count++;
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Fonction écrivant l'enregistrement d'un fichier et le plaçant dans la table (seconde passe)
+ *
+ * @param writer l'écriture en cours
+ * @param e le fichier
+ * @param age l'âge à enregistrer
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int write_record(cache_writer *writer, const files_cache_entry *e, uint32_t age) {
+    files_cache_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.ino = (uint64_t)e->ino;
+    rec.mtime_ns = e->mtime_ns;
+    rec.size = e->size;
+    rec.path_len = (uint32_t)strlen(e->path);
+    rec.path = writer->heap;
+    rec.recipe = writer->heap + PAD8((uint64_t)rec.path_len + 1);
+    rec.nb_chunks = e->data ? 0 : (uint32_t)e->nb_chunks;
+    rec.age = age;
+    rec.policy = e->history.policy;
+    rec.yield = e->history.yield;
+    rec.runs = e->history.runs;
+    rec.inlined = e->data != NULL;
+    memcpy(rec.digest, e->digest, sizeof(rec.digest));
+    rec.checksum = record_checksum(&rec, e);
+    writer->heap = rec.recipe + PAD8(recipe_size(e));
+
+    size_t h = path_hash(e->path, writer->slots);
+    while (writer->table[h] != 0) {
+        h = (h + 1) & (writer->slots - 1);
+    }
+    writer->table[h] = (uint32_t)(++writer->count);
+    return fwrite(&rec, sizeof(rec), 1, writer->file) == 1 ? 0 : -1;
+}
+
+/**
+ * @brief Fonction passant en revue les fichiers à garder dans le cache
+ *
+ * Les entrées en mémoire sont écrites, puis les enregistrements du cache
+ * projeté qu'elles ne remplacent pas. Les deux passes voient les mêmes
+ * fichiers dans le même ordre.
+ *
+ * @param cache le cache
+ * @param aging 1 pour vieillir d'une sauvegarde les fichiers non revus
+ * @param writer l'écriture en cours
+ * @param visit la fonction de la passe
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int cache_walk(files_cache *cache, int aging, cache_writer *writer, cache_visit visit) {
+    for (size_t i = 0; i < cache->table_size; i++) {
+        for (files_cache_entry *e = cache->table[i]; e; e = e->next) {
+            uint32_t age = e->seen ? 0 : e->age + (aging ? 1 : 0);
+            if (age <= FILES_CACHE_TTL && visit(writer, e, age) == -1) {
+                return -1;
+            }
+        }
+    }
+    if (!cache->map) {
+        return 0;
+    }
+    const files_cache_record *records = (const files_cache_record *)(cache->map + cache->header->records);
+    for (uint64_t i = 0; i < cache->header->count; i++) {
+        files_cache_entry view;
+        uint32_t age = records[i].age + (aging ? 1 : 0);
+        if (age <= FILES_CACHE_TTL && record_valid(cache, &records[i], &view) && !cache_find(cache, view.path)
+            && visit(writer, &view, age) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction écrivant tout le cache à côté de l'ancien, puis le renommant à sa place
+ *
+ * L'ancien fichier reste projeté jusqu'à la libération du cache : le
+ * renommage ne fait que retirer son nom.
+ *
+ * @param cache le cache
+ * @param aging 1 pour vieillir d'une sauvegarde les fichiers non revus
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int cache_write(files_cache *cache, int aging) {
+    char tmp_path[PATH_MAX + 8];
+    files_cache_header header;
+    cache_writer writer;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache->path);
+    memset(&writer, 0, sizeof(writer));
+    memset(&header, 0, sizeof(header));
+    writer.file = fopen(tmp_path, "wb");
+    if (!writer.file) {
+        perror("Erreur lors de la création du cache des fichiers");
+        return -1;
+    }
+    int ret = (fwrite(&header, sizeof(header), 1, writer.file) == 1) ? cache_walk(cache, aging, &writer, write_heap) : -1;
+
+    // Table chargée au plus à moitié : un chemin absent est reconnu en quelques cases
+    writer.slots = 16;
+    while (writer.slots < writer.count * 2) {
+        writer.slots *= 2;
+    }
+    memcpy(header.magic, FILES_CACHE_MAGIC, sizeof(header.magic));
+    header.count = writer.count;
+    header.slots = writer.slots;
+    header.heap = sizeof(header);
+    header.records = ret == 0 ? (uint64_t)ftello(writer.file) : 0;
+    header.table = header.records + header.count * sizeof(files_cache_record);
+    header.size = header.table + header.slots * sizeof(uint32_t);
+    header.checksum = checksum64(&header, offsetof(files_cache_header, checksum), 0);
+
+    writer.table = calloc(writer.slots, sizeof(uint32_t));
+    writer.heap = header.heap;
+    writer.count = 0;
+    if (ret == 0 && !writer.table) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        ret = -1;
+    }
+    if (ret == 0) {
+        ret = cache_walk(cache, aging, &writer, write_record);
+    }
+    if (ret == 0 && (writer.heap != header.records || writer.count != header.count
+                     || fwrite(writer.table, sizeof(uint32_t), writer.slots, writer.file) != writer.slots
+                     || fseeko(writer.file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer.file) != 1)) {
+        ret = -1;
+    }
+    free(writer.table);
+    if (close_synced(writer.file) != 0) {
+        ret = -1;
+    }
+    if (ret == -1 || rename(tmp_path, cache->path) == -1) {
+        perror("Erreur lors de l'enregistrement du cache des fichiers");
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour réécrire le cache des fichiers à la fin d'une sauvegarde
+ *
+ * Les fichiers revus par la sauvegarde repartent avec un âge nul ; les
+ * autres vieillissent d'une sauvegarde et sont oubliés au-delà de
+ * FILES_CACHE_TTL, ce qui garde le cache des autres sources du dépôt.
+ * Le cache est écrit à côté puis renommé : une interruption laisse l'ancien.
+ *
+ * @param cache le cache
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int files_cache_save(files_cache *cache) {
+    return cache_write(cache, 1);
+}
+
+/**
+ * @brief Fonction pour enregistrer le cache en cours de sauvegarde (point de reprise)
+ *
+ * Les fichiers pas encore revus gardent leur âge : une sauvegarde
+ * interrompue plusieurs fois ne fait pas oublier le reste de la source.
+ *
+ * @param cache le cache
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int files_cache_checkpoint(files_cache *cache) {
+    cache->stats.checkpoints++;
+    return cache_write(cache, 0);
+}
+
+/**
+ * @brief Procédure pour libérer le cache
+ *
+ * @param cache le cache
+ */
+void files_cache_free(files_cache *cache) {
+    if (cache->map) {
+        munmap((void *)cache->map, cache->map_size);
+        cache->map = NULL;
+        cache->header = NULL;
+    }
+    free(cache->table);
+    cache->table = NULL;
+    cache->count = 0;
+    arena_free(&cache->pool);
+}
@@ -0,0 +1,130 @@
+#ifndef FILES_CACHE_H
+#define FILES_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <openssl/md5.h>
+#include "arena.h"
+#include "manifest.h"
+#include "chunker.h"
+
+// Nom du cache des fichiers dans le répertoire du dépôt de chunks
+#define FILES_CACHE_NAME "files"
+
+// Nombre de sauvegardes sans revoir un fichier avant de l'oublier
+#define FILES_CACHE_TTL 20
+
+// Taille initiale de la table de hachage du cache
+#define FILES_CACHE_TABLE_SIZE 4096
+
+// Nombre de chunks d'une recette réutilisée dont la présence est vérifiée d'un coup
+#define FILES_CACHE_CHECK_BATCH 4096
+
+// Signature du cache des fichiers enregistré
+#define FILES_CACHE_MAGIC "BORGFC03"
+
+// Signature du cache enregistré sans empreinte du contenu des fichiers (ignoré : tout est relu une fois)
+#define FILES_CACHE_MAGIC_V2 "BORGFC02"
+
+// En-tête du cache enregistré (64 octets)
+typedef struct {
+    char magic[8];
+    uint64_t count;         // nombre de fichiers
+    uint64_t slots;         // cases de la table d'adressage ouvert, puissance de deux
+    uint64_t records;       // position des enregistrements
+    uint64_t table;         // position de la table (un uint32_t par case : rang du fichier + 1, 0 si vide)
+    uint64_t heap;          // position du tas des chemins et des recettes
+    uint64_t size;          // taille du fichier
+    uint64_t checksum;      // somme de contrôle des champs précédents
+} files_cache_header;
+
+// Fichier du cache enregistré (80 octets), dont le chemin et la recette sont dans le tas
+typedef struct {
+    uint64_t ino;
+    int64_t mtime_ns;
+    uint64_t size;
+    uint64_t path;          // position du chemin, terminé par un zéro
+    uint64_t recipe;        // position des empreintes puis des tailles des chunks, ou du contenu d'un petit fichier
+    uint32_t nb_chunks;
+    uint32_t age;
+    uint32_t path_len;
+    uint8_t policy;         // découpage de la recette (chunk_history)
+    int8_t yield;
+    uint8_t runs;
+    uint8_t inlined;        // 1 si le contenu du fichier tient lieu de recette
+    unsigned char digest[MD5_DIGEST_LENGTH]; // empreinte du contenu (voir files_cache_entry)
+    uint64_t checksum;      // somme de contrôle de l'enregistrement, de son chemin et de sa recette
+} files_cache_record;
+
+// Fichier vu par une sauvegarde précédente et sa recette de chunks
+typedef struct files_cache_entry {
+    char *path;             // chemin absolu du fichier source
+    ino_t ino;              // numéro d'inode
+    int64_t mtime_ns;       // date de modification en nanosecondes
+    uint64_t size;          // taille lue lors de la sauvegarde
+    uint32_t age;           // nombre de sauvegardes depuis la dernière visite
+    int seen;               // 1 si le fichier a été revu par la sauvegarde en cours
+    size_t nb_chunks;
+    unsigned char (*md5)[MD5_DIGEST_LENGTH];
+    uint32_t *len;
+    unsigned char *data;    // contenu d'un petit fichier stocké dans le manifeste (NULL sinon)
+    unsigned char digest[MD5_DIGEST_LENGTH]; // empreinte des size octets lus, nulle si inconnue
+    chunk_history history;  // découpage de la recette et rendement mesuré
+    struct files_cache_entry *next;
+} files_cache_entry;
+
+// Bilan du cache pour une sauvegarde
+typedef struct {
+    uint64_t unchanged;     // fichiers repris sans être relus
+    uint64_t appended;      // fichiers allongés dont seule la fin a été découpée
+    uint64_t reread;        // fichiers relus en entier
+    uint64_t skipped_bytes; // octets repris de la sauvegarde précédente sans découpage
+    uint64_t inlined;       // petits fichiers stockés dans le manifeste plutôt qu'en chunks
+    uint64_t policies[CHUNKER_POLICIES]; // fichiers lus par politique de découpage
+    uint64_t checkpoints;   // points de reprise enregistrés en cours de sauvegarde
+} files_cache_stats;
+
+// Cache des fichiers d'un dépôt, projeté en mémoire au début d'une sauvegarde et réécrit à la fin
+//
+// Le cache enregistré est consulté sur place ; seuls les fichiers consultés
+// ou mis à jour par la sauvegarde ont une entrée en mémoire, qui prend le
+// pas sur l'enregistrement du même chemin.
+typedef struct {
+    char path[PATH_MAX];    // chemin du fichier du cache
+    files_cache_entry **table; // entrées en mémoire
+    size_t table_size;      // puissance de deux
+    size_t count;
+    arena pool;             // entrées, chemins et nouvelles recettes
+    const unsigned char *map; // cache enregistré projeté en mémoire (NULL s'il est absent ou au format texte)
+    size_t map_size;
+    const files_cache_header *header;
+    files_cache_stats stats;
+} files_cache;
+
+// Fonction pour projeter le cache des fichiers d'un dépôt (vide s'il n'existe pas encore, chargé d'un coup si populate)
+int files_cache_load(files_cache *cache, const char *store_dir, int populate);
+// Fonction pour chercher un fichier dont l'inode n'a pas changé (NULL s'il est inconnu)
+files_cache_entry *files_cache_lookup(files_cache *cache, const char *path, const struct stat *st);
+// Fonction pour retrouver le découpage des lectures précédentes d'un chemin, quel que soit son inode
+int files_cache_history(files_cache *cache, const char *path, chunk_history *history);
+// Procédure pour marquer comme revu un fichier repris sans examen
+void files_cache_touch(files_cache *cache, const char *path);
+// Fonction pour savoir si un fichier est resté identique depuis sa mise en cache
+int files_cache_unchanged(const files_cache_entry *cached, const struct stat *st);
+// Fonction donnant le nombre de chunks d'une recette qu'un fichier allongé peut reprendre
+size_t files_cache_stable_prefix(const files_cache_entry *cached, const struct stat *st);
+// Fonction pour enregistrer la nouvelle recette d'un fichier (history à NULL pour garder l'ancien découpage,
+// digest à NULL si l'empreinte du contenu est inconnue)
+int files_cache_update(files_cache *cache, const char *path, const struct stat *st, const manifest_entry *entry,
+                       const chunk_history *history, const unsigned char *digest);
+// Fonction pour réécrire le cache, en oubliant les fichiers absents depuis FILES_CACHE_TTL sauvegardes
+int files_cache_save(files_cache *cache);
+// Fonction pour enregistrer le cache en cours de sauvegarde, sans vieillir les fichiers pas encore revus
+int files_cache_checkpoint(files_cache *cache);
+// Procédure pour libérer le cache
+void files_cache_free(files_cache *cache);
+
+#endif // FILES_CACHE_H
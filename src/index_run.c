@@ -0,0 +1,424 @@
+#include "index_run.h"
+#include "file_handler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/*
+ * Format d'un segment :
+ *   <enregistrements triés par empreinte, 32 octets chacun>
+ *   <première empreinte de chaque bloc de RUN_FENCE_STRIDE enregistrements>
+ *   <somme de contrôle de chaque bloc, 8 octets chacune>
+ *   <somme de contrôle des balises, des sommes des blocs et du pied de page>
+ *   <pied de page run_footer>
+ * Toutes les zones sont alignées sur leur taille d'élément : le segment est
+ * projeté en mémoire et consulté sur place. Seuls le pied de page et les
+ * balises sont vérifiés à l'ouverture ; un bloc l'est à sa première lecture.
+ * Un segment BORGRUN1 n'a ni sommes des blocs ni somme globale.
+ */
+
+// Pied de page d'un segment
+typedef struct {
+    char magic[8];
+    uint64_t records;
+    uint64_t nb_fences;
+    uint32_t stride;
+    uint32_t reserved;
+} run_footer;
+
+/**
+ * @brief Procédure construisant le chemin d'un segment
+ *
+ * @param dir le répertoire du dépôt de chunks
+ * @param id le numéro du segment
+ * @param buffer le tampon de sortie
+ * @param size la taille du tampon
+ */
+void run_path(const char *dir, uint32_t id, char *buffer, size_t size) {
+    snprintf(buffer, size, "%s/run-%08u", dir, id);
+}
+
+/**
+ * @brief Fonction donnant le nombre d'enregistrements d'un bloc
+ *
+ * @param records le nombre d'enregistrements du segment
+ * @param block le numéro du bloc
+ * @return uint64_t le nombre d'enregistrements, RUN_FENCE_STRIDE sauf pour le dernier bloc
+ */
+static uint64_t block_count(uint64_t records, uint64_t block) {
+    uint64_t count = records - block * RUN_FENCE_STRIDE;
+    return count > RUN_FENCE_STRIDE ? RUN_FENCE_STRIDE : count;
+}
+
+/**
+ * @brief Fonction pour ouvrir un segment en le projetant en mémoire
+ *
+ * Rien n'est désérialisé : les balises et les enregistrements sont lus
+ * directement dans la projection. Sans populate, seules les pages des
+ * balises et du pied de page sont lues à l'ouverture, ce qui la rend
+ * quasi instantanée quelle que soit la taille du segment.
+ *
+ * @param run le segment à initialiser
+ * @param dir le répertoire du dépôt de chunks
+ * @param id le numéro du segment
+ * @param populate 1 pour charger tout le segment dès l'ouverture
+ * @return int 0 en cas de succès, -1 si le segment est illisible ou invalide
+ */
+int run_open(index_run *run, const char *dir, uint32_t id, int populate) {
+    char path[PATH_MAX + 32];
+    run_footer footer;
+    struct stat st;
+
+    memset(run, 0, sizeof(*run));
+    run->id = id;
+    run_path(dir, id, path, sizeof(path));
+    run->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (run->fd == -1) {
+        perror("Erreur lors de l'ouverture d'un segment d'index");
+        return -1;
+    }
+    if (fstat(run->fd, &st) == -1 || (size_t)st.st_size < sizeof(footer)
+        || !(run->map = map_file(run->fd, (size_t)st.st_size, populate, 0))) {
+        fprintf(stderr, "Erreur : segment d'index illisible : %s\n", path);
+        run_close(run);
+        return -1;
+    }
+    run->map_size = (size_t)st.st_size;
+    memcpy(&footer, run->map + run->map_size - sizeof(footer), sizeof(footer));
+
+    int v2 = memcmp(footer.magic, RUN_MAGIC, sizeof(footer.magic)) == 0;
+    uint64_t tail = footer.nb_fences * (MD5_DIGEST_LENGTH + (v2 ? sizeof(uint64_t) : 0))
+                    + (v2 ? sizeof(uint64_t) : 0) + sizeof(footer);
+    if ((!v2 && memcmp(footer.magic, RUN_MAGIC_V1, sizeof(footer.magic)) != 0) || footer.stride != RUN_FENCE_STRIDE
+        || footer.nb_fences != (footer.records + RUN_FENCE_STRIDE - 1) / RUN_FENCE_STRIDE
+        || (uint64_t)st.st_size != footer.records * sizeof(store_record) + tail) {
+        fprintf(stderr, "Erreur : segment d'index invalide : %s\n", path);
+        run_close(run);
+        return -1;
+    }
+    run->records = footer.records;
+    run->nb_fences = footer.nb_fences;
+    run->recs = (const store_record *)run->map;
+    run->fences = (const unsigned char (*)[MD5_DIGEST_LENGTH])(run->map + run->records * sizeof(store_record));
+
+    if (v2) {
+        run->sums = (const uint64_t *)(run->fences + run->nb_fences);
+        uint64_t sum = checksum64(&footer, sizeof(footer), 0);
+        sum = checksum64(run->fences, run->nb_fences * MD5_DIGEST_LENGTH, sum);
+        sum = checksum64(run->sums, run->nb_fences * sizeof(uint64_t), sum);
+        if (memcmp(&sum, run->sums + run->nb_fences, sizeof(sum)) != 0) {
+            fprintf(stderr, "Erreur : somme de contrôle invalide pour le segment d'index %s\n", path);
+            run_close(run);
+            return -1;
+        }
+        run->checked = calloc(run->nb_fences ? run->nb_fences : 1, 1);
+        if (!run->checked) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            run_close(run);
+            return -1;
+        }
+    }
+    // Les recherches tombent n'importe où : inutile de lire autour de chaque page touchée
+    if (!populate && run->records > 0) {
+        madvise((void *)run->map, run->records * sizeof(store_record), MADV_RANDOM);
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure pour fermer un segment
+ *
+ * @param run le segment
+ */
+void run_close(index_run *run) {
+    if (run->map) {
+        munmap((void *)run->map, run->map_size);
+    }
+    if (run->fd != -1) {
+        close(run->fd);
+    }
+    free(run->checked);
+    free(run->marks);
+    memset(run, 0, sizeof(*run));
+    run->fd = -1;
+}
+
+/**
+ * @brief Fonction vérifiant la somme de contrôle d'un bloc d'enregistrements
+ *
+ * @param sums les sommes des blocs du segment (NULL si le segment n'en a pas)
+ * @param block le numéro du bloc
+ * @param recs les enregistrements du bloc
+ * @param count le nombre d'enregistrements du bloc
+ * @return int 1 si le bloc est intact ou sans somme, 0 sinon
+ */
+static int block_valid(const uint64_t *sums, uint64_t block, const store_record *recs, uint64_t count) {
+    if (!sums || sums[block] == checksum64(recs, count * sizeof(store_record), block)) {
+        return 1;
+    }
+    fprintf(stderr, "Erreur : bloc %llu d'un segment d'index corrompu\n", (unsigned long long)block);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour chercher une empreinte dans un segment
+ *
+ * Les balises désignent le seul bloc pouvant contenir l'empreinte, parcouru
+ * par dichotomie directement dans la projection. Sa somme de contrôle est
+ * vérifiée à sa première consultation. Lors d'une recherche par lots triés,
+ * les empreintes voisines tombent souvent dans le bloc déjà consulté.
+ *
+ * @param run le segment
+ * @param md5 l'empreinte recherchée
+ * @param rec l'enregistrement en sortie
+ * @param position le rang de l'enregistrement en sortie (peut être NULL)
+ * @param cache le dernier bloc consulté de ce segment (peut être NULL)
+ * @return int 1 si l'empreinte est présente, 0 sinon, -1 si le bloc est corrompu
+ */
+int run_find(const index_run *run, const unsigned char *md5, store_record *rec, uint64_t *position, run_block_cache *cache) {
+    run_block_cache local;
+    if (run->nb_fences == 0 || memcmp(md5, run->fences[0], MD5_DIGEST_LENGTH) < 0) {
+        return 0;
+    }
+
+    // Dernière balise inférieure ou égale à l'empreinte
+    uint64_t low = 0, high = run->nb_fences;
+    while (high - low > 1) {
+        uint64_t middle = low + (high - low) / 2;
+        if (memcmp(run->fences[middle], md5, MD5_DIGEST_LENGTH) <= 0) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (cache == NULL) {
+        cache = &local;
+        cache->run = run->id;
+        cache->block = UINT64_MAX;
+    }
+    if (cache->run != run->id || cache->block != low) {
+        const store_record *recs = run->recs + low * RUN_FENCE_STRIDE;
+        uint64_t count = block_count(run->records, low);
+        if (run->checked && run->checked[low] != 1) {
+            // Un bloc corrompu n'est signalé qu'une fois
+            if (run->checked[low] == 2 || !block_valid(run->sums, low, recs, count)) {
+                run->checked[low] = 2;
+                cache->block = UINT64_MAX;
+                return -1;
+            }
+            run->checked[low] = 1;
+        }
+        cache->run = run->id;
+        cache->block = low;
+        cache->count = (uint32_t)count;
+        cache->recs = recs;
+    }
+
+    uint32_t left = 0, right = cache->count;
+    while (left < right) {
+        uint32_t middle = left + (right - left) / 2;
+        int cmp = memcmp(cache->recs[middle].md5, md5, MD5_DIGEST_LENGTH);
+        if (cmp == 0) {
+            *rec = cache->recs[middle];
+            if (position) {
+                *position = low * RUN_FENCE_STRIDE + middle;
+            }
+            return 1;
+        }
+        if (cmp < 0) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour commencer l'écriture d'un segment
+ *
+ * Le segment est écrit sous un nom temporaire et n'apparaît qu'une fois
+ * complet et synchronisé.
+ *
+ * @param writer l'écriture à initialiser
+ * @param dir le répertoire du dépôt de chunks
+ * @param id le numéro du segment
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int run_writer_open(run_writer *writer, const char *dir, uint32_t id) {
+    memset(writer, 0, sizeof(*writer));
+    run_path(dir, id, writer->path, sizeof(writer->path));
+    snprintf(writer->tmp_path, sizeof(writer->tmp_path), "%s.tmp", writer->path);
+    writer->file = fopen(writer->tmp_path, "wb");
+    if (!writer->file) {
+        perror("Erreur lors de la création d'un segment d'index");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour ajouter un enregistrement au segment
+ *
+ * Les enregistrements doivent arriver par empreintes strictement croissantes.
+ *
+ * @param writer l'écriture en cours
+ * @param rec l'enregistrement
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int run_writer_add(run_writer *writer, const store_record *rec) {
+    if (writer->records > 0 && memcmp(rec->md5, writer->last, MD5_DIGEST_LENGTH) <= 0) {
+        fprintf(stderr, "Erreur : enregistrements d'index non triés\n");
+        return -1;
+    }
+    if (writer->records % RUN_FENCE_STRIDE == 0) {
+        if (writer->nb_fences == writer->capacity) {
+            uint64_t capacity = writer->capacity ? writer->capacity * 2 : 1024;
+            unsigned char (*fences)[MD5_DIGEST_LENGTH] = realloc(writer->fences, capacity * MD5_DIGEST_LENGTH);
+            if (fences) {
+                writer->fences = fences;
+            }
+            uint64_t *sums = realloc(writer->sums, capacity * sizeof(uint64_t));
+            if (sums) {
+                writer->sums = sums;
+            }
+            if (!fences || !sums) {
+                fprintf(stderr, "Erreur d'allocation mémoire\n");
+                return -1;
+            }
+            writer->capacity = capacity;
+        }
+        memcpy(writer->fences[writer->nb_fences++], rec->md5, MD5_DIGEST_LENGTH);
+    }
+    writer->block[writer->records % RUN_FENCE_STRIDE] = *rec;
+    if (fwrite(rec, sizeof(*rec), 1, writer->file) != 1) {
+        perror("Erreur lors de l'écriture d'un segment d'index");
+        return -1;
+    }
+    memcpy(writer->last, rec->md5, MD5_DIGEST_LENGTH);
+    writer->records++;
+    if (writer->records % RUN_FENCE_STRIDE == 0) {
+        writer->sums[writer->nb_fences - 1] = checksum64(writer->block, sizeof(writer->block), writer->nb_fences - 1);
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour terminer, synchroniser et publier le segment
+ *
+ * @param writer l'écriture en cours, libérée dans tous les cas
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int run_writer_commit(run_writer *writer) {
+    run_footer footer;
+    memset(&footer, 0, sizeof(footer));
+    memcpy(footer.magic, RUN_MAGIC, sizeof(footer.magic));
+    footer.records = writer->records;
+    footer.nb_fences = writer->nb_fences;
+    footer.stride = RUN_FENCE_STRIDE;
+
+    // Dernier bloc incomplet
+    uint64_t rest = writer->records % RUN_FENCE_STRIDE;
+    if (rest > 0) {
+        writer->sums[writer->nb_fences - 1] = checksum64(writer->block, rest * sizeof(store_record), writer->nb_fences - 1);
+    }
+    uint64_t sum = checksum64(&footer, sizeof(footer), 0);
+    sum = checksum64(writer->fences, writer->nb_fences * MD5_DIGEST_LENGTH, sum);
+    sum = checksum64(writer->sums, writer->nb_fences * sizeof(uint64_t), sum);
+
+    if ((writer->nb_fences > 0 && (fwrite(writer->fences, MD5_DIGEST_LENGTH, writer->nb_fences, writer->file) != writer->nb_fences
+                                   || fwrite(writer->sums, sizeof(uint64_t), writer->nb_fences, writer->file) != writer->nb_fences))
+        || fwrite(&sum, sizeof(sum), 1, writer->file) != 1
+        || fwrite(&footer, sizeof(footer), 1, writer->file) != 1 || fflush(writer->file) != 0
+        || fsync(fileno(writer->file)) == -1) {
+        perror("Erreur lors de l'écriture d'un segment d'index");
+        run_writer_abort(writer);
+        return -1;
+    }
+    fclose(writer->file);
+    writer->file = NULL;
+    if (rename(writer->tmp_path, writer->path) == -1) {
+        perror("Erreur lors de la publication d'un segment d'index");
+        run_writer_abort(writer);
+        return -1;
+    }
+    free(writer->fences);
+    free(writer->sums);
+    writer->fences = NULL;
+    writer->sums = NULL;
+    return 0;
+}
+
+/**
+ * @brief Procédure pour abandonner l'écriture d'un segment
+ *
+ * @param writer l'écriture en cours
+ */
+void run_writer_abort(run_writer *writer) {
+    if (writer->file) {
+        fclose(writer->file);
+        writer->file = NULL;
+    }
+    unlink(writer->tmp_path);
+    free(writer->fences);
+    free(writer->sums);
+    writer->fences = NULL;
+    writer->sums = NULL;
+}
+
+/**
+ * @brief Procédure pour parcourir un segment dans l'ordre des empreintes
+ *
+ * @param cursor le parcours à initialiser
+ * @param run le segment
+ */
+void run_cursor_open(run_cursor *cursor, const index_run *run) {
+    cursor->fd = run->fd;
+    cursor->sums = run->sums;
+    cursor->position = UINT64_MAX;
+    cursor->records = run->records;
+    cursor->buffer_start = 0;
+    cursor->buffer_count = 0;
+}
+
+/**
+ * @brief Fonction pour passer à l'enregistrement suivant
+ *
+ * @param cursor le parcours
+ * @return int 1 si un enregistrement est disponible dans cursor->rec, 0 à la fin, -1 en cas d'erreur
+ */
+int run_cursor_next(run_cursor *cursor) {
+    uint64_t next = (cursor->position == UINT64_MAX) ? 0 : cursor->position + 1;
+    if (next >= cursor->records) {
+        cursor->position = cursor->records;
+        return 0;
+    }
+    if (next >= cursor->buffer_start + cursor->buffer_count) {
+        uint64_t count = cursor->records - next;
+        if (count > RUN_CURSOR_BUFFER) {
+            count = RUN_CURSOR_BUFFER;
+        }
+        ssize_t lus = pread(cursor->fd, cursor->buffer, count * sizeof(store_record), (off_t)(next * sizeof(store_record)));
+        if (lus != (ssize_t)(count * sizeof(store_record))) {
+            perror("Erreur lors de la lecture d'un segment d'index");
+            return -1;
+        }
+        // Le tampon commence toujours au début d'un bloc : ses blocs sont vérifiés avant d'être recopiés ailleurs
+        for (uint64_t first = 0; first < count; first += RUN_FENCE_STRIDE) {
+            uint64_t block = (next + first) / RUN_FENCE_STRIDE;
+            if (!block_valid(cursor->sums, block, cursor->buffer + first, block_count(cursor->records, block))) {
+                return -1;
+            }
+        }
+        cursor->buffer_start = next;
+        cursor->buffer_count = (uint32_t)count;
+    }
+    cursor->position = next;
+    cursor->rec = cursor->buffer[next - cursor->buffer_start];
+    return 1;
+}
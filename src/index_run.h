@@ -0,0 +1,100 @@
+#ifndef INDEX_RUN_H
+#define INDEX_RUN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <openssl/md5.h>
+
+// Nombre d'enregistrements entre deux balises d'un segment (un bloc de 4 Ko)
+#define RUN_FENCE_STRIDE 128
+
+// Signature de fin d'un segment d'index (BORGRUN1 : segments antérieurs, sans sommes de contrôle)
+#define RUN_MAGIC "BORGRUN2"
+#define RUN_MAGIC_V1 "BORGRUN1"
+
+// Enregistrement de l'index sur disque (taille fixe)
+typedef struct {
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    uint32_t pack;   // numéro du pack contenant le chunk
+    uint32_t len;    // taille du chunk
+    uint64_t offset; // position des données dans le pack
+} store_record;
+
+// Segment d'index sur disque : enregistrements triés par empreinte, suivis
+// de la première empreinte de chaque bloc (balises), de la somme de contrôle
+// de chaque bloc et d'un pied de page. Le segment est projeté en mémoire et
+// utilisé sur place, sans être relu ni converti.
+typedef struct {
+    uint32_t id;            // numéro du segment (les plus récents ont les plus grands)
+    int fd;                 // segment ouvert en lecture (parcours séquentiels)
+    uint64_t records;       // nombre d'enregistrements
+    uint64_t nb_fences;     // nombre de balises
+    const unsigned char *map; // segment projeté en mémoire
+    size_t map_size;
+    const store_record *recs; // enregistrements, dans la projection
+    const unsigned char (*fences)[MD5_DIGEST_LENGTH]; // balises, dans la projection
+    const uint64_t *sums;   // somme de contrôle de chaque bloc, dans la projection (NULL pour un segment BORGRUN1)
+    unsigned char *checked; // état de chaque bloc : 0 pas encore vérifié, 1 intact, 2 corrompu
+    unsigned char *marks;   // un bit par enregistrement pour le ramasse-miettes (NULL sinon)
+} index_run;
+
+// Dernier bloc consulté d'un segment, pour les recherches par lots triés
+typedef struct {
+    uint32_t run;           // numéro du segment du bloc
+    uint64_t block;         // numéro du bloc (UINT64_MAX si vide)
+    uint32_t count;         // nombre d'enregistrements du bloc
+    const store_record *recs; // enregistrements du bloc, dans la projection
+} run_block_cache;
+
+// Écriture d'un nouveau segment, enregistrement par enregistrement dans l'ordre
+typedef struct {
+    FILE *file;
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 8];
+    uint64_t records;
+    uint64_t nb_fences;
+    uint64_t capacity;
+    unsigned char (*fences)[MD5_DIGEST_LENGTH];
+    uint64_t *sums;         // somme de contrôle de chaque bloc terminé
+    store_record block[RUN_FENCE_STRIDE]; // bloc en cours, pour sa somme de contrôle
+    unsigned char last[MD5_DIGEST_LENGTH];
+} run_writer;
+
+// Nombre d'enregistrements lus à la fois lors d'un parcours séquentiel (32 Ko, multiple de RUN_FENCE_STRIDE)
+#define RUN_CURSOR_BUFFER 1024
+
+// Lecture séquentielle d'un segment
+typedef struct {
+    int fd;
+    const uint64_t *sums;   // sommes de contrôle des blocs (NULL si le segment n'en a pas)
+    uint64_t position;      // rang de l'enregistrement courant
+    uint64_t records;
+    uint64_t buffer_start;  // rang du premier enregistrement du tampon
+    uint32_t buffer_count;
+    store_record buffer[RUN_CURSOR_BUFFER];
+    store_record rec;       // enregistrement courant
+} run_cursor;
+
+// Procédure construisant le chemin d'un segment
+void run_path(const char *dir, uint32_t id, char *buffer, size_t size);
+// Fonction pour ouvrir un segment en le projetant en mémoire (toutes ses pages chargées si populate)
+int run_open(index_run *run, const char *dir, uint32_t id, int populate);
+// Procédure pour fermer un segment
+void run_close(index_run *run);
+// Fonction pour chercher une empreinte dans un segment
+int run_find(const index_run *run, const unsigned char *md5, store_record *rec, uint64_t *position, run_block_cache *cache);
+// Fonction pour commencer l'écriture d'un segment
+int run_writer_open(run_writer *writer, const char *dir, uint32_t id);
+// Fonction pour ajouter un enregistrement (par empreintes croissantes) au segment
+int run_writer_add(run_writer *writer, const store_record *rec);
+// Fonction pour terminer, synchroniser et publier le segment
+int run_writer_commit(run_writer *writer);
+// Procédure pour abandonner l'écriture d'un segment
+void run_writer_abort(run_writer *writer);
+// Procédure pour parcourir un segment dans l'ordre des empreintes
+void run_cursor_open(run_cursor *cursor, const index_run *run);
+// Fonction pour passer à l'enregistrement suivant (1 s'il existe, 0 à la fin, -1 en cas d'erreur)
+int run_cursor_next(run_cursor *cursor);
+
+#endif // INDEX_RUN_H
@@ -0,0 +1,225 @@
+#include "libborg.h"
+#include "backup_manager.h"
+#include "manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+
+// Dépôt ouvert par la bibliothèque
+struct borg_repo {
+    chunk_store store;          // dépôt verrouillé pour toute la durée du descripteur
+    chunk_cache cache;          // chunks relus, partagé par toutes les restaurations du descripteur
+    pthread_mutex_t lock;       // sérialise les opérations sur le descripteur
+    borg_allocator allocator;   // copie de l'allocateur de l'appelant
+    int has_allocator;          // 1 si l'appelant a fourni un allocateur
+    char dir[PATH_MAX];         // répertoire du dépôt
+};
+
+/**
+ * @brief Fonction traduisant le errno laissé par un échec en code de retour
+ *
+ * @param err la valeur de errno juste après l'échec
+ * @return borg_status le code correspondant
+ */
+static borg_status status_from_errno(int err) {
+    switch (err) {
+        case ENOMEM:
+            return BORG_ERR_NOMEM;
+        case EWOULDBLOCK:
+            return BORG_ERR_LOCKED;
+        case ENOENT:
+            return BORG_ERR_NOT_FOUND;
+        default:
+            return BORG_ERR_IO;
+    }
+}
+
+/**
+ * @brief Fonction pour ouvrir un dépôt
+ *
+ * Le dépôt reste verrouillé et son index chargé jusqu'à borg_repo_close :
+ * les sauvegardes successives d'un même descripteur ne relisent pas l'index.
+ * Un second descripteur sur le même dépôt est refusé (BORG_ERR_LOCKED).
+ *
+ * @param repo le descripteur ouvert en sortie
+ * @param repo_dir le répertoire du dépôt
+ * @param opts les réglages du dépôt (NULL pour les réglages par défaut)
+ * @param allocator l'allocateur du descripteur et de l'index en mémoire (NULL pour malloc)
+ * @return borg_status BORG_OK en cas de succès
+ */
+borg_status borg_repo_open(borg_repo **repo, const char *repo_dir, const store_options *opts,
+                           const borg_allocator *allocator) {
+    static const store_options defaults = STORE_OPTIONS_DEFAULT;
+    if (!repo || !repo_dir || (allocator && (!allocator->alloc || !allocator->release))) {
+        return BORG_ERR_INVALID;
+    }
+    *repo = NULL;
+    if (strlen(repo_dir) >= PATH_MAX) {
+        return BORG_ERR_INVALID;
+    }
+
+    borg_repo *r = allocator ? allocator->alloc(sizeof(borg_repo), allocator->ctx) : malloc(sizeof(borg_repo));
+    if (!r) {
+        return BORG_ERR_NOMEM;
+    }
+    memset(r, 0, sizeof(*r));
+    if (allocator) {
+        r->allocator = *allocator;
+        r->has_allocator = 1;
+    }
+    snprintf(r->dir, sizeof(r->dir), "%s", repo_dir);
+
+    // L'index pointe sur la copie de l'allocateur, qui vit autant que le descripteur
+    store_options store_opts = opts ? *opts : defaults;
+    store_opts.allocator = r->has_allocator ? &r->allocator : NULL;
+    if (chunk_cache_init(&r->cache, CHUNK_CACHE_DEFAULT_BYTES) == -1) {
+        if (allocator) {
+            allocator->release(r, allocator->ctx);
+        } else {
+            free(r);
+        }
+        return BORG_ERR_NOMEM;
+    }
+    if (store_open(&r->store, repo_dir, &store_opts) == -1) {
+        borg_status status = status_from_errno(errno);
+        chunk_cache_free(&r->cache);
+        if (allocator) {
+            allocator->release(r, allocator->ctx);
+        } else {
+            free(r);
+        }
+        return status;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    *repo = r;
+    return BORG_OK;
+}
+
+/**
+ * @brief Fonction pour sauvegarder un répertoire dans le dépôt
+ *
+ * @param repo le dépôt ouvert (en écriture)
+ * @param source_dir le répertoire source
+ * @param limits les limites de lecture et d'écriture (NULL pour aucune limite)
+ * @param result les statistiques de la sauvegarde en sortie (NULL si inutiles)
+ * @return borg_status BORG_OK en cas de succès
+ */
+borg_status borg_backup(borg_repo *repo, const char *source_dir, const throttle_options *limits,
+                        catalog_entry *result) {
+    if (!repo || !source_dir) {
+        return BORG_ERR_INVALID;
+    }
+    if (repo->store.opts.read_only) {
+        return BORG_ERR_INVALID;
+    }
+    catalog_entry stats;
+    throttle t;
+    if (throttle_init(&t, limits) == -1) {
+        return BORG_ERR_NOMEM;
+    }
+
+    borg_status status = BORG_OK;
+    pthread_mutex_lock(&repo->lock);
+    throttle_apply_priority(&t);
+    if (backup_to_store(&repo->store, source_dir, repo->dir, &t, NULL, &stats, NULL) == -1) {
+        status = status_from_errno(errno);
+    }
+    pthread_mutex_unlock(&repo->lock);
+    throttle_free(&t);
+
+    if (status == BORG_OK && result) {
+        *result = stats;
+    }
+    return status;
+}
+
+/**
+ * @brief Fonction pour restaurer une sauvegarde du dépôt
+ *
+ * @param repo le dépôt ouvert
+ * @param snapshot le nom de la sauvegarde dans le dépôt
+ * @param restore_dir le répertoire où restaurer
+ * @param pattern le motif des chemins à restaurer (NULL pour toute la sauvegarde)
+ * @return borg_status BORG_OK en cas de succès
+ */
+borg_status borg_restore(borg_repo *repo, const char *snapshot, const char *restore_dir, const char *pattern) {
+    char backup_id[PATH_MAX + SNAPSHOT_NAME_SIZE];
+    char manifest_path[PATH_MAX + SNAPSHOT_NAME_SIZE + 32];
+    if (!repo || !snapshot || !restore_dir || strchr(snapshot, '/') || strlen(snapshot) >= SNAPSHOT_NAME_SIZE) {
+        return BORG_ERR_INVALID;
+    }
+    snprintf(backup_id, sizeof(backup_id), "%s/%s", repo->dir, snapshot);
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", backup_id, MANIFEST_NAME);
+    FILE *manifest = fopen(manifest_path, "r");
+    if (!manifest) {
+        return status_from_errno(errno);
+    }
+
+    borg_status status = BORG_OK;
+    pthread_mutex_lock(&repo->lock);
+    if (restore_from_store(&repo->store, &repo->cache, backup_id, manifest, restore_dir, pattern) == -1) {
+        status = status_from_errno(errno);
+    }
+    pthread_mutex_unlock(&repo->lock);
+    fclose(manifest);
+    return status;
+}
+
+/**
+ * @brief Procédure pour fermer un dépôt et libérer son descripteur
+ *
+ * Aucune opération ne doit être en cours sur le descripteur.
+ *
+ * @param repo le dépôt ouvert (NULL accepté)
+ */
+void borg_repo_close(borg_repo *repo) {
+    if (!repo) {
+        return;
+    }
+    store_close(&repo->store);
+    chunk_cache_free(&repo->cache);
+    pthread_mutex_destroy(&repo->lock);
+    if (repo->has_allocator) {
+        borg_allocator allocator = repo->allocator;
+        allocator.release(repo, allocator.ctx);
+    } else {
+        free(repo);
+    }
+}
+
+/**
+ * @brief Procédure pour obtenir le bilan du cache des chunks relus
+ *
+ * @param repo le dépôt ouvert
+ * @param stats le bilan en sortie, cumulé depuis l'ouverture
+ */
+void borg_cache_report(borg_repo *repo, chunk_cache_stats *stats) {
+    chunk_cache_report(&repo->cache, stats);
+}
+
+/**
+ * @brief Fonction pour décrire un code de retour
+ *
+ * @param status le code de retour
+ * @return const char* la description, en chaîne constante
+ */
+const char *borg_strerror(borg_status status) {
+    switch (status) {
+        case BORG_OK:
+            return "succès";
+        case BORG_ERR_INVALID:
+            return "paramètre invalide";
+        case BORG_ERR_NOMEM:
+            return "mémoire insuffisante";
+        case BORG_ERR_LOCKED:
+            return "dépôt utilisé par un autre processus";
+        case BORG_ERR_NOT_FOUND:
+            return "sauvegarde ou chemin absent";
+        case BORG_ERR_IO:
+            return "erreur d'entrée/sortie";
+    }
+    return "erreur inconnue";
+}
@@ -0,0 +1,47 @@
+#ifndef LIBBORG_H
+#define LIBBORG_H
+
+#include "arena.h"
+#include "chunk_store.h"
+#include "throttle.h"
+#include "catalog.h"
+#include "chunk_cache.h"
+
+// Bibliothèque de sauvegarde réutilisable
+//
+// Tout l'état d'un dépôt est dans un descripteur opaque : plusieurs dépôts
+// peuvent être sauvegardés en même temps par des threads différents. Les
+// opérations sur un même descripteur sont sérialisées.
+
+// Codes de retour de la bibliothèque
+typedef enum {
+    BORG_OK = 0,
+    BORG_ERR_INVALID,    // paramètre invalide
+    BORG_ERR_NOMEM,      // mémoire insuffisante
+    BORG_ERR_LOCKED,     // dépôt verrouillé par un autre descripteur ou processus
+    BORG_ERR_NOT_FOUND,  // sauvegarde ou chemin absent
+    BORG_ERR_IO          // erreur d'entrée/sortie ou dépôt illisible
+} borg_status;
+
+// Allocateur fourni par l'appelant (descripteur et index en mémoire du dépôt)
+typedef arena_allocator borg_allocator;
+
+// Descripteur opaque d'un dépôt ouvert
+typedef struct borg_repo borg_repo;
+
+// Fonction pour ouvrir un dépôt (opts et allocator à NULL pour les réglages par défaut)
+borg_status borg_repo_open(borg_repo **repo, const char *repo_dir, const store_options *opts,
+                           const borg_allocator *allocator);
+// Fonction pour sauvegarder un répertoire dans le dépôt (limits et result peuvent être NULL)
+borg_status borg_backup(borg_repo *repo, const char *source_dir, const throttle_options *limits,
+                        catalog_entry *result);
+// Fonction pour restaurer une sauvegarde du dépôt (pattern à NULL pour toute la sauvegarde)
+borg_status borg_restore(borg_repo *repo, const char *snapshot, const char *restore_dir, const char *pattern);
+// Procédure pour obtenir le bilan du cache des chunks relus par les restaurations
+void borg_cache_report(borg_repo *repo, chunk_cache_stats *stats);
+// Procédure pour fermer un dépôt et libérer son descripteur
+void borg_repo_close(borg_repo *repo);
+// Fonction pour décrire un code de retour
+const char *borg_strerror(borg_status status);
+
+#endif // LIBBORG_H
@@ -6,6 +6,11 @@
 #include "deduplication.h"
 #include "backup_manager.h"
 #include "network.h"
+#include "prune.h"
+#include "check.h"
+#include "estimate.h"
+#include "snapshot.h"
+#include "watcher.h"
 
 int main(int argc, char *argv[]) {
     // Analyse des arguments de la ligne de commande
@@ -22,6 +27,51 @@ int main(int argc, char *argv[]) {
         {.name="dest",.has_arg=1,.flag=0,.val='d'},
 		{.name="source",.has_arg=1,.flag=0,.val='s'},
 		{.name="verbose",.has_arg=0,.flag=0,.val='v'},
+		{.name="serve",.has_arg=0,.flag=0,.val='S'},
+		{.name="net-window",.has_arg=1,.flag=0,.val='W'},
+		{.name="net-sndbuf",.has_arg=1,.flag=0,.val='O'},
+		{.name="net-rcvbuf",.has_arg=1,.flag=0,.val='I'},
+		{.name="net-nodelay",.has_arg=1,.flag=0,.val='D'},
+		{.name="net-cork",.has_arg=0,.flag=0,.val='K'},
+		{.name="net-zerocopy",.has_arg=0,.flag=0,.val='Z'},
+		{.name="bench-net",.has_arg=1,.flag=0,.val='N'},
+		{.name="bench-clients",.has_arg=1,.flag=0,.val='c'},
+		{.name="workers",.has_arg=1,.flag=0,.val='w'},
+		{.name="max-clients",.has_arg=1,.flag=0,.val='m'},
+		{.name="quota",.has_arg=1,.flag=0,.val='q'},
+		{.name="prune",.has_arg=0,.flag=0,.val='P'},
+		{.name="keep-last",.has_arg=1,.flag=0,.val='L'},
+		{.name="keep-daily",.has_arg=1,.flag=0,.val='y'},
+		{.name="keep-weekly",.has_arg=1,.flag=0,.val='k'},
+		{.name="keep-monthly",.has_arg=1,.flag=0,.val='M'},
+		{.name="compact-limit",.has_arg=1,.flag=0,.val='x'},
+		{.name="filter-fpr",.has_arg=1,.flag=0,.val='f'},
+		{.name="filter-memory",.has_arg=1,.flag=0,.val='g'},
+		{.name="index-memory",.has_arg=1,.flag=0,.val='j'},
+		{.name="check",.has_arg=0,.flag=0,.val='C'},
+		{.name="verify-data-percent",.has_arg=1,.flag=0,.val='V'},
+		{.name="sample-percent",.has_arg=1,.flag=0,.val='E'},
+		{.name="limit-read",.has_arg=1,.flag=0,.val='R'},
+		{.name="limit-write",.has_arg=1,.flag=0,.val='T'},
+		{.name="limit-iops",.has_arg=1,.flag=0,.val='Q'},
+		{.name="nice",.has_arg=1,.flag=0,.val='n'},
+		{.name="ionice",.has_arg=1,.flag=0,.val='o'},
+		{.name="direct-io",.has_arg=0,.flag=0,.val='F'},
+		{.name="latency-target",.has_arg=1,.flag=0,.val='A'},
+		{.name="path",.has_arg=1,.flag=0,.val='i'},
+		{.name="cat",.has_arg=1,.flag=0,.val='X'},
+		{.name="offset",.has_arg=1,.flag=0,.val='B'},
+		{.name="length",.has_arg=1,.flag=0,.val='U'},
+		{.name="encrypt",.has_arg=1,.flag=0,.val='Y'},
+		{.name="cache-size",.has_arg=1,.flag=0,.val='G'},
+		{.name="watch",.has_arg=0,.flag=0,.val='H'},
+		{.name="exclude",.has_arg=1,.flag=0,.val='h'},
+		{.name="include",.has_arg=1,.flag=0,.val='z'},
+		{.name="exclude-marker",.has_arg=1,.flag=0,.val='J'},
+		{.name="exclude-larger",.has_arg=1,.flag=0,.val='1'},
+		{.name="exclude-older",.has_arg=1,.flag=0,.val='2'},
+		{.name="inline-max",.has_arg=1,.flag=0,.val='3'},
+		{.name="map-populate",.has_arg=0,.flag=0,.val='4'},
 		{.name=0,.has_arg=0,.flag=0,.val=0},
 	};
 
@@ -29,7 +79,19 @@ int main(int argc, char *argv[]) {
 	char *dest = NULL;
 	char *d_server = NULL;
 	char *s_server = NULL;
-	int backup=0, restore=0, list_back=0, dry_run=0, verbose=0, d_port = 0, s_port = 0;
+	char *path = NULL;
+	char *cat_path = NULL;
+	uint64_t cat_offset = 0, cat_length = 0;
+	uint64_t cache_bytes = CHUNK_CACHE_DEFAULT_BYTES;
+	int backup=0, restore=0, list_back=0, dry_run=0, verbose=0, serve=0, d_port = 0, s_port = 0, bench_net = 0, bench_clients = 1, prune = 0, check = 0, watch = 0;
+	net_options net_opts = NET_OPTIONS_DEFAULT;
+	server_options srv_opts = SERVER_OPTIONS_DEFAULT;
+	retention_policy policy = RETENTION_POLICY_DEFAULT;
+	check_options check_opts = CHECK_OPTIONS_DEFAULT;
+	estimate_options estimate_opts = ESTIMATE_OPTIONS_DEFAULT;
+	throttle_options throttle_opts = THROTTLE_OPTIONS_DEFAULT;
+	pattern_set patterns;
+	pattern_set_init(&patterns);
 	while ((opt = getopt_long(argc, argv, "", my_opts, NULL)) != -1) {
 		switch (opt) {
 			case 'b':
@@ -76,27 +138,264 @@ int main(int argc, char *argv[]) {
 				verbose = 1;
 				break;
 
+			case 'S':
+				serve = 1;
+				break;
+
+			case 'W':
+				net_opts.window = atoi(optarg);
+				break;
+
+			case 'O':
+				net_opts.sndbuf = atoi(optarg);
+				break;
+
+			case 'I':
+				net_opts.rcvbuf = atoi(optarg);
+				break;
+
+			case 'D':
+				net_opts.nodelay = atoi(optarg);
+				break;
+
+			case 'K':
+				net_opts.cork = 1;
+				break;
+
+			case 'Z':
+				net_opts.zerocopy = 1;
+				break;
+
+			case 'N':
+				bench_net = atoi(optarg);
+				break;
+
+			case 'c':
+				bench_clients = atoi(optarg);
+				break;
+
+			case 'w':
+				srv_opts.workers = atoi(optarg);
+				break;
+
+			case 'm':
+				srv_opts.max_clients = atoi(optarg);
+				break;
+
+			case 'q':
+				srv_opts.quota = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+
+			case 'P':
+				prune = 1;
+				break;
+
+			case 'L':
+				policy.keep_last = atoi(optarg);
+				break;
+
+			case 'y':
+				policy.keep_daily = atoi(optarg);
+				break;
+
+			case 'k':
+				policy.keep_weekly = atoi(optarg);
+				break;
+
+			case 'M':
+				policy.keep_monthly = atoi(optarg);
+				break;
+
+			case 'x':
+				policy.compact_limit = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+
+			case 'f':
+				srv_opts.store.filter_fpr = atof(optarg);
+				break;
+
+			case 'g':
+				srv_opts.store.filter_max_bytes = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+
+			case 'j':
+				srv_opts.store.index_memory = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+
+			case 'C':
+				check = 1;
+				break;
+
+			case 'V':
+				check_opts.verify_percent = atof(optarg);
+				break;
+
+			case 'E':
+				estimate_opts.sample_percent = atof(optarg);
+				break;
+
+			case 'R':
+				throttle_opts.read_bps = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+
+			case 'T':
+				throttle_opts.write_bps = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+
+			case 'Q':
+				throttle_opts.read_iops = (uint32_t)strtoul(optarg, NULL, 10);
+				break;
+
+			case 'n':
+				throttle_opts.nice = atoi(optarg);
+				break;
+
+			case 'o': // "idle" ou niveau 0 à 7 de la classe best-effort
+				if (strcmp(optarg, "idle") == 0) {
+					throttle_opts.ioprio_class = IOPRIO_CLASS_IDLE;
+				} else {
+					throttle_opts.ioprio_class = IOPRIO_CLASS_BE;
+					throttle_opts.ioprio_level = atoi(optarg);
+				}
+				break;
+
+			case 'F':
+				throttle_opts.direct = 1;
+				break;
+
+			case 'A':
+				throttle_opts.latency_target = atof(optarg) / 1000;
+				break;
+
+			case 'i':
+				path = strdup(optarg);
+				break;
+
+			case 'G': // en Mo, 0 pour restaurer sans cache
+				cache_bytes = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+
+			case 'H':
+				watch = 1;
+				break;
+
+			case 'h': // motifs appliqués dans l'ordre, le premier qui correspond l'emporte
+			case 'z':
+				if (pattern_set_add(&patterns, optarg, opt == 'z') == -1) {
+					exit(EXIT_FAILURE);
+				}
+				break;
+
+			case 'J': // nom d'un fichier excluant son dossier, par exemple .nobackup
+				if (pattern_set_add_marker(&patterns, optarg) == -1) {
+					exit(EXIT_FAILURE);
+				}
+				break;
+
+			case '1': // en Mo
+				patterns.max_size = strtoull(optarg, NULL, 10) * 1024 * 1024;
+				break;
+
+			case '2': // en jours
+				patterns.max_age = (time_t)strtoll(optarg, NULL, 10) * 24 * 3600;
+				break;
+
+			case '3': // en octets, 0 pour découper tous les fichiers en chunks
+				srv_opts.store.inline_max = (uint32_t)strtoul(optarg, NULL, 10);
+				if (srv_opts.store.inline_max > MANIFEST_INLINE_LIMIT) {
+					srv_opts.store.inline_max = MANIFEST_INLINE_LIMIT;
+				}
+				break;
+
+			case '4': // charge d'un coup l'index et le cache des fichiers projetés, au lieu de page en page
+				srv_opts.store.populate = 1;
+				break;
+
+			case 'X':
+				cat_path = strdup(optarg);
+				break;
+
+			case 'B':
+				cat_offset = strtoull(optarg, NULL, 10);
+				break;
+
+			case 'U':
+				cat_length = strtoull(optarg, NULL, 10);
+				break;
+
+			case 'Y': // auto, aes-256-gcm ou chacha20-poly1305 (à la création du dépôt)
+				srv_opts.store.encrypt = crypto_parse_cipher(optarg);
+				if (srv_opts.store.encrypt == -1) {
+					fprintf(stderr, "Erreur : chiffrement inconnu : %s\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+
 			case '?': // Option non reconnue
 				fprintf(stderr, "Unknown option encountered.\n");
 				exit(EXIT_FAILURE);
 		}
 	}
 
-    // Gestion des options
-	printf("Liste option :\n backup : %d\n restore : %d\n list-backups : %d\n dry-run : %d\n d-server : %s\n d-port : %d\n s-server : %s\n s-port : %d\n destination %s\n source %s\n verbose %d\n",backup,restore,list_back,dry_run,d_server,d_port,s_server,s_port,dest,source,verbose);
-	if (backup+restore+list_back > 1) {
+	if (pattern_set_compile(&patterns) == -1) {
+		exit(EXIT_FAILURE);
+	}
+	estimate_opts.patterns = &patterns;
+
+    // Gestion des options (les données de --cat sans --dest vont sur la sortie standard)
+	if (cat_path == NULL || dest != NULL) {
+		printf("Liste option :\n backup : %d\n restore : %d\n list-backups : %d\n dry-run : %d\n d-server : %s\n d-port : %d\n s-server : %s\n s-port : %d\n destination %s\n source %s\n verbose %d\n serve %d\n",backup,restore,list_back,dry_run,d_server,d_port,s_server,s_port,dest,source,verbose,serve);
+	}
+	if (backup+restore+list_back+serve+prune+check+watch+(bench_net > 0)+(cat_path != NULL) > 1) {
 		fprintf(stderr, "Erreur : plusieurs options choisies\n");
 		exit(EXIT_FAILURE);
+	} else if ((serve == 1 || d_server != NULL) && srv_opts.store.encrypt != CRYPTO_NONE) {
+		// Les clients envoient des empreintes MD5 sans clé : le serveur ne sert que des dépôts non chiffrés
+		fprintf(stderr, "Erreur : un dépôt chiffré ne peut être utilisé qu'en local\n");
+		exit(EXIT_FAILURE);
+	} else if (backup == 1 && dry_run == 1) {
+		// Estimation sans écriture : l'index consulté doit être local
+		if (source != NULL && dest != NULL && d_server == NULL) {
+			estimate_opts.store = srv_opts.store;
+			if (estimate_backup(source, dest, &estimate_opts) == -1) {
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fprintf(stderr, "Erreur : --dry-run demande une source et une destination locale\n");
+			exit(EXIT_FAILURE);
+		}
+	} else if(backup == 1 && d_server != NULL) {
+		if (source != NULL && d_port > 0) {
+			if (remote_backup(source, d_server, d_port, &net_opts, &throttle_opts, &patterns) == -1) {
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fprintf(stderr, "Erreur : source ou/et port du serveur non spécifiés\n");
+			exit(EXIT_FAILURE);
+		}
 	} else if(backup == 1) {
 		if (source != NULL && dest != NULL) {
-			create_backup(source, dest);
+			if (create_backup(source, dest, &srv_opts.store, &throttle_opts, &patterns) == -1) {
+				exit(EXIT_FAILURE);
+			}
 		} else {
 			fprintf(stderr, "Erreur : source ou/et destination non spécifiées\n");
 			exit(EXIT_FAILURE);
 		}
+	} else if (restore == 1 && s_server != NULL) {
+		if (source != NULL && dest != NULL && s_port > 0) {
+			if (remote_restore(s_server, s_port, source, dest, path, &net_opts) == -1) {
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fprintf(stderr, "Erreur : sauvegarde, destination ou port du serveur non spécifiés\n");
+			exit(EXIT_FAILURE);
+		}
 	} else if (restore == 1) {
 		if (source != NULL && dest != NULL) {
-			restore_backup(source, dest);
+			if (restore_backup(source, dest, path, cache_bytes) == -1) {
+				exit(EXIT_FAILURE);
+			}
 		} else {
 			fprintf(stderr, "Erreur : source ou/et destination non spécifiées\n");
 			exit(EXIT_FAILURE);
@@ -108,7 +407,60 @@ int main(int argc, char *argv[]) {
 			fprintf(stderr, "Erreur : destination non spécifiée\n");
 			exit(EXIT_FAILURE);
 		}
+	} else if (serve == 1) {
+		if (dest != NULL && d_port > 0) {
+			// Le serveur ne s'arrête qu'en cas d'erreur
+			if (serve_repository(dest, d_port, &net_opts, &srv_opts) == -1) {
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fprintf(stderr, "Erreur : destination ou/et port d'écoute non spécifiés\n");
+			exit(EXIT_FAILURE);
+		}
+	} else if (prune == 1) {
+		if (dest != NULL) {
+			if (prune_backups(dest, &policy, dry_run) == -1) {
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fprintf(stderr, "Erreur : destination non spécifiée\n");
+			exit(EXIT_FAILURE);
+		}
+	} else if (check == 1) {
+		if (dest != NULL) {
+			check_opts.workers = srv_opts.workers;
+			if (check_repository(dest, &check_opts) == -1) {
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fprintf(stderr, "Erreur : destination non spécifiée\n");
+			exit(EXIT_FAILURE);
+		}
+	} else if (cat_path != NULL) {
+		if (source != NULL) {
+			if (snapshot_cat(source, cat_path, cat_offset, cat_length, dest) == -1) {
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fprintf(stderr, "Erreur : sauvegarde non spécifiée\n");
+			exit(EXIT_FAILURE);
+		}
+	} else if (watch == 1) {
+		// L'observateur tourne jusqu'à SIGINT ou SIGTERM
+		if (source != NULL && dest != NULL) {
+			if (watch_source(source, dest) == -1) {
+				exit(EXIT_FAILURE);
+			}
+		} else {
+			fprintf(stderr, "Erreur : source ou/et destination non spécifiées\n");
+			exit(EXIT_FAILURE);
+		}
+	} else if (bench_net > 0) {
+		if (network_benchmark(d_port > 0 ? d_port : 19027, (size_t)bench_net, bench_clients, &net_opts, &srv_opts) == -1) {
+			exit(EXIT_FAILURE);
+		}
 	}
+	pattern_set_free(&patterns);
 	
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,1013 @@
+#include "manifest.h"
+#include "arena.h"
+#include "file_handler.h"
+#include "pattern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+/*
+ * Format du manifeste (une ligne par enregistrement) :
+ *   D;<mode>;<mtime>;<chemin>
+ *   F;<mode>;<mtime>;<taille>;<chemin>
+ *   C;<md5>;<taille du chunk>       (une ligne par chunk, à la suite du fichier)
+ *   B;<contenu en base64>           (à la place des chunks, pour un petit fichier)
+ * Le chemin est placé en dernier pour pouvoir contenir des ';'.
+ */
+
+/**
+ * @brief Procédure pour initialiser une entrée vide
+ *
+ * @param entry l'entrée à initialiser
+ */
+void manifest_entry_init(manifest_entry *entry) {
+    memset(entry, 0, sizeof(*entry));
+}
+
+/**
+ * @brief Fonction pour ajouter un chunk à la recette d'un fichier
+ *
+ * @param entry l'entrée du fichier
+ * @param md5 l'empreinte du chunk
+ * @param len la taille du chunk
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int manifest_entry_add_chunk(manifest_entry *entry, const unsigned char *md5, uint32_t len) {
+    if (entry->nb_chunks == entry->capacity) {
+        size_t capacity = entry->capacity ? entry->capacity * 2 : 64;
+        void *new_md5 = realloc(entry->md5, capacity * MD5_DIGEST_LENGTH);
+        if (!new_md5) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        entry->md5 = new_md5;
+        uint32_t *new_len = realloc(entry->len, capacity * sizeof(uint32_t));
+        if (!new_len) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        entry->len = new_len;
+        entry->capacity = capacity;
+    }
+    memcpy(entry->md5[entry->nb_chunks], md5, MD5_DIGEST_LENGTH);
+    entry->len[entry->nb_chunks] = len;
+    entry->nb_chunks++;
+    return 0;
+}
+
+/**
+ * @brief Fonction pour stocker le contenu d'un petit fichier dans son entrée, à la place des chunks
+ *
+ * @param entry l'entrée du fichier, sans chunks
+ * @param data le contenu du fichier
+ * @param len sa taille, au plus MANIFEST_INLINE_LIMIT
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int manifest_entry_set_data(manifest_entry *entry, const void *data, size_t len) {
+    unsigned char *copy = malloc(len ? len : 1);
+    if (!copy) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    memcpy(copy, data, len);
+    free(entry->data);
+    entry->data = copy;
+    entry->size = len;
+    return 0;
+}
+
+/**
+ * @brief Procédure pour libérer la recette d'une entrée
+ *
+ * @param entry l'entrée à libérer
+ */
+void manifest_entry_free(manifest_entry *entry) {
+    free(entry->md5);
+    free(entry->len);
+    free(entry->data);
+    manifest_entry_init(entry);
+}
+
+/**
+ * @brief Fonction pour écrire une entrée dans le manifeste
+ *
+ * @param manifest le fichier manifeste ouvert en écriture
+ * @param entry l'entrée à écrire
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int manifest_write_entry(FILE *manifest, const manifest_entry *entry) {
+    if (entry->type == 'D') {
+        if (fprintf(manifest, "D;%o;%lld;%s\n", (unsigned int)entry->mode, (long long)entry->mtime, entry->path) < 0) {
+            perror("Erreur lors de l'écriture du manifeste");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (fprintf(manifest, "F;%o;%lld;%llu;%s\n", (unsigned int)entry->mode, (long long)entry->mtime,
+                (unsigned long long)entry->size, entry->path) < 0) {
+        perror("Erreur lors de l'écriture du manifeste");
+        return -1;
+    }
+    if (entry->data) {
+        char encoded[(MANIFEST_INLINE_LIMIT + 2) / 3 * 4 + 1];
+        if (entry->size > MANIFEST_INLINE_LIMIT) {
+            fprintf(stderr, "Erreur : %s est trop grand pour le manifeste\n", entry->path);
+            return -1;
+        }
+        EVP_EncodeBlock((unsigned char *)encoded, entry->data, (int)entry->size);
+        if (fprintf(manifest, "B;%s\n", encoded) < 0) {
+            perror("Erreur lors de l'écriture du manifeste");
+            return -1;
+        }
+        return 0;
+    }
+    for (size_t i = 0; i < entry->nb_chunks; i++) {
+        char hex[MD5_DIGEST_LENGTH * 2 + 1];
+        for (int j = 0; j < MD5_DIGEST_LENGTH; j++) {
+            sprintf(&hex[j * 2], "%02x", entry->md5[i][j]);
+        }
+        if (fprintf(manifest, "C;%s;%u\n", hex, entry->len[i]) < 0) {
+            perror("Erreur lors de l'écriture du manifeste");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction convertissant une empreinte hexadécimale en binaire
+ *
+ * @param hex la chaîne de 32 caractères hexadécimaux
+ * @param md5 l'empreinte binaire en sortie
+ * @return int 0 en cas de succès, -1 si la chaîne est invalide
+ */
+static int parse_md5(const char *hex, unsigned char *md5) {
+    for (int i = 0; i < MD5_DIGEST_LENGTH; i++) {
+        unsigned int byte;
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1) {
+            return -1;
+        }
+        md5[i] = (unsigned char)byte;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction décodant la ligne d'en-tête d'une entrée (dossier ou fichier)
+ *
+ * @param line la ligne lue dans le manifeste (son saut de ligne est retiré)
+ * @param entry l'entrée dont le type, les droits, la date, la taille et le chemin sont remplis
+ * @return int 0 en cas de succès, -1 si la ligne est invalide
+ */
+static int parse_entry_line(char *line, manifest_entry *entry) {
+    unsigned int mode;
+    long long mtime;
+    unsigned long long size;
+    int offset = 0;
+
+    line[strcspn(line, "\n")] = '\0';
+    if (sscanf(line, "D;%o;%lld;%n", &mode, &mtime, &offset) == 2 && offset > 0) {
+        entry->type = 'D';
+        size = 0;
+    } else if (sscanf(line, "F;%o;%lld;%llu;%n", &mode, &mtime, &size, &offset) == 3 && offset > 0) {
+        entry->type = 'F';
+    } else {
+        fprintf(stderr, "Erreur : ligne de manifeste invalide : %s\n", line);
+        return -1;
+    }
+    entry->mode = (mode_t)mode;
+    entry->mtime = (time_t)mtime;
+    entry->size = size;
+    snprintf(entry->path, sizeof(entry->path), "%s", line + offset);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour lire l'entrée suivante du manifeste
+ *
+ * Les lignes de chunks qui suivent un fichier sont lues jusqu'à la prochaine
+ * entrée, que l'on détecte en regardant le premier caractère de la ligne.
+ *
+ * @param manifest le fichier manifeste ouvert en lecture
+ * @param entry l'entrée en sortie (sa recette précédente est libérée)
+ * @return int 1 si une entrée a été lue, 0 en fin de fichier, -1 si le manifeste est invalide
+ */
+int manifest_read_entry(FILE *manifest, manifest_entry *entry) {
+    char line[PATH_MAX + 128];
+
+    manifest_entry_free(entry);
+    if (fgets(line, sizeof(line), manifest) == NULL) {
+        return 0;
+    }
+    if (parse_entry_line(line, entry) == -1) {
+        return -1;
+    }
+
+    if (entry->type == 'F') {
+        int c;
+        while ((c = fgetc(manifest)) == 'C') {
+            char hex[MD5_DIGEST_LENGTH * 2 + 1];
+            unsigned int len;
+            unsigned char md5[MD5_DIGEST_LENGTH];
+            if (fgets(line, sizeof(line), manifest) == NULL
+                || sscanf(line, ";%32[0-9a-f];%u", hex, &len) != 2
+                || parse_md5(hex, md5) == -1
+                || manifest_entry_add_chunk(entry, md5, len) == -1) {
+                fprintf(stderr, "Erreur : recette invalide pour %s\n", entry->path);
+                return -1;
+            }
+        }
+        if (c == 'B') {
+            // Le décodage compte les octets de remplissage : seule la taille de l'entrée fait foi
+            unsigned char decoded[MANIFEST_INLINE_LIMIT + 3];
+            int n = -1;
+            if (fgets(line, sizeof(line), manifest) != NULL && line[0] == ';' && entry->size <= MANIFEST_INLINE_LIMIT) {
+                line[strcspn(line, "\n")] = '\0';
+                n = EVP_DecodeBlock(decoded, (const unsigned char *)line + 1, (int)strlen(line + 1));
+            }
+            if (n < (int)entry->size || n > (int)entry->size + 2
+                || manifest_entry_set_data(entry, decoded, (size_t)entry->size) == -1) {
+                fprintf(stderr, "Erreur : contenu invalide pour %s\n", entry->path);
+                return -1;
+            }
+            c = fgetc(manifest);
+        }
+        if (c != EOF) {
+            ungetc(c, manifest);
+        }
+    }
+    return 1;
+}
+
+static int walk_dir(FILE *manifest, const char *root, const char *rel, pattern_set *patterns, int state,
+                    file_chunker chunk, void *ctx);
+
+/**
+ * @brief Fonction écrivant l'entrée d'un chemin déjà examiné par stat
+ *
+ * @param manifest le manifeste en cours de construction
+ * @param root la racine de la sauvegarde
+ * @param entry l'entrée à compléter, dont le chemin est rempli
+ * @param st les informations du chemin
+ * @param recurse 1 pour parcourir aussi le contenu d'un dossier
+ * @param patterns le filtre des entrées (NULL pour tout garder)
+ * @param state la décision du filtre pour ce chemin
+ * @param chunk la fonction découpant chaque fichier
+ * @param ctx le contexte passé à chunk
+ * @return int 0 en cas de succès, -1 si la sauvegarde doit être interrompue
+ */
+static int walk_entry(FILE *manifest, const char *root, manifest_entry *entry, const struct stat *st, int recurse,
+                      pattern_set *patterns, int state, file_chunker chunk, void *ctx) {
+    char src_path[PATH_MAX * 2];
+    snprintf(src_path, sizeof(src_path), "%s/%s", root, entry->path);
+    entry->mode = st->st_mode;
+    entry->mtime = st->st_mtime;
+
+    if (S_ISDIR(st->st_mode)) {
+        entry->type = 'D';
+        if (manifest_write_entry(manifest, entry) == -1) {
+            return -1;
+        }
+        if (recurse) {
+            char sub[PATH_MAX];
+            snprintf(sub, sizeof(sub), "%s", entry->path);
+            return walk_dir(manifest, root, sub, patterns, state, chunk, ctx);
+        }
+    } else if (S_ISREG(st->st_mode)) {
+        entry->type = 'F';
+        int status = chunk(ctx, src_path, entry);
+        if (status == 0) {
+            return manifest_write_entry(manifest, entry);
+        } else if (status == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Entrée d'un dossier lue d'avance, avec ses informations
+typedef struct {
+    ino_t ino;
+    const char *name;       // nom dans l'arène du parcours du dossier
+    struct stat st;
+    int ok;                 // 1 si st est rempli
+} walk_item;
+
+/**
+ * @brief Fonction de comparaison des entrées d'un dossier par numéro d'inode
+ */
+static int compare_items(const void *a, const void *b) {
+    const walk_item *x = a;
+    const walk_item *y = b;
+    return (x->ino > y->ino) - (x->ino < y->ino);
+}
+
+/**
+ * @brief Fonction lisant d'un coup toutes les entrées d'un dossier et leurs informations
+ *
+ * Les noms sont lus jusqu'au bout avant tout stat, puis triés par numéro
+ * d'inode : les inodes voisins partagent leurs blocs de table, et un
+ * dossier de petits fichiers est examiné en parcourant la table dans
+ * l'ordre plutôt qu'au hasard. Chaque stat est relatif au dossier ouvert
+ * (fstatat), sans résoudre de nouveau le chemin complet.
+ *
+ * @param dir_path le chemin du dossier
+ * @param names l'arène recevant les noms
+ * @param items le tableau des entrées en sortie, à libérer par l'appelant
+ * @return ssize_t le nombre d'entrées, -1 si le dossier est illisible
+ */
+static ssize_t read_dir_items(const char *dir_path, arena *names, walk_item **items) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        perror("Erreur lors de l'ouverture du répertoire source");
+        return -1;
+    }
+    size_t count = 0, capacity = 0;
+    struct dirent *dirent;
+    *items = NULL;
+    while ((dirent = readdir(dir)) != NULL) {
+        if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            walk_item *grown = realloc(*items, capacity * sizeof(walk_item));
+            if (!grown) {
+                break;
+            }
+            *items = grown;
+        }
+        walk_item *item = &(*items)[count];
+        item->ino = dirent->d_ino;
+        item->name = arena_strdup(names, dirent->d_name);
+        if (!item->name) {
+            break;
+        }
+        count++;
+    }
+    if (dirent != NULL) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        closedir(dir);
+        free(*items);
+        *items = NULL;
+        return -1;
+    }
+    qsort(*items, count, sizeof(walk_item), compare_items);
+    for (size_t i = 0; i < count; i++) {
+        walk_item *item = &(*items)[i];
+        item->ok = (fstatat(dirfd(dir), item->name, &item->st, 0) == 0);
+        if (!item->ok) {
+            perror("Erreur lors de la récupération des informations sur un fichier");
+        }
+    }
+    closedir(dir);
+    return (ssize_t)count;
+}
+
+/**
+ * @brief Fonction parcourant récursivement un dossier dont la décision du filtre est connue
+ *
+ * Chaque entrée passe par le filtre dès son stat : un dossier exclu n'est
+ * jamais ouvert, ni rien de ce qu'il contient. Le dossier est lu en entier
+ * et refermé avant de descendre dans ses sous-dossiers.
+ *
+ * @param manifest le manifeste en cours de construction
+ * @param root la racine de la sauvegarde
+ * @param rel le chemin relatif du répertoire à parcourir ("" pour la racine)
+ * @param patterns le filtre des entrées (NULL pour tout garder)
+ * @param state la décision du filtre pour ce répertoire
+ * @param chunk la fonction découpant chaque fichier
+ * @param ctx le contexte passé à chunk
+ * @return int 0 en cas de succès, -1 si la sauvegarde doit être interrompue
+ */
+static int walk_dir(FILE *manifest, const char *root, const char *rel, pattern_set *patterns, int state,
+                    file_chunker chunk, void *ctx) {
+    char dir_path[PATH_MAX];
+    arena names;
+    walk_item *items;
+    snprintf(dir_path, sizeof(dir_path), "%s%s%s", root, rel[0] ? "/" : "", rel);
+    arena_init(&names, 4096);
+    ssize_t count = read_dir_items(dir_path, &names, &items);
+    if (count == -1) {
+        arena_free(&names);
+        return rel[0] ? 0 : -1;
+    }
+
+    manifest_entry entry;
+    manifest_entry_init(&entry);
+    int ret = 0;
+    for (ssize_t i = 0; ret == 0 && i < count; i++) {
+        if (!items[i].ok) {
+            continue;
+        }
+        const struct stat *statbuf = &items[i].st;
+        manifest_entry_free(&entry);
+        snprintf(entry.path, sizeof(entry.path), "%s%s%s", rel, rel[0] ? "/" : "", items[i].name);
+        int decision = pattern_check(patterns, root, entry.path, statbuf->st_mode, (uint64_t)statbuf->st_size,
+                                     statbuf->st_mtime, state);
+        if (decision != PATTERN_EXCLUDE) {
+            ret = walk_entry(manifest, root, &entry, statbuf, 1, patterns, decision, chunk, ctx);
+        }
+    }
+    manifest_entry_free(&entry);
+    free(items);
+    arena_free(&names);
+    return ret;
+}
+
+/**
+ * @brief Fonction pour parcourir récursivement un répertoire et écrire son manifeste
+ *
+ * Les dossiers sont écrits avant leur contenu ; le découpage des fichiers
+ * réguliers est délégué à chunk, qui choisit où vont les chunks. Les
+ * entrées écartées par le filtre ne sont ni lues ni parcourues.
+ *
+ * @param manifest le manifeste en cours de construction
+ * @param root la racine de la sauvegarde
+ * @param rel le chemin relatif du répertoire à parcourir ("" pour la racine)
+ * @param patterns le filtre des entrées (NULL pour tout garder)
+ * @param chunk la fonction découpant chaque fichier
+ * @param ctx le contexte passé à chunk
+ * @return int 0 en cas de succès, -1 si la sauvegarde doit être interrompue
+ */
+int manifest_walk(FILE *manifest, const char *root, const char *rel, pattern_set *patterns, file_chunker chunk,
+                  void *ctx) {
+    int state = rel[0] ? pattern_check_path(patterns, root, rel, S_IFDIR, 0, 0) : PATTERN_INCLUDE;
+    if (state == PATTERN_EXCLUDE) {
+        return 0;
+    }
+    return walk_dir(manifest, root, rel, patterns, state, chunk, ctx);
+}
+
+/**
+ * @brief Fonction pour écrire l'entrée d'un seul chemin, et éventuellement le contenu d'un dossier
+ *
+ * Sert aux sauvegardes qui ne revisitent que les chemins modifiés : un
+ * chemin disparu depuis n'est pas une erreur.
+ *
+ * @param manifest le manifeste en cours de construction
+ * @param root la racine de la sauvegarde
+ * @param rel le chemin relatif à examiner
+ * @param recurse 1 pour parcourir aussi le contenu d'un dossier
+ * @param patterns le filtre des entrées (NULL pour tout garder)
+ * @param chunk la fonction découpant chaque fichier
+ * @param ctx le contexte passé à chunk
+ * @return int 0 en cas de succès, 1 si le chemin n'existe plus, -1 si la sauvegarde doit être interrompue
+ */
+int manifest_walk_path(FILE *manifest, const char *root, const char *rel, int recurse, pattern_set *patterns,
+                       file_chunker chunk, void *ctx) {
+    char src_path[PATH_MAX * 2];
+    struct stat statbuf;
+    manifest_entry entry;
+
+    snprintf(src_path, sizeof(src_path), "%s/%s", root, rel);
+    if (stat(src_path, &statbuf) == -1) {
+        return 1;
+    }
+    int state = pattern_check_path(patterns, root, rel, statbuf.st_mode, (uint64_t)statbuf.st_size, statbuf.st_mtime);
+    if (state == PATTERN_EXCLUDE) {
+        return 0;
+    }
+    manifest_entry_init(&entry);
+    snprintf(entry.path, sizeof(entry.path), "%s", rel);
+    int ret = walk_entry(manifest, root, &entry, &statbuf, recurse, patterns, state, chunk, ctx);
+    manifest_entry_free(&entry);
+    return ret;
+}
+
+// Dossier de restauration gardé ouvert : les petits fichiers qui s'y suivent y sont créés par openat
+typedef struct {
+    char dir[PATH_MAX];     // chemin relatif du dossier ouvert
+    int fd;                 // -1 si aucun dossier n'est ouvert
+} restore_cursor;
+
+/**
+ * @brief Fonction restaurant un petit fichier dont le contenu est dans le manifeste
+ *
+ * Les fichiers d'un même dossier se suivent dans le manifeste : le dossier
+ * est ouvert une fois pour tous, et chaque fichier ne coûte qu'une
+ * création, une écriture et sa date, sans résoudre son chemin complet.
+ *
+ * @param entry l'entrée du fichier
+ * @param restore_dir le répertoire où restaurer la sauvegarde
+ * @param cursor le dossier ouvert par le fichier précédent
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int restore_inline(const manifest_entry *entry, const char *restore_dir, restore_cursor *cursor) {
+    char dir[PATH_MAX];
+    char dir_path[PATH_MAX * 2];
+    const char *slash = strrchr(entry->path, '/');
+    const char *name = slash ? slash + 1 : entry->path;
+
+    snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - entry->path) : 0, entry->path);
+    if (cursor->fd == -1 || strcmp(cursor->dir, dir) != 0) {
+        if (cursor->fd != -1) {
+            close(cursor->fd);
+        }
+        snprintf(dir_path, sizeof(dir_path), "%s%s%s", restore_dir, dir[0] ? "/" : "", dir);
+        cursor->fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        snprintf(cursor->dir, sizeof(cursor->dir), "%s", dir);
+        if (cursor->fd == -1) {
+            fprintf(stderr, "Erreur : impossible d'ouvrir %s : %s\n", dir_path, strerror(errno));
+            return -1;
+        }
+    }
+
+    int fd = openat(cursor->fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, entry->mode & 07777);
+    if (fd == -1) {
+        fprintf(stderr, "Erreur : impossible de créer le fichier %s/%s : %s\n", restore_dir, entry->path, strerror(errno));
+        return -1;
+    }
+    int ret = write_full(fd, entry->data, (size_t)entry->size);
+    if (ret == -1) {
+        fprintf(stderr, "Erreur : restauration incomplète de %s/%s\n", restore_dir, entry->path);
+    }
+    struct timespec times[2] = {{0, UTIME_OMIT}, {entry->mtime, 0}};
+    futimens(fd, times);
+    close(fd);
+    return ret;
+}
+
+/**
+ * @brief Fonction restaurant une entrée du manifeste dans un répertoire
+ *
+ * @param entry l'entrée à restaurer
+ * @param restore_dir le répertoire où restaurer la sauvegarde
+ * @param cursor le dossier gardé ouvert pour les petits fichiers
+ * @param fetch la fonction écrivant les chunks d'un fichier dans un descripteur
+ * @param ctx le contexte passé à fetch
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int restore_entry(const manifest_entry *entry, const char *restore_dir, restore_cursor *cursor,
+                         chunk_fetcher fetch, void *ctx) {
+    char out_path[PATH_MAX * 2];
+    int ret = 0;
+
+    snprintf(out_path, sizeof(out_path), "%s/%s", restore_dir, entry->path);
+    if (entry->type == 'D') {
+        if (mkdir(out_path, entry->mode & 07777) == -1 && errno != EEXIST) {
+            fprintf(stderr, "Erreur : impossible de créer %s : %s\n", out_path, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+    if (entry->data) {
+        return restore_inline(entry, restore_dir, cursor);
+    }
+
+    int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, entry->mode & 07777);
+    if (fd == -1) {
+        fprintf(stderr, "Erreur : impossible de créer le fichier %s : %s\n", out_path, strerror(errno));
+        return -1;
+    }
+    if (fetch(ctx, entry, fd) == -1) {
+        fprintf(stderr, "Erreur : restauration incomplète de %s\n", out_path);
+        ret = -1;
+    }
+    close(fd);
+
+    struct timespec times[2] = {{0, UTIME_OMIT}, {entry->mtime, 0}};
+    utimensat(AT_FDCWD, out_path, times, 0);
+    return ret;
+}
+
+/**
+ * @brief Fonction pour restaurer toutes les entrées d'un manifeste dans un répertoire
+ *
+ * @param manifest le fichier manifeste ouvert en lecture
+ * @param restore_dir le répertoire où restaurer la sauvegarde
+ * @param fetch la fonction écrivant les chunks d'un fichier dans un descripteur
+ * @param ctx le contexte passé à fetch
+ * @return int 0 en cas de succès, -1 si au moins un fichier n'a pas pu être restauré
+ */
+int manifest_restore(FILE *manifest, const char *restore_dir, chunk_fetcher fetch, void *ctx) {
+    manifest_entry entry;
+    restore_cursor cursor = {"", -1};
+    int ret = 0;
+    int lu;
+
+    manifest_entry_init(&entry);
+    if (mkdir(restore_dir, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Erreur : impossible de créer %s : %s\n", restore_dir, strerror(errno));
+        return -1;
+    }
+
+    while ((lu = manifest_read_entry(manifest, &entry)) == 1) {
+        if (restore_entry(&entry, restore_dir, &cursor, fetch, ctx) == -1) {
+            ret = -1;
+        }
+    }
+    manifest_entry_free(&entry);
+    if (cursor.fd != -1) {
+        close(cursor.fd);
+    }
+    return (lu == -1) ? -1 : ret;
+}
+
+// En-tête de l'index des chemins d'un manifeste, suivi des positions des
+// entrées dans le manifeste (uint64_t), triées par chemin
+typedef struct {
+    char magic[8];
+    uint64_t entries;
+} path_index_header;
+
+// Entrée du manifeste en cours d'indexation
+typedef struct {
+    uint64_t offset;        // position de la ligne d'en-tête dans le manifeste
+    const char *path;       // chemin de l'entrée (dans l'arène)
+} path_slot;
+
+/**
+ * @brief Fonction de comparaison pour trier les entrées par chemin
+ */
+static int compare_slots(const void *a, const void *b) {
+    return strcmp(((const path_slot *)a)->path, ((const path_slot *)b)->path);
+}
+
+/**
+ * @brief Fonction pour construire l'index des chemins d'un manifeste
+ *
+ * L'index ne contient que la position de chaque entrée, triée par chemin :
+ * 8 octets par entrée, les chemins étant relus dans le manifeste lors des
+ * recherches par dichotomie.
+ *
+ * @param manifest_path le manifeste à indexer
+ * @param index_path le fichier d'index à créer
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int manifest_build_index(const char *manifest_path, const char *index_path) {
+    char line[PATH_MAX + 128];
+    char tmp_path[PATH_MAX + 8];
+    path_slot *slots = NULL;
+    size_t count = 0, capacity = 0;
+    manifest_entry entry;
+    arena pool;
+    int ret = -1;
+
+    FILE *manifest = fopen(manifest_path, "r");
+    if (!manifest) {
+        perror("Erreur lors de l'ouverture du manifeste");
+        return -1;
+    }
+    arena_init(&pool, 0);
+    manifest_entry_init(&entry);
+    off_t offset = 0;
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        // Seules les lignes d'entrée sont indexées, pas les chunks ni le contenu d'un petit fichier
+        if (line[0] != 'C' && line[0] != 'B') {
+            if (parse_entry_line(line, &entry) == -1) {
+                goto fin;
+            }
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                path_slot *new_slots = realloc(slots, capacity * sizeof(path_slot));
+                if (!new_slots) {
+                    fprintf(stderr, "Erreur d'allocation mémoire\n");
+                    goto fin;
+                }
+                slots = new_slots;
+            }
+            slots[count].offset = (uint64_t)offset;
+            slots[count].path = arena_strdup(&pool, entry.path);
+            if (!slots[count].path) {
+                fprintf(stderr, "Erreur d'allocation mémoire\n");
+                goto fin;
+            }
+            count++;
+        }
+        offset = ftello(manifest);
+    }
+    qsort(slots, count, sizeof(path_slot), compare_slots);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", index_path);
+    FILE *index = fopen(tmp_path, "w");
+    if (!index) {
+        perror("Erreur lors de la création de l'index du manifeste");
+        goto fin;
+    }
+    path_index_header header;
+    memcpy(header.magic, MANIFEST_INDEX_MAGIC, sizeof(header.magic));
+    header.entries = count;
+    int written = fwrite(&header, sizeof(header), 1, index) == 1;
+    for (size_t i = 0; written && i < count; i++) {
+        written = fwrite(&slots[i].offset, sizeof(uint64_t), 1, index) == 1;
+    }
+    if (close_synced(index) != 0 || !written || rename(tmp_path, index_path) == -1) {
+        perror("Erreur lors de l'écriture de l'index du manifeste");
+        unlink(tmp_path);
+        goto fin;
+    }
+    ret = 0;
+
+fin:
+    free(slots);
+    arena_free(&pool);
+    fclose(manifest);
+    return ret;
+}
+
+/**
+ * @brief Fonction indiquant si un chemin ou l'un de ses dossiers parents correspond au motif
+ *
+ * Comme pour tar, désigner un dossier restaure tout son contenu.
+ *
+ * @param pattern le motif (syntaxe de fnmatch, '*' ne traversant pas les '/')
+ * @param path le chemin relatif de l'entrée
+ * @return int 1 si l'entrée est à restaurer, 0 sinon
+ */
+static int path_matches(const char *pattern, const char *path) {
+    char prefix[PATH_MAX];
+    snprintf(prefix, sizeof(prefix), "%s", path);
+    for (;;) {
+        if (fnmatch(pattern, prefix, FNM_PATHNAME) == 0) {
+            return 1;
+        }
+        char *slash = strrchr(prefix, '/');
+        if (!slash) {
+            return 0;
+        }
+        *slash = '\0';
+    }
+}
+
+/**
+ * @brief Fonction créant les dossiers parents d'une entrée absents du répertoire de restauration
+ *
+ * @param restore_dir le répertoire de restauration
+ * @param path le chemin relatif de l'entrée
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int make_parents(const char *restore_dir, const char *path) {
+    char dir[PATH_MAX * 2];
+    size_t base = (size_t)snprintf(dir, sizeof(dir), "%s/", restore_dir);
+    for (const char *slash = strchr(path, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        snprintf(dir + base, sizeof(dir) - base, "%.*s", (int)(slash - path), path);
+        if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+            fprintf(stderr, "Erreur : impossible de créer %s : %s\n", dir, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction lisant la position d'une entrée dans l'index des chemins
+ *
+ * @param fd l'index ouvert en lecture
+ * @param i le rang de l'entrée dans l'ordre des chemins
+ * @param offset la position de l'entrée dans le manifeste en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int index_offset(int fd, uint64_t i, uint64_t *offset) {
+    off_t pos = (off_t)(sizeof(path_index_header) + i * sizeof(uint64_t));
+    return (pread(fd, offset, sizeof(*offset), pos) == (ssize_t)sizeof(*offset)) ? 0 : -1;
+}
+
+/**
+ * @brief Fonction lisant l'en-tête de l'entrée du manifeste située à une position donnée
+ *
+ * Les chunks ne sont pas lus : seul le chemin sert à la recherche.
+ *
+ * @param manifest le manifeste ouvert en lecture
+ * @param offset la position de l'entrée
+ * @param entry l'entrée dont l'en-tête est rempli
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int read_header_at(FILE *manifest, uint64_t offset, manifest_entry *entry) {
+    char line[PATH_MAX + 128];
+    if (fseeko(manifest, (off_t)offset, SEEK_SET) == -1 || fgets(line, sizeof(line), manifest) == NULL) {
+        return -1;
+    }
+    return parse_entry_line(line, entry);
+}
+
+/**
+ * @brief Fonction ouvrant l'index des chemins d'un manifeste après avoir vérifié son en-tête
+ *
+ * @param index_path le fichier d'index
+ * @param entries le nombre d'entrées indexées en sortie
+ * @return int le descripteur de l'index, -1 s'il est absent ou invalide
+ */
+static int open_path_index(const char *index_path, uint64_t *entries) {
+    path_index_header header;
+    struct stat st;
+
+    int fd = open(index_path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+        || memcmp(header.magic, MANIFEST_INDEX_MAGIC, sizeof(header.magic)) != 0
+        || (uint64_t)st.st_size != sizeof(header) + header.entries * sizeof(uint64_t)) {
+        fprintf(stderr, "Attention : index du manifeste invalide, parcours complet\n");
+        close(fd);
+        return -1;
+    }
+    *entries = header.entries;
+    return fd;
+}
+
+/**
+ * @brief Fonction cherchant par dichotomie la première entrée dont le chemin n'est pas inférieur à une clé
+ *
+ * Seuls les key_len premiers caractères des chemins sont comparés : la
+ * partie fixe d'un motif donne ainsi la première entrée qui la prolonge, et
+ * une clé comparée avec son '\0' final donne une recherche exacte.
+ *
+ * @param fd l'index ouvert en lecture
+ * @param entries le nombre d'entrées indexées
+ * @param manifest le manifeste ouvert en lecture
+ * @param key la clé cherchée
+ * @param key_len le nombre de caractères comparés
+ * @param entry une entrée de travail (son en-tête est écrasé)
+ * @param first le rang de l'entrée trouvée en sortie (entries si aucune)
+ * @return int 0 en cas de succès, -1 si l'index ou le manifeste est illisible
+ */
+static int index_lower_bound(int fd, uint64_t entries, FILE *manifest, const char *key, size_t key_len,
+                             manifest_entry *entry, uint64_t *first) {
+    uint64_t lo = 0, hi = entries, offset;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (index_offset(fd, mid, &offset) == -1 || read_header_at(manifest, offset, entry) == -1) {
+            return -1;
+        }
+        if (strncmp(entry->path, key, key_len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *first = lo;
+    return 0;
+}
+
+/**
+ * @brief Procédure ramenant un chemin donné par l'utilisateur à la forme du manifeste
+ *
+ * Les chemins du manifeste sont relatifs, sans '/' initial ni final.
+ *
+ * @param path le chemin ou le motif donné
+ * @param out le chemin normalisé en sortie
+ * @param size la taille de out
+ */
+static void normalize_path(const char *path, char *out, size_t size) {
+    while (path[0] == '/' || (path[0] == '.' && path[1] == '/')) {
+        path += (path[0] == '/') ? 1 : 2;
+    }
+    snprintf(out, size, "%s", path);
+    for (size_t n = strlen(out); n > 0 && out[n - 1] == '/'; n--) {
+        out[n - 1] = '\0';
+    }
+}
+
+/**
+ * @brief Fonction pour chercher l'entrée d'un chemin dans un manifeste
+ *
+ * Avec un index, la recherche se fait par dichotomie et ne lit que
+ * l'entrée trouvée et une vingtaine de lignes d'en-tête ; sinon le
+ * manifeste est parcouru depuis le début.
+ *
+ * @param manifest le fichier manifeste ouvert en lecture
+ * @param index_path l'index des chemins du manifeste (NULL ou absent pour un parcours complet)
+ * @param path le chemin cherché, relatif à la racine de la sauvegarde
+ * @param entry l'entrée trouvée en sortie, avec sa recette
+ * @return int 1 si le chemin a été trouvé, 0 s'il est absent, -1 si le manifeste est illisible
+ */
+int manifest_find(FILE *manifest, const char *index_path, const char *path, manifest_entry *entry) {
+    char key[PATH_MAX];
+    uint64_t entries = 0, first, offset;
+    int ret = 0;
+
+    normalize_path(path, key, sizeof(key));
+    int index = index_path ? open_path_index(index_path, &entries) : -1;
+    if (index == -1) {
+        rewind(manifest);
+        while ((ret = manifest_read_entry(manifest, entry)) == 1 && strcmp(entry->path, key) != 0) {
+        }
+        return ret;
+    }
+
+    if (index_lower_bound(index, entries, manifest, key, strlen(key) + 1, entry, &first) == -1) {
+        ret = -1;
+    } else if (first < entries) {
+        if (index_offset(index, first, &offset) == -1 || read_header_at(manifest, offset, entry) == -1) {
+            ret = -1;
+        } else if (strcmp(entry->path, key) == 0) {
+            ret = (fseeko(manifest, (off_t)offset, SEEK_SET) == 0 && manifest_read_entry(manifest, entry) == 1) ? 1 : -1;
+        }
+    }
+    close(index);
+    if (ret == -1) {
+        fprintf(stderr, "Erreur : lecture du manifeste par son index impossible\n");
+    }
+    return ret;
+}
+
+/**
+ * @brief Fonction pour restaurer les entrées d'un manifeste correspondant à un motif
+ *
+ * Toute entrée correspondant au motif, ou contenue dans un dossier qui y
+ * correspond, est restaurée à son chemin relatif sous restore_dir. Avec un
+ * index, seules les entrées dont le chemin commence par la partie fixe du
+ * motif (avant le premier caractère spécial) sont lues : la première est
+ * trouvée par dichotomie, si bien que le travail dépend de ce qui est
+ * restauré et non de la taille de la sauvegarde. Sans index (sauvegardes
+ * plus anciennes ou reçues par le réseau), le manifeste est parcouru en
+ * entier mais seuls les chunks des entrées retenues sont lus.
+ *
+ * @param manifest le fichier manifeste ouvert en lecture
+ * @param index_path l'index des chemins du manifeste (NULL ou absent pour un parcours complet)
+ * @param pattern le motif des chemins à restaurer, relatif à la racine de la sauvegarde
+ * @param restore_dir le répertoire où restaurer les entrées
+ * @param fetch la fonction écrivant les chunks d'un fichier dans un descripteur
+ * @param ctx le contexte passé à fetch
+ * @return int 0 en cas de succès, -1 si rien ne correspond ou si une entrée n'a pas pu être restaurée
+ */
+int manifest_restore_matching(FILE *manifest, const char *index_path, const char *pattern, const char *restore_dir,
+                              chunk_fetcher fetch, void *ctx) {
+    char motif[PATH_MAX];
+    manifest_entry entry;
+    restore_cursor cursor = {"", -1};
+    uint64_t entries = 0, visited = 0, restored = 0, bytes = 0;
+    int ret = 0, broken = 0;
+    int lu = 0;
+
+    normalize_path(pattern, motif, sizeof(motif));
+    if (motif[0] == '\0') {
+        return manifest_restore(manifest, restore_dir, fetch, ctx);
+    }
+    if (mkdir(restore_dir, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Erreur : impossible de créer %s : %s\n", restore_dir, strerror(errno));
+        return -1;
+    }
+
+    manifest_entry_init(&entry);
+    int index = index_path ? open_path_index(index_path, &entries) : -1;
+    if (index != -1) {
+        size_t fixed = strcspn(motif, "*?[\\");
+        uint64_t first, offset;
+
+        broken = index_lower_bound(index, entries, manifest, motif, fixed, &entry, &first) == -1;
+        for (uint64_t i = first; i < entries && !broken; i++) {
+            if (index_offset(index, i, &offset) == -1 || read_header_at(manifest, offset, &entry) == -1) {
+                broken = 1;
+                break;
+            }
+            if (strncmp(entry.path, motif, fixed) != 0) {
+                break;
+            }
+            visited++;
+            if (!path_matches(motif, entry.path)) {
+                continue;
+            }
+            if (fseeko(manifest, (off_t)offset, SEEK_SET) == -1 || manifest_read_entry(manifest, &entry) != 1) {
+                broken = 1;
+                break;
+            }
+            if (make_parents(restore_dir, entry.path) == -1 || restore_entry(&entry, restore_dir, &cursor, fetch, ctx) == -1) {
+                ret = -1;
+            }
+            restored++;
+            bytes += entry.size;
+        }
+        if (broken) {
+            fprintf(stderr, "Erreur : lecture du manifeste par son index impossible\n");
+            ret = -1;
+        }
+        close(index);
+    } else {
+        while ((lu = manifest_read_entry(manifest, &entry)) == 1) {
+            visited++;
+            if (!path_matches(motif, entry.path)) {
+                continue;
+            }
+            if (make_parents(restore_dir, entry.path) == -1 || restore_entry(&entry, restore_dir, &cursor, fetch, ctx) == -1) {
+                ret = -1;
+            }
+            restored++;
+            bytes += entry.size;
+        }
+    }
+    manifest_entry_free(&entry);
+    if (cursor.fd != -1) {
+        close(cursor.fd);
+    }
+    if (lu == -1) {
+        return -1;
+    }
+    if (restored == 0 && ret == 0) {
+        fprintf(stderr, "Erreur : aucune entrée ne correspond à %s\n", motif);
+        return -1;
+    }
+    printf("Restauration partielle : %llu entrées (%llu octets) sur %llu entrées du manifeste consultées\n",
+           (unsigned long long)restored, (unsigned long long)bytes, (unsigned long long)visited);
+    return ret;
+}
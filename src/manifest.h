@@ -0,0 +1,73 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+#include <openssl/md5.h>
+#include "pattern.h"
+
+// Nom du fichier manifeste dans le répertoire d'une sauvegarde
+#define MANIFEST_NAME "manifest"
+
+// Nom de l'index des chemins du manifeste, à côté de celui-ci
+#define MANIFEST_INDEX_NAME "manifest.idx"
+
+// Signature de l'index des chemins d'un manifeste
+#define MANIFEST_INDEX_MAGIC "BORGMFX1"
+
+// Taille maximale d'un petit fichier stocké dans le manifeste (son contenu encodé tient sur une ligne)
+#define MANIFEST_INLINE_LIMIT 2048
+
+// Entrée du manifeste : un dossier, ou un fichier et sa recette de chunks
+typedef struct manifest_entry {
+    char type;              // 'D' pour un dossier, 'F' pour un fichier
+    char path[PATH_MAX];    // chemin relatif à la racine de la sauvegarde
+    mode_t mode;            // droits du fichier
+    time_t mtime;           // date de dernière modification
+    uint64_t size;          // taille logique du fichier
+    size_t nb_chunks;       // nombre de chunks de la recette
+    size_t capacity;        // nombre de chunks alloués
+    unsigned char (*md5)[MD5_DIGEST_LENGTH]; // empreintes des chunks dans l'ordre du fichier
+    uint32_t *len;          // taille de chaque chunk
+    unsigned char *data;    // contenu d'un petit fichier stocké dans le manifeste, de taille size (NULL sinon)
+} manifest_entry;
+
+// Fonction de récupération des chunks d'un fichier lors d'une restauration
+typedef int (*chunk_fetcher)(void *ctx, const manifest_entry *entry, int out_fd);
+
+// Fonction découpant un fichier en chunks lors d'une sauvegarde et complétant sa recette
+// (0 en cas de succès, 1 pour ignorer le fichier, -1 pour interrompre la sauvegarde)
+typedef int (*file_chunker)(void *ctx, const char *path, manifest_entry *entry);
+
+// Procédure pour initialiser une entrée vide
+void manifest_entry_init(manifest_entry *entry);
+// Fonction pour ajouter un chunk à la recette d'un fichier
+int manifest_entry_add_chunk(manifest_entry *entry, const unsigned char *md5, uint32_t len);
+// Fonction pour stocker le contenu d'un petit fichier dans son entrée, à la place des chunks
+int manifest_entry_set_data(manifest_entry *entry, const void *data, size_t len);
+// Procédure pour libérer la recette d'une entrée
+void manifest_entry_free(manifest_entry *entry);
+// Fonction pour écrire une entrée dans le manifeste
+int manifest_write_entry(FILE *manifest, const manifest_entry *entry);
+// Fonction pour lire l'entrée suivante du manifeste
+int manifest_read_entry(FILE *manifest, manifest_entry *entry);
+// Fonction pour parcourir récursivement un répertoire et écrire son manifeste, sans ce qu'écarte le filtre
+int manifest_walk(FILE *manifest, const char *root, const char *rel, pattern_set *patterns, file_chunker chunk,
+                  void *ctx);
+// Fonction pour écrire l'entrée d'un seul chemin (1 s'il n'existe plus), et le contenu d'un dossier si recurse vaut 1
+int manifest_walk_path(FILE *manifest, const char *root, const char *rel, int recurse, pattern_set *patterns,
+                       file_chunker chunk, void *ctx);
+// Fonction pour restaurer toutes les entrées d'un manifeste dans un répertoire
+int manifest_restore(FILE *manifest, const char *restore_dir, chunk_fetcher fetch, void *ctx);
+// Fonction pour construire l'index des chemins d'un manifeste
+int manifest_build_index(const char *manifest_path, const char *index_path);
+// Fonction pour chercher l'entrée d'un chemin dans un manifeste (1 si trouvée, 0 sinon, -1 en cas d'erreur)
+int manifest_find(FILE *manifest, const char *index_path, const char *path, manifest_entry *entry);
+// Fonction pour restaurer les entrées d'un manifeste correspondant à un motif
+int manifest_restore_matching(FILE *manifest, const char *index_path, const char *pattern, const char *restore_dir,
+                              chunk_fetcher fetch, void *ctx);
+
+#endif // MANIFEST_H
@@ -1,10 +1,1840 @@
+#define _GNU_SOURCE // nftw()
+
 #include "network.h"
 #include "file_handler.h"
+#include "deduplication.h"
+#include "chunk_store.h"
+#include "manifest.h"
+#include "backup_manager.h"
+#include "catalog.h"
+#include "chunker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/*
+ * Protocole de transfert : chaque message est précédé d'un en-tête
+ * (type, taille) en ordre réseau.
+ *
+ * Sauvegarde :
+ *   client -> HELLO, puis pour chaque lot de BATCH_SIZE chunks :
+ *   client -> HAVE (empreintes du lot)
+ *   serveur -> NEED (un octet par empreinte, 1 si le chunk manque)
+ *   client -> CHUNK (empreinte + données) pour chaque chunk manquant
+ *   client -> MANIFEST (par morceaux), COMMIT
+ *   serveur -> OK (nom de la sauvegarde créée)
+ * Le client n'attend pas la réponse NEED d'un lot avant d'envoyer les
+ * suivants : jusqu'à window lots sont en vol, ce qui masque la latence.
+ *
+ * Restauration :
+ *   client -> GET_MANIFEST (nom de la sauvegarde)
+ *   serveur -> MANIFEST (par morceaux), OK
+ *   client -> GET_CHUNKS (empreintes), plusieurs demandes en vol
+ *   serveur -> CHUNK pour chaque empreinte demandée
+ */
+enum message_type {
+    MSG_HELLO = 1,
+    MSG_HAVE,
+    MSG_NEED,
+    MSG_CHUNK,
+    MSG_MANIFEST,
+    MSG_COMMIT,
+    MSG_GET_MANIFEST,
+    MSG_GET_CHUNKS,
+    MSG_OK,
+    MSG_ERROR
+};
+
+// Taille maximale d'un message (le plus gros est un morceau de manifeste)
+#define MAX_MESSAGE_SIZE MANIFEST_PART_SIZE
+
+// Taille initiale du tampon de réception d'une connexion (agrandi pour les gros messages)
+#define RECEIVE_BUFFER_INITIAL (128 * 1024)
+
+// Taille du tampon d'écriture des fichiers restaurés
+#define RESTORE_BUFFER_SIZE (1024 * 1024)
+
+// Nombre de listes de la table des chunks demandés et pas encore reçus
+#define PENDING_BUCKETS 4096
+
+// Nombre maximal de chunks demandés à un client et pas encore reçus
+#define MAX_PENDING (64 * BATCH_SIZE)
+
+// Nombre maximal de lectures sur une session avant de passer aux autres
+#define READS_PER_TURN 16
+
+// Délai maximal d'un envoi bloquant vers un client, en secondes
+#define SEND_TIMEOUT 30
+
+// En-tête d'un message
+typedef struct {
+    uint32_t type;
+    uint32_t len;
+} message_header;
+
+// Connexion avec un tampon de réception : plusieurs messages sont lus par appel système
+typedef struct {
+    int fd;
+    unsigned char *buffer;
+    size_t size;  // taille du tampon
+    size_t start; // début des données non consommées
+    size_t end;   // fin des données reçues
+} connection;
+
+// Lot de chunks en attente de négociation avec le serveur
+typedef struct {
+    int count;
+    uint32_t zc_seq; // nombre d'envois MSG_ZEROCOPY à voir terminés avant de réutiliser le lot
+    unsigned char md5[BATCH_SIZE][MD5_DIGEST_LENGTH];
+    uint32_t len[BATCH_SIZE];
+    uint32_t offset[BATCH_SIZE]; // position de chaque chunk dans data
+    size_t used;                 // octets occupés dans data
+    message_header headers[BATCH_SIZE];
+    unsigned char data[BATCH_DATA_SIZE]; // empreinte suivie des données, chunk après chunk
+} upload_batch;
+
+// Fenêtre glissante de lots envoyés au serveur
+typedef struct {
+    connection conn;
+    net_options opts;
+    upload_batch *batches;  // anneau de opts.window lots
+    int head;               // plus ancien lot en vol
+    int in_flight;          // nombre de lots en attente de la réponse NEED
+    int current;            // lot en cours de remplissage
+    uint32_t zc_sent;       // nombre d'envois MSG_ZEROCOPY effectués
+    uint32_t zc_done;       // nombre d'envois MSG_ZEROCOPY terminés
+    unsigned long long bytes_total; // octets lus dans la source
+    unsigned long long bytes_sent;  // octets de chunks envoyés au serveur
+    throttle *throttle;     // limitation des lectures de la source
+    chunker chunker;        // découpage des fichiers de la source
+} upload_pipeline;
+
+// Chunk demandé à un client mais pas encore reçu
+typedef struct pending_node {
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    struct pending_node *next;
+} pending_node;
+
+// Serveur : dépôt partagé par toutes les sessions et threads de traitement
+typedef struct {
+    chunk_store store;
+    pthread_mutex_t lock;  // protège le dépôt et le compteur de sessions
+    const char *repo_dir;
+    server_options opts;
+    int epoll_fd;
+    int listen_fd;
+    int clients;           // nombre de sessions ouvertes
+} server;
+
+// Session d'un client côté serveur
+typedef struct {
+    connection conn;
+    server *srv;
+    int hello;                       // 1 une fois la version du protocole vérifiée
+    unsigned long long stored;       // octets de nouveaux chunks écrits par la session
+    unsigned long long committed;    // valeur de stored à la dernière sauvegarde validée
+    double started;                  // début de la sauvegarde en cours
+    size_t nb_pending;               // nombre de chunks demandés et pas encore reçus
+    FILE *tmp;                       // manifeste en cours de réception
+    char tmp_path[PATH_MAX + 32];
+    pending_node *pending[PENDING_BUCKETS];
+    message_header *reply_headers;   // en-têtes des réponses à GET_CHUNKS
+    unsigned char *reply_data;       // données des réponses à GET_CHUNKS
+} session;
+
+// Contexte d'une restauration distante
+typedef struct {
+    connection *conn;
+    int window;
+    unsigned char *out;  // tampon d'écriture du fichier restauré
+} restore_context;
+
+/**
+ * @brief Fonction mesurant le temps écoulé en secondes
+ *
+ * @return double le temps d'une horloge monotone
+ */
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Fonction envoyant entièrement un tableau de tampons en un minimum d'appels système
+ *
+ * @param fd la socket
+ * @param iov les tampons (le tableau est modifié au fil de l'envoi)
+ * @param iovcnt le nombre de tampons
+ * @param zerocopy 1 pour utiliser MSG_ZEROCOPY
+ * @param zc_sent compteur des envois MSG_ZEROCOPY (peut être NULL si zerocopy vaut 0)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int send_iov(int fd, struct iovec *iov, int iovcnt, int zerocopy, uint32_t *zc_sent) {
+    int flags = MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0);
+    while (iovcnt > 0) {
+        struct msghdr msg = {0};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (iovcnt > IOV_MAX) ? IOV_MAX : iovcnt;
+        ssize_t n = sendmsg(fd, &msg, flags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                flags &= ~MSG_ZEROCOPY; // Plus de mémoire pour épingler les pages : envoi classique
+                continue;
+            }
+            perror("Erreur lors de l'envoi");
+            return -1;
+        }
+        if (flags & MSG_ZEROCOPY) {
+            (*zc_sent)++;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0 && n > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction envoyant un message (en-tête et contenu en un seul appel système)
+ *
+ * @param fd la socket
+ * @param type le type du message
+ * @param payload le contenu du message
+ * @param len la taille du contenu
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int send_message(int fd, uint32_t type, const void *payload, uint32_t len) {
+    message_header header = {htonl(type), htonl(len)};
+    struct iovec iov[2] = {{&header, sizeof(header)}, {(void *)payload, len}};
+    return send_iov(fd, iov, len > 0 ? 2 : 1, 0, NULL);
+}
+
+/**
+ * @brief Fonction initialisant une connexion et son tampon de réception
+ *
+ * @param conn la connexion
+ * @param fd la socket
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int connection_init(connection *conn, int fd) {
+    conn->fd = fd;
+    conn->start = 0;
+    conn->end = 0;
+    conn->size = RECEIVE_BUFFER_INITIAL;
+    conn->buffer = malloc(conn->size);
+    if (!conn->buffer) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure fermant une connexion et libérant son tampon
+ *
+ * @param conn la connexion
+ */
+static void connection_close(connection *conn) {
+    if (conn->fd != -1) {
+        close(conn->fd);
+    }
+    free(conn->buffer);
+    conn->buffer = NULL;
+    conn->fd = -1;
+}
+
+/**
+ * @brief Fonction garantissant la place pour need octets non consommés dans le tampon
+ *
+ * Les données non consommées sont ramenées au début du tampon, qui est agrandi
+ * si nécessaire. Les contenus de messages déjà rendus deviennent invalides.
+ *
+ * @param conn la connexion
+ * @param need le nombre d'octets voulus
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int connection_reserve(connection *conn, size_t need) {
+    if (conn->size - conn->start >= need) {
+        return 0;
+    }
+    if (conn->start > 0) {
+        memmove(conn->buffer, conn->buffer + conn->start, conn->end - conn->start);
+        conn->end -= conn->start;
+        conn->start = 0;
+    }
+    if (conn->size >= need) {
+        return 0;
+    }
+    size_t size = conn->size * 2;
+    while (size < need) {
+        size *= 2;
+    }
+    unsigned char *buffer = realloc(conn->buffer, size);
+    if (!buffer) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    conn->buffer = buffer;
+    conn->size = size;
+    return 0;
+}
+
+/**
+ * @brief Fonction lisant sur la socket les données disponibles
+ *
+ * @param conn la connexion
+ * @param flags MSG_DONTWAIT pour ne pas bloquer, 0 sinon
+ * @return ssize_t le nombre d'octets lus, 0 si rien n'est disponible, -1 en cas d'erreur ou de fermeture
+ */
+static ssize_t connection_recv(connection *conn, int flags) {
+    if (connection_reserve(conn, conn->end - conn->start + 1) == -1) {
+        return -1;
+    }
+    for (;;) {
+        ssize_t n = recv(conn->fd, conn->buffer + conn->end, conn->size - conn->end, flags);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && (flags & MSG_DONTWAIT)) {
+            return 0;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        conn->end += (size_t)n;
+        return n;
+    }
+}
+
+/**
+ * @brief Fonction extrayant le prochain message complet du tampon de réception
+ *
+ * Le contenu pointe dans le tampon de la connexion et n'est valable que
+ * jusqu'à la lecture suivante sur la connexion.
+ *
+ * @param conn la connexion
+ * @param type le type du message en sortie
+ * @param payload le contenu en sortie
+ * @param len la taille du contenu en sortie
+ * @return int 1 si un message a été extrait, 0 s'il est incomplet, -1 s'il est invalide
+ */
+static int connection_parse(connection *conn, uint32_t *type, unsigned char **payload, uint32_t *len) {
+    message_header header;
+    if (conn->end - conn->start < sizeof(header)) {
+        return 0;
+    }
+    memcpy(&header, conn->buffer + conn->start, sizeof(header));
+    *type = ntohl(header.type);
+    *len = ntohl(header.len);
+    if (*len > MAX_MESSAGE_SIZE) {
+        fprintf(stderr, "Erreur : message trop grand (%u octets)\n", *len);
+        return -1;
+    }
+    if (conn->end - conn->start < sizeof(header) + *len) {
+        return (connection_reserve(conn, sizeof(header) + *len) == -1) ? -1 : 0;
+    }
+    *payload = conn->buffer + conn->start + sizeof(header);
+    conn->start += sizeof(header) + *len;
+    return 1;
+}
+
+/**
+ * @brief Fonction recevant un message en attendant qu'il soit complet
+ *
+ * @param conn la connexion
+ * @param type le type du message en sortie
+ * @param payload le contenu en sortie
+ * @param len la taille du contenu en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int receive_message(connection *conn, uint32_t *type, unsigned char **payload, uint32_t *len) {
+    int ret;
+    while ((ret = connection_parse(conn, type, payload, len)) == 0) {
+        if (connection_recv(conn, 0) == -1) {
+            return -1;
+        }
+    }
+    return (ret == 1) ? 0 : -1;
+}
+
+/**
+ * @brief Procédure affichant l'erreur renvoyée par le correspondant
+ *
+ * @param type le type du message reçu
+ * @param payload le contenu du message
+ * @param len la taille du contenu
+ */
+static void print_remote_error(uint32_t type, const unsigned char *payload, uint32_t len) {
+    if (type == MSG_ERROR) {
+        fprintf(stderr, "Erreur du serveur : %.*s\n", (int)len, (const char *)payload);
+    } else {
+        fprintf(stderr, "Erreur : réponse inattendue du serveur\n");
+    }
+}
+
+/**
+ * @brief Fonction attendant un OK du correspondant et affichant une éventuelle erreur
+ *
+ * @param conn la connexion
+ * @param reply une copie du contenu de la réponse en sortie (peut être NULL)
+ * @return int 0 si la réponse est OK, -1 sinon
+ */
+static int expect_ok(connection *conn, char **reply) {
+    uint32_t type, len;
+    unsigned char *payload;
+    if (receive_message(conn, &type, &payload, &len) == -1) {
+        fprintf(stderr, "Erreur : connexion interrompue\n");
+        return -1;
+    }
+    if (type != MSG_OK) {
+        print_remote_error(type, payload, len);
+        return -1;
+    }
+    if (reply) {
+        *reply = strndup((const char *)payload, len);
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure appliquant les réglages TCP à une socket
+ *
+ * Les tailles de tampons doivent être fixées avant connect()/listen() pour
+ * que le facteur d'échelle de la fenêtre TCP en tienne compte.
+ *
+ * @param fd la socket
+ * @param opts les réglages du transport
+ */
+static void apply_socket_options(int fd, const net_options *opts) {
+    if (opts->sndbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &opts->sndbuf, sizeof(opts->sndbuf)) == -1) {
+        perror("SO_SNDBUF");
+    }
+    if (opts->rcvbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opts->rcvbuf, sizeof(opts->rcvbuf)) == -1) {
+        perror("SO_RCVBUF");
+    }
+    if (opts->nodelay) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+}
+
+/**
+ * @brief Procédure activant ou désactivant TCP_CORK si l'option est demandée
+ *
+ * @param fd la socket
+ * @param opts les réglages du transport
+ * @param on 1 pour retenir les segments partiels, 0 pour les envoyer
+ */
+static void set_cork(int fd, const net_options *opts, int on) {
+    if (opts->cork) {
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+    }
+}
+
+/**
+ * @brief Fonction ouvrant une connexion TCP vers un serveur et vérifiant la version du protocole
+ *
+ * @param conn la connexion à initialiser
+ * @param server_address le nom ou l'adresse du serveur
+ * @param port le port du serveur
+ * @param opts les réglages du transport
+ * @param attempts le nombre de tentatives de connexion (espacées de 100 ms)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int connect_to_server(connection *conn, const char *server_address, int port, const net_options *opts, int attempts) {
+    struct addrinfo hints = {0}, *res, *rp;
+    char port_str[16];
+    int fd = -1;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    int err = getaddrinfo(server_address, port_str, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "Erreur : impossible de résoudre %s : %s\n", server_address, gai_strerror(err));
+        return -1;
+    }
+    for (int attempt = 0; fd == -1 && attempt < attempts; attempt++) {
+        if (attempt > 0) {
+            usleep(100000);
+        }
+        for (rp = res; rp != NULL; rp = rp->ai_next) {
+            fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+            if (fd == -1) {
+                continue;
+            }
+            apply_socket_options(fd, opts);
+            if (connect(fd, rp->ai_addr, rp->ai_addrlen) == 0) {
+                break;
+            }
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd == -1) {
+        fprintf(stderr, "Erreur : impossible de se connecter à %s:%d\n", server_address, port);
+        return -1;
+    }
+
+    if (connection_init(conn, fd) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (send_message(fd, MSG_HELLO, PROTOCOL_VERSION, strlen(PROTOCOL_VERSION)) == -1 || expect_ok(conn, NULL) == -1) {
+        connection_close(conn);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction lisant les notifications de fin d'envoi MSG_ZEROCOPY
+ *          jusqu'à ce que target envois soient terminés
+ *
+ * @param pipeline la fenêtre d'envoi
+ * @param target le nombre d'envois qui doivent être terminés
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int wait_zerocopy(upload_pipeline *pipeline, uint32_t target) {
+    while ((int32_t)(pipeline->zc_done - target) < 0) {
+        char control[128];
+        struct msghdr msg = {0};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(pipeline->conn.fd, &msg, MSG_ERRQUEUE) == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                struct pollfd pfd = {pipeline->conn.fd, 0, 0};
+                poll(&pfd, 1, 1000); // POLLERR signale une notification disponible
+                continue;
+            }
+            perror("Erreur lors de la lecture des notifications MSG_ZEROCOPY");
+            return -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_errno == 0 && serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                pipeline->zc_done = serr->ee_data + 1; // Intervalle [ee_info, ee_data] terminé
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction initialisant la fenêtre d'envoi sur une connexion établie
+ *
+ * @param pipeline la fenêtre à initialiser
+ * @param opts les réglages du transport
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int pipeline_init(upload_pipeline *pipeline, const net_options *opts) {
+    pipeline->opts = *opts;
+    if (pipeline->opts.window < 1) {
+        pipeline->opts.window = 1;
+    }
+    pipeline->batches = calloc((size_t)pipeline->opts.window, sizeof(upload_batch));
+    if (!pipeline->batches) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    if (pipeline->opts.zerocopy) {
+        int one = 1;
+        if (setsockopt(pipeline->conn.fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == -1) {
+            fprintf(stderr, "MSG_ZEROCOPY indisponible, envoi classique\n");
+            pipeline->opts.zerocopy = 0;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction traitant la réponse NEED du plus ancien lot en vol
+ *          et envoyant d'un seul tenant les chunks demandés
+ *
+ * @param pipeline la fenêtre d'envoi
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int pipeline_complete_oldest(upload_pipeline *pipeline) {
+    struct iovec iov[2 * BATCH_SIZE];
+    upload_batch *batch = &pipeline->batches[pipeline->head];
+    uint32_t type, len;
+    unsigned char *need;
+    int iovcnt = 0;
+
+    if (receive_message(&pipeline->conn, &type, &need, &len) == -1) {
+        fprintf(stderr, "Erreur : connexion interrompue\n");
+        return -1;
+    }
+    if (type != MSG_NEED || len != (uint32_t)batch->count) {
+        print_remote_error(type, need, len);
+        return -1;
+    }
+
+    for (int i = 0; i < batch->count; i++) {
+        if (need[i]) {
+            batch->headers[i].type = htonl(MSG_CHUNK);
+            batch->headers[i].len = htonl(MD5_DIGEST_LENGTH + batch->len[i]);
+            iov[iovcnt].iov_base = &batch->headers[i];
+            iov[iovcnt++].iov_len = sizeof(message_header);
+            iov[iovcnt].iov_base = batch->data + batch->offset[i];
+            iov[iovcnt++].iov_len = MD5_DIGEST_LENGTH + batch->len[i];
+            pipeline->bytes_sent += batch->len[i];
+        }
+    }
+    if (iovcnt > 0) {
+        set_cork(pipeline->conn.fd, &pipeline->opts, 1);
+        if (send_iov(pipeline->conn.fd, iov, iovcnt, pipeline->opts.zerocopy, &pipeline->zc_sent) == -1) {
+            return -1;
+        }
+        set_cork(pipeline->conn.fd, &pipeline->opts, 0);
+    }
+    batch->zc_seq = pipeline->zc_sent;
+    pipeline->head = (pipeline->head + 1) % pipeline->opts.window;
+    pipeline->in_flight--;
+    return 0;
+}
+
+/**
+ * @brief Fonction envoyant les empreintes du lot courant sans attendre la réponse,
+ *          puis passant au lot suivant de l'anneau
+ *
+ * @param pipeline la fenêtre d'envoi
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int pipeline_send_batch(upload_pipeline *pipeline) {
+    upload_batch *batch = &pipeline->batches[pipeline->current];
+    if (batch->count == 0) {
+        return 0;
+    }
+    if (send_message(pipeline->conn.fd, MSG_HAVE, batch->md5, batch->count * MD5_DIGEST_LENGTH) == -1) {
+        return -1;
+    }
+    pipeline->in_flight++;
+    if (pipeline->in_flight == pipeline->opts.window && pipeline_complete_oldest(pipeline) == -1) {
+        return -1;
+    }
+
+    // Le lot suivant de l'anneau est libre, mais le noyau lit peut-être encore ses pages
+    pipeline->current = (pipeline->current + 1) % pipeline->opts.window;
+    batch = &pipeline->batches[pipeline->current];
+    batch->count = 0;
+    batch->used = 0;
+    return pipeline->opts.zerocopy ? wait_zerocopy(pipeline, batch->zc_seq) : 0;
+}
+
+/**
+ * @brief Fonction donnant l'emplacement où lire les données du prochain chunk
+ *
+ * @param pipeline la fenêtre d'envoi
+ * @return unsigned char* un tampon de CHUNK_MAX_SIZE octets
+ */
+static unsigned char *pipeline_slot(upload_pipeline *pipeline) {
+    upload_batch *batch = &pipeline->batches[pipeline->current];
+    return batch->data + batch->used + MD5_DIGEST_LENGTH;
+}
+
+/**
+ * @brief Fonction ajoutant au lot courant le chunk lu dans pipeline_slot()
+ *
+ * Les chunks sont rangés bout à bout : le lot part dès qu'il est plein ou
+ * qu'il ne peut plus recevoir un chunk de CHUNK_MAX_SIZE octets.
+ *
+ * @param pipeline la fenêtre d'envoi
+ * @param len la taille du chunk
+ * @param md5 l'empreinte du chunk en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int pipeline_commit(upload_pipeline *pipeline, uint32_t len, unsigned char *md5) {
+    upload_batch *batch = &pipeline->batches[pipeline->current];
+    unsigned char *slot = batch->data + batch->used;
+    compute_md5(slot + MD5_DIGEST_LENGTH, len, slot);
+    memcpy(batch->md5[batch->count], slot, MD5_DIGEST_LENGTH);
+    memcpy(md5, slot, MD5_DIGEST_LENGTH);
+    batch->len[batch->count] = len;
+    batch->offset[batch->count] = (uint32_t)batch->used;
+    batch->used += MD5_DIGEST_LENGTH + len;
+    batch->count++;
+    pipeline->bytes_total += len;
+    int full = batch->count == BATCH_SIZE || BATCH_DATA_SIZE - batch->used < MD5_DIGEST_LENGTH + CHUNK_MAX_SIZE;
+    return full ? pipeline_send_batch(pipeline) : 0;
+}
+
+/**
+ * @brief Fonction envoyant le dernier lot et vidant la fenêtre
+ *
+ * @param pipeline la fenêtre d'envoi
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int pipeline_finish(upload_pipeline *pipeline) {
+    if (pipeline_send_batch(pipeline) == -1) {
+        return -1;
+    }
+    while (pipeline->in_flight > 0) {
+        if (pipeline_complete_oldest(pipeline) == -1) {
+            return -1;
+        }
+    }
+    return pipeline->opts.zerocopy ? wait_zerocopy(pipeline, pipeline->zc_sent) : 0;
+}
+
+/**
+ * @brief Procédure libérant la fenêtre d'envoi et son découpeur, et fermant sa connexion
+ *
+ * @param pipeline la fenêtre d'envoi
+ */
+static void pipeline_close(upload_pipeline *pipeline) {
+    connection_close(&pipeline->conn);
+    free(pipeline->batches);
+    pipeline->batches = NULL;
+    chunker_free(&pipeline->chunker);
+}
+
+/**
+ * @brief Fonction découpant un fichier en chunks copiés dans les lots à négocier
+ *          et construisant sa recette
+ *
+ * Le fichier est découpé comme par une sauvegarde locale, selon la
+ * politique que chunker_choose tire de son format. Le client n'a pas de
+ * cache des fichiers : sans historique, un fichier au faible rendement
+ * reste découpé selon son contenu. Aucun fichier n'est recopié dans le
+ * manifeste, le client ne sachant pas si le dépôt du serveur est chiffré.
+ *
+ * @param ctx la fenêtre d'envoi
+ * @param path le chemin du fichier
+ * @param entry l'entrée du manifeste à compléter
+ * @return int 0 en cas de succès, 1 si le fichier est illisible, -1 si le transfert a échoué
+ */
+static int upload_file(void *ctx, const char *path, manifest_entry *entry) {
+    upload_pipeline *pipeline = ctx;
+    int fd = throttle_open(pipeline->throttle, path);
+    if (fd == -1) {
+        perror("Erreur lors de l'ouverture du fichier");
+        return 1;
+    }
+    if (chunker_start(&pipeline->chunker, pipeline->throttle, fd, 0) == -1) {
+        perror("Erreur lors de la lecture du fichier");
+        throttle_close(pipeline->throttle, fd);
+        return 1;
+    }
+    chunker_choose(&pipeline->chunker, entry->path, 0, NULL);
+
+    const unsigned char *data;
+    ssize_t bytes_lus;
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    entry->size = 0;
+    while ((bytes_lus = chunker_next(&pipeline->chunker, pipeline->throttle, fd, &data)) > 0) {
+        memcpy(pipeline_slot(pipeline), data, (size_t)bytes_lus);
+        entry->size += (uint64_t)bytes_lus;
+        if (pipeline_commit(pipeline, (uint32_t)bytes_lus, md5) == -1
+            || manifest_entry_add_chunk(entry, md5, (uint32_t)bytes_lus) == -1) {
+            throttle_close(pipeline->throttle, fd);
+            return -1;
+        }
+    }
+    throttle_close(pipeline->throttle, fd);
+    // Une recette tronquée serait restaurée comme un fichier complet : le fichier est écarté
+    if (bytes_lus < 0) {
+        perror("Erreur lors de la lecture du fichier");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction envoyant un manifeste par morceaux
+ *
+ * @param fd la socket
+ * @param manifest le manifeste ouvert en lecture
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int send_manifest(int fd, FILE *manifest) {
+    char *buffer = malloc(MANIFEST_PART_SIZE);
+    size_t n;
+    int ret = 0;
+    if (!buffer) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    rewind(manifest);
+    while (ret == 0 && (n = fread(buffer, 1, MANIFEST_PART_SIZE, manifest)) > 0) {
+        ret = send_message(fd, MSG_MANIFEST, buffer, (uint32_t)n);
+    }
+    free(buffer);
+    return ret;
+}
+
+/**
+ * @brief Fonction pour sauvegarder un répertoire sur un serveur distant
+ *
+ * Les empreintes des chunks sont envoyées par lots et seuls les chunks que le
+ * serveur ne possède pas encore traversent le réseau, suivis du manifeste.
+ * Les empreintes sont des MD5 sans clé : le dépôt du serveur ne peut pas
+ * être chiffré (voir serve_repository).
+ *
+ * @param source_dir le répertoire à sauvegarder
+ * @param server_address le nom ou l'adresse du serveur
+ * @param port le port du serveur
+ * @param opts les réglages du transport (NULL pour les valeurs par défaut)
+ * @param throttle_opts les limites de lecture de la source (NULL pour aucune limite)
+ * @param patterns le filtre des entrées de la source (NULL pour tout garder)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int remote_backup(const char *source_dir, const char *server_address, int port, const net_options *opts,
+                  const throttle_options *throttle_opts, pattern_set *patterns) {
+    static const net_options defaults = NET_OPTIONS_DEFAULT;
+    upload_pipeline pipeline = {0};
+    throttle limits;
+    FILE *manifest = tmpfile();
+    char *name = NULL;
+    char origin[PATH_MAX + 300];
+    char host[256] = "?";
+    char *source_path = realpath(source_dir, NULL);
+    int ret = -1;
+
+    gethostname(host, sizeof(host) - 1);
+    snprintf(origin, sizeof(origin), "%s:%s", host, source_path ? source_path : source_dir);
+    free(source_path);
+    pipeline.conn.fd = -1;
+    if (!opts) {
+        opts = &defaults;
+    }
+    if (!manifest) {
+        perror("Erreur lors de la création du manifeste temporaire");
+        return -1;
+    }
+    if (throttle_init(&limits, throttle_opts) == -1) {
+        fclose(manifest);
+        return -1;
+    }
+    throttle_apply_priority(&limits);
+    pipeline.throttle = &limits;
+    if (connect_to_server(&pipeline.conn, server_address, port, opts, 1) == -1 || pipeline_init(&pipeline, opts) == -1
+        || chunker_init(&pipeline.chunker) == -1) {
+        goto fin;
+    }
+
+    printf("Sauvegarde de %s vers %s:%d\n", source_dir, server_address, port);
+    double debut = now_seconds();
+    if (manifest_walk(manifest, source_dir, "", patterns, upload_file, &pipeline) == -1 || pipeline_finish(&pipeline) == -1
+        || send_manifest(pipeline.conn.fd, manifest) == -1
+        || send_message(pipeline.conn.fd, MSG_COMMIT, origin, strlen(origin)) == -1
+        || expect_ok(&pipeline.conn, &name) == -1) {
+        fprintf(stderr, "Erreur : la sauvegarde distante a échoué\n");
+        goto fin;
+    }
+    double duree = now_seconds() - debut;
+
+    printf("Sauvegarde distante terminée : %s\n", name ? name : "?");
+    printf("Octets lus : %llu, octets envoyés : %llu (%.1f%% évités)\n", pipeline.bytes_total, pipeline.bytes_sent,
+           pipeline.bytes_total ? 100.0 * (double)(pipeline.bytes_total - pipeline.bytes_sent) / (double)pipeline.bytes_total : 0.0);
+    printf("Durée : %.2f s, débit source : %.1f Mo/s\n", duree, duree > 0 ? (double)pipeline.bytes_total / duree / 1e6 : 0.0);
+    throttle_report(&limits);
+    ret = 0;
 
-void send_data(const char *server_address, int port, const void *data, size_t size) {
-    // Implémenter la logique d'envoi de données à un serveur distant
+fin:
+    throttle_free(&limits);
+    pipeline_close(&pipeline);
+    free(name);
+    fclose(manifest);
+    return ret;
 }
 
-void receive_data(int port, void **data, size_t *size) {
-    // Implémenter la logique de réception de données depuis un serveur distant
+/**
+ * @brief Fonction demandant au serveur les chunks d'un fichier et les écrivant dans l'ordre
+ *
+ * Plusieurs demandes GET_CHUNKS restent en vol pour ne pas payer un aller-retour par lot.
+ *
+ * @param ctx le contexte de restauration
+ * @param entry l'entrée du fichier à restaurer
+ * @param out_fd le fichier de sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int fetch_remote(void *ctx, const manifest_entry *entry, int out_fd) {
+    restore_context *restore = ctx;
+    size_t requested = 0;
+    size_t filled = 0;
+    size_t max_in_flight = (size_t)restore->window * BATCH_SIZE;
+
+    for (size_t i = 0; i < entry->nb_chunks; i++) {
+        while (requested < entry->nb_chunks && requested - i < max_in_flight) {
+            size_t count = entry->nb_chunks - requested;
+            if (count > BATCH_SIZE) {
+                count = BATCH_SIZE;
+            }
+            if (send_message(restore->conn->fd, MSG_GET_CHUNKS, entry->md5[requested], (uint32_t)(count * MD5_DIGEST_LENGTH)) == -1) {
+                return -1;
+            }
+            requested += count;
+        }
+
+        uint32_t type, len;
+        unsigned char *payload;
+        if (receive_message(restore->conn, &type, &payload, &len) == -1) {
+            fprintf(stderr, "Erreur : connexion interrompue\n");
+            return -1;
+        }
+        if (type != MSG_CHUNK || len != MD5_DIGEST_LENGTH + entry->len[i]
+            || memcmp(payload, entry->md5[i], MD5_DIGEST_LENGTH) != 0) {
+            print_remote_error(type, payload, len);
+            return -1;
+        }
+        if (filled + entry->len[i] > RESTORE_BUFFER_SIZE) {
+            if (write(out_fd, restore->out, filled) != (ssize_t)filled) {
+                perror("Erreur lors de l'écriture de la data dans le fichier");
+                return -1;
+            }
+            filled = 0;
+        }
+        memcpy(restore->out + filled, payload + MD5_DIGEST_LENGTH, entry->len[i]);
+        filled += entry->len[i];
+    }
+    if (filled > 0 && write(out_fd, restore->out, filled) != (ssize_t)filled) {
+        perror("Erreur lors de l'écriture de la data dans le fichier");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour restaurer une sauvegarde depuis un serveur distant
+ *
+ * @param server_address le nom ou l'adresse du serveur
+ * @param port le port du serveur
+ * @param backup_id le nom de la sauvegarde sur le serveur
+ * Avec un motif, le manifeste est reçu en entier mais seuls les chunks des
+ * entrées retenues sont demandés au serveur.
+ *
+ * @param restore_dir le répertoire où restaurer la sauvegarde
+ * @param pattern le motif des chemins à restaurer (NULL pour toute la sauvegarde)
+ * @param opts les réglages du transport (NULL pour les valeurs par défaut)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int remote_restore(const char *server_address, int port, const char *backup_id, const char *restore_dir,
+                   const char *pattern, const net_options *opts) {
+    static const net_options defaults = NET_OPTIONS_DEFAULT;
+    connection conn = {-1, NULL, 0, 0, 0};
+    restore_context restore = {&conn, 0, NULL};
+    FILE *manifest = tmpfile();
+    int ret = -1;
+
+    if (!opts) {
+        opts = &defaults;
+    }
+    restore.window = opts->window > 0 ? opts->window : 1;
+    restore.out = malloc(RESTORE_BUFFER_SIZE);
+    if (!manifest || !restore.out) {
+        fprintf(stderr, "Erreur lors de la préparation de la restauration\n");
+        goto fin;
+    }
+    if (connect_to_server(&conn, server_address, port, opts, 1) == -1
+        || send_message(conn.fd, MSG_GET_MANIFEST, backup_id, strlen(backup_id)) == -1) {
+        goto fin;
+    }
+
+    for (;;) {
+        uint32_t type, len;
+        unsigned char *payload;
+        if (receive_message(&conn, &type, &payload, &len) == -1) {
+            fprintf(stderr, "Erreur : connexion interrompue\n");
+            goto fin;
+        }
+        if (type == MSG_OK) {
+            break;
+        }
+        if (type != MSG_MANIFEST) {
+            print_remote_error(type, payload, len);
+            goto fin;
+        }
+        fwrite(payload, 1, len, manifest);
+    }
+
+    rewind(manifest);
+    printf("Restauration de %s depuis %s:%d vers %s\n", backup_id, server_address, port, restore_dir);
+    ret = pattern ? manifest_restore_matching(manifest, NULL, pattern, restore_dir, fetch_remote, &restore)
+                  : manifest_restore(manifest, restore_dir, fetch_remote, &restore);
+
+fin:
+    connection_close(&conn);
+    free(restore.out);
+    if (manifest) {
+        fclose(manifest);
+    }
+    return ret;
+}
+
+/**
+ * @brief Fonction cherchant un chunk parmi ceux demandés au client et pas encore reçus
+ *
+ * @param s la session
+ * @param md5 l'empreinte du chunk
+ * @param remove 1 pour retirer le chunk de la table s'il y est
+ * @return int 1 si le chunk était attendu, 0 sinon
+ */
+static int pending_find(session *s, const unsigned char *md5, int remove) {
+    pending_node **link = &s->pending[md5[0] | ((md5[1] & 0x0f) << 8)];
+    while (*link != NULL) {
+        if (memcmp((*link)->md5, md5, MD5_DIGEST_LENGTH) == 0) {
+            if (remove) {
+                pending_node *node = *link;
+                *link = node->next;
+                free(node);
+                s->nb_pending--;
+            }
+            return 1;
+        }
+        link = &(*link)->next;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction ajoutant un chunk à ceux demandés au client
+ *
+ * @param s la session
+ * @param md5 l'empreinte du chunk
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int pending_add(session *s, const unsigned char *md5) {
+    pending_node *node = malloc(sizeof(pending_node));
+    if (!node) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    int h = md5[0] | ((md5[1] & 0x0f) << 8);
+    memcpy(node->md5, md5, MD5_DIGEST_LENGTH);
+    node->next = s->pending[h];
+    s->pending[h] = node;
+    s->nb_pending++;
+    return 0;
+}
+
+/**
+ * @brief Fonction vérifiant que tous les chunks référencés par un manifeste sont dans le dépôt
+ *
+ * Le verrou du dépôt est pris fichier par fichier pour ne pas bloquer les autres sessions.
+ *
+ * @param manifest le manifeste ouvert en lecture
+ * @param srv le serveur
+ * @param stats la taille et le nombre de fichiers de la sauvegarde en sortie
+ * @return int 0 si le manifeste est complet, -1 sinon
+ */
+static int check_manifest(FILE *manifest, server *srv, catalog_entry *stats) {
+    manifest_entry entry;
+    int lu;
+    int ret = 0;
+    unsigned char *present = NULL;
+    size_t capacity = 0;
+    manifest_entry_init(&entry);
+    rewind(manifest);
+    while (ret == 0 && (lu = manifest_read_entry(manifest, &entry)) == 1) {
+        if (entry.type == 'F') {
+            stats->size += entry.size;
+            stats->files++;
+        }
+        if (entry.nb_chunks > capacity) {
+            unsigned char *new_present = realloc(present, entry.nb_chunks);
+            if (!new_present) {
+                fprintf(stderr, "Erreur d'allocation mémoire\n");
+                ret = -1;
+                break;
+            }
+            present = new_present;
+            capacity = entry.nb_chunks;
+        }
+        pthread_mutex_lock(&srv->lock);
+        if (store_contains_batch(&srv->store, (const unsigned char *)entry.md5, entry.nb_chunks, present) == -1) {
+            ret = -1;
+        }
+        pthread_mutex_unlock(&srv->lock);
+        for (size_t i = 0; ret == 0 && i < entry.nb_chunks; i++) {
+            if (!present[i]) {
+                fprintf(stderr, "Erreur : chunk manquant pour %s\n", entry.path);
+                ret = -1;
+            }
+        }
+    }
+    free(present);
+    manifest_entry_free(&entry);
+    return (lu == -1) ? -1 : ret;
+}
+
+/**
+ * @brief Fonction créant une sauvegarde à partir d'un manifeste reçu et l'ajoutant au catalogue
+ *
+ * @param srv le serveur
+ * @param tmp_path le manifeste temporaire reçu du client
+ * @param stats l'entrée du catalogue, dont le nom, la taille et le nombre de fichiers sont complétés
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int commit_snapshot(server *srv, const char *tmp_path, catalog_entry *stats) {
+    char snapshot_dir[PATH_MAX];
+    char manifest_path[PATH_MAX + 32];
+    char index_path[PATH_MAX + 32];
+
+    pthread_mutex_lock(&srv->lock);
+    int flushed = store_flush(&srv->store);
+    pthread_mutex_unlock(&srv->lock);
+    FILE *manifest = fopen(tmp_path, "r");
+    if (!manifest || flushed == -1 || check_manifest(manifest, srv, stats) == -1) {
+        if (manifest) {
+            fclose(manifest);
+        }
+        return -1;
+    }
+    fclose(manifest);
+
+    // Deux sessions peuvent valider dans la même milliseconde : on réessaie avec un nouvel horodatage
+    for (int attempt = 0;; attempt++) {
+        get_current_timestamp(stats->name, sizeof(stats->name));
+        snprintf(snapshot_dir, sizeof(snapshot_dir), "%s/%s", srv->repo_dir, stats->name);
+        if (mkdir(snapshot_dir, 0755) == 0) {
+            break;
+        }
+        if (errno != EEXIST || attempt == 100) {
+            perror("Erreur lors de la création de la sauvegarde");
+            return -1;
+        }
+        usleep(1000);
+    }
+    snprintf(index_path, sizeof(index_path), "%s/%s", snapshot_dir, MANIFEST_INDEX_NAME);
+    if (manifest_build_index(tmp_path, index_path) == -1) {
+        fprintf(stderr, "Attention : sauvegarde sans index des chemins\n");
+    }
+    snprintf(manifest_path, sizeof(manifest_path), "%s/%s", snapshot_dir, MANIFEST_NAME);
+    if (rename(tmp_path, manifest_path) == -1 || sync_dir(snapshot_dir) == -1 || sync_dir(srv->repo_dir) == -1) {
+        perror("Erreur lors de la création de la sauvegarde");
+        unlink(index_path);
+        rmdir(snapshot_dir);
+        return -1;
+    }
+    stats->date = time(NULL);
+    return catalog_append(srv->repo_dir, stats);
+}
+
+/**
+ * @brief Fonction envoyant une erreur textuelle au client
+ *
+ * @param fd la socket du client
+ * @param msg le message d'erreur
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int send_error(int fd, const char *msg) {
+    return send_message(fd, MSG_ERROR, msg, strlen(msg));
+}
+
+/**
+ * @brief Fonction traitant la demande de manifeste d'un client
+ *
+ * @param s la session
+ * @param name le nom de la sauvegarde demandée
+ * @param len la taille du nom
+ * @return int 0 en cas de succès, -1 si la connexion a échoué
+ */
+static int serve_manifest(session *s, const unsigned char *name, uint32_t len) {
+    char path[PATH_MAX + 128];
+    if (len == 0 || len > 64 || name[0] == '.' || memchr(name, '/', len) != NULL || memchr(name, '\0', len) != NULL) {
+        return send_error(s->conn.fd, "nom de sauvegarde invalide");
+    }
+    snprintf(path, sizeof(path), "%s/%.*s/%s", s->srv->repo_dir, (int)len, (const char *)name, MANIFEST_NAME);
+    FILE *manifest = fopen(path, "r");
+    if (!manifest) {
+        return send_error(s->conn.fd, "sauvegarde introuvable");
+    }
+    int ret = send_manifest(s->conn.fd, manifest);
+    fclose(manifest);
+    return (ret == 0) ? send_message(s->conn.fd, MSG_OK, NULL, 0) : -1;
+}
+
+/**
+ * @brief Fonction répondant à une demande de chunks en un seul envoi
+ *
+ * Les tampons de réponse ne sont alloués qu'à la première demande, pour que
+ * les sessions de sauvegarde restent légères.
+ *
+ * @param s la session
+ * @param payload les empreintes demandées
+ * @param len la taille de la demande
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int serve_chunks(session *s, unsigned char *payload, uint32_t len) {
+    struct iovec iov[3 * BATCH_SIZE];
+    uint32_t n = len / MD5_DIGEST_LENGTH;
+    int iovcnt = 0;
+    uint32_t i;
+
+    if (len % MD5_DIGEST_LENGTH != 0 || n > BATCH_SIZE) {
+        return -1;
+    }
+    if (!s->reply_data) {
+        s->reply_headers = malloc(BATCH_SIZE * sizeof(message_header));
+        s->reply_data = malloc((size_t)BATCH_SIZE * CHUNK_MAX_SIZE);
+        if (!s->reply_headers || !s->reply_data) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&s->srv->lock);
+    for (i = 0; i < n; i++) {
+        unsigned char *md5 = payload + i * MD5_DIGEST_LENGTH;
+        unsigned char *data = s->reply_data + (size_t)i * CHUNK_MAX_SIZE;
+        uint32_t chunk_len;
+        if (store_get(&s->srv->store, md5, data, &chunk_len) == -1) {
+            break;
+        }
+        s->reply_headers[i].type = htonl(MSG_CHUNK);
+        s->reply_headers[i].len = htonl(MD5_DIGEST_LENGTH + chunk_len);
+        iov[iovcnt].iov_base = &s->reply_headers[i];
+        iov[iovcnt++].iov_len = sizeof(message_header);
+        iov[iovcnt].iov_base = md5;
+        iov[iovcnt++].iov_len = MD5_DIGEST_LENGTH;
+        iov[iovcnt].iov_base = data;
+        iov[iovcnt++].iov_len = chunk_len;
+    }
+    pthread_mutex_unlock(&s->srv->lock);
+
+    if (iovcnt > 0 && send_iov(s->conn.fd, iov, iovcnt, 0, NULL) == -1) {
+        return -1;
+    }
+    if (i < n) {
+        send_error(s->conn.fd, "chunk introuvable");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction traitant un message reçu d'un client
+ *
+ * @param s la session
+ * @param type le type du message
+ * @param payload le contenu du message
+ * @param len la taille du contenu
+ * @return int 0 pour continuer la session, -1 pour la fermer
+ */
+static int session_handle(session *s, uint32_t type, unsigned char *payload, uint32_t len) {
+    if (!s->hello && type != MSG_HELLO) {
+        return -1;
+    }
+
+    switch (type) {
+        case MSG_HELLO:
+            s->hello = (len == strlen(PROTOCOL_VERSION) && memcmp(payload, PROTOCOL_VERSION, len) == 0);
+            if (!s->hello) {
+                send_error(s->conn.fd, "version du protocole incompatible");
+                return -1;
+            }
+            return send_message(s->conn.fd, MSG_OK, NULL, 0);
+
+        case MSG_HAVE: {
+            uint32_t n = len / MD5_DIGEST_LENGTH;
+            unsigned char need[BATCH_SIZE];
+            if (len % MD5_DIGEST_LENGTH != 0 || n > BATCH_SIZE) {
+                return -1;
+            }
+            // Le lot est cherché trié, pour lire chaque bloc des segments une seule fois
+            pthread_mutex_lock(&s->srv->lock);
+            int found = store_contains_batch(&s->srv->store, payload, n, need);
+            pthread_mutex_unlock(&s->srv->lock);
+            if (found == -1) {
+                return -1;
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                need[i] = !need[i];
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                unsigned char *md5 = payload + i * MD5_DIGEST_LENGTH;
+                // Un chunk déjà demandé dans un lot encore en vol n'est pas redemandé
+                need[i] = need[i] && !pending_find(s, md5, 0);
+                if (need[i] && pending_add(s, md5) == -1) {
+                    return -1;
+                }
+            }
+            if (s->nb_pending > MAX_PENDING) {
+                send_error(s->conn.fd, "trop de chunks demandés en attente");
+                return -1;
+            }
+            return send_message(s->conn.fd, MSG_NEED, need, n);
+        }
+
+        case MSG_CHUNK: {
+            unsigned char md5[MD5_DIGEST_LENGTH];
+            if (len < MD5_DIGEST_LENGTH || len - MD5_DIGEST_LENGTH > CHUNK_MAX_SIZE) {
+                return -1;
+            }
+            compute_md5(payload + MD5_DIGEST_LENGTH, len - MD5_DIGEST_LENGTH, md5);
+            if (memcmp(md5, payload, MD5_DIGEST_LENGTH) != 0) {
+                fprintf(stderr, "Erreur : chunk corrompu reçu\n");
+                return -1;
+            }
+            pending_find(s, md5, 1);
+            pthread_mutex_lock(&s->srv->lock);
+            int written = store_put(&s->srv->store, md5, payload + MD5_DIGEST_LENGTH, len - MD5_DIGEST_LENGTH);
+            pthread_mutex_unlock(&s->srv->lock);
+            if (written == -1) {
+                return -1;
+            }
+            s->stored += (written == 1) ? len - MD5_DIGEST_LENGTH : 0;
+            if (s->srv->opts.quota > 0 && s->stored > s->srv->opts.quota) {
+                send_error(s->conn.fd, "quota dépassé");
+                return -1;
+            }
+            return 0;
+        }
+
+        case MSG_MANIFEST:
+            if (!s->tmp) {
+                snprintf(s->tmp_path, sizeof(s->tmp_path), "%s/.manifest-XXXXXX", s->srv->repo_dir);
+                int fd = mkstemp(s->tmp_path);
+                if (fd == -1 || (s->tmp = fdopen(fd, "w")) == NULL) {
+                    perror("Erreur lors de la création du manifeste");
+                    return -1;
+                }
+            }
+            return (fwrite(payload, 1, len, s->tmp) == len) ? 0 : -1;
+
+        case MSG_COMMIT: {
+            catalog_entry stats;
+            if (!s->tmp && session_handle(s, MSG_MANIFEST, NULL, 0) == -1) {
+                return -1; // Sauvegarde d'un répertoire vide
+            }
+            int ok = (close_synced(s->tmp) == 0);
+            s->tmp = NULL;
+
+            // Le COMMIT contient l'origine de la sauvegarde annoncée par le client
+            memset(&stats, 0, sizeof(stats));
+            snprintf(stats.source, sizeof(stats.source), "%.*s", (int)len, (const char *)payload);
+            stats.added = s->stored - s->committed;
+            stats.duration = now_seconds() - s->started;
+            if (ok && commit_snapshot(s->srv, s->tmp_path, &stats) == 0) {
+                store_filter_stats filter;
+                pthread_mutex_lock(&s->srv->lock);
+                store_filter_report(&s->srv->store, &filter);
+                pthread_mutex_unlock(&s->srv->lock);
+                printf("Sauvegarde reçue : %s (filtre : %llu recherches, %llu évitées, %llu faux positifs)\n", stats.name,
+                       (unsigned long long)filter.lookups, (unsigned long long)filter.negatives,
+                       (unsigned long long)filter.false_positives);
+                s->committed = s->stored;
+                s->started = now_seconds();
+                return send_message(s->conn.fd, MSG_OK, stats.name, strlen(stats.name));
+            }
+            unlink(s->tmp_path);
+            return send_error(s->conn.fd, "impossible d'enregistrer la sauvegarde");
+        }
+
+        case MSG_GET_MANIFEST:
+            return serve_manifest(s, payload, len);
+
+        case MSG_GET_CHUNKS:
+            return serve_chunks(s, payload, len);
+
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Fonction créant la session d'un client accepté
+ *
+ * @param srv le serveur
+ * @param fd la socket du client
+ * @return session* la session, NULL en cas d'erreur (la socket est alors fermée)
+ */
+static session *session_create(server *srv, int fd) {
+    struct timeval timeout = {SEND_TIMEOUT, 0};
+    session *s = calloc(1, sizeof(session));
+    if (!s || connection_init(&s->conn, fd) == -1) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        free(s);
+        close(fd);
+        return NULL;
+    }
+    s->srv = srv;
+    s->started = now_seconds();
+    // Un client qui ne lit plus ses réponses ne bloque pas un thread indéfiniment
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return s;
+}
+
+/**
+ * @brief Procédure terminant une session et libérant ses ressources
+ *
+ * @param s la session
+ */
+static void session_destroy(session *s) {
+    server *srv = s->srv;
+    epoll_ctl(srv->epoll_fd, EPOLL_CTL_DEL, s->conn.fd, NULL);
+    if (s->tmp) {
+        fclose(s->tmp);
+        unlink(s->tmp_path);
+    }
+    for (int i = 0; i < PENDING_BUCKETS; i++) {
+        while (s->pending[i] != NULL) {
+            pending_node *next = s->pending[i]->next;
+            free(s->pending[i]);
+            s->pending[i] = next;
+        }
+    }
+    connection_close(&s->conn);
+    free(s->reply_headers);
+    free(s->reply_data);
+    free(s);
+
+    pthread_mutex_lock(&srv->lock);
+    store_flush(&srv->store);
+    srv->clients--;
+    pthread_mutex_unlock(&srv->lock);
+}
+
+/**
+ * @brief Fonction lisant et traitant les messages disponibles d'une session
+ *
+ * Le nombre de lectures est borné pour qu'un client rapide ne monopolise pas
+ * un thread. Tant que ses messages ne sont pas traités, la session n'est plus
+ * lue : la fenêtre TCP se remplit et le client est ralenti.
+ *
+ * @param s la session
+ * @return int 0 pour continuer la session, -1 pour la fermer
+ */
+static int session_process(session *s) {
+    for (int i = 0; i < READS_PER_TURN; i++) {
+        uint32_t type, len;
+        unsigned char *payload;
+        int ret;
+        ssize_t n = connection_recv(&s->conn, MSG_DONTWAIT);
+        if (n == -1) {
+            return -1;
+        }
+        while ((ret = connection_parse(&s->conn, &type, &payload, &len)) == 1) {
+            if (session_handle(s, type, payload, len) == -1) {
+                return -1;
+            }
+        }
+        if (ret == -1) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure acceptant les connexions en attente
+ *
+ * @param srv le serveur
+ */
+static void server_accept(server *srv) {
+    for (;;) {
+        int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            break;
+        }
+
+        pthread_mutex_lock(&srv->lock);
+        int full = (srv->clients >= srv->opts.max_clients);
+        if (!full) {
+            srv->clients++;
+        }
+        pthread_mutex_unlock(&srv->lock);
+        if (full) {
+            send_error(fd, "serveur saturé");
+            close(fd);
+            continue;
+        }
+
+        session *s = session_create(srv, fd);
+        struct epoll_event ev = {EPOLLIN | EPOLLONESHOT, {.ptr = s}};
+        if (s && epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            perror("epoll_ctl");
+            session_destroy(s);
+        } else if (!s) {
+            pthread_mutex_lock(&srv->lock);
+            srv->clients--;
+            pthread_mutex_unlock(&srv->lock);
+        }
+    }
+
+    struct epoll_event ev = {EPOLLIN | EPOLLONESHOT, {.ptr = NULL}};
+    epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, srv->listen_fd, &ev);
+}
+
+/**
+ * @brief Fonction exécutée par chaque thread de traitement
+ *
+ * Tous les threads attendent sur le même epoll. EPOLLONESHOT garantit qu'une
+ * session n'est traitée que par un thread à la fois : elle n'est réarmée
+ * qu'une fois ses messages traités.
+ *
+ * @param arg le serveur
+ * @return void* NULL
+ */
+static void *server_worker(void *arg) {
+    server *srv = arg;
+    for (;;) {
+        struct epoll_event ev;
+        int n = epoll_wait(srv->epoll_fd, &ev, 1, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        if (ev.data.ptr == NULL) {
+            server_accept(srv);
+            continue;
+        }
+
+        session *s = ev.data.ptr;
+        if (session_process(s) == -1) {
+            session_destroy(s);
+            continue;
+        }
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, s->conn.fd, &ev) == -1) {
+            perror("epoll_ctl");
+            session_destroy(s);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Fonction pour recevoir les sauvegardes des clients dans un répertoire de sauvegarde
+ *
+ * Les sessions sont multiplexées par epoll sur un petit nombre de threads et
+ * partagent le même dépôt de chunks, protégé par un verrou. Un dépôt chiffré
+ * n'est jamais servi : les clients désignent les chunks par leur MD5 sans
+ * clé, et le chiffrement n'est disponible que pour les sauvegardes locales.
+ *
+ * @param repo_dir le répertoire de sauvegarde
+ * @param port le port d'écoute
+ * @param opts les réglages du transport (NULL pour les valeurs par défaut)
+ * @param srv_opts les réglages du serveur (NULL pour les valeurs par défaut)
+ * @return int -1 en cas d'erreur (le serveur ne s'arrête pas sinon)
+ */
+int serve_repository(const char *repo_dir, int port, const net_options *opts, const server_options *srv_opts) {
+    static const net_options defaults = NET_OPTIONS_DEFAULT;
+    static const server_options server_defaults = SERVER_OPTIONS_DEFAULT;
+    struct sockaddr_in addr = {0};
+    int one = 1;
+
+    // Le serveur est partagé avec les threads : il n'est jamais libéré une fois ceux-ci lancés
+    server *srv = calloc(1, sizeof(server));
+    if (!srv) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    srv->repo_dir = repo_dir;
+    srv->listen_fd = -1;
+    srv->epoll_fd = -1;
+    srv->opts = srv_opts ? *srv_opts : server_defaults;
+    srv->opts.workers = (srv->opts.workers < 1) ? 1 : srv->opts.workers;
+    srv->opts.max_clients = (srv->opts.max_clients < 1) ? 1 : srv->opts.max_clients;
+    if (!opts) {
+        opts = &defaults;
+    }
+    // Les clients envoient des empreintes MD5 en clair : un dépôt chiffré n'est pas servi
+    srv->opts.store.encrypt = CRYPTO_NONE;
+    if (store_open(&srv->store, repo_dir, &srv->opts.store) == -1) {
+        free(srv);
+        return -1;
+    }
+    if (srv->store.encrypted) {
+        fprintf(stderr, "Erreur : un dépôt chiffré ne peut être utilisé qu'en local\n");
+        store_close(&srv->store);
+        free(srv);
+        return -1;
+    }
+    pthread_mutex_init(&srv->lock, NULL);
+
+    srv->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (srv->listen_fd == -1) {
+        perror("socket");
+        goto erreur;
+    }
+    setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    apply_socket_options(srv->listen_fd, opts); // Hérités par les sockets acceptées
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(srv->listen_fd, SOMAXCONN) == -1) {
+        perror("Erreur lors de l'écoute sur le port");
+        goto erreur;
+    }
+
+    srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {EPOLLIN | EPOLLONESHOT, {.ptr = NULL}};
+    if (srv->epoll_fd == -1 || epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->listen_fd, &ev) == -1) {
+        perror("epoll");
+        goto erreur;
+    }
+
+    store_filter_stats filter;
+    store_index_stats index;
+    store_filter_report(&srv->store, &filter);
+    store_index_report(&srv->store, &index);
+    printf("Serveur en écoute sur le port %d, dépôt : %s (%zu chunks en %zu segments, index de %llu octets, filtre de %llu octets), %d threads, %d sessions au plus\n",
+           port, repo_dir, srv->store.count, index.runs, (unsigned long long)index.memory,
+           (unsigned long long)filter.memory, srv->opts.workers, srv->opts.max_clients);
+    fflush(stdout);
+    for (int i = 1; i < srv->opts.workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, server_worker, srv) != 0) {
+            fprintf(stderr, "Erreur : impossible de créer le thread %d\n", i);
+            break;
+        }
+        pthread_detach(thread);
+    }
+    server_worker(srv); // Le thread principal traite aussi les événements
+    return -1;
+
+erreur:
+    if (srv->epoll_fd != -1) {
+        close(srv->epoll_fd);
+    }
+    if (srv->listen_fd != -1) {
+        close(srv->listen_fd);
+    }
+    pthread_mutex_destroy(&srv->lock);
+    store_close(&srv->store);
+    free(srv);
+    return -1;
+}
+
+/**
+ * @brief Procédure remplissant un tampon avec des octets pseudo-aléatoires (xorshift64)
+ *
+ * @param buffer le tampon
+ * @param len la taille du tampon (multiple de 8)
+ * @param state l'état du générateur
+ */
+static void fill_random(unsigned char *buffer, size_t len, uint64_t *state) {
+    for (size_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+        memcpy(buffer + i, state, sizeof(uint64_t));
+    }
+}
+
+/**
+ * @brief Fonction envoyant des chunks synthétiques au serveur de test sur une nouvelle connexion
+ *
+ * @param port le port du serveur
+ * @param megabytes la quantité de données à envoyer
+ * @param seed la graine du générateur (la même graine produit les mêmes chunks)
+ * @param opts les réglages du transport
+ * @param sent le nombre d'octets de chunks envoyés en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int benchmark_client(int port, size_t megabytes, uint64_t seed, const net_options *opts, unsigned long long *sent) {
+    size_t nb_chunks = megabytes * 1024 * 1024 / CHUNK_SIZE;
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    upload_pipeline pipeline = {0};
+    int ret = -1;
+
+    pipeline.conn.fd = -1;
+    if (connect_to_server(&pipeline.conn, "127.0.0.1", port, opts, 50) == 0 && pipeline_init(&pipeline, opts) == 0) {
+        size_t i;
+        for (i = 0; i < nb_chunks; i++) {
+            fill_random(pipeline_slot(&pipeline), CHUNK_SIZE, &seed);
+            if (pipeline_commit(&pipeline, CHUNK_SIZE, md5) == -1) {
+                break;
+            }
+        }
+        // Le COMMIT sert de barrière : le serveur a traité tous les chunks quand il répond
+        if (i == nb_chunks && pipeline_finish(&pipeline) == 0 && send_message(pipeline.conn.fd, MSG_COMMIT, NULL, 0) == 0
+            && expect_ok(&pipeline.conn, NULL) == 0) {
+            *sent = pipeline.bytes_sent;
+            ret = 0;
+        }
+    }
+    pipeline_close(&pipeline);
+    return ret;
+}
+
+/**
+ * @brief Fonction lançant simultanément plusieurs clients de test et mesurant le débit cumulé
+ *
+ * @param port le port du serveur
+ * @param megabytes la quantité de données envoyée par chaque client
+ * @param clients le nombre de clients
+ * @param seed la graine du premier client (chaque client a la sienne)
+ * @param opts les réglages du transport
+ * @param label le nom de la mesure
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int benchmark_phase(int port, size_t megabytes, int clients, uint64_t seed, const net_options *opts, const char *label) {
+    pid_t *pids = calloc((size_t)clients, sizeof(pid_t));
+    unsigned long long sent = 0, part;
+    int started = 0, failed = 0;
+    int fds[2];
+
+    if (!pids || pipe(fds) == -1) {
+        perror("Erreur lors de la préparation des clients");
+        free(pids);
+        return -1;
+    }
+    fflush(stdout);
+    double debut = now_seconds();
+    for (; started < clients; started++) {
+        pids[started] = fork();
+        if (pids[started] == -1) {
+            perror("fork");
+            break;
+        }
+        if (pids[started] == 0) {
+            uint64_t client_seed = (seed + (uint64_t)started * 0x9E3779B97F4A7C15ULL) | 1;
+            close(fds[0]);
+            int ok = (benchmark_client(port, megabytes, client_seed, opts, &part) == 0
+                      && write(fds[1], &part, sizeof(part)) == (ssize_t)sizeof(part));
+            _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    close(fds[1]);
+    while (read(fds[0], &part, sizeof(part)) == (ssize_t)sizeof(part)) {
+        sent += part;
+    }
+    close(fds[0]);
+    failed = clients - started;
+    for (int i = 0; i < started; i++) {
+        int status;
+        if (waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+    double duree = now_seconds() - debut;
+    free(pids);
+
+    double volume = (double)clients * megabytes * 1024 * 1024;
+    printf("%s : %d client(s) x %zu Mo en %.3f s, %.1f Mo/s (%.2f Gbit/s), %llu octets de chunks envoyés\n", label,
+           clients, megabytes, duree, volume / duree / 1e6, volume * 8 / duree / 1e9, sent);
+    if (failed > 0) {
+        fprintf(stderr, "Erreur : %d client(s) en échec\n", failed);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction de suppression d'une entrée pour nftw
+ */
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf) {
+    (void)sb;
+    (void)flag;
+    (void)ftwbuf;
+    return remove(path);
+}
+
+/**
+ * @brief Fonction mesurant le débit du transport vers un serveur local temporaire
+ *
+ * Un serveur est lancé dans un processus fils sur un dépôt temporaire, puis
+ * les clients, chacun dans son processus. Une première passe envoie des
+ * chunks tous nouveaux (débit de transfert), une seconde renvoie les mêmes
+ * (débit de la seule négociation des empreintes).
+ *
+ * @param port le port d'écoute du serveur temporaire
+ * @param megabytes la quantité de données de chaque passe, par client
+ * @param clients le nombre de clients simultanés
+ * @param opts les réglages du transport (NULL pour les valeurs par défaut)
+ * @param srv_opts les réglages du serveur (NULL pour les valeurs par défaut)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int network_benchmark(int port, size_t megabytes, int clients, const net_options *opts, const server_options *srv_opts) {
+    static const net_options defaults = NET_OPTIONS_DEFAULT;
+    static const server_options server_defaults = SERVER_OPTIONS_DEFAULT;
+    char repo_dir[] = "/tmp/borg-bench-XXXXXX";
+    server_options server = srv_opts ? *srv_opts : server_defaults;
+    uint64_t seed = (uint64_t)time(NULL) | 1;
+    int ret = -1;
+
+    if (!opts) {
+        opts = &defaults;
+    }
+    clients = (clients < 1) ? 1 : clients;
+    server.max_clients = (server.max_clients < clients) ? clients : server.max_clients;
+    if (mkdtemp(repo_dir) == NULL) {
+        perror("Erreur lors de la création du dépôt temporaire");
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        rmdir(repo_dir);
+        return -1;
+    }
+    if (pid == 0) {
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(EXIT_FAILURE);
+        }
+        serve_repository(repo_dir, port, opts, &server);
+        _exit(EXIT_FAILURE);
+    }
+
+    printf("Banc d'essai réseau sur 127.0.0.1:%d (%d client(s), %d threads, fenêtre de %d lots de %d chunks%s%s)\n", port,
+           clients, server.workers, opts->window, BATCH_SIZE, opts->zerocopy ? ", MSG_ZEROCOPY" : "",
+           opts->cork ? ", TCP_CORK" : "");
+    if (benchmark_phase(port, megabytes, clients, seed, opts, "Chunks nouveaux") == 0
+        && benchmark_phase(port, megabytes, clients, seed, opts, "Chunks déjà présents") == 0) {
+        ret = 0;
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    nftw(repo_dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return ret;
 }
@@ -1,9 +1,59 @@
 #include <stddef.h>
+#include "chunk_store.h"
+#include "throttle.h"
+#include "pattern.h"
 
 #ifndef NETWORK_H
 #define NETWORK_H
 
-void send_data(const char *server_address, int port, const void *data, size_t size);
-void receive_data(int port, void **data, size_t *size);
+// Version du protocole échangée à l'ouverture d'une session
+#define PROTOCOL_VERSION "BORG2"
 
-#endif // NETWORK_H
\ No newline at end of file
+// Nombre d'empreintes envoyées par lot lors de la négociation des chunks
+#define BATCH_SIZE 256
+
+// Place réservée aux données d'un lot : BATCH_SIZE chunks de CHUNK_SIZE octets précédés de leur empreinte
+#define BATCH_DATA_SIZE (BATCH_SIZE * (MD5_DIGEST_LENGTH + CHUNK_SIZE))
+
+// Taille maximale d'un morceau de manifeste dans un message
+#define MANIFEST_PART_SIZE (1024 * 1024)
+
+// Nombre de lots en vol par défaut (fenêtre glissante)
+#define DEFAULT_WINDOW 8
+
+// Réglages du transport TCP
+typedef struct {
+    int window;   // nombre de lots négociés sans attendre la réponse du serveur
+    int sndbuf;   // taille de SO_SNDBUF en octets (0 = valeur du système)
+    int rcvbuf;   // taille de SO_RCVBUF en octets (0 = valeur du système)
+    int nodelay;  // 1 pour activer TCP_NODELAY
+    int cork;     // 1 pour regrouper les chunks d'un lot avec TCP_CORK
+    int zerocopy; // 1 pour envoyer les chunks avec MSG_ZEROCOPY
+} net_options;
+
+// Réglages par défaut du transport
+#define NET_OPTIONS_DEFAULT {DEFAULT_WINDOW, 0, 0, 1, 0, 0}
+
+// Réglages du serveur
+typedef struct {
+    int workers;              // nombre de threads de traitement
+    int max_clients;          // nombre maximal de sessions simultanées
+    unsigned long long quota; // octets de nouveaux chunks acceptés par session (0 = illimité)
+    store_options store;      // réglages du filtre du dépôt
+} server_options;
+
+// Réglages par défaut du serveur
+#define SERVER_OPTIONS_DEFAULT {4, 512, 0, STORE_OPTIONS_DEFAULT}
+
+// Fonction pour sauvegarder un répertoire sur un serveur distant en n'envoyant que les chunks manquants
+int remote_backup(const char *source_dir, const char *server_address, int port, const net_options *opts,
+                  const throttle_options *throttle_opts, pattern_set *patterns);
+// Fonction pour restaurer une sauvegarde depuis un serveur distant
+int remote_restore(const char *server_address, int port, const char *backup_id, const char *restore_dir,
+                   const char *pattern, const net_options *opts);
+// Fonction pour recevoir les sauvegardes des clients dans un répertoire de sauvegarde
+int serve_repository(const char *repo_dir, int port, const net_options *opts, const server_options *srv_opts);
+// Fonction mesurant le débit du transport de plusieurs clients vers un serveur local temporaire
+int network_benchmark(int port, size_t megabytes, int clients, const net_options *opts, const server_options *srv_opts);
+
+#endif // NETWORK_H
@@ -0,0 +1,523 @@
+#include "pattern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Caractères qui font d'un texte un motif
+#define PATTERN_META "*?[\\"
+
+/**
+ * @brief Procédure pour initialiser un filtre vide, qui garde tout
+ *
+ * @param set le filtre
+ */
+void pattern_set_init(pattern_set *set) {
+    memset(set, 0, sizeof(*set));
+    arena_init(&set->pool, 0);
+}
+
+/**
+ * @brief Fonction compilant un composant de motif
+ *
+ * Les formes courantes (nom exact, *.ext, préfixe*) sont reconnues une
+ * fois pour toutes et comparées sans fnmatch lors du parcours.
+ *
+ * @param set le filtre, dont l'arène reçoit le texte
+ * @param part le composant compilé en sortie
+ * @param text le texte du composant
+ * @param len sa longueur
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int compile_part(pattern_set *set, pattern_part *part, const char *text, size_t len) {
+    char *copy = arena_alloc(&set->pool, len + 1);
+    if (!copy) {
+        return -1;
+    }
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    part->text = copy;
+    part->len = len;
+
+    size_t nb_meta = 0;
+    for (size_t i = 0; i < len; i++) {
+        nb_meta += (strchr(PATTERN_META, copy[i]) != NULL);
+    }
+    if (len == 2 && strcmp(copy, "**") == 0) {
+        part->kind = PATTERN_PART_DEEP;
+    } else if (len == 1 && copy[0] == '*') {
+        part->kind = PATTERN_PART_ANY;
+    } else if (nb_meta == 0) {
+        part->kind = PATTERN_PART_LITERAL;
+    } else if (nb_meta == 1 && copy[0] == '*') {
+        part->kind = PATTERN_PART_SUFFIX;
+        part->text = copy + 1;
+        part->len = len - 1;
+    } else if (nb_meta == 1 && copy[len - 1] == '*') {
+        part->kind = PATTERN_PART_PREFIX;
+        part->len = len - 1;
+    } else {
+        part->kind = PATTERN_PART_GLOB;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour ajouter une règle --exclude ou --include
+ *
+ * Les motifs sont relatifs à la racine de la source. Un motif sans / vise
+ * un nom à n'importe quelle profondeur (*.o, node_modules), un motif avec
+ * / vise un chemin depuis la racine (build/tmp, docs/manuel.pdf) ; un / final
+ * restreint la règle aux dossiers. Le motif est découpé et compilé ici,
+ * une seule fois.
+ *
+ * @param set le filtre
+ * @param pattern le motif
+ * @param include 1 pour --include, 0 pour --exclude
+ * @return int 0 en cas de succès, -1 si le motif est vide ou la mémoire manque
+ */
+int pattern_set_add(pattern_set *set, const char *pattern, int include) {
+    char normalized[PATH_MAX];
+    size_t len = 0;
+    int anchored = 0;
+
+    while (pattern[0] == '.' && pattern[1] == '/') {
+        pattern += 2;
+    }
+    if (pattern[0] == '/') {
+        anchored = 1;
+    }
+    // Les / en trop sont retirés : "a//b/" devient "a/b", restreint aux dossiers
+    for (const char *p = pattern; *p && len < sizeof(normalized) - 1; p++) {
+        if (*p == '/' && (len == 0 || normalized[len - 1] == '/')) {
+            continue;
+        }
+        normalized[len++] = *p;
+    }
+    int dir_only = (len > 0 && normalized[len - 1] == '/');
+    if (dir_only) {
+        len--;
+    }
+    normalized[len] = '\0';
+    if (len == 0) {
+        fprintf(stderr, "Erreur : motif vide\n");
+        return -1;
+    }
+
+    if (set->count == set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 16;
+        pattern_rule *rules = realloc(set->rules, capacity * sizeof(pattern_rule));
+        if (!rules) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        set->rules = rules;
+        set->capacity = capacity;
+    }
+    pattern_rule *rule = &set->rules[set->count];
+    memset(rule, 0, sizeof(*rule));
+    rule->include = include;
+    rule->dir_only = dir_only;
+    rule->anchored = anchored || strchr(normalized, '/') != NULL;
+    rule->literal = strpbrk(normalized, PATTERN_META) == NULL;
+    rule->text = arena_strdup(&set->pool, pattern);
+
+    size_t nb_parts = 1;
+    for (size_t i = 0; i < len; i++) {
+        nb_parts += (normalized[i] == '/');
+    }
+    rule->parts = arena_alloc(&set->pool, nb_parts * sizeof(pattern_part));
+    if (!rule->text || !rule->parts) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    const char *start = normalized;
+    for (size_t i = 0; i < nb_parts; i++) {
+        const char *slash = strchr(start, '/');
+        size_t part_len = slash ? (size_t)(slash - start) : strlen(start);
+        if (compile_part(set, &rule->parts[i], start, part_len) == -1) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        start += part_len + 1;
+    }
+    rule->nb_parts = nb_parts;
+    // Pour un nom seul, ** n'a pas de sens propre : il vaut *
+    if (!rule->anchored && rule->parts[0].kind == PATTERN_PART_DEEP) {
+        rule->parts[0].kind = PATTERN_PART_ANY;
+    }
+    set->count++;
+    return 0;
+}
+
+/**
+ * @brief Fonction pour ajouter un fichier marqueur excluant le dossier qui le contient
+ *
+ * @param set le filtre
+ * @param name le nom du marqueur (.nobackup, CACHEDIR.TAG...)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int pattern_set_add_marker(pattern_set *set, const char *name) {
+    const char **markers = realloc(set->markers, (set->nb_markers + 1) * sizeof(char *));
+    if (!markers) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    set->markers = markers;
+    set->markers[set->nb_markers] = arena_strdup(&set->pool, name);
+    if (!set->markers[set->nb_markers]) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    set->nb_markers++;
+    return 0;
+}
+
+/**
+ * @brief Fonction de comparaison des règles littérales pour qsort
+ *
+ * À clé égale, la règle la plus ancienne passe devant.
+ */
+static int compare_literals(const void *a, const void *b) {
+    const pattern_literal *la = a, *lb = b;
+    int cmp = strcmp(la->key, lb->key);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (la->rule > lb->rule) - (la->rule < lb->rule);
+}
+
+/**
+ * @brief Fonction pour indexer les règles une fois toutes ajoutées, avant le parcours
+ *
+ * Les règles littérales, les plus nombreuses en pratique, sont rangées dans
+ * deux tables triées (chemins et noms) consultées par dichotomie : leur
+ * nombre ne ralentit pas le parcours. Seules les règles à motif sont
+ * essayées une à une.
+ *
+ * @param set le filtre
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int pattern_set_compile(pattern_set *set) {
+    free(set->paths);
+    free(set->names);
+    free(set->globs);
+    set->nb_paths = set->nb_names = set->nb_globs = 0;
+    set->now = time(NULL);
+    if (set->count == 0) {
+        set->paths = NULL;
+        set->names = NULL;
+        set->globs = NULL;
+        return 0;
+    }
+    set->paths = malloc(set->count * sizeof(pattern_literal));
+    set->names = malloc(set->count * sizeof(pattern_literal));
+    set->globs = malloc(set->count * sizeof(size_t));
+    if (!set->paths || !set->names || !set->globs) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    for (size_t i = 0; i < set->count; i++) {
+        pattern_rule *rule = &set->rules[i];
+        if (!rule->literal) {
+            set->globs[set->nb_globs++] = i;
+            continue;
+        }
+        // Le texte d'une règle littérale est celui de ses composants mis bout à bout
+        char key[PATH_MAX];
+        size_t len = 0;
+        for (size_t p = 0; p < rule->nb_parts; p++) {
+            len += (size_t)snprintf(key + len, sizeof(key) - len, "%s%s", p ? "/" : "", rule->parts[p].text);
+            if (len >= sizeof(key)) {
+                len = sizeof(key) - 1;
+            }
+        }
+        pattern_literal *table = rule->anchored ? set->paths : set->names;
+        size_t *nb = rule->anchored ? &set->nb_paths : &set->nb_names;
+        table[*nb].key = arena_strdup(&set->pool, key);
+        table[*nb].rule = i;
+        if (!table[*nb].key) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        (*nb)++;
+    }
+    qsort(set->paths, set->nb_paths, sizeof(pattern_literal), compare_literals);
+    qsort(set->names, set->nb_names, sizeof(pattern_literal), compare_literals);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour savoir si le filtre peut écarter quelque chose
+ *
+ * @param set le filtre (NULL pour aucun)
+ * @return int 1 si une règle, un marqueur ou une limite est réglé, 0 sinon
+ */
+int pattern_set_active(const pattern_set *set) {
+    return set && (set->count > 0 || set->nb_markers > 0 || set->max_size > 0 || set->max_age > 0);
+}
+
+/**
+ * @brief Fonction comparant un composant de motif à un nom
+ *
+ * @param part le composant
+ * @param name le nom (pas forcément terminé par un zéro)
+ * @param len la longueur du nom
+ * @return int 1 si le nom correspond, 0 sinon
+ */
+static int part_matches(const pattern_part *part, const char *name, size_t len) {
+    char buffer[NAME_MAX + 1];
+    switch (part->kind) {
+        case PATTERN_PART_ANY:
+        case PATTERN_PART_DEEP:
+            return 1;
+        case PATTERN_PART_LITERAL:
+            return len == part->len && memcmp(name, part->text, len) == 0;
+        case PATTERN_PART_SUFFIX:
+            return len >= part->len && memcmp(name + len - part->len, part->text, part->len) == 0;
+        case PATTERN_PART_PREFIX:
+            return len >= part->len && memcmp(name, part->text, part->len) == 0;
+        default:
+            if (len > NAME_MAX) {
+                return 0;
+            }
+            memcpy(buffer, name, len);
+            buffer[len] = '\0';
+            return fnmatch(part->text, buffer, 0) == 0;
+    }
+}
+
+/**
+ * @brief Fonction comparant les composants d'un motif à un chemin relatif
+ *
+ * @param parts les composants restants du motif
+ * @param nb leur nombre
+ * @param path la suite du chemin
+ * @param prefix 1 pour accepter que le chemin s'arrête avant le motif (le chemin est alors un dossier
+ * dont le contenu peut correspondre)
+ * @return int 1 si le chemin correspond, 0 sinon
+ */
+static int parts_match(const pattern_part *parts, size_t nb, const char *path, int prefix) {
+    if (*path == '\0') {
+        if (prefix) {
+            return nb > 0;
+        }
+        // Seuls des ** peuvent encore correspondre à rien
+        for (size_t i = 0; i < nb; i++) {
+            if (parts[i].kind != PATTERN_PART_DEEP) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (nb == 0) {
+        return 0;
+    }
+    const char *slash = strchr(path, '/');
+    size_t len = slash ? (size_t)(slash - path) : strlen(path);
+    const char *rest = slash ? slash + 1 : path + len;
+    if (parts[0].kind == PATTERN_PART_DEEP) {
+        // ** absorbe zéro composant, ou un de plus
+        return prefix || parts_match(parts + 1, nb - 1, path, prefix) || parts_match(parts, nb, rest, prefix);
+    }
+    return part_matches(&parts[0], path, len) && parts_match(parts + 1, nb - 1, rest, prefix);
+}
+
+/**
+ * @brief Fonction cherchant la première règle littérale applicable à une clé
+ *
+ * @param set le filtre
+ * @param table la table triée
+ * @param nb sa taille
+ * @param key le chemin ou le nom
+ * @param is_dir 1 si l'entrée est un dossier
+ * @param best la position de la meilleure règle trouvée jusqu'ici
+ * @return size_t la position de la meilleure règle
+ */
+static size_t literal_lookup(const pattern_set *set, const pattern_literal *table, size_t nb, const char *key,
+                             int is_dir, size_t best) {
+    size_t lo = 0, hi = nb;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(table[mid].key, key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < nb && strcmp(table[lo].key, key) == 0; lo++) {
+        if (table[lo].rule < best && (is_dir || !set->rules[table[lo].rule].dir_only)) {
+            return table[lo].rule;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Fonction donnant la première règle qui correspond à un chemin
+ *
+ * @param set le filtre compilé
+ * @param rel le chemin relatif à la racine de la source
+ * @param is_dir 1 si l'entrée est un dossier
+ * @return const pattern_rule* la règle, NULL si aucune ne correspond
+ */
+static const pattern_rule *first_match(const pattern_set *set, const char *rel, int is_dir) {
+    const char *name = strrchr(rel, '/');
+    name = name ? name + 1 : rel;
+    size_t best = literal_lookup(set, set->paths, set->nb_paths, rel, is_dir, set->count);
+    best = literal_lookup(set, set->names, set->nb_names, name, is_dir, best);
+    for (size_t i = 0; i < set->nb_globs && set->globs[i] < best; i++) {
+        const pattern_rule *rule = &set->rules[set->globs[i]];
+        if (rule->dir_only && !is_dir) {
+            continue;
+        }
+        if (rule->anchored ? parts_match(rule->parts, rule->nb_parts, rel, 0)
+                           : part_matches(&rule->parts[0], name, strlen(name))) {
+            best = set->globs[i];
+            break;
+        }
+    }
+    return (best < set->count) ? &set->rules[best] : NULL;
+}
+
+/**
+ * @brief Fonction pour savoir si une règle --include peut viser le contenu d'un dossier
+ *
+ * @param set le filtre compilé
+ * @param dir le chemin relatif du dossier
+ * @return int 1 si le dossier doit être parcouru malgré son exclusion, 0 sinon
+ */
+static int include_reaches(const pattern_set *set, const char *dir) {
+    for (size_t i = 0; i < set->count; i++) {
+        const pattern_rule *rule = &set->rules[i];
+        if (rule->include && (!rule->anchored || parts_match(rule->parts, rule->nb_parts, dir, 1))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction cherchant un fichier marqueur dans un dossier
+ *
+ * @param set le filtre
+ * @param root la racine de la source
+ * @param rel le chemin relatif du dossier
+ * @return int 1 si un marqueur est présent, 0 sinon
+ */
+static int has_marker(const pattern_set *set, const char *root, const char *rel) {
+    char path[PATH_MAX * 2];
+    for (size_t i = 0; i < set->nb_markers; i++) {
+        snprintf(path, sizeof(path), "%s/%s%s%s", root, rel, rel[0] ? "/" : "", set->markers[i]);
+        if (access(path, F_OK) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction décidant du sort d'une entrée, sans compter les exclusions
+ */
+static int classify(const pattern_set *set, const char *root, const char *rel, mode_t mode, uint64_t size,
+                    time_t mtime, int parent) {
+    int is_dir = S_ISDIR(mode);
+    const pattern_rule *rule = first_match(set, rel, is_dir);
+    if (rule && rule->include) {
+        return PATTERN_INCLUDE;
+    }
+    if (!rule && parent != PATTERN_TRAVERSE) {
+        int excluded = 0;
+        if (S_ISREG(mode)) {
+            excluded = (set->max_size > 0 && size > set->max_size)
+                       || (set->max_age > 0 && mtime < set->now - set->max_age);
+        } else if (is_dir && root) {
+            excluded = has_marker(set, root, rel);
+        }
+        if (!excluded) {
+            return PATTERN_INCLUDE;
+        }
+    }
+    return (is_dir && include_reaches(set, rel)) ? PATTERN_TRAVERSE : PATTERN_EXCLUDE;
+}
+
+/**
+ * @brief Fonction décidant du sort d'une entrée connaissant celui de son dossier parent
+ *
+ * La première règle qui correspond au chemin l'emporte ; sans règle, les
+ * limites de taille et d'âge (fichiers) et les marqueurs (dossiers)
+ * s'appliquent. Un dossier exclu n'est pas ouvert, sauf si un --include
+ * vise une partie de son contenu : il est alors parcouru et seul ce
+ * contenu est gardé.
+ *
+ * @param set le filtre compilé (NULL pour tout garder)
+ * @param root la racine de la source (NULL pour ignorer les marqueurs)
+ * @param rel le chemin relatif à la racine
+ * @param mode le type et les droits de l'entrée
+ * @param size sa taille
+ * @param mtime sa date de modification
+ * @param parent la décision prise pour son dossier parent
+ * @return int PATTERN_INCLUDE, PATTERN_EXCLUDE ou PATTERN_TRAVERSE
+ */
+int pattern_check(pattern_set *set, const char *root, const char *rel, mode_t mode, uint64_t size, time_t mtime,
+                  int parent) {
+    if (!set) {
+        return PATTERN_INCLUDE;
+    }
+    int decision = classify(set, root, rel, mode, size, mtime, parent);
+    if (decision == PATTERN_EXCLUDE) {
+        set->excluded++;
+    }
+    return decision;
+}
+
+/**
+ * @brief Fonction décidant du sort d'une entrée en examinant aussi tous ses dossiers parents
+ *
+ * Sert quand une entrée est examinée hors d'un parcours, dossier par
+ * dossier (sauvegarde guidée par le journal des modifications).
+ *
+ * @param set le filtre compilé (NULL pour tout garder)
+ * @param root la racine de la source (NULL pour ignorer les marqueurs)
+ * @param rel le chemin relatif à la racine
+ * @param mode le type et les droits de l'entrée
+ * @param size sa taille
+ * @param mtime sa date de modification
+ * @return int PATTERN_INCLUDE, PATTERN_EXCLUDE ou PATTERN_TRAVERSE
+ */
+int pattern_check_path(pattern_set *set, const char *root, const char *rel, mode_t mode, uint64_t size, time_t mtime) {
+    char prefix[PATH_MAX];
+    int parent = PATTERN_INCLUDE;
+    if (!pattern_set_active(set)) {
+        return PATTERN_INCLUDE;
+    }
+    snprintf(prefix, sizeof(prefix), "%s", rel);
+    for (char *slash = strchr(prefix, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        parent = classify(set, root, prefix, S_IFDIR, 0, 0, parent);
+        *slash = '/';
+        if (parent == PATTERN_EXCLUDE) {
+            set->excluded++;
+            return PATTERN_EXCLUDE;
+        }
+    }
+    return pattern_check(set, root, rel, mode, size, mtime, parent);
+}
+
+/**
+ * @brief Procédure pour libérer le filtre
+ *
+ * @param set le filtre
+ */
+void pattern_set_free(pattern_set *set) {
+    free(set->rules);
+    free(set->paths);
+    free(set->names);
+    free(set->globs);
+    free(set->markers);
+    arena_free(&set->pool);
+    memset(set, 0, sizeof(*set));
+}
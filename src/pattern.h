@@ -0,0 +1,85 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include "arena.h"
+
+// Décisions du filtre pour une entrée de la source
+#define PATTERN_INCLUDE 0   // entrée sauvegardée
+#define PATTERN_EXCLUDE 1   // entrée ignorée, et tout son contenu pour un dossier
+#define PATTERN_TRAVERSE 2  // dossier exclu mais parcouru : un --include vise une partie de son contenu
+
+// Formes d'un composant de motif compilé
+#define PATTERN_PART_LITERAL 0 // nom exact
+#define PATTERN_PART_ANY 1     // *
+#define PATTERN_PART_SUFFIX 2  // *texte
+#define PATTERN_PART_PREFIX 3  // texte*
+#define PATTERN_PART_GLOB 4    // autre motif, confié à fnmatch
+#define PATTERN_PART_DEEP 5    // **, zéro ou plusieurs composants
+
+// Composant d'un motif, entre deux /
+typedef struct {
+    int kind;               // PATTERN_PART_*
+    const char *text;       // texte à comparer (le motif entier pour PATTERN_PART_GLOB)
+    size_t len;
+} pattern_part;
+
+// Règle --exclude ou --include compilée
+typedef struct {
+    const char *text;       // motif tel que donné
+    int include;            // 1 pour --include, 0 pour --exclude
+    int anchored;           // 1 si le motif contient un / : comparé au chemin depuis la racine, sinon au nom seul
+    int dir_only;           // 1 si le motif finit par / : ne vise que les dossiers
+    int literal;            // 1 si le motif ne contient aucun caractère spécial
+    pattern_part *parts;
+    size_t nb_parts;
+} pattern_rule;
+
+// Règle littérale indexée par son chemin ou son nom
+typedef struct {
+    const char *key;
+    size_t rule;            // position de la règle, la première correspondance l'emporte
+} pattern_literal;
+
+// Filtre des entrées d'une sauvegarde, compilé une fois avant le parcours
+typedef struct {
+    pattern_rule *rules;    // règles dans l'ordre de la ligne de commande
+    size_t count;
+    size_t capacity;
+    pattern_literal *paths; // règles littérales sur un chemin, triées
+    size_t nb_paths;
+    pattern_literal *names; // règles littérales sur un nom, triées
+    size_t nb_names;
+    size_t *globs;          // positions des autres règles, dans l'ordre
+    size_t nb_globs;
+    const char **markers;   // fichiers dont la présence exclut leur dossier (.nobackup...)
+    size_t nb_markers;
+    uint64_t max_size;      // taille au-delà de laquelle un fichier est exclu (0 pour aucune limite)
+    time_t max_age;         // âge au-delà duquel un fichier est exclu en secondes (0 pour aucune limite)
+    time_t now;             // date de référence des âges, fixée à la compilation
+    uint64_t excluded;      // entrées écartées depuis la compilation
+    arena pool;             // textes et composants des règles
+} pattern_set;
+
+// Procédure pour initialiser un filtre vide, qui garde tout
+void pattern_set_init(pattern_set *set);
+// Fonction pour ajouter une règle --exclude (include à 0) ou --include (include à 1)
+int pattern_set_add(pattern_set *set, const char *pattern, int include);
+// Fonction pour ajouter un fichier marqueur excluant le dossier qui le contient
+int pattern_set_add_marker(pattern_set *set, const char *name);
+// Fonction pour indexer les règles une fois toutes ajoutées, avant le parcours
+int pattern_set_compile(pattern_set *set);
+// Fonction pour savoir si le filtre peut écarter quelque chose
+int pattern_set_active(const pattern_set *set);
+// Fonction décidant du sort d'une entrée connaissant celui de son dossier parent (root à NULL : marqueurs ignorés)
+int pattern_check(pattern_set *set, const char *root, const char *rel, mode_t mode, uint64_t size, time_t mtime,
+                  int parent);
+// Fonction décidant du sort d'une entrée en examinant aussi tous ses dossiers parents
+int pattern_check_path(pattern_set *set, const char *root, const char *rel, mode_t mode, uint64_t size, time_t mtime);
+// Procédure pour libérer le filtre
+void pattern_set_free(pattern_set *set);
+
+#endif // PATTERN_H
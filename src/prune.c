@@ -0,0 +1,282 @@
+#define _GNU_SOURCE // nftw(), DT_DIR
+#include "prune.h"
+#include "backup_manager.h"
+#include "catalog.h"
+#include "chunk_store.h"
+#include "manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stddef.h>
+
+// Sauvegarde candidate à la suppression
+typedef struct {
+    char name[SNAPSHOT_NAME_SIZE];
+    long day;    // clé du jour (AAAAMMJJ)
+    long week;   // clé de la semaine ISO (AAAASS)
+    long month;  // clé du mois (AAAAMM)
+    int keep;    // 1 si une règle garde la sauvegarde
+} snapshot_info;
+
+/**
+ * @brief Fonction de comparaison pour trier les sauvegardes de la plus récente à la plus ancienne
+ */
+static int compare_newest_first(const void *a, const void *b) {
+    return strcmp(((const snapshot_info *)b)->name, ((const snapshot_info *)a)->name);
+}
+
+/**
+ * @brief Fonction listant les sauvegardes d'un répertoire de sauvegarde
+ *
+ * Seuls les répertoires dont le nom est un horodatage de sauvegarde sont
+ * retenus ; le dépôt de chunks et le catalogue sont ignorés. Une sauvegarde
+ * interrompue, dont le manifeste n'a jamais été publié, n'est pas une
+ * sauvegarde : elle ne doit compter pour aucune règle de conservation, sans
+ * quoi elle prendrait la place d'une sauvegarde publiée.
+ *
+ * @param repo_dir le répertoire de sauvegarde
+ * @param snapshots le tableau des sauvegardes en sortie (à libérer avec free)
+ * @param count le nombre de sauvegardes en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int list_snapshots(const char *repo_dir, snapshot_info **snapshots, size_t *count) {
+    size_t capacity = 0;
+    struct dirent *entry;
+    struct tm date;
+
+    *snapshots = NULL;
+    *count = 0;
+    DIR *dir = opendir(repo_dir);
+    if (!dir) {
+        perror("Erreur lors de l'ouverture du répertoire de sauvegarde");
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_type != DT_DIR || strlen(entry->d_name) >= SNAPSHOT_NAME_SIZE) {
+            continue;
+        }
+        memset(&date, 0, sizeof(date));
+        if (!parse_folder_date(entry->d_name, &date) || !snapshot_published(repo_dir, entry->d_name)) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            snapshot_info *new_snapshots = realloc(*snapshots, capacity * sizeof(snapshot_info));
+            if (!new_snapshots) {
+                fprintf(stderr, "Erreur d'allocation mémoire\n");
+                free(*snapshots);
+                closedir(dir);
+                return -1;
+            }
+            *snapshots = new_snapshots;
+        }
+        snapshot_info *snap = &(*snapshots)[(*count)++];
+        snprintf(snap->name, sizeof(snap->name), "%s", entry->d_name);
+        snap->day = date.tm_year * 10000L + date.tm_mon * 100L + date.tm_mday;
+        snap->month = date.tm_year * 100L + date.tm_mon;
+
+        // La semaine ISO dépend du jour de la semaine, calculé par mktime
+        char week[16];
+        date.tm_year -= 1900;
+        date.tm_mon -= 1;
+        date.tm_isdst = -1;
+        mktime(&date);
+        strftime(week, sizeof(week), "%G%V", &date);
+        snap->week = atol(week);
+        snap->keep = 0;
+    }
+    closedir(dir);
+    qsort(*snapshots, *count, sizeof(snapshot_info), compare_newest_first);
+    return 0;
+}
+
+/**
+ * @brief Procédure gardant la sauvegarde la plus récente de chacune des n dernières périodes
+ *
+ * @param snapshots les sauvegardes triées de la plus récente à la plus ancienne
+ * @param count le nombre de sauvegardes
+ * @param offset la position de la clé de période dans snapshot_info
+ * @param n le nombre de périodes à garder
+ */
+static void keep_per_period(snapshot_info *snapshots, size_t count, size_t offset, int n) {
+    long last = -1;
+    for (size_t i = 0; i < count && n > 0; i++) {
+        long key = *(const long *)((const char *)&snapshots[i] + offset);
+        if (key != last) {
+            snapshots[i].keep = 1;
+            last = key;
+            n--;
+        }
+    }
+}
+
+/**
+ * @brief Fonction appelée par nftw pour supprimer un élément d'une sauvegarde
+ */
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    if (remove(path) == -1) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction marquant tous les chunks référencés par le manifeste d'une sauvegarde
+ *
+ * Une sauvegarde sans manifeste (ancien format) ne référence aucun chunk.
+ *
+ * @param store le dépôt de chunks
+ * @param repo_dir le répertoire de sauvegarde
+ * @param name le nom de la sauvegarde
+ * @param missing le nombre de chunks référencés mais absents du dépôt
+ * @return int 0 en cas de succès, -1 si le manifeste est illisible
+ */
+static int mark_snapshot(chunk_store *store, const char *repo_dir, const char *name, size_t *missing) {
+    char path[PATH_MAX];
+    manifest_entry entry;
+    int lu;
+
+    snprintf(path, sizeof(path), "%s/%s/%s", repo_dir, name, MANIFEST_NAME);
+    FILE *manifest = fopen(path, "r");
+    if (!manifest) {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+    manifest_entry_init(&entry);
+    while ((lu = manifest_read_entry(manifest, &entry)) == 1) {
+        for (size_t i = 0; i < entry.nb_chunks; i++) {
+            if (store_mark(store, entry.md5[i]) == -1) {
+                (*missing)++;
+            }
+        }
+    }
+    manifest_entry_free(&entry);
+    fclose(manifest);
+    if (lu == -1) {
+        fprintf(stderr, "Erreur : manifeste illisible : %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour supprimer les sauvegardes hors des règles de conservation et libérer leurs chunks
+ *
+ * Une sauvegarde est gardée dès qu'une règle la retient. Les chunks encore
+ * référencés sont retrouvés en parcourant les manifestes des sauvegardes
+ * gardées (phase de marquage) plutôt qu'au moyen de compteurs de références,
+ * ce qui ne demande qu'un octet par chunk en mémoire. Les packs sont ensuite
+ * compactés, en recopiant au plus policy->compact_limit octets par passage.
+ *
+ * @param repo_dir le répertoire de sauvegarde
+ * @param policy les règles de conservation
+ * @param dry_run 1 pour afficher ce qui serait supprimé sans rien modifier
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int prune_backups(const char *repo_dir, const retention_policy *policy, int dry_run) {
+    chunk_store store;
+    snapshot_info *snapshots;
+    size_t count, removed = 0, missing = 0;
+    store_gc_stats stats;
+    int status = 0;
+
+    if (policy->keep_last <= 0 && policy->keep_daily <= 0 && policy->keep_weekly <= 0 && policy->keep_monthly <= 0) {
+        fprintf(stderr, "Erreur : aucune règle de conservation spécifiée\n");
+        return -1;
+    }
+    // Le verrou du dépôt empêche une sauvegarde de référencer un chunk pendant sa suppression
+    if (store_open(&store, repo_dir, NULL) == -1) {
+        return -1;
+    }
+    if (list_snapshots(repo_dir, &snapshots, &count) == -1) {
+        store_close(&store);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count && (int)i < policy->keep_last; i++) {
+        snapshots[i].keep = 1;
+    }
+    keep_per_period(snapshots, count, offsetof(snapshot_info, day), policy->keep_daily);
+    keep_per_period(snapshots, count, offsetof(snapshot_info, week), policy->keep_weekly);
+    keep_per_period(snapshots, count, offsetof(snapshot_info, month), policy->keep_monthly);
+
+    for (size_t i = 0; i < count; i++) {
+        if (snapshots[i].keep) {
+            printf("Conservée : %s\n", snapshots[i].name);
+            continue;
+        }
+        printf("%s : %s\n", dry_run ? "À supprimer" : "Supprimée", snapshots[i].name);
+        removed++;
+        if (!dry_run) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", repo_dir, snapshots[i].name);
+            if (nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS) == -1) {
+                fprintf(stderr, "Erreur lors de la suppression de la sauvegarde %s\n", snapshots[i].name);
+                status = -1;
+            }
+        }
+    }
+
+    // Le catalogue ne doit plus lister les sauvegardes supprimées
+    if (!dry_run && removed > 0) {
+        catalog_entry *entries;
+        size_t nb_entries, kept = 0;
+        if (catalog_load(repo_dir, &entries, &nb_entries) == 0) {
+            for (size_t i = 0; i < nb_entries; i++) {
+                char path[PATH_MAX];
+                snprintf(path, sizeof(path), "%s/%s", repo_dir, entries[i].name);
+                if (access(path, F_OK) == 0) {
+                    entries[kept++] = entries[i];
+                }
+            }
+            if (catalog_rewrite(repo_dir, entries, kept) == -1) {
+                status = -1;
+            }
+            free(entries);
+        }
+    }
+
+    // Phase de marquage : tout chunk d'une sauvegarde gardée reste vivant
+    if (store_clear_marks(&store) == -1) {
+        fprintf(stderr, "Erreur : ramasse-miettes annulé, aucun chunk n'a été supprimé\n");
+        free(snapshots);
+        store_close(&store);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (snapshots[i].keep && mark_snapshot(&store, repo_dir, snapshots[i].name, &missing) == -1) {
+            fprintf(stderr, "Erreur : ramasse-miettes annulé, aucun chunk n'a été supprimé\n");
+            free(snapshots);
+            store_close(&store);
+            return -1;
+        }
+    }
+    free(snapshots);
+    if (missing > 0) {
+        fprintf(stderr, "Attention : %zu chunks référencés sont absents du dépôt\n", missing);
+    }
+
+    // Phase de balayage : suppression des chunks non marqués et compactage des packs
+    if (store_sweep(&store, policy->compact_limit, dry_run, &stats) == -1) {
+        store_close(&store);
+        return -1;
+    }
+    store_close(&store);
+
+    printf("Sauvegardes %s : %zu sur %zu\n", dry_run ? "à supprimer" : "supprimées", removed, count);
+    printf("Chunks libérés : %zu (%llu octets)\n", stats.chunks_removed, (unsigned long long)stats.bytes_removed);
+    printf("Packs supprimés : %zu dont %zu compactés (%llu octets recopiés)\n", stats.packs_deleted,
+           stats.packs_compacted, (unsigned long long)stats.bytes_moved);
+    printf("Espace disque %s : %llu octets\n", dry_run ? "récupérable" : "libéré",
+           (unsigned long long)stats.bytes_freed);
+    return status;
+}
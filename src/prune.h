@@ -0,0 +1,24 @@
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include <stdint.h>
+
+// Volume maximal de chunks vivants recopiés par défaut lors d'un compactage (1 Go)
+#define DEFAULT_COMPACT_LIMIT (1024ULL * 1024 * 1024)
+
+// Règles de conservation des sauvegardes
+typedef struct {
+    int keep_last;          // nombre de sauvegardes les plus récentes à garder
+    int keep_daily;         // nombre de jours dont on garde la dernière sauvegarde
+    int keep_weekly;        // nombre de semaines dont on garde la dernière sauvegarde
+    int keep_monthly;       // nombre de mois dont on garde la dernière sauvegarde
+    uint64_t compact_limit; // octets recopiés au plus par le compactage (0 = illimité)
+} retention_policy;
+
+// Règles par défaut : aucune sauvegarde n'est désignée pour être gardée
+#define RETENTION_POLICY_DEFAULT {0, 0, 0, 0, DEFAULT_COMPACT_LIMIT}
+
+// Fonction pour supprimer les sauvegardes hors des règles de conservation et libérer leurs chunks
+int prune_backups(const char *repo_dir, const retention_policy *policy, int dry_run);
+
+#endif // PRUNE_H
@@ -0,0 +1,371 @@
+#include "restore_plan.h"
+#include "deduplication.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Procédure pour initialiser un plan de restauration
+ *
+ * @param plan le plan
+ * @param store le dépôt de chunks de la sauvegarde
+ * @param cache le cache des chunks partagés entre lots (NULL sans cache)
+ * @param restore_dir le répertoire de restauration
+ */
+void restore_plan_init(restore_plan *plan, chunk_store *store, chunk_cache *cache, const char *restore_dir) {
+    memset(plan, 0, sizeof(*plan));
+    plan->store = store;
+    plan->cache = cache;
+    plan->restore_dir = restore_dir;
+    arena_init(&plan->pool, 0);
+    for (size_t i = 0; i < RESTORE_OPEN_FILES; i++) {
+        plan->open[i].fd = -1;
+    }
+}
+
+/**
+ * @brief Fonction ajoutant un fichier au plan
+ *
+ * Le fichier, tout juste créé par manifest_restore, est porté à sa taille
+ * finale : ses chunks pourront y être écrits dans n'importe quel ordre. Ses
+ * droits sont complétés de l'écriture par le propriétaire le temps de la
+ * restauration. Quand le plan atteint RESTORE_PLAN_MAX_REFS références, le
+ * lot est exécuté.
+ *
+ * @param ctx le plan de restauration
+ * @param entry l'entrée du fichier à restaurer
+ * @param out_fd le fichier de sortie, vide
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int restore_plan_collect(void *ctx, const manifest_entry *entry, int out_fd) {
+    restore_plan *plan = ctx;
+    char path[PATH_MAX * 2];
+    uint64_t size = 0;
+
+    for (size_t i = 0; i < entry->nb_chunks; i++) {
+        size += entry->len[i];
+    }
+    if (ftruncate(out_fd, (off_t)size) == -1) {
+        perror("Erreur lors du dimensionnement du fichier restauré");
+        return -1;
+    }
+    if (entry->nb_chunks == 0) {
+        return 0;
+    }
+    if ((entry->mode & S_IWUSR) == 0 && fchmod(out_fd, (entry->mode & 07777) | S_IWUSR) == -1) {
+        perror("Erreur lors du changement des droits du fichier restauré");
+        return -1;
+    }
+
+    if (plan->nb_files == plan->files_capacity) {
+        size_t capacity = plan->files_capacity ? plan->files_capacity * 2 : 1024;
+        plan_file *files = realloc(plan->files, capacity * sizeof(plan_file));
+        if (!files) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        plan->files = files;
+        plan->files_capacity = capacity;
+    }
+    if (plan->nb_refs + entry->nb_chunks > plan->refs_capacity) {
+        size_t capacity = plan->refs_capacity ? plan->refs_capacity : 4096;
+        while (capacity < plan->nb_refs + entry->nb_chunks) {
+            capacity *= 2;
+        }
+        plan_ref *refs = realloc(plan->refs, capacity * sizeof(plan_ref));
+        if (!refs) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        plan->refs = refs;
+        plan->refs_capacity = capacity;
+    }
+    snprintf(path, sizeof(path), "%s/%s", plan->restore_dir, entry->path);
+    plan_file *file = &plan->files[plan->nb_files];
+    file->path = arena_strdup(&plan->pool, path);
+    if (!file->path) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    file->mode = entry->mode;
+    file->mtime = entry->mtime;
+    file->failed = 0;
+
+    uint64_t offset = 0;
+    for (size_t i = 0; i < entry->nb_chunks; i++) {
+        plan_ref *ref = &plan->refs[plan->nb_refs++];
+        memcpy(ref->md5, entry->md5[i], MD5_DIGEST_LENGTH);
+        ref->len = entry->len[i];
+        ref->file = (uint32_t)plan->nb_files;
+        ref->offset = offset;
+        offset += entry->len[i];
+    }
+    plan->nb_files++;
+
+    // Les échecs du lot sont signalés fichier par fichier et retenus dans plan->failed
+    if (plan->nb_refs >= RESTORE_PLAN_MAX_REFS) {
+        restore_plan_execute(plan);
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction de comparaison des références par empreinte, puis par fichier et position
+ */
+static int compare_refs(const void *a, const void *b) {
+    const plan_ref *x = a, *y = b;
+    int c = memcmp(x->md5, y->md5, MD5_DIGEST_LENGTH);
+    if (c != 0) {
+        return c;
+    }
+    if (x->file != y->file) {
+        return x->file < y->file ? -1 : 1;
+    }
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/**
+ * @brief Fonction de comparaison des chunks par pack, puis par position
+ */
+static int compare_chunks(const void *a, const void *b) {
+    const store_record *x = &((const plan_chunk *)a)->rec, *y = &((const plan_chunk *)b)->rec;
+    if (x->pack != y->pack) {
+        return x->pack < y->pack ? -1 : 1;
+    }
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/**
+ * @brief Fonction donnant un descripteur d'écriture sur un fichier du lot
+ *
+ * Les chunks d'un fichier sont le plus souvent voisins dans le dépôt : le
+ * descripteur ouvert le moins récemment utilisé est refermé pour faire de
+ * la place, sans que les fichiers soient rouverts sans cesse.
+ *
+ * @param plan le plan
+ * @param file le rang du fichier dans le lot
+ * @return int le descripteur, -1 si le fichier ne peut pas être ouvert
+ */
+static int plan_fd(restore_plan *plan, uint32_t file) {
+    plan_open_file *victim = &plan->open[0];
+    for (size_t i = 0; i < RESTORE_OPEN_FILES; i++) {
+        plan_open_file *slot = &plan->open[i];
+        if (slot->fd != -1 && slot->file == file) {
+            slot->used = ++plan->clock;
+            return slot->fd;
+        }
+        if (slot->used < victim->used) {
+            victim = slot;
+        }
+    }
+    if (victim->fd != -1) {
+        close(victim->fd);
+    }
+    victim->fd = open(plan->files[file].path, O_WRONLY);
+    if (victim->fd == -1) {
+        fprintf(stderr, "Erreur : impossible d'ouvrir %s : %s\n", plan->files[file].path, strerror(errno));
+        victim->used = 0;
+        return -1;
+    }
+    victim->file = file;
+    victim->used = ++plan->clock;
+    plan->stats.reopens++;
+    return victim->fd;
+}
+
+/**
+ * @brief Procédure écrivant un chunk à toutes les places qui le référencent
+ *
+ * @param plan le plan
+ * @param chunk le chunk et ses références
+ * @param data les données du chunk (NULL s'il est illisible)
+ * @param len la taille des données
+ */
+static void plan_scatter(restore_plan *plan, const plan_chunk *chunk, const void *data, uint32_t len) {
+    for (size_t r = chunk->first; r < chunk->first + chunk->count; r++) {
+        const plan_ref *ref = &plan->refs[r];
+        plan_file *file = &plan->files[ref->file];
+        if (!data || len != ref->len) {
+            file->failed = 1;
+            continue;
+        }
+        int fd = plan_fd(plan, ref->file);
+        size_t done = 0;
+        while (fd != -1 && done < len) {
+            ssize_t n = pwrite(fd, (const char *)data + done, len - done, (off_t)(ref->offset + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += (size_t)n;
+        }
+        if (done < len) {
+            file->failed = 1;
+            continue;
+        }
+        plan->stats.refs++;
+        plan->stats.bytes_written += len;
+    }
+}
+
+// Chunks d'un lot en cours de lecture
+typedef struct {
+    restore_plan *plan;
+    const plan_chunk *chunks;
+    int keep;               // 1 pour garder les chunks relus en cache pour les lots suivants
+} plan_reader;
+
+/**
+ * @brief Fonction recevant les chunks relus dans l'ordre du dépôt
+ *
+ * @param ctx les chunks du lot
+ * @param i le rang du chunk relu
+ * @param data les données déchiffrées (NULL si le chunk est illisible)
+ * @param len la taille des données
+ * @return int 0 pour continuer la lecture
+ */
+static int plan_sink(void *ctx, size_t i, const void *data, uint32_t len) {
+    plan_reader *reader = ctx;
+    const plan_chunk *chunk = &reader->chunks[i];
+    plan_scatter(reader->plan, chunk, data, len);
+    if (data && reader->keep) {
+        chunk_cache_insert(reader->plan->cache, chunk->rec.md5, data, len);
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure terminant les fichiers d'un lot : droits, date et bilan
+ *
+ * @param plan le plan
+ */
+static void plan_finish_files(restore_plan *plan) {
+    for (size_t i = 0; i < RESTORE_OPEN_FILES; i++) {
+        if (plan->open[i].fd != -1) {
+            close(plan->open[i].fd);
+            plan->open[i].fd = -1;
+        }
+        plan->open[i].used = 0;
+    }
+    for (size_t i = 0; i < plan->nb_files; i++) {
+        plan_file *file = &plan->files[i];
+        if ((file->mode & S_IWUSR) == 0) {
+            chmod(file->path, file->mode & 07777);
+        }
+        struct timespec times[2] = {{0, UTIME_OMIT}, {file->mtime, 0}};
+        utimensat(AT_FDCWD, file->path, times, 0);
+        if (file->failed) {
+            fprintf(stderr, "Erreur : restauration incomplète de %s\n", file->path);
+            plan->failed = 1;
+        }
+    }
+    plan->nb_files = 0;
+    plan->nb_refs = 0;
+    plan->clock = 0;
+    arena_reset(&plan->pool);
+}
+
+/**
+ * @brief Fonction pour lire les chunks du lot en cours dans l'ordre du dépôt
+ *
+ * Les références sont triées par empreinte pour ne chercher et ne lire
+ * qu'une fois chaque chunk distinct, même s'il revient dans de nombreux
+ * fichiers. Les chunks déjà dans le cache sont écrits sans lecture ; les
+ * autres sont triés par pack et position, relus séquentiellement puis
+ * écrits à chacune de leurs places.
+ *
+ * @param plan le plan
+ * @return int 0 en cas de succès, -1 si un fichier du plan n'a pas pu être restauré
+ */
+int restore_plan_execute(restore_plan *plan) {
+    unsigned char buffer[CHUNK_MAX_SIZE];
+    if (plan->nb_refs == 0) {
+        plan_finish_files(plan);
+        return plan->failed ? -1 : 0;
+    }
+    qsort(plan->refs, plan->nb_refs, sizeof(plan_ref), compare_refs);
+
+    // Un chunk par empreinte distincte, à chercher dans le cache puis dans l'index
+    plan_chunk *chunks = malloc(plan->nb_refs * sizeof(plan_chunk));
+    if (!chunks) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        plan_finish_files(plan);
+        plan->failed = 1;
+        return -1;
+    }
+    size_t nb_chunks = 0;
+    for (size_t first = 0; first < plan->nb_refs;) {
+        plan_chunk chunk;
+        chunk.first = first;
+        chunk.count = 1;
+        while (first + chunk.count < plan->nb_refs
+               && memcmp(plan->refs[first + chunk.count].md5, plan->refs[first].md5, MD5_DIGEST_LENGTH) == 0) {
+            chunk.count++;
+        }
+        first += chunk.count;
+        plan->stats.chunks++;
+
+        uint32_t len;
+        if (plan->cache && chunk_cache_lookup(plan->cache, plan->refs[chunk.first].md5, buffer, &len) == 1) {
+            plan_scatter(plan, &chunk, buffer, len);
+            plan->stats.cache_hits++;
+            continue;
+        }
+        if (store_locate(plan->store, plan->refs[chunk.first].md5, &chunk.rec) != 1) {
+            fprintf(stderr, "Erreur : chunk manquant dans le dépôt\n");
+            plan_scatter(plan, &chunk, NULL, 0);
+            continue;
+        }
+        chunks[nb_chunks++] = chunk;
+    }
+    qsort(chunks, nb_chunks, sizeof(plan_chunk), compare_chunks);
+
+    int ret = 0;
+    store_record *records = malloc((nb_chunks ? nb_chunks : 1) * sizeof(store_record));
+    if (!records) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        ret = -1;
+    } else {
+        store_read_stats read_stats;
+        // Seul un lot plein peut être suivi d'autres lots : le dernier ne remplit pas le cache
+        plan_reader reader = {plan, chunks, plan->cache != NULL && plan->nb_refs >= RESTORE_PLAN_MAX_REFS};
+        for (size_t i = 0; i < nb_chunks; i++) {
+            records[i] = chunks[i].rec;
+        }
+        ret = store_read_records(plan->store, records, nb_chunks, plan_sink, &reader, &read_stats);
+        plan->stats.reads += read_stats.reads;
+        plan->stats.bytes_read += read_stats.bytes_read;
+    }
+    free(records);
+    free(chunks);
+    plan->stats.batches++;
+    plan_finish_files(plan);
+    if (ret == -1) {
+        plan->failed = 1;
+    }
+    return plan->failed ? -1 : 0;
+}
+
+/**
+ * @brief Procédure pour libérer le plan
+ *
+ * @param plan le plan
+ */
+void restore_plan_free(restore_plan *plan) {
+    for (size_t i = 0; i < RESTORE_OPEN_FILES; i++) {
+        if (plan->open[i].fd != -1) {
+            close(plan->open[i].fd);
+        }
+    }
+    free(plan->files);
+    free(plan->refs);
+    arena_free(&plan->pool);
+    memset(plan, 0, sizeof(*plan));
+}
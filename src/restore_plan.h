@@ -0,0 +1,87 @@
+#ifndef RESTORE_PLAN_H
+#define RESTORE_PLAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <openssl/md5.h>
+#include "chunk_store.h"
+#include "chunk_cache.h"
+#include "manifest.h"
+#include "arena.h"
+
+// Nombre de références de chunks planifiées avant d'exécuter un lot (32 Mo de plan)
+#define RESTORE_PLAN_MAX_REFS (1024 * 1024)
+
+// Nombre de fichiers restaurés gardés ouverts pendant l'écriture d'un lot
+#define RESTORE_OPEN_FILES 64
+
+// Fichier à restaurer, déjà créé à sa taille finale
+typedef struct {
+    const char *path;       // chemin de sortie (dans l'arène du plan)
+    mode_t mode;            // droits à rétablir une fois le fichier écrit
+    time_t mtime;           // date de modification à rétablir une fois le fichier écrit
+    int failed;             // 1 si un chunk du fichier n'a pas pu être écrit
+} plan_file;
+
+// Référence d'un chunk : où ses données vont dans un fichier restauré
+typedef struct {
+    unsigned char md5[MD5_DIGEST_LENGTH];
+    uint32_t len;           // taille attendue du chunk
+    uint32_t file;          // rang du fichier dans le lot
+    uint64_t offset;        // position des données dans le fichier
+} plan_ref;
+
+// Chunk distinct d'un lot et ses références (triées par empreinte)
+typedef struct {
+    store_record rec;       // place du chunk dans le dépôt
+    size_t first;           // première référence au chunk
+    size_t count;           // nombre de références
+} plan_chunk;
+
+// Descripteur gardé ouvert sur un fichier restauré
+typedef struct {
+    uint32_t file;
+    int fd;                 // -1 pour un emplacement libre
+    uint64_t used;          // date du dernier accès
+} plan_open_file;
+
+// Bilan d'une restauration planifiée
+typedef struct {
+    uint64_t batches;       // lots exécutés
+    uint64_t refs;          // références de chunks écrites
+    uint64_t chunks;        // chunks distincts
+    uint64_t cache_hits;    // chunks servis par le cache sans lecture du dépôt
+    uint64_t reads;         // lectures de pack
+    uint64_t bytes_read;    // octets lus dans les packs
+    uint64_t bytes_written; // octets écrits dans les fichiers restaurés
+    uint64_t reopens;       // ouvertures de fichiers restaurés pour y écrire
+} restore_plan_stats;
+
+// Restauration planifiée : les chunks des fichiers sont relus dans l'ordre du dépôt
+typedef struct {
+    chunk_store *store;
+    chunk_cache *cache;     // chunks partagés entre lots (NULL sans cache)
+    const char *restore_dir;
+    arena pool;             // chemins des fichiers du lot
+    plan_file *files;
+    size_t nb_files, files_capacity;
+    plan_ref *refs;
+    size_t nb_refs, refs_capacity;
+    plan_open_file open[RESTORE_OPEN_FILES];
+    uint64_t clock;         // compteur des accès aux descripteurs ouverts
+    int failed;             // 1 si un fichier n'a pas pu être restauré
+    restore_plan_stats stats;
+} restore_plan;
+
+// Procédure pour initialiser un plan de restauration
+void restore_plan_init(restore_plan *plan, chunk_store *store, chunk_cache *cache, const char *restore_dir);
+// Fonction ajoutant un fichier au plan (à passer comme chunk_fetcher à manifest_restore)
+int restore_plan_collect(void *ctx, const manifest_entry *entry, int out_fd);
+// Fonction pour lire les chunks du lot en cours dans l'ordre du dépôt et les écrire dans les fichiers
+int restore_plan_execute(restore_plan *plan);
+// Procédure pour libérer le plan
+void restore_plan_free(restore_plan *plan);
+
+#endif // RESTORE_PLAN_H
@@ -0,0 +1,309 @@
+#include "snapshot.h"
+#include "file_handler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief Fonction pour ouvrir une sauvegarde en lecture
+ *
+ * La sauvegarde a son propre cache de SNAPSHOT_CACHE_BYTES.
+ *
+ * @param snap la sauvegarde ouverte en sortie
+ * @param backup_id le chemin du répertoire de la sauvegarde
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int snapshot_open(snapshot *snap, const char *backup_id) {
+    return snapshot_open_shared(snap, backup_id, NULL);
+}
+
+/**
+ * @brief Fonction pour ouvrir une sauvegarde en lecture avec un cache de chunks partagé
+ *
+ * Le dépôt de chunks est ouvert en lecture seule : une sauvegarde ou un
+ * serveur peuvent continuer à écrire dans le répertoire pendant la lecture.
+ * Plusieurs sauvegardes d'un même dépôt, lues par des threads différents,
+ * peuvent partager un cache : un chunk commun n'est alors relu qu'une fois.
+ *
+ * @param snap la sauvegarde ouverte en sortie
+ * @param backup_id le chemin du répertoire de la sauvegarde
+ * @param cache le cache partagé, qui doit survivre à la sauvegarde (NULL pour un cache propre)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int snapshot_open_shared(snapshot *snap, const char *backup_id, chunk_cache *cache) {
+    char repo_dir[PATH_MAX];
+    char path[PATH_MAX + 32];
+    store_options opts = STORE_OPTIONS_DEFAULT;
+
+    memset(snap, 0, sizeof(*snap));
+    snprintf(path, sizeof(path), "%s/%s", backup_id, MANIFEST_NAME);
+    snap->manifest = fopen(path, "r");
+    if (!snap->manifest) {
+        fprintf(stderr, "Erreur : impossible d'ouvrir le manifeste %s : %s\n", path, strerror(errno));
+        return -1;
+    }
+    snprintf(snap->index_path, sizeof(snap->index_path), "%s/%s", backup_id, MANIFEST_INDEX_NAME);
+
+    // Le dépôt est le répertoire parent de la sauvegarde
+    snprintf(repo_dir, sizeof(repo_dir), "%s", backup_id);
+    for (size_t n = strlen(repo_dir); n > 1 && repo_dir[n - 1] == '/'; n--) {
+        repo_dir[n - 1] = '\0';
+    }
+    char *slash = strrchr(repo_dir, '/');
+    if (!slash) {
+        snprintf(repo_dir, sizeof(repo_dir), ".");
+    } else if (slash == repo_dir) {
+        repo_dir[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+
+    if (chunk_cache_init(&snap->own_cache, cache ? 0 : SNAPSHOT_CACHE_BYTES) == -1) {
+        fclose(snap->manifest);
+        return -1;
+    }
+    snap->cache = cache ? cache : &snap->own_cache;
+    opts.read_only = 1;
+    if (store_open(&snap->store, repo_dir, &opts) == -1) {
+        chunk_cache_free(&snap->own_cache);
+        fclose(snap->manifest);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour ouvrir un fichier d'une sauvegarde
+ *
+ * La position du début de chaque chunk est calculée une fois pour toutes :
+ * une lecture trouve ensuite son premier chunk par dichotomie.
+ *
+ * @param snap la sauvegarde ouverte
+ * @param path le chemin du fichier, relatif à la racine de la sauvegarde
+ * @param file le fichier ouvert en sortie
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int snapshot_file_open(snapshot *snap, const char *path, snapshot_file *file) {
+    memset(file, 0, sizeof(*file));
+    manifest_entry_init(&file->entry);
+    int found = manifest_find(snap->manifest, snap->index_path, path, &file->entry);
+    if (found != 1) {
+        if (found == 0) {
+            fprintf(stderr, "Erreur : %s est absent de la sauvegarde\n", path);
+        }
+        manifest_entry_free(&file->entry);
+        return -1;
+    }
+    if (file->entry.type != 'F') {
+        fprintf(stderr, "Erreur : %s n'est pas un fichier\n", path);
+        manifest_entry_free(&file->entry);
+        return -1;
+    }
+
+    file->offsets = malloc((file->entry.nb_chunks + 1) * sizeof(uint64_t));
+    if (!file->offsets) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        manifest_entry_free(&file->entry);
+        return -1;
+    }
+    file->offsets[0] = 0;
+    for (size_t i = 0; i < file->entry.nb_chunks; i++) {
+        file->offsets[i + 1] = file->offsets[i] + file->entry.len[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour donner la taille d'un fichier ouvert
+ *
+ * @param file le fichier ouvert
+ * @return uint64_t la taille du fichier, somme des tailles de ses chunks ou de son contenu stocké dans le manifeste
+ */
+uint64_t snapshot_file_size(const snapshot_file *file) {
+    return file->entry.data ? file->entry.size : file->offsets[file->entry.nb_chunks];
+}
+
+/**
+ * @brief Fonction donnant les données d'un chunk, depuis le cache ou le dépôt
+ *
+ * Le dernier chunk relu est gardé à part : des lectures successives dans
+ * un même chunk ne repassent pas par le cache.
+ *
+ * @param snap la sauvegarde ouverte
+ * @param md5 l'empreinte du chunk
+ * @param len la taille attendue du chunk
+ * @return const unsigned char* les données du chunk, NULL si elles sont illisibles
+ */
+static const unsigned char *snapshot_chunk(snapshot *snap, const unsigned char *md5, uint32_t len) {
+    if (snap->has_chunk && memcmp(snap->chunk_md5, md5, MD5_DIGEST_LENGTH) == 0) {
+        return snap->chunk;
+    }
+    uint32_t lus;
+    snap->has_chunk = 0;
+    if (chunk_cache_get(snap->cache, &snap->store, md5, snap->chunk, &lus) == -1) {
+        fprintf(stderr, "Erreur : chunk manquant dans le dépôt\n");
+        return NULL;
+    }
+    if (lus != len) {
+        fprintf(stderr, "Erreur : chunk de %u octets au lieu de %u\n", lus, len);
+        return NULL;
+    }
+    memcpy(snap->chunk_md5, md5, MD5_DIGEST_LENGTH);
+    snap->has_chunk = 1;
+    return snap->chunk;
+}
+
+/**
+ * @brief Fonction pour lire len octets d'un fichier à partir d'une position
+ *
+ * Seuls les chunks recouvrant la plage sont lus : une lecture de 4 Ko
+ * coûte un ou deux chunks, quelle que soit la taille du fichier.
+ *
+ * @param snap la sauvegarde ouverte
+ * @param file le fichier ouvert
+ * @param buffer le tampon de sortie
+ * @param len le nombre d'octets voulus
+ * @param offset la position du premier octet
+ * @return ssize_t le nombre d'octets lus (0 au-delà de la fin du fichier), -1 en cas d'erreur
+ */
+ssize_t snapshot_pread(snapshot *snap, const snapshot_file *file, void *buffer, size_t len, uint64_t offset) {
+    uint64_t size = snapshot_file_size(file);
+    if (offset >= size) {
+        return 0;
+    }
+    if (len > size - offset) {
+        len = (size_t)(size - offset);
+    }
+    if (file->entry.data) {
+        memcpy(buffer, file->entry.data + offset, len);
+        return (ssize_t)len;
+    }
+
+    // Dernier chunk commençant avant la position
+    size_t lo = 0, hi = file->entry.nb_chunks;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (file->offsets[mid] <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Les chunks suivants de la plage sont annoncés au noyau avant d'être lus un par un
+    size_t last = lo;
+    while (last + 1 < file->entry.nb_chunks && file->offsets[last + 1] < offset + len) {
+        last++;
+    }
+    if (last > lo) {
+        size_t n = last - lo + 1;
+        chunk_cache_prefetch(snap->cache, &snap->store, file->entry.md5 + lo,
+                             n < CHUNK_CACHE_PREFETCH ? n : CHUNK_CACHE_PREFETCH);
+    }
+
+    size_t done = 0;
+    for (size_t i = lo; done < len; i++) {
+        const unsigned char *data = snapshot_chunk(snap, file->entry.md5[i], file->entry.len[i]);
+        if (!data) {
+            return -1;
+        }
+        size_t start = (size_t)(offset + done - file->offsets[i]);
+        size_t n = file->entry.len[i] - start;
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy((unsigned char *)buffer + done, data + start, n);
+        done += n;
+    }
+    return (ssize_t)done;
+}
+
+/**
+ * @brief Procédure pour fermer un fichier d'une sauvegarde
+ *
+ * @param file le fichier ouvert
+ */
+void snapshot_file_close(snapshot_file *file) {
+    free(file->offsets);
+    file->offsets = NULL;
+    manifest_entry_free(&file->entry);
+}
+
+/**
+ * @brief Procédure pour fermer une sauvegarde
+ *
+ * @param snap la sauvegarde ouverte
+ */
+void snapshot_close(snapshot *snap) {
+    store_close(&snap->store);
+    fclose(snap->manifest);
+    chunk_cache_free(&snap->own_cache);
+    snap->cache = NULL;
+}
+
+/**
+ * @brief Fonction pour écrire une plage d'un fichier sauvegardé dans un fichier ou sur la sortie standard
+ *
+ * Le bilan est affiché sur la sortie d'erreur pour ne pas se mêler aux données.
+ *
+ * @param backup_id le chemin du répertoire de la sauvegarde
+ * @param path le chemin du fichier dans la sauvegarde
+ * @param offset la position du premier octet
+ * @param length le nombre d'octets voulus (0 pour aller jusqu'à la fin du fichier)
+ * @param output le fichier de sortie (NULL pour la sortie standard)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int snapshot_cat(const char *backup_id, const char *path, uint64_t offset, uint64_t length, const char *output) {
+    snapshot snap;
+    snapshot_file file;
+    int ret = 0;
+
+    if (snapshot_open(&snap, backup_id) == -1) {
+        return -1;
+    }
+    if (snapshot_file_open(&snap, path, &file) == -1) {
+        snapshot_close(&snap);
+        return -1;
+    }
+    int out_fd = output ? open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+    unsigned char *buffer = malloc(SNAPSHOT_CAT_BLOCK);
+    if (out_fd == -1 || !buffer) {
+        fprintf(stderr, "Erreur : impossible de créer %s\n", output ? output : "la sortie");
+        ret = -1;
+    }
+
+    uint64_t size = snapshot_file_size(&file);
+    uint64_t end = (length == 0 || length > size || offset > size - length) ? size : offset + length;
+    uint64_t written = 0;
+    while (ret == 0 && offset < end) {
+        size_t want = (end - offset < SNAPSHOT_CAT_BLOCK) ? (size_t)(end - offset) : SNAPSHOT_CAT_BLOCK;
+        ssize_t n = snapshot_pread(&snap, &file, buffer, want, offset);
+        if (n <= 0) {
+            ret = -1;
+            break;
+        }
+        if (write_full(out_fd, buffer, (size_t)n) == -1) {
+            perror("Erreur lors de l'écriture de la sortie");
+            ret = -1;
+            break;
+        }
+        offset += (uint64_t)n;
+        written += (uint64_t)n;
+    }
+    chunk_cache_stats stats;
+    chunk_cache_report(snap.cache, &stats);
+    fprintf(stderr, "Lecture de %s : %llu octets sur %llu, %llu chunks lus dans le dépôt, %llu trouvés dans le cache\n",
+            file.entry.path, (unsigned long long)written, (unsigned long long)size,
+            (unsigned long long)stats.misses, (unsigned long long)stats.hits);
+
+    free(buffer);
+    if (output && out_fd != -1 && close(out_fd) == -1) {
+        ret = -1;
+    }
+    snapshot_file_close(&file);
+    snapshot_close(&snap);
+    return ret;
+}
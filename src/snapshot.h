@@ -0,0 +1,54 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "chunk_store.h"
+#include "deduplication.h"
+#include "manifest.h"
+#include "chunk_cache.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+
+// Mémoire des chunks gardés par une sauvegarde ouverte (4 Mo)
+#define SNAPSHOT_CACHE_BYTES (4 * 1024 * 1024)
+
+// Taille des lectures de snapshot_cat
+#define SNAPSHOT_CAT_BLOCK (64 * 1024)
+
+// Sauvegarde ouverte en lecture, sans restauration
+typedef struct {
+    char index_path[PATH_MAX + 32];
+    FILE *manifest;
+    chunk_store store;      // dépôt ouvert en lecture seule
+    chunk_cache own_cache;  // cache propre à la sauvegarde
+    chunk_cache *cache;     // cache utilisé : le sien ou celui partagé par l'appelant
+    unsigned char chunk[CHUNK_MAX_SIZE]; // dernier chunk relu
+    unsigned char chunk_md5[MD5_DIGEST_LENGTH];
+    int has_chunk;          // 1 si chunk contient le chunk d'empreinte chunk_md5
+} snapshot;
+
+// Fichier d'une sauvegarde ouvert en lecture
+typedef struct {
+    manifest_entry entry;   // entrée du manifeste et sa recette
+    uint64_t *offsets;      // position du début de chaque chunk, plus la taille du fichier
+} snapshot_file;
+
+// Fonction pour ouvrir une sauvegarde en lecture
+int snapshot_open(snapshot *snap, const char *backup_id);
+// Fonction pour ouvrir une sauvegarde en lecture avec un cache de chunks partagé
+int snapshot_open_shared(snapshot *snap, const char *backup_id, chunk_cache *cache);
+// Fonction pour ouvrir un fichier d'une sauvegarde
+int snapshot_file_open(snapshot *snap, const char *path, snapshot_file *file);
+// Fonction pour donner la taille d'un fichier ouvert
+uint64_t snapshot_file_size(const snapshot_file *file);
+// Fonction pour lire len octets d'un fichier à partir d'une position
+ssize_t snapshot_pread(snapshot *snap, const snapshot_file *file, void *buffer, size_t len, uint64_t offset);
+// Procédure pour fermer un fichier d'une sauvegarde
+void snapshot_file_close(snapshot_file *file);
+// Procédure pour fermer une sauvegarde
+void snapshot_close(snapshot *snap);
+// Fonction pour écrire une plage d'un fichier sauvegardé dans un fichier ou sur la sortie standard
+int snapshot_cat(const char *backup_id, const char *path, uint64_t offset, uint64_t length, const char *output);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,244 @@
+#define _GNU_SOURCE // O_DIRECT
+#include "throttle.h"
+#include "deduplication.h"
+#include "file_handler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/**
+ * @brief Fonction donnant l'heure d'une horloge monotone en secondes
+ *
+ * @return double l'heure en secondes
+ */
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Procédure attendant une durée donnée en secondes
+ *
+ * @param seconds la durée
+ */
+static void sleep_seconds(double seconds) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+/**
+ * @brief Procédure initialisant un seau à jetons pouvant accumuler une seconde de débit
+ *
+ * @param bucket le seau
+ * @param rate le débit en jetons par seconde (0 = illimité)
+ */
+static void bucket_init(token_bucket *bucket, double rate) {
+    bucket->rate = rate;
+    bucket->burst = rate;
+    bucket->tokens = rate;
+    bucket->last = monotonic_seconds();
+}
+
+/**
+ * @brief Procédure prélevant des jetons dans un seau, en attendant s'il n'y en a pas assez
+ *
+ * Le seau peut s'endetter d'une demande plus grosse que sa capacité : la
+ * dette est remboursée par l'attente, ce qui garde le débit moyen exact.
+ *
+ * @param t le régulateur
+ * @param bucket le seau
+ * @param amount le nombre de jetons demandés
+ */
+static void bucket_take(throttle *t, token_bucket *bucket, double amount) {
+    if (bucket->rate <= 0) {
+        return;
+    }
+    double rate = bucket->rate * t->factor;
+    double now = monotonic_seconds();
+    bucket->tokens += (now - bucket->last) * rate;
+    if (bucket->tokens > bucket->burst) {
+        bucket->tokens = bucket->burst;
+    }
+    bucket->last = now;
+    bucket->tokens -= amount;
+    if (bucket->tokens < 0) {
+        double wait = -bucket->tokens / rate;
+        sleep_seconds(wait);
+        t->waited += wait;
+    }
+}
+
+/**
+ * @brief Fonction pour initialiser le régulateur
+ *
+ * @param t le régulateur
+ * @param opts les réglages (NULL pour les réglages par défaut)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int throttle_init(throttle *t, const throttle_options *opts) {
+    static const throttle_options defaults = THROTTLE_OPTIONS_DEFAULT;
+    memset(t, 0, sizeof(*t));
+    t->opts = opts ? *opts : defaults;
+    t->factor = 1;
+    bucket_init(&t->read_bytes, (double)t->opts.read_bps);
+    bucket_init(&t->write_bytes, (double)t->opts.write_bps);
+    bucket_init(&t->read_ops, (double)t->opts.read_iops);
+    // O_DIRECT impose un tampon aligné sur les blocs du disque
+    if (t->opts.direct && posix_memalign((void **)&t->bounce, CHUNK_SIZE, CHUNK_MAX_SIZE) != 0) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        t->bounce = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Procédure pour appliquer les priorités CPU et d'entrées-sorties au thread appelant
+ *
+ * Sous Linux, la priorité CPU et la priorité d'entrées-sorties sont propres
+ * à chaque thread et héritées par les threads qu'il crée ensuite. Un échec
+ * n'est pas bloquant : la sauvegarde continue avec les priorités du système.
+ *
+ * @param t le régulateur
+ */
+void throttle_apply_priority(const throttle *t) {
+    if (t->opts.nice != 0 && setpriority(PRIO_PROCESS, 0, t->opts.nice) == -1) {
+        perror("Attention : priorité CPU inchangée");
+    }
+    if (t->opts.ioprio_class != IOPRIO_CLASS_NONE) {
+        int ioprio = (t->opts.ioprio_class << 13) | (t->opts.ioprio_level & 7);
+        if (syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, ioprio) == -1) {
+            perror("Attention : priorité d'entrées-sorties inchangée");
+        }
+    }
+}
+
+/**
+ * @brief Fonction pour ouvrir un fichier source en lecture
+ *
+ * Si le système de fichiers refuse O_DIRECT, le fichier est ouvert normalement.
+ *
+ * @param t le régulateur
+ * @param path le chemin du fichier
+ * @return int le descripteur, -1 en cas d'erreur
+ */
+int throttle_open(throttle *t, const char *path) {
+    t->since_drop = 0;
+    if (t->opts.direct) {
+        int fd = open(path, O_RDONLY | O_DIRECT);
+        if (fd != -1 || errno != EINVAL) {
+            return fd;
+        }
+    }
+    return open(path, O_RDONLY);
+}
+
+/**
+ * @brief Fonction pour lire jusqu'à len octets d'une source dans les limites du régulateur
+ *
+ * Chaque lecture attend ses jetons de débit et d'opérations. Sa durée
+ * alimente une moyenne lissée : au-delà de la latence visée, les débits
+ * accordés diminuent de 20 %, puis remontent de 1 % par lecture rapide.
+ * Sans limite de débit, le recul se fait en intercalant des pauses
+ * proportionnelles à la durée des lectures.
+ *
+ * @param t le régulateur
+ * @param fd le fichier ouvert avec throttle_open
+ * @param buffer le tampon de sortie
+ * @param len la taille voulue, au plus CHUNK_MAX_SIZE avec O_DIRECT
+ * @return ssize_t le nombre d'octets lus (inférieur à len en fin de fichier), -1 en cas d'erreur
+ */
+ssize_t throttle_read(throttle *t, int fd, void *buffer, size_t len) {
+    bucket_take(t, &t->read_ops, 1);
+    bucket_take(t, &t->read_bytes, (double)len);
+
+    double start = monotonic_seconds();
+    ssize_t n = read_full(fd, t->bounce ? t->bounce : buffer, len);
+    double elapsed = monotonic_seconds() - start;
+    if (n <= 0) {
+        return n;
+    }
+    if (t->bounce) {
+        memcpy(buffer, t->bounce, (size_t)n);
+    }
+
+    t->latency = (t->latency > 0) ? 0.8 * t->latency + 0.2 * elapsed : elapsed;
+    if (t->opts.latency_target > 0) {
+        if (t->latency > t->opts.latency_target) {
+            t->factor = (t->factor * 0.8 > THROTTLE_MIN_FACTOR) ? t->factor * 0.8 : THROTTLE_MIN_FACTOR;
+        } else if (t->factor < 1) {
+            t->factor = (t->factor + 0.01 < 1) ? t->factor + 0.01 : 1;
+        }
+        if (t->read_bytes.rate <= 0 && t->factor < 1) {
+            double pause = elapsed * (1 / t->factor - 1);
+            sleep_seconds(pause);
+            t->waited += pause;
+        }
+    }
+
+    // Les pages déjà lues ne serviront plus : on évite d'évincer celles des applications
+    if (t->opts.drop_cache && !t->bounce) {
+        t->since_drop += (uint64_t)n;
+        if (t->since_drop >= THROTTLE_DROP_BYTES) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            t->since_drop = 0;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Procédure pour fermer un fichier source et évincer ses pages du cache
+ *
+ * @param t le régulateur
+ * @param fd le fichier ouvert avec throttle_open
+ */
+void throttle_close(throttle *t, int fd) {
+    if (t->opts.drop_cache && !t->bounce) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+}
+
+/**
+ * @brief Procédure pour attendre le droit d'écrire len octets dans le dépôt
+ *
+ * @param t le régulateur
+ * @param len la taille écrite
+ */
+void throttle_write(throttle *t, size_t len) {
+    bucket_take(t, &t->write_bytes, (double)len);
+}
+
+/**
+ * @brief Procédure pour afficher le bilan du régulateur, s'il a limité quelque chose
+ *
+ * @param t le régulateur
+ */
+void throttle_report(const throttle *t) {
+    if (t->opts.read_bps == 0 && t->opts.write_bps == 0 && t->opts.read_iops == 0 && t->opts.latency_target <= 0) {
+        return;
+    }
+    printf("Limitation : %.2f s d'attente, latence de lecture moyenne %.3f ms, %.0f%% du débit accordé en fin de sauvegarde\n",
+           t->waited, t->latency * 1000, t->factor * 100);
+}
+
+/**
+ * @brief Procédure pour libérer le régulateur
+ *
+ * @param t le régulateur
+ */
+void throttle_free(throttle *t) {
+    free(t->bounce);
+    t->bounce = NULL;
+}
@@ -0,0 +1,72 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Volume lu entre deux demandes d'éviction du cache de pages (8 Mo)
+#define THROTTLE_DROP_BYTES (8 * 1024 * 1024)
+
+// Fraction minimale du débit accordée lors du recul adaptatif
+#define THROTTLE_MIN_FACTOR 0.05
+
+// Classes de priorité d'entrées-sorties (ioprio_set)
+#define IOPRIO_CLASS_NONE 0
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+// Réglages de la limitation des ressources d'une sauvegarde (0 = sans limite)
+typedef struct {
+    uint64_t read_bps;     // octets lus par seconde
+    uint64_t write_bps;    // octets écrits dans le dépôt par seconde
+    uint32_t read_iops;    // lectures par seconde
+    int nice;              // priorité CPU des threads de la sauvegarde
+    int ioprio_class;      // classe de priorité d'entrées-sorties (IOPRIO_CLASS_*)
+    int ioprio_level;      // niveau dans la classe (0 à 7)
+    int direct;            // 1 pour lire les sources avec O_DIRECT
+    int drop_cache;        // 1 pour évincer du cache les pages des sources déjà lues
+    double latency_target; // latence de lecture au-delà de laquelle la sauvegarde ralentit (s)
+} throttle_options;
+
+// Réglages par défaut : aucune limite, sources évincées du cache après lecture
+#define THROTTLE_OPTIONS_DEFAULT {0, 0, 0, 0, IOPRIO_CLASS_NONE, 4, 0, 1, 0}
+
+// Seau à jetons limitant un débit
+typedef struct {
+    double rate;    // jetons accordés par seconde (0 = illimité)
+    double burst;   // jetons accumulables au plus
+    double tokens;  // jetons disponibles (négatif : dette à attendre)
+    double last;    // date du dernier remplissage
+} token_bucket;
+
+// Régulateur des ressources d'une sauvegarde
+typedef struct {
+    throttle_options opts;
+    token_bucket read_bytes;
+    token_bucket write_bytes;
+    token_bucket read_ops;
+    double factor;          // fraction des débits accordée (recul adaptatif)
+    double latency;         // latence moyenne lissée des lectures (s)
+    double waited;          // temps passé à attendre (s)
+    uint64_t since_drop;    // octets lus depuis la dernière éviction du cache
+    unsigned char *bounce;  // tampon aligné des lectures O_DIRECT
+} throttle;
+
+// Fonction pour initialiser le régulateur (opts à NULL pour les réglages par défaut)
+int throttle_init(throttle *t, const throttle_options *opts);
+// Procédure pour appliquer les priorités CPU et d'entrées-sorties au thread appelant
+void throttle_apply_priority(const throttle *t);
+// Fonction pour ouvrir un fichier source en lecture
+int throttle_open(throttle *t, const char *path);
+// Fonction pour lire jusqu'à len octets d'une source dans les limites du régulateur
+ssize_t throttle_read(throttle *t, int fd, void *buffer, size_t len);
+// Procédure pour fermer un fichier source et évincer ses pages du cache
+void throttle_close(throttle *t, int fd);
+// Procédure pour attendre le droit d'écrire len octets dans le dépôt
+void throttle_write(throttle *t, size_t len);
+// Procédure pour afficher le bilan du régulateur
+void throttle_report(const throttle *t);
+// Procédure pour libérer le régulateur
+void throttle_free(throttle *t);
+
+#endif // THROTTLE_H
@@ -0,0 +1,786 @@
+#define _GNU_SOURCE
+#include "watcher.h"
+#include "chunk_store.h"
+#include "file_handler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+
+/*
+ * Format du journal des chemins modifiés (une ligne par enregistrement) :
+ *   W;<date>;<source>     l'observateur a commencé à surveiller la source
+ *   X;<date>              l'observateur s'est arrêté
+ *   P;<date>;<chemin>     le chemin a changé (contenu, droits, création ou suppression)
+ *   T;<date>;<chemin>     tout le sous-arbre du chemin est à reparcourir (dossier créé, déplacé...)
+ *   F;<date>              date de début de la dernière sauvegarde ayant parcouru toute la source
+ * Les chemins sont relatifs à la racine de la source ("" pour la racine).
+ */
+
+// Observateur d'une source
+typedef struct {
+    char root[PATH_MAX];        // chemin absolu de la source
+    size_t root_len;
+    char journal[PATH_MAX + 32];
+    int fd;                     // descripteur fanotify ou inotify
+    int fanotify;               // 1 avec fanotify, 0 avec inotify
+    int mount_fd;               // répertoire de la source, pour résoudre les descripteurs de fichiers (fanotify)
+    char **wd_paths;            // chemin relatif de chaque surveillance (inotify), indexé par wd
+    size_t nb_wd;
+    size_t watches;             // surveillances actives (inotify)
+    char *batch;                // lignes en attente d'écriture dans le journal
+    size_t batch_len;
+    size_t batch_capacity;
+    uint64_t events;            // événements reçus
+    uint64_t recorded;          // chemins notés dans le journal
+} watcher;
+
+static volatile sig_atomic_t watch_stop = 0;
+
+/**
+ * @brief Procédure appelée à la réception de SIGINT ou SIGTERM
+ */
+static void on_stop_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+/**
+ * @brief Fonction ajoutant des lignes au journal, sous son verrou
+ *
+ * Le journal est rouvert à chaque lot : une sauvegarde qui l'allège le
+ * remplace par un nouveau fichier, qu'il faut alors reprendre.
+ *
+ * @param path le chemin du journal
+ * @param data les lignes à ajouter
+ * @param len leur taille
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int journal_append(const char *path, const char *data, size_t len) {
+    for (;;) {
+        struct stat st_fd, st_path;
+        int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1 || flock(fd, LOCK_EX) == -1) {
+            perror("Erreur lors de l'ouverture du journal des modifications");
+            if (fd != -1) {
+                close(fd);
+            }
+            return -1;
+        }
+        if (fstat(fd, &st_fd) == 0 && stat(path, &st_path) == 0 && st_fd.st_ino != st_path.st_ino) {
+            close(fd); // Remplacé entre l'ouverture et le verrou
+            continue;
+        }
+        int ret = write_full(fd, data, len);
+        if (ret == -1) {
+            perror("Erreur lors de l'écriture du journal des modifications");
+        }
+        close(fd);
+        return ret;
+    }
+}
+
+/**
+ * @brief Fonction ajoutant une ligne au lot en cours
+ *
+ * @param w l'observateur
+ * @param kind le type de ligne (W, X, P ou T)
+ * @param text le chemin ou la source (NULL pour aucun)
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int batch_add(watcher *w, char kind, const char *text) {
+    char line[PATH_MAX + 64];
+    int len = text ? snprintf(line, sizeof(line), "%c;%lld;%s\n", kind, (long long)time(NULL), text)
+                   : snprintf(line, sizeof(line), "%c;%lld\n", kind, (long long)time(NULL));
+    if (len < 0 || (size_t)len >= sizeof(line)) {
+        return 0;
+    }
+    if (w->batch_len + (size_t)len > w->batch_capacity) {
+        size_t capacity = w->batch_capacity ? w->batch_capacity * 2 : 4096;
+        while (capacity < w->batch_len + (size_t)len) {
+            capacity *= 2;
+        }
+        char *batch = realloc(w->batch, capacity);
+        if (!batch) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        w->batch = batch;
+        w->batch_capacity = capacity;
+    }
+    memcpy(w->batch + w->batch_len, line, (size_t)len);
+    w->batch_len += (size_t)len;
+    return 0;
+}
+
+/**
+ * @brief Fonction notant un chemin modifié
+ *
+ * Un nom contenant un retour à la ligne casserait le format : c'est alors
+ * tout le dossier qui le contient qui sera reparcouru.
+ *
+ * @param w l'observateur
+ * @param rel le chemin relatif à la racine de la source
+ * @param subtree 1 pour reparcourir tout le sous-arbre
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int record_path(watcher *w, const char *rel, int subtree) {
+    char parent[PATH_MAX];
+    if (strchr(rel, '\n')) {
+        snprintf(parent, sizeof(parent), "%s", rel);
+        char *slash = strrchr(parent, '/');
+        if (slash) {
+            *slash = '\0';
+        } else {
+            parent[0] = '\0';
+        }
+        parent[strcspn(parent, "\n")] = '\0';
+        rel = parent;
+        subtree = 1;
+    }
+    w->recorded++;
+    return batch_add(w, subtree ? 'T' : 'P', rel);
+}
+
+/**
+ * @brief Fonction écrivant le lot en cours dans le journal
+ *
+ * @param w l'observateur
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int batch_flush(watcher *w) {
+    if (w->batch_len == 0) {
+        return 0;
+    }
+    int ret = journal_append(w->journal, w->batch, w->batch_len);
+    w->batch_len = 0;
+    return ret;
+}
+
+/**
+ * @brief Fonction donnant le chemin relatif d'un chemin absolu situé dans la source
+ *
+ * @param w l'observateur
+ * @param path le chemin absolu
+ * @return const char* le chemin relatif, NULL s'il est hors de la source
+ */
+static const char *relative_path(const watcher *w, const char *path) {
+    if (strncmp(path, w->root, w->root_len) != 0) {
+        return NULL;
+    }
+    if (w->root_len == 1) {
+        return path + 1; // Source à la racine du système de fichiers
+    }
+    if (path[w->root_len] == '\0') {
+        return path + w->root_len;
+    }
+    return (path[w->root_len] == '/') ? path + w->root_len + 1 : NULL;
+}
+
+/**
+ * @brief Fonction préparant l'observation de tout le système de fichiers de la source avec fanotify
+ *
+ * Les événements portent le descripteur du dossier parent et le nom de
+ * l'entrée (FAN_REPORT_DFID_NAME) : aucune surveillance par dossier n'est
+ * nécessaire, quelle que soit la taille de l'arborescence. Il faut
+ * CAP_SYS_ADMIN et un noyau 5.9 ou plus récent.
+ *
+ * @param w l'observateur
+ * @return int 0 en cas de succès, -1 si fanotify n'est pas utilisable
+ */
+static int fanotify_setup(watcher *w) {
+    w->fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC, O_RDONLY | O_LARGEFILE);
+    if (w->fd == -1) {
+        return -1;
+    }
+    uint64_t mask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB | FAN_ONDIR;
+    w->mount_fd = open(w->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (w->mount_fd == -1 || fanotify_mark(w->fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, w->root) == -1) {
+        close(w->fd);
+        w->fd = -1;
+        return -1;
+    }
+    w->fanotify = 1;
+    return 0;
+}
+
+/**
+ * @brief Fonction traitant un lot d'événements fanotify
+ *
+ * Le dossier de chaque événement est retrouvé à partir de son descripteur.
+ * Un dossier supprimé entre-temps ne peut plus l'être, mais sa propre
+ * suppression est signalée dans son parent, qui fait reparcourir son
+ * sous-arbre : l'événement peut être ignoré.
+ *
+ * @param w l'observateur
+ * @param buffer les événements lus
+ * @param len leur taille
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int fanotify_process(watcher *w, char *buffer, ssize_t len) {
+    const uint64_t namespace_change = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO;
+    for (struct fanotify_event_metadata *m = (struct fanotify_event_metadata *)buffer; FAN_EVENT_OK(m, len);
+         m = FAN_EVENT_NEXT(m, len)) {
+        w->events++;
+        if (m->mask & FAN_Q_OVERFLOW) {
+            if (record_path(w, "", 1) == -1) {
+                return -1;
+            }
+            continue;
+        }
+        struct fanotify_event_info_fid *fid = (struct fanotify_event_info_fid *)(m + 1);
+        if ((char *)(fid + 1) > (char *)m + m->event_len || fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+            continue;
+        }
+        struct file_handle *handle = (struct file_handle *)fid->handle;
+        const char *name = (const char *)(handle->f_handle + handle->handle_bytes);
+        int dir_fd = open_by_handle_at(w->mount_fd, handle, O_PATH | O_CLOEXEC);
+        if (dir_fd == -1) {
+            continue;
+        }
+        char link[64], dir[PATH_MAX], path[PATH_MAX * 2];
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", dir_fd);
+        ssize_t n = readlink(link, dir, sizeof(dir) - 1);
+        close(dir_fd);
+        if (n <= 0) {
+            continue;
+        }
+        dir[n] = '\0';
+        const char *dir_rel = relative_path(w, dir);
+        if (!dir_rel) {
+            continue;
+        }
+        if (strcmp(name, ".") == 0) {
+            snprintf(path, sizeof(path), "%s", dir_rel);
+        } else {
+            snprintf(path, sizeof(path), "%s%s%s", dir_rel, dir_rel[0] ? "/" : "", name);
+        }
+        int subtree = (m->mask & FAN_ONDIR) && (m->mask & namespace_change);
+        if (record_path(w, path, subtree) == -1
+            || ((m->mask & namespace_change) && strcmp(name, ".") != 0 && record_path(w, dir_rel, 0) == -1)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction ajoutant une surveillance inotify à un dossier et à tous ses sous-dossiers
+ *
+ * Surveiller un dossier déjà surveillé (après un déplacement) redonne la
+ * même surveillance, dont le chemin est mis à jour.
+ *
+ * @param w l'observateur
+ * @param rel le chemin relatif du dossier
+ * @return int 0 en cas de succès, -1 si la limite de surveillances est atteinte
+ */
+static int inotify_add_tree(watcher *w, const char *rel) {
+    char path[PATH_MAX * 2];
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO
+                          | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+    snprintf(path, sizeof(path), "%s%s%s", w->root, rel[0] ? "/" : "", rel);
+    int wd = inotify_add_watch(w->fd, path, mask);
+    if (wd == -1) {
+        if (errno == ENOSPC) {
+            fprintf(stderr, "Erreur : limite de surveillances inotify atteinte (fs.inotify.max_user_watches)\n");
+            return -1;
+        }
+        return 0; // Dossier disparu ou illisible entre-temps
+    }
+    if ((size_t)wd >= w->nb_wd) {
+        size_t nb = w->nb_wd ? w->nb_wd : 1024;
+        while (nb <= (size_t)wd) {
+            nb *= 2;
+        }
+        char **paths = realloc(w->wd_paths, nb * sizeof(char *));
+        if (!paths) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        memset(paths + w->nb_wd, 0, (nb - w->nb_wd) * sizeof(char *));
+        w->wd_paths = paths;
+        w->nb_wd = nb;
+    }
+    if (!w->wd_paths[wd]) {
+        w->watches++;
+    }
+    free(w->wd_paths[wd]);
+    w->wd_paths[wd] = strdup(rel);
+    if (!w->wd_paths[wd]) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *dirent;
+    int ret = 0;
+    while (ret == 0 && (dirent = readdir(dir)) != NULL) {
+        if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0) {
+            continue;
+        }
+        char sub[PATH_MAX];
+        struct stat st;
+        snprintf(sub, sizeof(sub), "%s%s%s", rel, rel[0] ? "/" : "", dirent->d_name);
+        snprintf(path, sizeof(path), "%s/%s", w->root, sub);
+        if (dirent->d_type == DT_DIR || (dirent->d_type == DT_UNKNOWN && lstat(path, &st) == 0 && S_ISDIR(st.st_mode))) {
+            ret = inotify_add_tree(w, sub);
+        }
+    }
+    closedir(dir);
+    return ret;
+}
+
+/**
+ * @brief Fonction préparant l'observation de la source avec inotify, dossier par dossier
+ *
+ * @param w l'observateur
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int inotify_setup(watcher *w) {
+    w->fd = inotify_init1(IN_CLOEXEC);
+    if (w->fd == -1) {
+        perror("Erreur lors de l'initialisation d'inotify");
+        return -1;
+    }
+    w->fanotify = 0;
+    return inotify_add_tree(w, "");
+}
+
+/**
+ * @brief Fonction traitant un lot d'événements inotify
+ *
+ * Un dossier créé ou arrivé par déplacement est surveillé à son tour, et
+ * tout son sous-arbre est à reparcourir : des entrées ont pu y apparaître
+ * avant sa surveillance.
+ *
+ * @param w l'observateur
+ * @param buffer les événements lus
+ * @param len leur taille
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int inotify_process(watcher *w, char *buffer, ssize_t len) {
+    const uint32_t namespace_change = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+    for (char *p = buffer; p < buffer + len;) {
+        struct inotify_event *ev = (struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + ev->len;
+        w->events++;
+        if (ev->mask & IN_Q_OVERFLOW) {
+            if (record_path(w, "", 1) == -1) {
+                return -1;
+            }
+            continue;
+        }
+        if (ev->wd < 0 || (size_t)ev->wd >= w->nb_wd || !w->wd_paths[ev->wd]) {
+            continue;
+        }
+        if (ev->mask & IN_IGNORED) {
+            free(w->wd_paths[ev->wd]);
+            w->wd_paths[ev->wd] = NULL;
+            w->watches--;
+            continue;
+        }
+        const char *dir_rel = w->wd_paths[ev->wd];
+        char path[PATH_MAX * 2];
+        if (ev->len == 0) {
+            snprintf(path, sizeof(path), "%s", dir_rel);
+        } else {
+            snprintf(path, sizeof(path), "%s%s%s", dir_rel, dir_rel[0] ? "/" : "", ev->name);
+        }
+        int subtree = (ev->mask & IN_ISDIR) && (ev->mask & namespace_change);
+        if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && inotify_add_tree(w, path) == -1) {
+            return -1;
+        }
+        if (record_path(w, path, subtree) == -1
+            || ((ev->mask & namespace_change) && ev->len > 0 && record_path(w, w->wd_paths[ev->wd], 0) == -1)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Fonction pour observer une source et noter ses chemins modifiés dans le journal du dépôt
+ *
+ * L'observateur tourne jusqu'à SIGINT ou SIGTERM. Il utilise fanotify
+ * quand c'est possible, sinon inotify. Tant qu'il tourne, il tient le
+ * verrou WATCH_LOCK_NAME : une sauvegarde qui le trouve libre sait que des
+ * modifications ont pu échapper au journal et reparcourt toute la source.
+ *
+ * @param source_dir le répertoire source
+ * @param backup_dir le répertoire du dépôt
+ * @return int 0 en cas d'arrêt normal, -1 en cas d'erreur
+ */
+int watch_source(const char *source_dir, const char *backup_dir) {
+    watcher w;
+    char store_dir[PATH_MAX + 16];
+    char lock_path[PATH_MAX + 32];
+    char buffer[WATCH_EVENT_BUFFER] __attribute__((aligned(8)));
+
+    memset(&w, 0, sizeof(w));
+    w.fd = -1;
+    w.mount_fd = -1;
+    if (realpath(source_dir, w.root) == NULL) {
+        perror("Erreur : source invalide");
+        return -1;
+    }
+    w.root_len = strlen(w.root);
+    snprintf(store_dir, sizeof(store_dir), "%s/%s", backup_dir, STORE_DIR);
+    mkdir(backup_dir, 0755);
+    mkdir(store_dir, 0755);
+    snprintf(w.journal, sizeof(w.journal), "%s/%s", store_dir, WATCH_JOURNAL_NAME);
+    snprintf(lock_path, sizeof(lock_path), "%s/%s", store_dir, WATCH_LOCK_NAME);
+
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd == -1 || flock(lock_fd, LOCK_EX | LOCK_NB) == -1) {
+        fprintf(stderr, "Erreur : un observateur tourne déjà pour le dépôt %s\n", backup_dir);
+        if (lock_fd != -1) {
+            close(lock_fd);
+        }
+        return -1;
+    }
+    if (fanotify_setup(&w) == 0) {
+        printf("Observation de %s avec fanotify\n", w.root);
+    } else if (inotify_setup(&w) == 0) {
+        printf("Observation de %s avec inotify (%zu dossiers)\n", w.root, w.watches);
+    } else {
+        close(lock_fd);
+        return -1;
+    }
+    fflush(stdout);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // Les événements sont écrits dès leur lecture : une sauvegarde les voit au plus tard une seconde après
+    int ret = (batch_add(&w, 'W', w.root) == 0 && batch_flush(&w) == 0) ? 0 : -1;
+    while (ret == 0 && !watch_stop) {
+        struct pollfd pfd = {w.fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 1000);
+        if (ready <= 0) {
+            continue;
+        }
+        ssize_t len = read(w.fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            if (len == -1 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            perror("Erreur lors de la lecture des événements");
+            ret = -1;
+            break;
+        }
+        ret = w.fanotify ? fanotify_process(&w, buffer, len) : inotify_process(&w, buffer, len);
+        if (batch_flush(&w) == -1) {
+            ret = -1;
+        }
+    }
+
+    // L'arrêt est noté : les sauvegardes suivantes reparcourront toute la source
+    w.batch_len = 0;
+    if (batch_add(&w, 'X', NULL) == 0) {
+        batch_flush(&w);
+    }
+    printf("Observateur arrêté : %llu événements, %llu chemins notés\n", (unsigned long long)w.events,
+           (unsigned long long)w.recorded);
+    for (size_t i = 0; i < w.nb_wd; i++) {
+        free(w.wd_paths[i]);
+    }
+    free(w.wd_paths);
+    free(w.batch);
+    close(w.fd);
+    if (w.mount_fd != -1) {
+        close(w.mount_fd);
+    }
+    close(lock_fd);
+    return ret;
+}
+
+/**
+ * @brief Fonction de comparaison de deux chemins pour qsort et bsearch
+ */
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Fonction ajoutant un chemin aux chemins modifiés
+ *
+ * @param set les chemins modifiés
+ * @param path le chemin relatif
+ * @param subtree 1 si tout son sous-arbre est à reparcourir
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int dirty_set_add(dirty_set *set, const char *path, int subtree) {
+    if (set->count == set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 256;
+        char **paths = realloc(set->paths, capacity * sizeof(char *));
+        unsigned char *flags = paths ? realloc(set->subtree, capacity) : NULL;
+        if (paths) {
+            set->paths = paths;
+        }
+        if (!flags) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        set->subtree = flags;
+        set->capacity = capacity;
+    }
+    set->paths[set->count] = arena_strdup(&set->pool, path);
+    if (!set->paths[set->count]) {
+        fprintf(stderr, "Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    set->subtree[set->count++] = (unsigned char)subtree;
+    return 0;
+}
+
+/**
+ * @brief Fonction triant les chemins modifiés et fusionnant les doublons
+ *
+ * Les indicateurs suivent leur chemin : ils sont portés par un tableau
+ * d'indices trié, puis recopiés dans l'ordre.
+ *
+ * @param set les chemins modifiés
+ * @return int 0 en cas de succès, -1 sinon
+ */
+static int dirty_set_sort(dirty_set *set) {
+    if (set->count == 0) {
+        return 0;
+    }
+    // Le drapeau est collé devant chaque chemin le temps du tri, puis retiré
+    for (size_t i = 0; i < set->count; i++) {
+        char *tagged = arena_alloc(&set->pool, strlen(set->paths[i]) + 2);
+        if (!tagged) {
+            fprintf(stderr, "Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        strcpy(tagged + 1, set->paths[i]);
+        tagged[0] = set->subtree[i] ? 'T' : 'P';
+        set->paths[i] = tagged + 1;
+    }
+    qsort(set->paths, set->count, sizeof(char *), compare_paths);
+    size_t kept = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        unsigned char subtree = set->paths[i][-1] == 'T';
+        if (kept > 0 && strcmp(set->paths[kept - 1], set->paths[i]) == 0) {
+            set->subtree[kept - 1] |= subtree;
+            continue;
+        }
+        set->paths[kept] = set->paths[i];
+        set->subtree[kept++] = subtree;
+    }
+    set->count = kept;
+    return 0;
+}
+
+/**
+ * @brief Fonction pour lire les chemins modifiés depuis une date
+ *
+ * Le journal n'est utilisable que si l'observateur de cette source tourne
+ * toujours (son verrou est tenu), s'il a démarré avant la date et si une
+ * sauvegarde a parcouru toute la source il y a moins de
+ * WATCH_FULL_WALK_INTERVAL. Sinon la sauvegarde reparcourt tout.
+ *
+ * @param store_dir le répertoire du dépôt de chunks
+ * @param source le chemin absolu de la source
+ * @param since la date de début de la sauvegarde précédente de cette source
+ * @param set les chemins modifiés depuis, en sortie (à libérer avec dirty_set_free)
+ * @return int 1 si le journal est utilisable, 0 sinon, -1 en cas d'erreur
+ */
+int watch_load(const char *store_dir, const char *source, time_t since, dirty_set *set) {
+    char path[PATH_MAX + 32];
+    char line[PATH_MAX + 64];
+    memset(set, 0, sizeof(*set));
+    arena_init(&set->pool, 0);
+
+    snprintf(path, sizeof(path), "%s/%s", store_dir, WATCH_LOCK_NAME);
+    int lock_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (lock_fd == -1) {
+        return 0;
+    }
+    int running = (flock(lock_fd, LOCK_SH | LOCK_NB) == -1 && errno == EWOULDBLOCK);
+    close(lock_fd);
+    if (!running) {
+        printf("Observateur arrêté : parcours complet de la source\n");
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", store_dir, WATCH_JOURNAL_NAME);
+    FILE *journal = fopen(path, "r");
+    if (!journal) {
+        return 0;
+    }
+    flock(fileno(journal), LOCK_SH);
+    long long started = -1, full_walk = -1;
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), journal)) {
+        long long date;
+        int offset = 0;
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%*c;%lld%n", &date, &offset) != 1) {
+            continue;
+        }
+        const char *text = (line[offset] == ';') ? line + offset + 1 : "";
+        switch (line[0]) {
+            case 'W':
+                started = (strcmp(text, source) == 0) ? date : -1;
+                break;
+            case 'X':
+                started = -1;
+                break;
+            case 'F':
+                full_walk = date;
+                break;
+            case 'P':
+            case 'T':
+                if (date + WATCH_SLACK >= since) {
+                    ret = dirty_set_add(set, text, line[0] == 'T');
+                }
+                break;
+        }
+    }
+    fclose(journal);
+    if (ret == -1 || dirty_set_sort(set) == -1) {
+        dirty_set_free(set);
+        return -1;
+    }
+    if (started < 0 || started >= (long long)since) {
+        printf("Journal des modifications incomplet depuis la dernière sauvegarde : parcours complet de la source\n");
+    } else if (full_walk < 0 || full_walk + WATCH_FULL_WALK_INTERVAL < (long long)time(NULL)) {
+        printf("Dernier parcours complet trop ancien : parcours complet de la source\n");
+    } else if (set->count > 0 && set->paths[0][0] == '\0' && set->subtree[0]) {
+        printf("Événements perdus par l'observateur : parcours complet de la source\n");
+    } else {
+        return 1;
+    }
+    dirty_set_free(set);
+    return 0;
+}
+
+/**
+ * @brief Fonction pour savoir si un chemin a changé ou se trouve dans un sous-arbre à reparcourir
+ *
+ * Un sous-arbre à reparcourir l'emporte : le chemin sera revu avec lui.
+ *
+ * @param set les chemins modifiés, triés
+ * @param path le chemin relatif
+ * @param index la position du chemin dans set s'il a changé, en sortie
+ * @return int WATCH_DIRTY_SUBTREE, WATCH_DIRTY_PATH ou WATCH_CLEAN
+ */
+int dirty_set_lookup(const dirty_set *set, const char *path, size_t *index) {
+    char prefix[PATH_MAX];
+    const char *key;
+    if (set->count == 0) {
+        return WATCH_CLEAN;
+    }
+    snprintf(prefix, sizeof(prefix), "%s", path);
+    for (char *slash = strrchr(prefix, '/'); slash; slash = strrchr(prefix, '/')) {
+        *slash = '\0';
+        key = prefix;
+        char **found = bsearch(&key, set->paths, set->count, sizeof(char *), compare_paths);
+        if (found && set->subtree[found - set->paths]) {
+            return WATCH_DIRTY_SUBTREE;
+        }
+    }
+    key = path;
+    char **found = bsearch(&key, set->paths, set->count, sizeof(char *), compare_paths);
+    if (!found) {
+        return WATCH_CLEAN;
+    }
+    *index = (size_t)(found - set->paths);
+    return WATCH_DIRTY_PATH;
+}
+
+/**
+ * @brief Procédure pour libérer les chemins modifiés
+ *
+ * @param set les chemins modifiés
+ */
+void dirty_set_free(dirty_set *set) {
+    free(set->paths);
+    free(set->subtree);
+    arena_free(&set->pool);
+    memset(set, 0, sizeof(*set));
+}
+
+/**
+ * @brief Fonction pour alléger le journal après une sauvegarde
+ *
+ * Seuls restent le démarrage de l'observateur en cours, la date du dernier
+ * parcours complet et les événements postérieurs au début de la sauvegarde,
+ * dont la suivante aura besoin. Le journal est réécrit à côté puis renommé
+ * sous son verrou ; l'observateur rouvre le nouveau fichier.
+ *
+ * @param store_dir le répertoire du dépôt de chunks
+ * @param start la date de début de la sauvegarde
+ * @param full_walk 1 si la sauvegarde a parcouru toute la source
+ * @return int 0 en cas de succès, -1 sinon
+ */
+int watch_trim(const char *store_dir, time_t start, int full_walk) {
+    char path[PATH_MAX + 32];
+    char tmp_path[PATH_MAX + 40];
+    char line[PATH_MAX + 64];
+    char header[PATH_MAX + 64] = "";
+    char last_full[PATH_MAX + 64] = "";
+
+    snprintf(path, sizeof(path), "%s/%s", store_dir, WATCH_JOURNAL_NAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *journal = fopen(path, "r");
+    if (!journal) {
+        return 0;
+    }
+    flock(fileno(journal), LOCK_EX);
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        perror("Erreur lors de la réécriture du journal des modifications");
+        fclose(journal);
+        return -1;
+    }
+    // Premier passage : démarrage de l'observateur et dernier parcours complet, placés en tête
+    if (full_walk) {
+        snprintf(last_full, sizeof(last_full), "F;%lld\n", (long long)start);
+    }
+    while (fgets(line, sizeof(line), journal)) {
+        if (line[0] == 'W' || line[0] == 'X') {
+            snprintf(header, sizeof(header), "%s", line);
+        } else if (line[0] == 'F' && !full_walk) {
+            snprintf(last_full, sizeof(last_full), "%s", line);
+        }
+    }
+    int ret = (fputs(header, out) == EOF || fputs(last_full, out) == EOF) ? -1 : 0;
+
+    // Second passage : événements dont la sauvegarde suivante aura besoin
+    rewind(journal);
+    while (ret == 0 && fgets(line, sizeof(line), journal)) {
+        long long date;
+        if ((line[0] == 'P' || line[0] == 'T') && sscanf(line, "%*c;%lld", &date) == 1
+            && date + WATCH_SLACK >= (long long)start && fputs(line, out) == EOF) {
+            ret = -1;
+        }
+    }
+    if (close_synced(out) != 0) {
+        ret = -1;
+    }
+    if (ret == -1 || rename(tmp_path, path) == -1) {
+        perror("Erreur lors de la réécriture du journal des modifications");
+        unlink(tmp_path);
+        fclose(journal);
+        return -1;
+    }
+    fclose(journal); // Libère le verrou : l'observateur en attente rouvre le nouveau journal
+    return 0;
+}
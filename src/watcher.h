@@ -0,0 +1,49 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "arena.h"
+
+// Journal des chemins modifiés, dans le répertoire du dépôt de chunks
+#define WATCH_JOURNAL_NAME "watch"
+
+// Verrou tenu par l'observateur tant qu'il tourne
+#define WATCH_LOCK_NAME "watch.lock"
+
+// Intervalle au-delà duquel une sauvegarde reparcourt toute la source malgré le journal (24 h)
+#define WATCH_FULL_WALK_INTERVAL (24 * 3600)
+
+// Marge sur les dates du journal, pour les événements écrits pendant la seconde du début d'une sauvegarde
+#define WATCH_SLACK 2
+
+// Taille du tampon de lecture des événements
+#define WATCH_EVENT_BUFFER (64 * 1024)
+
+// Résultats de dirty_set_lookup
+#define WATCH_CLEAN 0
+#define WATCH_DIRTY_PATH 1
+#define WATCH_DIRTY_SUBTREE 2
+
+// Chemins modifiés depuis une sauvegarde, relatifs à la racine de la source et triés
+typedef struct {
+    char **paths;
+    unsigned char *subtree; // 1 si tout le sous-arbre du chemin est à reparcourir
+    size_t count;
+    size_t capacity;
+    arena pool;             // chaînes des chemins
+} dirty_set;
+
+// Fonction pour observer une source et noter ses chemins modifiés dans le journal du dépôt
+int watch_source(const char *source_dir, const char *backup_dir);
+// Fonction pour lire les chemins modifiés depuis une date (1 si le journal est utilisable, 0 s'il faut tout parcourir)
+int watch_load(const char *store_dir, const char *source, time_t since, dirty_set *set);
+// Fonction pour savoir si un chemin a changé (WATCH_DIRTY_PATH) ou se trouve dans un sous-arbre à reparcourir
+int dirty_set_lookup(const dirty_set *set, const char *path, size_t *index);
+// Procédure pour libérer les chemins modifiés
+void dirty_set_free(dirty_set *set);
+// Fonction pour alléger le journal après une sauvegarde, en ne gardant que les événements postérieurs à son début
+int watch_trim(const char *store_dir, time_t start, int full_walk);
+
+#endif // WATCHER_H
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Outils communs aux tests : chaque test s'exécute dans un répertoire
+# temporaire supprimé à la fin, avec l'exécutable construit par make.
+
+set -eu
+
+BORG="$(cd "$(dirname "$0")/.." && pwd)/lp25_borgbackup"
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+
+# Procédure arrêtant le test en échec
+fail() {
+    echo "ÉCHEC : $*" >&2
+    exit 1
+}
+
+# Procédure exécutant l'outil en masquant sa sortie, affichée en cas d'échec
+borg() {
+    if ! "$BORG" "$@" > borg.log 2>&1; then
+        cat borg.log >&2
+        fail "lp25_borgbackup $*"
+    fi
+}
+
+# Procédure créant une source de test : un gros fichier aléatoire, un petit
+# fichier et un sous-répertoire
+make_source() {
+    mkdir -p "$1/sub"
+    head -c 300000 /dev/urandom > "$1/gros"
+    echo "petit fichier" > "$1/petit"
+    head -c 70000 /dev/urandom > "$1/sub/moyen"
+}
+
+# Fonction affichant le nom des sauvegardes publiées d'un dépôt, de la plus ancienne à la plus récente
+published_snapshots() {
+    for snap in "$1"/????-??-??-*; do
+        if [ -f "$snap/manifest" ]; then
+            basename "$snap"
+        fi
+    done
+}
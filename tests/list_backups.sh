@@ -0,0 +1,30 @@
+#!/bin/sh
+# --list-backups ne modifie jamais le dépôt, ignore les sauvegardes non
+# publiées et, pour une sauvegarde cataloguée deux fois, affiche la dernière
+# ligne ajoutée.
+
+. "$(dirname "$0")/common.sh"
+
+make_source src
+borg --backup --source src --dest repo
+snap=$(published_snapshots repo)
+
+# Sauvegarde interrompue et sauvegarde réseau en cours de publication
+mkdir "repo/2099-12-31-23:59:59.000" "repo/2099-12-31-23:59:59.001"
+touch "repo/2099-12-31-23:59:59.000/manifest.tmp" "repo/2099-12-31-23:59:59.001/manifest.idx"
+
+# Nouvelle ligne pour la même sauvegarde, qui doit remplacer la première
+tail -n 1 repo/.catalog | sed 's/^\([^;]*;[^;]*;\)[0-9]*/\1424242/' >> repo/.catalog
+cp repo/.catalog catalog.avant
+
+borg --list-backups --dest repo
+grep -q "Nom du répertoire: $snap" borg.log || fail "sauvegarde publiée absente du listage"
+grep -q "2099-12-31" borg.log && fail "sauvegarde non publiée listée"
+grep -q "Taille totale: 424242 octets" borg.log || fail "la dernière ligne du catalogue n'a pas été retenue"
+cmp -s repo/.catalog catalog.avant || fail "le listage a modifié le catalogue"
+
+# Une sauvegarde absente du catalogue est listée sans y être ajoutée
+: > repo/.catalog
+borg --list-backups --dest repo
+grep -q "Nom du répertoire: $snap" borg.log || fail "sauvegarde hors catalogue absente du listage"
+[ ! -s repo/.catalog ] || fail "le listage a écrit dans le catalogue"
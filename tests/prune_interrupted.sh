@@ -0,0 +1,23 @@
+#!/bin/sh
+# Une sauvegarde interrompue (manifeste temporaire jamais renommé) ne doit
+# compter pour aucune règle de conservation : --keep-last 1 garde la seule
+# sauvegarde publiée et ne libère aucun de ses chunks.
+
+. "$(dirname "$0")/common.sh"
+
+make_source src
+borg --backup --source src --dest repo
+snap=$(published_snapshots repo)
+[ -n "$snap" ] || fail "aucune sauvegarde publiée"
+
+# Sauvegarde interrompue, plus récente que la sauvegarde publiée
+mkdir "repo/2099-12-31-23:59:59.000"
+touch "repo/2099-12-31-23:59:59.000/manifest.tmp"
+
+borg --prune --keep-last 1 --dest repo
+grep -q "Conservée : $snap" borg.log || fail "la sauvegarde publiée n'a pas été conservée"
+grep -q "Chunks libérés : 0 " borg.log || fail "des chunks de la sauvegarde publiée ont été libérés"
+
+borg --restore --source "repo/$snap" --dest out
+diff -r src out || fail "restauration différente de la source"
+borg --check --dest repo
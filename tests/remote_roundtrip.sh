@@ -0,0 +1,45 @@
+#!/bin/sh
+# Aller-retour par le réseau local : un serveur reçoit deux sauvegardes
+# successives d'une source, chacune est restaurée à l'identique, et le dépôt
+# reste sain.
+
+. "$(dirname "$0")/common.sh"
+
+# Démarrage du serveur sur le premier port libre : sur un port occupé, il
+# s'arrête aussitôt en erreur
+port=$((20000 + $$ % 20000))
+for essai in 1 2 3 4 5 6 7 8 9 10; do
+    "$BORG" --serve --dest repo --d-port "$port" > serveur.log 2>&1 &
+    serveur=$!
+    sleep 0.5
+    if kill -0 "$serveur" 2> /dev/null; then
+        break
+    fi
+    serveur=
+    port=$((port + 1))
+done
+[ -n "$serveur" ] || fail "serveur impossible à démarrer"
+trap 'kill "$serveur" 2> /dev/null || true; rm -rf "$WORK"' EXIT
+
+make_source src
+borg --backup --source src --d-server 127.0.0.1 --d-port "$port"
+premiere=$(published_snapshots repo)
+[ -n "$premiere" ] || fail "aucune sauvegarde publiée par le serveur"
+cp -r src attendu1
+
+# Seconde sauvegarde : un fichier modifié, un fichier ajouté
+head -c 50000 /dev/urandom >> src/gros
+echo "nouveau" > src/sub/nouveau
+sleep 0.01
+borg --backup --source src --d-server 127.0.0.1 --d-port "$port"
+seconde=$(published_snapshots repo | grep -v "$premiere")
+[ -n "$seconde" ] || fail "seconde sauvegarde absente"
+
+borg --restore --source "$premiere" --dest out1 --s-server 127.0.0.1 --s-port "$port"
+diff -r attendu1 out1 || fail "première sauvegarde restaurée différente de la source"
+borg --restore --source "$seconde" --dest out2 --s-server 127.0.0.1 --s-port "$port"
+diff -r src out2 || fail "seconde sauvegarde restaurée différente de la source"
+
+kill "$serveur"
+wait "$serveur" 2> /dev/null || true
+borg --check --dest repo